@@ -0,0 +1,267 @@
+/*
+*
+*  This program is free software; you can redistribute it and/or modify it
+*  under the terms of the GNU General Public License as published by the
+*  Free Software Foundation; either version 2 of the License, or (at
+*  your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful, but
+*  WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*  General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software Foundation,
+*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**  
+ *	@author		commonbullet
+ *	@version	1.07
+ */
+
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "VDFCache.h"
+
+#if defined _WIN32
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#endif
+
+
+// --- VDFCache implementation ---
+
+VDFCache::VDFCache()
+{
+	enabled = true;
+	directory = NULL;
+}
+
+VDFCache::~VDFCache()
+{
+	FinalizeArray(directory);
+}
+
+/**
+ *	Turns caching on/off.
+ *	@param	enabled		If false trees are always parsed from text files.
+ */
+void VDFCache::SetEnabled(bool enabled)
+{
+	this->enabled = enabled;
+}
+
+/**
+ *	Sets a directory to keep cache files. By default they're
+ *	stored next to each text file (sidecar).
+ *	@param	directory	Cache directory. NULL or empty to use sidecar files.
+ */
+void VDFCache::SetDirectory(const char *directory)
+{
+	FinalizeArray(this->directory);
+
+	if(directory == NULL || *directory == '\0')
+		return;
+
+	this->directory = new char[strlen(directory) + 1];
+	strcpy(this->directory, directory);
+
+	mkdir(this->directory, 0755);
+}
+
+/**
+ *	Gets the cache file name of a text file.
+ *	@param	filename	Source file.
+ *	@param	path		Receives cache file name.
+ *	@param	maxlen		Size of path buffer.
+ */
+void VDFCache::GetCachePath(const char *filename, char *path, size_t maxlen)
+{
+	if(directory)
+		_snprintf(path, maxlen, "%s/%08x%s", directory,
+			HashBytes(filename, strlen(filename)), VDF_CACHE_EXTENSION);
+	else
+		_snprintf(path, maxlen, "%s%s", filename, VDF_CACHE_EXTENSION);
+
+	path[maxlen - 1] = '\0';
+}
+
+/**
+ *	Gets size and modification time of a source file.
+ *	@param	filename	Source file.
+ *	@param	key			Receives file information.
+ *	@return				false if file doesn't exist.
+ */
+bool VDFCache::GetSourceKey(const char *filename, VDFCacheKey &key)
+{
+	struct stat info;
+
+	if(stat(filename, &info) != 0)
+		return false;
+
+	key.size = (UINT)((unsigned long long)info.st_size & 0xFFFFFFFF);
+	key.sizeHigh = (UINT)((unsigned long long)info.st_size >> 32);
+	key.mtime = (UINT)((unsigned long long)info.st_mtime & 0xFFFFFFFF);
+	key.mtimeHigh = (UINT)((unsigned long long)info.st_mtime >> 32);
+	key.hash = 0;
+
+	return true;
+}
+
+/**
+ *	Hashes the content of a file.
+ *	@param	filename	Source file.
+ *	@param	hash		Receives the hash value.
+ *	@return				false if file can't be read.
+ */
+bool VDFCache::HashFile(const char *filename, UINT &hash)
+{
+	FILE	*pFile;
+	char	*buffer;
+	size_t	len;
+
+	if((pFile = fopen(filename, "rb")) == NULL)
+		return false;
+
+	buffer = new char[VDF_CACHE_READ_CHUNK];
+	hash = VDF_HASH_SEED;
+
+	while((len = fread(buffer, 1, VDF_CACHE_READ_CHUNK, pFile)) > 0)
+		hash = HashBytes(buffer, len, hash);
+
+	FinalizeArray(buffer);
+	fclose(pFile);
+
+	return true;
+}
+
+/**
+ *	Loads a tree from the cached image of a text file.
+ *	@param	parser		Parser used to read the image.
+ *	@param	filename	Text file.
+ *	@param	vdfTree		Receives the tree.
+ *	@param	openFW		Node addition forward (optional).
+ *	@return				false if there's no valid image for that file.
+ */
+bool VDFCache::Load(VDFTreeFile *parser, const char *filename, VDFTree **vdfTree, OpenForward *openFW)
+{
+	char			cachePath[VDF_MAX_PATH];
+	unsigned char	header[VDF_CACHE_HEADER_SIZE];
+	char			*cachedName;
+	FILE			*cacheFile;
+	VDFCacheKey		key;
+	UINT			nameLength;
+	bool			valid;
+
+	if(!enabled || filename == NULL)
+		return false;
+
+	if(!GetSourceKey(filename, key))
+		return false;
+
+	GetCachePath(filename, cachePath, sizeof(cachePath));
+
+	if((cacheFile = fopen(cachePath, "rb")) == NULL)
+		return false;
+
+	valid = fread(header, 1, VDF_CACHE_HEADER_SIZE, cacheFile) == VDF_CACHE_HEADER_SIZE
+		&& memcmp(header, VDF_CACHE_MAGIC, 4) == 0
+		&& header[4] == VDF_CACHE_VERSION
+		&& header[5] == (VDFReader::shared.escapes ? 1 : 0)
+		&& ReadUInt(header + 8) == key.size
+		&& ReadUInt(header + 12) == key.sizeHigh
+		&& ReadUInt(header + 16) == key.mtime
+		&& ReadUInt(header + 20) == key.mtimeHigh;
+
+	nameLength = valid ? ReadUInt(header + 28) : 0;
+
+	// cache directory files are named by path hash, so source path is checked too
+	if(valid && nameLength == strlen(filename)) {
+		cachedName = new char[nameLength + 1];
+		valid = fread(cachedName, 1, nameLength + 1, cacheFile) == nameLength + 1
+			&& memcmp(cachedName, filename, nameLength + 1) == 0;
+		FinalizeArray(cachedName);
+	}
+	else
+		valid = false;
+
+	fclose(cacheFile);
+
+	if(!valid || !HashFile(filename, key.hash) || key.hash != ReadUInt(header + 24))
+		return false;
+
+	return parser->OpenBinaryVDF(cachePath, VDF_CACHE_HEADER_SIZE + nameLength + 1, vdfTree, openFW);
+}
+
+/**
+ *	Stores the image of a tree parsed from a text file. The image is written
+ *	into a temporary file, which replaces the old image when it's complete.
+ *	@param	parser		Parser used to write the image.
+ *	@param	filename	Text file.
+ *	@param	vdfTree		Tree parsed from filename.
+ *	@return				true if the image has been written.
+ */
+bool VDFCache::Store(VDFTreeFile *parser, const char *filename, VDFTree *vdfTree)
+{
+	char			cachePath[VDF_MAX_PATH];
+	char			tempPath[VDF_MAX_PATH + 4];
+	FILE			*cacheFile;
+	VDFCacheKey		key;
+	VDFBuffer		header;
+	UINT			nameLength;
+	bool			ret;
+
+	if(!enabled || filename == NULL || vdfTree == NULL || vdfTree->rootNode == NULL)
+		return false;
+
+	if(VDFReader::IsBinaryVDF(filename))
+		return false;
+
+	// image would miss changes of included files or condition flags
+	if(parser->HasDirectives() || parser->HasConditions())
+		return false;
+
+	if(!GetSourceKey(filename, key) || !HashFile(filename, key.hash))
+		return false;
+
+	GetCachePath(filename, cachePath, sizeof(cachePath));
+	_snprintf(tempPath, sizeof(tempPath), "%s.tmp", cachePath);
+	tempPath[sizeof(tempPath) - 1] = '\0';
+
+	if((cacheFile = fopen(tempPath, "wb")) == NULL)
+		return false;
+
+	nameLength = (UINT)strlen(filename);
+
+	header.Append(VDF_CACHE_MAGIC, 4);
+	header.AppendByte(VDF_CACHE_VERSION);
+	// strings depend on escape sequences setting
+	header.AppendByte(VDFReader::shared.escapes ? 1 : 0);
+	header.AppendByte(0);
+	header.AppendByte(0);
+	header.AppendUInt(key.size);
+	header.AppendUInt(key.sizeHigh);
+	header.AppendUInt(key.mtime);
+	header.AppendUInt(key.mtimeHigh);
+	header.AppendUInt(key.hash);
+	header.AppendUInt(nameLength);
+	header.Append(filename, nameLength + 1);
+
+	ret = fwrite(header.data, 1, header.length, cacheFile) == header.length
+		&& parser->WriteBinary(cacheFile, vdfTree);
+
+	ret = (fclose(cacheFile) == 0) && ret;
+
+	if(ret) {
+		remove(cachePath);
+		ret = rename(tempPath, cachePath) == 0;
+	}
+	if(!ret)
+		remove(tempPath);
+
+	return ret;
+}
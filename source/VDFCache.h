@@ -0,0 +1,52 @@
+#ifndef __VDFCACHE_H__
+#define __VDFCACHE_H__
+
+#include "VDFParser.h"
+
+/** Compiled cache files (header + binary vdf image) */
+#define VDF_CACHE_MAGIC			"VDFC"
+#define VDF_CACHE_VERSION		1
+#define VDF_CACHE_HEADER_SIZE	32
+#define VDF_CACHE_EXTENSION		".vdfc"
+#define VDF_CACHE_READ_CHUNK	65536
+
+/**
+ *  Source file identification stored in cache header.
+ */
+struct VDFCacheKey
+{
+	UINT	size;
+	UINT	sizeHigh;
+	UINT	mtime;
+	UINT	mtimeHigh;
+	UINT	hash;
+};
+
+/**
+ *	Keeps pre-parsed images of text vdf files, so unchanged files
+ *	are loaded without tokenizing. An image is valid while source
+ *	path, size, modification time and content hash match.
+ */
+class VDFCache
+{
+public:
+				VDFCache		();
+				~VDFCache		();
+	void		SetEnabled		(bool enabled);
+	void		SetDirectory	(const char *directory);
+	bool		IsEnabled		() { return enabled; }
+	bool		Load			(VDFTreeFile *parser, const char *filename,
+								 VDFTree **vdfTree, OpenForward *openFW = NULL);
+	bool		Store			(VDFTreeFile *parser, const char *filename, VDFTree *vdfTree);
+	void		GetCachePath	(const char *filename, char *path, size_t maxlen);
+	static bool	GetSourceKey	(const char *filename, VDFCacheKey &key);
+
+protected:
+	bool		HashFile		(const char *filename, UINT &hash);
+
+	bool		enabled;
+	char		*directory;
+};
+
+
+#endif //__VDFCACHE_H__
@@ -1,249 +1,650 @@
-/*
-*
-*  This program is free software; you can redistribute it and/or modify it
-*  under the terms of the GNU General Public License as published by the
-*  Free Software Foundation; either version 2 of the License, or (at
-*  your option) any later version.
-*
-*  This program is distributed in the hope that it will be useful, but
-*  WITHOUT ANY WARRANTY; without even the implied warranty of
-*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
-*  General Public License for more details.
-*
-*  You should have received a copy of the GNU General Public License
-*  along with this program; if not, write to the Free Software Foundation,
-*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
-*/
-
-/**  
- *	@author		commonbullet
- *	@version	1.07
- */
-
-#include <string.h>
-#include "VDFCollection.h"
-
-
-// --- VDFCollection implementation ---
-
-VDFCollection::VDFCollection()
-{
-	treeCounter	= 0;
-	searchCounter = 0;
-	//openForwards = 0;
-	//parseForwards = 0;
-	vdfTrees = NULL;
-	logger = NULL;
-
-	parseForward = new ParseForward*[MAX_PARSE_FORWARDS];
-	openForward = new OpenForward*[MAX_OPEN_FORWARDS];
-	
-	memset(parseForward, 0, MAX_PARSE_FORWARDS);
-	memset(openForward, 0, MAX_OPEN_FORWARDS);
-	
-}
-
-VDFCollection::~VDFCollection()
-{
-	Destroy();
-}
-
-void VDFCollection::SetLogger(IErrorLogger *logger)
-{
-	this->logger = logger;
-}
-
-
-/**
- *	Object freeing
- */
-void VDFCollection::Destroy()
-{
-	size_t i;
-	
-	for(i = 0; i < treeCounter; i++) {
-		if(vdfTrees[i] == NULL)
-			continue;
-		Finalize(vdfTrees[i]->vdfTree);
-		FinalizeArray(vdfTrees[i]->vdfFile);
-	}
-	FinalizeArray(vdfTrees);
-
-	for(i = 0; i < searchCounter; i++) {
-		if(vdfSearch[i] == NULL)
-			continue;
-		Finalize(vdfSearch[i]);
-	}
-	
-	FinalizeArray(vdfSearch);
-	FinalizeArray(parseForward);
-	FinalizeArray(openForward);
-
-	searchCounter = 0;
-	treeCounter = 0;
-}
-
-/**
- *	Looks for a free parse slot. The max number of simultaneos parsing
- *	(nested) is defined by MAX_PARSE_FORWARDS.
- *	@return		The index of an available slot or -1 if all slots are being used.
- */
-int VDFCollection::GetFreeParserID()
-{
-	
-	for(UINT i = 0; i < MAX_PARSE_FORWARDS; i++) {
-		if(parseForward[i] == NULL)
-			return i;
-	}
-	return -1;
-}
-
-/**
- *	Looks for a free parse slot. The max number of simultaneos parsing
- *	(nested) is defined by MAX_PARSE_FORWARDS.
- *	@return		The index of an available slot or -1 if all slots are being used.
- */
-int VDFCollection::GetFreeOpenTreeID()
-{
-	
-	for(UINT i = 0; i < MAX_PARSE_FORWARDS; i++) {
-		if(openForward[i] == NULL)
-			return i;
-	}
-	return -1;
-}
-
-/**
- *	Starts parsing process.
- *	@param	filename	Name of the file to be parsed.
- *	@param	pFW     	Forward settings.
- */
-void VDFCollection::ParseTree(const char *filename, ParseForward *pFW)
-{
-	VDFEventReader parser = VDFEventReader(this->logger);
-	
-	if(pFW == NULL)
-		return;
-	
-	parser.ParseVDF(filename, pFW);
-}
-
-
-/**
- *	Adds a new vdf tree to collection
- *	@param	filename	Name of the tree file. Can be NULL if you're
- *						creating a new Tree.
- *	@param	create  	Set it to <code>true</code> if you're creating a Tree
- *						rather than opening an existing one.
- *	@return				The VDFTree pointer or NULL on fail.
- */
-VDFTree *VDFCollection::AddTree(const char *filename, bool create, OpenForward *openFW)
-{
-	VDFTreeFile	parser = VDFTreeFile(logger);
-	VDFTree		*vdfTree;
-	
-	vdfTree  = NULL;
-
-	if(create) {
-		vdfTree = new VDFTree;
-		vdfTree->CreateTree();
-	}
-	else {
-		if(!parser.OpenVDF(filename, &vdfTree, openFW))
-			return	NULL;
-	}
-
-	GrowPArray(&vdfTrees, treeCounter);
-	
-	vdfTrees[treeCounter] = new VDFEnum;
-	vdfTrees[treeCounter]->vdfFile = new char[strlen(filename) + 1];	
-	strcpy(vdfTrees[treeCounter]->vdfFile, filename);
-	vdfTrees[treeCounter]->vdfTree = vdfTree;	
-	vdfTree->treeId = (UINT) treeCounter++;
-
-	return vdfTree;
-}
-
-/**
- *	Adds a new Search object to collection
- *	@return A pointer to the new Search object.
- */
-VDFSearch *VDFCollection::AddSearch()
-{
-	VDFSearch *newSearch;	
-	
-	GrowPArray(&vdfSearch, searchCounter);	
-	newSearch = new VDFSearch;
-	newSearch->searchId = (UINT)searchCounter;
-	vdfSearch[searchCounter++] = newSearch;
-	
-	return newSearch;
-}
-
-/**
- *	Sets a search string/type to a search pointer included with <code>AddSearch</code>.
- *	@param	search		Target search pointer.
- *	@param	tree		Tree in which search will be performed.
- *	@param	searchStr	String to be searched.
- *	@param	type		Search for key or value - VDF_MATCH_KEY or VDF_MATCH_VALUE.
- *						<br>Note: searching for both at the same time isn't supported.
- *	@param	level		Checks which level to perform search. If -1 (default) all levels match.
- *	@param	ignoreCase	If different from 0 it doesn't match case.
- */
-void VDFCollection::SetSearch(VDFSearch *search, VDFTree *tree, char *searchStr, UINT type,
-										int level, UINT ignoreCase)
-{
-	UINT flags;
-	
-	if(search == NULL || tree == NULL)
-		return;
-
-	flags = type | ((ignoreCase) ? VDF_IGNORE_CASE : 0);
-	
-	search->SetSearch(tree, searchStr, flags, level);	
-}
-
-/**
- *	Removes a search from list
- *	param	@index	Index of the search to be removed.
- */
-void VDFCollection::RemoveSearch(const UINT index)
-{
-	if(index < searchCounter)
-		Finalize(vdfSearch[index]);
-}
-
-/**
- *	Removes a specific tree
- *	@param	index	Index of a tree.
- */
-void VDFCollection::RemoveTree(const UINT index)
-{
-	Finalize(vdfTrees[index]);
-}
-
-/**
- *	Removes a specific tree
- *	@param	tree	Tree object to be destroyed.
- */
-void VDFCollection::RemoveTree(VDFTree **tree)
-{
-	if(*tree != NULL) {
-		vdfTrees[(*tree)->treeId] = NULL;
-		(*tree)->DestroyTree();
-	}
-}
-
-/**
- *	Get a contatiner by its index
- *	@param	unsigned int	Target index
- *	@return					The container or null if it's been deleted
- *							or if index is out of bounds.
- */
-VDFEnum *VDFCollection::GetContainerById(const UINT index)
-{
-	if(index < treeCounter)
-		return vdfTrees[index];
-	return NULL;
-}
-
+/*
+*
+*  This program is free software; you can redistribute it and/or modify it
+*  under the terms of the GNU General Public License as published by the
+*  Free Software Foundation; either version 2 of the License, or (at
+*  your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful, but
+*  WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*  General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software Foundation,
+*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**  
+ *	@author		commonbullet
+ *	@version	1.07
+ */
+
+#include <string.h>
+#include "VDFCollection.h"
+
+
+// --- VDFCollection implementation ---
+
+VDFCollection::VDFCollection()
+{
+	treeCounter	= 0;
+	searchCounter = 0;
+	saveJobCounter = 0;
+	saveJobs = NULL;
+	parseJobCounter = 0;
+	parseJobs = NULL;
+	//openForwards = 0;
+	//parseForwards = 0;
+	vdfTrees = NULL;
+	vdfSearch = NULL;
+	logger = NULL;
+
+	parseForward = new ParseForward*[MAX_PARSE_FORWARDS];
+	openForward = new OpenForward*[MAX_OPEN_FORWARDS];
+	
+	memset(parseForward, 0, MAX_PARSE_FORWARDS);
+	memset(openForward, 0, MAX_OPEN_FORWARDS);
+	
+}
+
+VDFCollection::~VDFCollection()
+{
+	Destroy();
+}
+
+void VDFCollection::SetLogger(IErrorLogger *logger)
+{
+	this->logger = logger;
+	includes.SetLogger(logger);
+}
+
+
+/**
+ *	Object freeing
+ */
+void VDFCollection::Destroy()
+{
+	size_t i;
+
+	watcher.Stop();
+	
+	for(i = 0; i < treeCounter; i++) {
+		if(vdfTrees[i] == NULL)
+			continue;
+		StopJournal(vdfTrees[i]->vdfTree);
+		Finalize(vdfTrees[i]->vdfTree);
+		FinalizeArray(vdfTrees[i]->vdfFile);
+		Finalize(vdfTrees[i]);
+	}
+	FinalizeArray(vdfTrees);
+
+	for(i = 0; i < searchCounter; i++) {
+		if(vdfSearch[i] == NULL)
+			continue;
+		Finalize(vdfSearch[i]);
+	}
+	
+	FinalizeArray(vdfSearch);
+
+	for(i = 0; i < saveJobCounter; i++)
+		Finalize(saveJobs[i]);
+
+	FinalizeArray(saveJobs);
+
+	for(i = 0; i < parseJobCounter; i++)
+		Finalize(parseJobs[i]);
+
+	FinalizeArray(parseJobs);
+	includes.Clear();
+	FinalizeArray(parseForward);
+	FinalizeArray(openForward);
+
+	searchCounter = 0;
+	saveJobCounter = 0;
+	parseJobCounter = 0;
+	treeCounter = 0;
+}
+
+/**
+ *	Looks for a free parse slot. The max number of simultaneos parsing
+ *	(nested) is defined by MAX_PARSE_FORWARDS.
+ *	@return		The index of an available slot or -1 if all slots are being used.
+ */
+int VDFCollection::GetFreeParserID()
+{
+	
+	for(UINT i = 0; i < MAX_PARSE_FORWARDS; i++) {
+		if(parseForward[i] == NULL)
+			return i;
+	}
+	return -1;
+}
+
+/**
+ *	Looks for a free parse slot. The max number of simultaneos parsing
+ *	(nested) is defined by MAX_PARSE_FORWARDS.
+ *	@return		The index of an available slot or -1 if all slots are being used.
+ */
+int VDFCollection::GetFreeOpenTreeID()
+{
+	
+	for(UINT i = 0; i < MAX_PARSE_FORWARDS; i++) {
+		if(openForward[i] == NULL)
+			return i;
+	}
+	return -1;
+}
+
+/**
+ *	Starts parsing process.
+ *	@param	filename	Name of the file to be parsed.
+ *	@param	pFW     	Forward settings.
+ */
+void VDFCollection::ParseTree(const char *filename, ParseForward *pFW)
+{
+	VDFEventReader parser = VDFEventReader(this->logger);
+	
+	if(pFW == NULL)
+		return;
+	
+	parser.ParseVDF(filename, pFW);
+}
+
+/**
+ *	Parses vdf data stored in memory.
+ *	@param	data	Vdf data.
+ *	@param	length	Data length in bytes.
+ *	@param	pFW     Forward settings.
+ */
+void VDFCollection::ParseString(const char *data, size_t length, ParseForward *pFW)
+{
+	VDFEventReader parser = VDFEventReader(this->logger);
+
+	if(pFW == NULL)
+		return;
+
+	parser.ParseVDFString(data, length, pFW);
+}
+
+
+/**
+ *	Adds a new vdf tree to collection
+ *	@param	filename	Name of the tree file. Can be NULL if you're
+ *						creating a new Tree.
+ *	@param	create  	Set it to <code>true</code> if you're creating a Tree
+ *						rather than opening an existing one.
+ *	@return				The VDFTree pointer or NULL on fail.
+ */
+VDFTree *VDFCollection::AddTree(const char *filename, bool create, OpenForward *openFW)
+{
+	VDFTreeFile	parser = VDFTreeFile(logger);
+	VDFTree		*vdfTree;
+	
+	vdfTree  = NULL;
+	parser.SetIncludeResolver(&includes);
+
+	if(create) {
+		vdfTree = new VDFTree;
+		vdfTree->CreateTree();
+	}
+	else if(VDFImage::IsImageVDF(filename)) {
+		vdfTree = new VDFTree;
+		if(!vdfTree->LoadImage(filename)) {
+			delete vdfTree;
+			return NULL;
+		}
+		if(openFW)
+			ExecImageForwards(vdfTree, openFW);
+	}
+	else if(!cache.Load(&parser, filename, &vdfTree, openFW)) {
+		if(!parser.OpenVDF(filename, &vdfTree, openFW))
+			return	NULL;
+		// partial trees (interrupted by open forward) aren't cached
+		if(!parser.WasInterrupted())
+			cache.Store(&parser, filename, vdfTree);
+	}
+
+	// changes kept since file was last saved
+	if(!create)
+		VDFJournal::Replay(vdfTree, filename, logger);
+
+	return RegisterTree(vdfTree, filename);
+}
+
+/**
+ *	Adds a new vdf tree read from memory to collection. Cache isn't used.
+ *	@param	data		Vdf data (text or binary format).
+ *	@param	length		Data length in bytes.
+ *	@param	filename	File name for the tree (used when it's saved).
+ *	@param	openFW		Node addition forward (optional).
+ *	@return				The VDFTree pointer or NULL on fail.
+ */
+VDFTree *VDFCollection::AddTreeFromString(const char *data, size_t length, const char *filename,
+											OpenForward *openFW)
+{
+	VDFTreeFile	parser = VDFTreeFile(logger);
+	VDFTree		*vdfTree;
+
+	vdfTree = NULL;
+	parser.SetIncludeResolver(&includes);
+
+	if(!parser.OpenVDFString(data, length, &vdfTree, openFW))
+		return NULL;
+
+	return RegisterTree(vdfTree, filename);
+}
+
+/**
+ *	Adds a tree opened in lazy mode to collection, nodes below a given
+ *	level are read on first access. Cache isn't used.
+ *	@param	filename	Name of the tree file.
+ *	@param	depth		Level of nodes whose branches are read on access.
+ *	@return				The VDFTree pointer or NULL on fail.
+ */
+VDFTree *VDFCollection::AddLazyTree(const char *filename, UINT depth)
+{
+	VDFTreeFile	parser = VDFTreeFile(logger);
+	VDFTree		*vdfTree;
+
+	// images are already read on demand
+	if(VDFImage::IsImageVDF(filename))
+		return AddTree(filename);
+
+	vdfTree = NULL;
+	parser.SetIncludeResolver(&includes);
+
+	if(!parser.OpenVDFLazy(filename, depth, &vdfTree))
+		return NULL;
+
+	// journaled changes need all branches
+	VDFJournal::Replay(vdfTree, filename, logger);
+
+	return RegisterTree(vdfTree, filename);
+}
+
+/**
+ *	Adds a tree that's been built elsewhere to collection.
+ *	@param	vdfTree		Tree to be added, collection takes its ownership.
+ *	@param	filename	File name for the tree.
+ *	@return				The tree.
+ */
+VDFTree *VDFCollection::RegisterTree(VDFTree *vdfTree, const char *filename)
+{
+	GrowPArray(&vdfTrees, treeCounter);
+	
+	vdfTrees[treeCounter] = new VDFEnum;
+	vdfTrees[treeCounter]->vdfFile = new char[strlen(filename) + 1];	
+	strcpy(vdfTrees[treeCounter]->vdfFile, filename);
+	vdfTrees[treeCounter]->vdfTree = vdfTree;	
+	vdfTree->treeId = (UINT) treeCounter++;
+
+	return vdfTree;
+}
+
+/**
+ *	Fires node addition forward for all nodes of a frozen tree.
+ *	Image nodes are passed as handles, as they're not created.
+ *	@param	vdfTree		Frozen tree.
+ *	@param	openFW		Forward settings.
+ */
+void VDFCollection::ExecImageForwards(VDFTree *vdfTree, OpenForward *openFW)
+{
+	VDFImage	*image;
+	UINT		node;
+	int			depth;
+	int			ret;
+
+	image = vdfTree->image;
+	depth = 0;
+	ret = RETURN_TREEPARSER_CONTINUE;
+
+	for(node = image->GetRootNode(); node != VDF_IMAGE_NONE && ret == RETURN_TREEPARSER_CONTINUE;
+		node = image->GetNextTraverseStep(node, depth))
+	{
+		ret = (*(openFW->pfnOpen))(openFW->fwdid, openFW->mdFilename, vdfTree,
+			(VDFNode*)image->GetHandle(node), depth);
+	}
+}
+
+/**
+ *	Adds a new Search object to collection
+ *	@return A pointer to the new Search object.
+ */
+VDFSearch *VDFCollection::AddSearch()
+{
+	VDFSearch *newSearch;	
+	
+	GrowPArray(&vdfSearch, searchCounter);	
+	newSearch = new VDFSearch;
+	newSearch->searchId = (UINT)searchCounter;
+	vdfSearch[searchCounter++] = newSearch;
+	
+	return newSearch;
+}
+
+/**
+ *	Sets a search string/type to a search pointer included with <code>AddSearch</code>.
+ *	@param	search		Target search pointer.
+ *	@param	tree		Tree in which search will be performed.
+ *	@param	searchStr	String to be searched.
+ *	@param	type		Search for key or value - VDF_MATCH_KEY or VDF_MATCH_VALUE.
+ *						<br>Note: searching for both at the same time isn't supported.
+ *	@param	level		Checks which level to perform search. If -1 (default) all levels match.
+ *	@param	ignoreCase	If different from 0 it doesn't match case.
+ */
+void VDFCollection::SetSearch(VDFSearch *search, VDFTree *tree, char *searchStr, UINT type,
+										int level, UINT ignoreCase)
+{
+	UINT flags;
+	
+	if(search == NULL || tree == NULL)
+		return;
+
+	flags = type | ((ignoreCase) ? VDF_IGNORE_CASE : 0);
+	
+	search->SetSearch(tree, searchStr, flags, level);	
+}
+
+/**
+ *	Removes a search from list
+ *	param	@index	Index of the search to be removed.
+ */
+void VDFCollection::RemoveSearch(const UINT index)
+{
+	if(index < searchCounter)
+		Finalize(vdfSearch[index]);
+}
+
+/**
+ *	Creates a budgeted save job.
+ *	@return		New job, see <code>VDFSaveJob::Begin</code>.
+ */
+VDFSaveJob *VDFCollection::AddSaveJob()
+{
+	VDFSaveJob *newJob;
+
+	GrowPArray(&saveJobs, saveJobCounter);
+	newJob = new VDFSaveJob;
+	newJob->jobId = (UINT)saveJobCounter;
+	saveJobs[saveJobCounter++] = newJob;
+
+	return newJob;
+}
+
+/**
+ *	Removes a save job, its file is closed.
+ *	@param	index	Index of the job to be removed.
+ */
+void VDFCollection::RemoveSaveJob(const UINT index)
+{
+	if(index < saveJobCounter)
+		Finalize(saveJobs[index]);
+}
+
+/**
+ *	Starts reading a file in steps.
+ *	@param	filename	File to be read.
+ *	@return				New job, or NULL if file can't be read.
+ */
+VDFParseJob *VDFCollection::AddParseJob(const char *filename)
+{
+	VDFParseJob *newJob;
+
+	newJob = new VDFParseJob(logger);
+	newJob->SetIncludeResolver(&includes);
+
+	if(!newJob->Begin(filename)) {
+		delete newJob;
+		return NULL;
+	}
+
+	GrowPArray(&parseJobs, parseJobCounter);
+	newJob->jobId = (UINT)parseJobCounter;
+	parseJobs[parseJobCounter++] = newJob;
+
+	return newJob;
+}
+
+/**
+ *	Removes a parse job, a tree that hasn't been taken is destroyed.
+ *	@param	index	Index of the job to be removed.
+ */
+void VDFCollection::RemoveParseJob(const UINT index)
+{
+	if(index < parseJobCounter)
+		Finalize(parseJobs[index]);
+}
+
+/**
+ *	Removes a specific tree
+ *	@param	index	Index of a tree.
+ */
+void VDFCollection::RemoveTree(const UINT index)
+{
+	Finalize(vdfTrees[index]);
+}
+
+/**
+ *	Removes a specific tree
+ *	@param	tree	Tree object to be destroyed.
+ */
+void VDFCollection::RemoveTree(VDFTree **tree)
+{
+	VDFEnum *container;
+
+	if(*tree != NULL) {
+		watcher.Unwatch(*tree);
+		StopJournal(*tree);
+		// tree object is kept, plugins may still hold its handle
+		if((container = GetContainerById((*tree)->treeId)) != NULL) {
+			FinalizeArray(container->vdfFile);
+			Finalize(vdfTrees[(*tree)->treeId]);
+		}
+		// running saves go on with their snapshot copy
+		(*tree)->DestroyTree();
+	}
+}
+
+/**
+ *	Get a contatiner by its index
+ *	@param	unsigned int	Target index
+ *	@return					The container or null if it's been deleted
+ *							or if index is out of bounds.
+ */
+VDFEnum *VDFCollection::GetContainerById(const UINT index)
+{
+	if(index < treeCounter)
+		return vdfTrees[index];
+	return NULL;
+}
+
+/**
+ *	Finds the tree that holds an image node.
+ *	@param	handle	Image node handle.
+ *	@param	node	Receives node index in tree image.
+ *	@return			The tree or NULL if no tree owns that node.
+ */
+VDFTree *VDFCollection::GetImageOwner(const void *handle, UINT &node)
+{
+	size_t i;
+
+	for(i = 0; i < treeCounter; i++) {
+		if(vdfTrees[i] == NULL || vdfTrees[i]->vdfTree->image == NULL)
+			continue;
+		if(vdfTrees[i]->vdfTree->image->GetHandleNode(handle, node))
+			return vdfTrees[i]->vdfTree;
+	}
+	return NULL;
+}
+
+/**
+ *	Finds the tree that holds a regular node.
+ *	@param	node	Node handle.
+ *	@return			The tree or NULL if node isn't linked to any tree.
+ */
+VDFTree *VDFCollection::GetNodeOwner(VDFNode *node)
+{
+	size_t i;
+
+	if(node == NULL)
+		return NULL;
+
+	while(node->parentNode)
+		node = node->parentNode;
+	while(node->previousNode)
+		node = node->previousNode;
+
+	for(i = 0; i < treeCounter; i++) {
+		if(vdfTrees[i] != NULL && vdfTrees[i]->vdfTree->rootNode == node)
+			return vdfTrees[i]->vdfTree;
+	}
+	return NULL;
+}
+
+/**
+ *	Gets the journal of the tree that holds a regular node.
+ *	@param	node	Node handle.
+ *	@return			The journal or NULL if node's tree isn't journaled.
+ */
+VDFJournal *VDFCollection::GetNodeJournal(VDFNode *node)
+{
+	VDFTree *tree;
+
+	if(VDFJournal::activeJournals == 0 || (tree = GetNodeOwner(node)) == NULL)
+		return NULL;
+
+	return tree->journal;
+}
+
+/**
+ *	Starts journaling tree changes into a file next to tree file.
+ *	@param	tree	Tree to be journaled.
+ *	@param	limit	Journal size (bytes) that triggers compaction.
+ *	@return			false if tree isn't in collection or journal can't be written.
+ */
+bool VDFCollection::StartJournal(VDFTree *tree, size_t limit)
+{
+	VDFEnum *container;
+
+	if(tree == NULL || (container = GetContainerById(tree->treeId)) == NULL
+		|| container->vdfTree != tree)
+		return false;
+
+	// records address regular nodes
+	tree->Thaw();
+
+	if(tree->journal == NULL)
+		tree->journal = new VDFJournal(logger);
+
+	if(!tree->journal->Start(tree, container->vdfFile, limit)) {
+		StopJournal(tree);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ *	Writes pending journal records and stops journaling a tree.
+ *	@param	tree	Journaled tree.
+ */
+void VDFCollection::StopJournal(VDFTree *tree)
+{
+	if(tree != NULL)
+		Finalize(tree->journal);
+}
+
+/**
+ *	Starts reloading a tree when its file is changed.
+ *	@param	tree	Tree to be watched.
+ *	@param	forward	Id handed back by <code>ReloadNext</code>.
+ *	@return			false if tree isn't in collection, it's already
+ *					watched or its file can't be watched.
+ */
+bool VDFCollection::WatchTree(VDFTree *tree, int forward)
+{
+	VDFEnum *container;
+
+	if(tree == NULL || (container = GetContainerById(tree->treeId)) == NULL
+		|| container->vdfTree != tree)
+		return false;
+
+	return watcher.Watch(tree, container->vdfFile, forward);
+}
+
+/**
+ *	Reloads the next watched tree whose file has changed. Node handles of
+ *	that tree aren't valid anymore, its journal (if any) is stopped.
+ *	@param	forward	Receives the id passed to <code>WatchTree</code>.
+ *	@return			The reloaded tree or NULL if no file has changed.
+ */
+VDFTree *VDFCollection::ReloadNext(int &forward)
+{
+	VDFWatchEntry *entry;
+
+	if((entry = watcher.NextReload(&includes, logger)) == NULL)
+		return NULL;
+
+	// journal records were kept for the former file
+	StopJournal(entry->tree);
+	watcher.SetWritten(entry->tree);
+
+	forward = entry->forward;
+
+	return entry->tree;
+}
+
+/**
+ *	Tells that module has written a file, so a watched tree isn't reloaded
+ *	for that change.
+ *	@param	tree		Tree that's been saved.
+ *	@param	filename	Written file.
+ */
+void VDFCollection::SetTreeWritten(VDFTree *tree, const char *filename)
+{
+	VDFEnum *container;
+
+	if(tree == NULL || filename == NULL || !watcher.IsWatched(tree)
+		|| (container = GetContainerById(tree->treeId)) == NULL || strcmp(container->vdfFile, filename))
+		return;
+
+	watcher.SetWritten(tree);
+}
+
+/**
+ *	Adds up memory held by a tree and its container.
+ *	@param	index	Tree index.
+ *	@param	usage	Receives byte counts (they're added to current values).
+ */
+void VDFCollection::GetTreeMemoryUsage(const UINT index, VDFMemoryUsage &usage)
+{
+	VDFEnum *container;
+
+	if((container = GetContainerById(index)) == NULL)
+		return;
+
+	usage.indexBytes += sizeof(VDFEnum) + strlen(container->vdfFile) + 1;
+	container->vdfTree->GetMemoryUsage(usage);
+}
+
+/**
+ *	Adds up memory held by all trees, searches and included files in collection.
+ *	@param	usage	Receives byte counts (they're added to current values).
+ */
+void VDFCollection::GetMemoryUsage(VDFMemoryUsage &usage)
+{
+	size_t i;
+
+	usage.indexBytes += treeCounter * sizeof(VDFEnum*) + searchCounter * sizeof(VDFSearch*);
+
+	for(i = 0; i < treeCounter; i++)
+		GetTreeMemoryUsage((UINT)i, usage);
+
+	for(i = 0; i < searchCounter; i++) {
+		if(vdfSearch[i] != NULL)
+			vdfSearch[i]->GetMemoryUsage(usage);
+	}
+
+	includes.GetMemoryUsage(usage);
+}
@@ -1,59 +1,97 @@
-#ifndef __VDFCOLLECTION_H__
-#define __VDFCOLLECTION_H__
-
-#include "VDFSearch.h"
-#include "VDFParser.h"
-
-
-/**
- *  Container type for handling collection of trees.
- */
-struct VDFEnum
-{
-	VDFTree *vdfTree;
-	char	*vdfFile;
-};
-
-
-/**
- *  This class is designed to handle all trees, searches in a plugin session. 
- *	It implements convenient methods to store and destroy trees and searches. 
- */
-class VDFCollection
-{
-public:	
-	int			GetFreeParserID 	();
-	int			GetFreeOpenTreeID	();
-	void		ParseTree			(const char *filename, ParseForward *parseForward);
-	
-	VDFTree		*AddTree			(const char *filename, bool create = false, OpenForward *openForward = NULL);
-	VDFSearch	*AddSearch			();
-	void		SetSearch			(VDFSearch *search,VDFTree *tree, char *searchStr,
-									 UINT type, int level = -1, UINT ignoreCase = 0);	
-	
-	void		RemoveTree			(const UINT index);
-	void		RemoveTree			(VDFTree **tree);
-	void		RemoveSearch		(const UINT index);
-	VDFEnum		*GetContainerById	(const UINT index);
-
-	void		killOpenForward		(int fwid);
-	void		killParseForward	(int fwid);
-	void		SetLogger(IErrorLogger *logger);
-
-	void		Destroy();
-				VDFCollection ();
-				~VDFCollection();
-
-	size_t		treeCounter;
-	VDFEnum		**vdfTrees;	
-	size_t		searchCounter;
-	VDFSearch	**vdfSearch;
-	IErrorLogger *logger;
-
-	OpenForward		**openForward;
-	ParseForward	**parseForward;
-
-};
-
-
-#endif //__VDFCOLLECTION_H__
+#ifndef __VDFCOLLECTION_H__
+#define __VDFCOLLECTION_H__
+
+#include "VDFSearch.h"
+#include "VDFParser.h"
+#include "VDFCache.h"
+#include "VDFInclude.h"
+#include "VDFImage.h"
+#include "VDFJournal.h"
+#include "VDFWatch.h"
+#include "VDFLazy.h"
+
+
+/**
+ *  Container type for handling collection of trees.
+ */
+struct VDFEnum
+{
+	VDFTree *vdfTree;
+	char	*vdfFile;
+};
+
+
+/**
+ *  This class is designed to handle all trees, searches in a plugin session. 
+ *	It implements convenient methods to store and destroy trees and searches. 
+ */
+class VDFCollection
+{
+public:	
+	int			GetFreeParserID 	();
+	int			GetFreeOpenTreeID	();
+	void		ParseTree			(const char *filename, ParseForward *parseForward);
+	void		ParseString			(const char *data, size_t length, ParseForward *parseForward);
+	
+	VDFTree		*AddTree			(const char *filename, bool create = false, OpenForward *openForward = NULL);
+	VDFTree		*AddTreeFromString	(const char *data, size_t length, const char *filename,
+									 OpenForward *openForward = NULL);
+	VDFTree		*AddLazyTree		(const char *filename, UINT depth);
+	VDFTree		*RegisterTree		(VDFTree *vdfTree, const char *filename);
+	VDFSearch	*AddSearch			();
+	void		SetSearch			(VDFSearch *search,VDFTree *tree, char *searchStr,
+									 UINT type, int level = -1, UINT ignoreCase = 0);	
+	
+	void		RemoveTree			(const UINT index);
+	void		RemoveTree			(VDFTree **tree);
+	void		RemoveSearch		(const UINT index);
+	VDFSaveJob	*AddSaveJob			();
+	void		RemoveSaveJob		(const UINT index);
+	VDFParseJob	*AddParseJob		(const char *filename);
+	void		RemoveParseJob		(const UINT index);
+	VDFEnum		*GetContainerById	(const UINT index);
+	VDFTree		*GetImageOwner		(const void *handle, UINT &node);
+	VDFTree		*GetNodeOwner		(VDFNode *node);
+	VDFJournal	*GetNodeJournal		(VDFNode *node);
+	bool		StartJournal		(VDFTree *tree, size_t limit);
+	void		StopJournal			(VDFTree *tree);
+	bool		WatchTree			(VDFTree *tree, int forward);
+	VDFTree		*ReloadNext			(int &forward);
+	void		SetTreeWritten		(VDFTree *tree, const char *filename);
+	void		GetTreeMemoryUsage	(const UINT index, VDFMemoryUsage &usage);
+	void		GetMemoryUsage		(VDFMemoryUsage &usage);
+
+	void		killOpenForward		(int fwid);
+	void		killParseForward	(int fwid);
+	void		SetLogger(IErrorLogger *logger);
+
+protected:
+	void		ExecImageForwards	(VDFTree *vdfTree, OpenForward *openFW);
+
+public:
+
+	void		Destroy();
+				VDFCollection ();
+				~VDFCollection();
+
+	size_t		treeCounter;
+	VDFEnum		**vdfTrees;	
+	size_t		searchCounter;
+	VDFSearch	**vdfSearch;
+	size_t		saveJobCounter;
+	VDFSaveJob	**saveJobs;
+	size_t		parseJobCounter;
+	VDFParseJob	**parseJobs;
+	IErrorLogger *logger;
+
+	OpenForward		**openForward;
+	ParseForward	**parseForward;
+
+	VDFCache		cache;
+	VDFIncludeCache	includes;
+	VDFWatcher		watcher;
+
+};
+
+
+#endif //__VDFCOLLECTION_H__
@@ -0,0 +1,276 @@
+/*
+*
+*  This program is free software; you can redistribute it and/or modify it
+*  under the terms of the GNU General Public License as published by the
+*  Free Software Foundation; either version 2 of the License, or (at
+*  your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful, but
+*  WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*  General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software Foundation,
+*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**  
+ *	@author		commonbullet
+ *	@version	1.07
+ */
+
+#include <string.h>
+
+#include "VDFDiff.h"
+
+/** change set sections */
+enum
+{
+	VDF_DIFF_ADDED = 0,
+	VDF_DIFF_REMOVED,
+	VDF_DIFF_CHANGED
+};
+
+static const char *sectionKeys[] = {"added", "removed", "changed"};
+
+
+// --- VDFDiff implementation ---
+
+VDFDiff::VDFDiff()
+{
+	changes = 0;
+	result = NULL;
+	oldOrigin = NULL;
+	newOrigin = NULL;
+	pending = NULL;
+	pendingSize = 0;
+	pendingCount = 0;
+	table = NULL;
+	tableSize = 0;
+	mask = 0;
+	path = NULL;
+	pathSize = 0;
+	ancestors = NULL;
+	ancestorsSize = 0;
+}
+
+VDFDiff::~VDFDiff()
+{
+	FinalizeArray(pending);
+	FinalizeArray(table);
+	FinalizeArray(path);
+	FinalizeArray(ancestors);
+}
+
+/**
+ *	Compares the children of two nodes. Keys of each level are matched
+ *	through a hash table of old children, so the diff runs in linear time;
+ *	repeated keys are matched in order.
+ *
+ *	@param	oldNode		Node with old children.
+ *	@param	newNode		Node with new children.
+ *	@return				Change set tree, it's owned by the caller.
+ */
+VDFTree *VDFDiff::Compare(VDFNode *oldNode, VDFNode *newNode)
+{
+	int i;
+
+	result = new VDFTree;
+	result->rootNode = result->CreateNode();
+	VDFTree::SetKeyPair(result->rootNode, "diff");
+
+	for(i = VDF_DIFF_ADDED; i <= VDF_DIFF_CHANGED; i++) {
+		sections[i] = result->CreateNode();
+		VDFTree::SetKeyPair(sections[i], sectionKeys[i]);
+		result->AppendChild(result->rootNode, sections[i]);
+		lastChanges[i] = NULL;
+	}
+	changes = 0;
+
+	if(oldNode != NULL && newNode != NULL) {
+		oldOrigin = oldNode;
+		newOrigin = newNode;
+		pendingCount = 0;
+
+		EnsureArraySize(pending, pendingSize, 2);
+		pending[pendingCount++] = oldNode;
+		pending[pendingCount++] = newNode;
+
+		while(pendingCount) {
+			newNode = pending[--pendingCount];
+			oldNode = pending[--pendingCount];
+			CompareChildren(oldNode, newNode);
+		}
+	}
+
+	return result;
+}
+
+/**
+ *	Compares two trees, root level keys are matched
+ *	as children of a node (see <code>Compare</code>).
+ *
+ *	@param	oldTree		Old tree.
+ *	@param	newTree		New tree.
+ *	@return				Change set tree, it's owned by the caller.
+ */
+VDFTree *VDFDiff::CompareTrees(VDFTree *oldTree, VDFTree *newTree)
+{
+	VDFNode	oldRoot;
+	VDFNode	newRoot;
+
+	// root levels are hung from temporary parents, their nodes keep
+	// a NULL parent so paths stop at root level anyway
+	oldRoot.childNode = oldTree ? oldTree->rootNode : NULL;
+	newRoot.childNode = newTree ? newTree->rootNode : NULL;
+
+	return Compare(&oldRoot, &newRoot);
+}
+
+/**
+ *	Compares one level: new children without match are added, old
+ *	children without match are removed and matched pairs with different
+ *	values are changed. Matched branches are queued to be compared.
+ *
+ *	@param	oldNode		Old parent node.
+ *	@param	newNode		New parent node.
+ */
+void VDFDiff::CompareChildren(VDFNode *oldNode, VDFNode *newNode)
+{
+	VDFNode		*child;
+	VDFDiffSlot	*slot;
+	size_t		children;
+	const char	*oldValue;
+	const char	*newValue;
+
+	children = 0;
+	for(child = oldNode->childNode; child; child = child->nextNode)
+		children++;
+
+	// open addressing, table is kept at most half full
+	for(mask = 16; mask < children * 2; mask <<= 1);
+
+	EnsureArraySize(table, tableSize, mask);
+	memset(table, 0, mask * sizeof(VDFDiffSlot));
+	mask--;
+
+	// looking for the node itself gets a free slot, repeated keys are kept
+	for(child = oldNode->childNode; child; child = child->nextNode)
+		FindSlot(child->key, child)->node = child;
+
+	for(child = newNode->childNode; child; child = child->nextNode) {
+		if((slot = FindSlot(child->key, NULL))->node == NULL) {
+			AddChange(VDF_DIFF_ADDED, child, child->value);
+			continue;
+		}
+		slot->matched = true;
+
+		oldValue = slot->node->value ? slot->node->value : "";
+		newValue = child->value ? child->value : "";
+
+		if(strcmp(oldValue, newValue))
+			AddChange(VDF_DIFF_CHANGED, child, newValue);
+
+		if(slot->node->childNode || child->childNode) {
+			EnsureArraySize(pending, pendingSize, pendingCount + 2);
+			pending[pendingCount++] = slot->node;
+			pending[pendingCount++] = child;
+		}
+	}
+
+	// removed nodes are listed in old order
+	for(child = oldNode->childNode; child; child = child->nextNode) {
+		if(!FindSlot(child->key, child)->matched)
+			AddChange(VDF_DIFF_REMOVED, child, child->value);
+	}
+}
+
+/**
+ *	Looks for a slot in the old children table.
+ *
+ *	@param	key		Key to look for.
+ *	@param	node	Node to look for, or NULL to get the first old child with
+ *					that key not matched yet.
+ *	@return			The slot; it's an empty one if key isn't there.
+ */
+VDFDiffSlot *VDFDiff::FindSlot(const char *key, VDFNode *node)
+{
+	VDFDiffSlot	*slot;
+	size_t		ind;
+
+	if(key == NULL)
+		key = "";
+
+	for(ind = HashBytes(key, strlen(key)) & mask; table[ind].node; ind = (ind + 1) & mask) {
+		slot = &table[ind];
+
+		if(node != NULL) {
+			if(slot->node == node)
+				return slot;
+		}
+		else if(!slot->matched && !strcmp(slot->node->key ? slot->node->key : "", key))
+			return slot;
+	}
+
+	return &table[ind];
+}
+
+/**
+ *	Appends a change to a result section, its key is the node path.
+ *	Added and removed branches get a copy of their children, so they
+ *	can be rebuilt from the change set.
+ *
+ *	@param	section		Result section.
+ *	@param	node		Added, removed or changed node.
+ *	@param	value		Value of the change.
+ */
+void VDFDiff::AddChange(int section, VDFNode *node, const char *value)
+{
+	VDFNode	*origin;
+	VDFNode	*change;
+	VDFNode	*child;
+	size_t	count;
+	size_t	len;
+	size_t	pos;
+
+	origin = section == VDF_DIFF_REMOVED ? oldOrigin : newOrigin;
+
+	change = result->CreateNode();
+
+	if(section != VDF_DIFF_CHANGED && node->childNode != NULL) {
+		change->childNode = result->CloneBranch(node->childNode, true);
+		for(child = change->childNode; child; child = child->nextNode)
+			child->parentNode = change;
+	}
+
+	for(count = 0, len = 0; node != NULL && node != origin; node = node->parentNode) {
+		EnsureArraySize(ancestors, ancestorsSize, count + 1);
+		ancestors[count++] = node;
+		len += (node->key ? strlen(node->key) : 0) + 1;
+	}
+
+	EnsureArraySize(path, pathSize, len + 1);
+
+	for(pos = 0; count; count--) {
+		node = ancestors[count - 1];
+		if(node->key) {
+			len = strlen(node->key);
+			memcpy(path + pos, node->key, len);
+			pos += len;
+		}
+		if(count > 1)
+			path[pos++] = '/';
+	}
+	path[pos] = 0;
+
+	VDFTree::SetKeyPair(change, path, value && *value ? value : NULL);
+
+	if(lastChanges[section])
+		result->AppendNode(lastChanges[section], change);
+	else
+		result->AppendChild(sections[section], change);
+
+	lastChanges[section] = change;
+	changes++;
+}
@@ -0,0 +1,64 @@
+#ifndef __VDFDIFF_H__
+#define __VDFDIFF_H__
+
+#include "VDFTree.h"
+
+/**
+ *  Child of an old node, it's marked once a new node is matched to it.
+ */
+struct VDFDiffSlot
+{
+	VDFNode		*node;
+	bool		matched;
+};
+
+/**
+ *	Builds the change set between two branches as a new tree:
+ *	<pre>
+ *	"diff"
+ *	{
+ *		"added"		{ "path/to/key"	"new value" { children } }
+ *		"removed"	{ "path/to/key"	"old value" { children } }
+ *		"changed"	{ "path/to/key"	"new value" }
+ *	}
+ *	</pre>
+ *	Paths are made of the keys below compared nodes, joined by '/'.
+ *	Added or removed branches are listed once, with a copy of their children.
+ */
+class VDFDiff
+{
+public:
+					VDFDiff			();
+					~VDFDiff		();
+	VDFTree			*Compare		(VDFNode *oldNode, VDFNode *newNode);
+	VDFTree			*CompareTrees	(VDFTree *oldTree, VDFTree *newTree);
+
+	size_t			changes;
+
+protected:
+	void			CompareChildren	(VDFNode *oldNode, VDFNode *newNode);
+	VDFDiffSlot		*FindSlot		(const char *key, VDFNode *node);
+	void			AddChange		(int section, VDFNode *node, const char *value);
+
+	VDFTree			*result;
+	VDFNode			*sections[3];
+	VDFNode			*lastChanges[3];
+
+	/** origins of compared branches, paths stop there */
+	VDFNode			*oldOrigin;
+	VDFNode			*newOrigin;
+
+	VDFNode			**pending;
+	size_t			pendingSize;
+	size_t			pendingCount;
+	VDFDiffSlot		*table;
+	size_t			tableSize;
+	size_t			mask;
+	char			*path;
+	size_t			pathSize;
+	VDFNode			**ancestors;
+	size_t			ancestorsSize;
+};
+
+
+#endif //__VDFDIFF_H__
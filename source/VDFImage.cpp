@@ -0,0 +1,525 @@
+/*
+*
+*  This program is free software; you can redistribute it and/or modify it
+*  under the terms of the GNU General Public License as published by the
+*  Free Software Foundation; either version 2 of the License, or (at
+*  your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful, but
+*  WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*  General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software Foundation,
+*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**  
+ *	@author		commonbullet
+ *	@version	1.07
+ */
+
+
+#include <string.h>
+#include <stdio.h>
+
+#include "VDFImage.h"
+
+#define VDF_IMAGE_COLUMN_SIZE(count) ((count) * (UINT)sizeof(UINT))
+
+
+// --- VDFImage implementation ---
+
+VDFImage::VDFImage()
+{
+	data = NULL;
+	size = 0;
+	SetColumns();
+}
+
+VDFImage::~VDFImage()
+{
+	FinalizeArray(data);
+}
+
+/**
+ *	Checks if a file is a frozen tree image.
+ *	@param	filename	File to be checked.
+ *	@return				true if the file starts with image signature.
+ */
+bool VDFImage::IsImageVDF(const char *filename)
+{
+	FILE *pFile;
+	char magic[4];
+	bool ret;
+
+	if((pFile = fopen(filename, "rb")) == NULL)
+		return false;
+
+	ret = fread(magic, 1, 4, pFile) == 4 && memcmp(magic, VDF_IMAGE_MAGIC, 4) == 0;
+	fclose(pFile);
+
+	return ret;
+}
+
+/**
+ *	Loads an image file. The whole block is read at once and used as is.
+ *	@param	filename	Image file.
+ *	@return				false if the file can't be read or if it's not a valid image.
+ */
+bool VDFImage::Load(const char *filename)
+{
+	FILE *pFile;
+	long fileSize;
+
+	FinalizeArray(data);
+	size = 0;
+	SetColumns();
+
+	if((pFile = fopen(filename, "rb")) == NULL)
+		return false;
+
+	fseek(pFile, 0, SEEK_END);
+	fileSize = ftell(pFile);
+	fseek(pFile, 0, SEEK_SET);
+
+	if(fileSize < (long)sizeof(VDFImageHeader)) {
+		fclose(pFile);
+		return false;
+	}
+
+	data = new char[fileSize];
+	size = fread(data, 1, fileSize, pFile);
+	fclose(pFile);
+
+	if(!Validate()) {
+		FinalizeArray(data);
+		size = 0;
+		return false;
+	}
+
+	SetColumns();
+
+	return true;
+}
+
+/**
+ *	Saves the image block into a file.
+ *	@param	filename	Target file.
+ *	@return				true on success.
+ */
+bool VDFImage::Save(const char *filename)
+{
+	FILE *pFile;
+	bool ret;
+
+	if(data == NULL || filename == NULL)
+		return false;
+
+	if((pFile = fopen(filename, "wb")) == NULL)
+		return false;
+
+	ret = fwrite(data, 1, size, pFile) == size;
+	ret = (fclose(pFile) == 0) && ret;
+
+	return ret;
+}
+
+/**
+ *	Checks image header, so links and string offsets can be
+ *	bounds checked on access without touching every node.
+ *	@return		true if it's a valid image.
+ */
+bool VDFImage::Validate()
+{
+	VDFImageHeader *header;
+
+	if(size < sizeof(VDFImageHeader))
+		return false;
+
+	header = (VDFImageHeader*)data;
+
+	if(memcmp(header->magic, VDF_IMAGE_MAGIC, 4) != 0 || header->version != VDF_IMAGE_VERSION)
+		return false;
+
+	if(header->size != size || !header->nodeCount)
+		return false;
+
+	if(header->nodeCount > (size - sizeof(VDFImageHeader)) / VDF_IMAGE_COLUMN_SIZE(VDF_IMAGE_COLUMNS))
+		return false;
+
+	if(header->stringsOffset != sizeof(VDFImageHeader)
+		+ VDF_IMAGE_COLUMNS * VDF_IMAGE_COLUMN_SIZE(header->nodeCount))
+		return false;
+
+	// pool starts with the empty string and strings can't run out of block
+	if(header->stringsOffset >= size || data[header->stringsOffset] != '\0' || data[size - 1] != '\0')
+		return false;
+
+	return true;
+}
+
+/**
+ *	Points node columns and string pool into data block.
+ */
+void VDFImage::SetColumns()
+{
+	VDFImageHeader *header;
+
+	if(data == NULL) {
+		nodeCount = 0;
+		parent = child = next = key = value = NULL;
+		strings = NULL;
+		stringsSize = 0;
+		return;
+	}
+
+	header = (VDFImageHeader*)data;
+	nodeCount = header->nodeCount;
+
+	parent = (UINT*)(data + sizeof(VDFImageHeader));
+	child = parent + VDF_IMAGE_CHILD * nodeCount;
+	next = parent + VDF_IMAGE_NEXT * nodeCount;
+	key = parent + VDF_IMAGE_KEY * nodeCount;
+	value = parent + VDF_IMAGE_VALUE * nodeCount;
+
+	strings = data + header->stringsOffset;
+	stringsSize = header->size - header->stringsOffset;
+}
+
+/**
+ *	Freezes a tree into a new image block.
+ *	@param	vdfTree		Source tree.
+ *	@return				false if tree is empty.
+ */
+bool VDFImage::Build(VDFTree *vdfTree)
+{
+	VDFImageHeader	*header;
+	VDFNode			*node;
+	UINT			*levelLast;
+	size_t			levelSize;
+	UINT			ind;
+	UINT			count;
+	UINT			stringOffset;
+	size_t			len;
+	int				depth;
+
+	FinalizeArray(data);
+	size = 0;
+	SetColumns();
+
+	if(vdfTree == NULL || vdfTree->rootNode == NULL)
+		return false;
+
+	count = 0;
+	len = 1;
+	depth = 0;
+
+	for(node = vdfTree->rootNode; node; node = VDFTree::GetNextTraverseStep(node, depth)) {
+		count++;
+		if(node->key)
+			len += strlen(node->key) + 1;
+		if(node->value)
+			len += strlen(node->value) + 1;
+	}
+
+	size = sizeof(VDFImageHeader) + VDF_IMAGE_COLUMNS * VDF_IMAGE_COLUMN_SIZE(count) + len;
+	data = new char[size];
+	memset(data, 0, sizeof(VDFImageHeader));
+
+	header = (VDFImageHeader*)data;
+	memcpy(header->magic, VDF_IMAGE_MAGIC, 4);
+	header->version = VDF_IMAGE_VERSION;
+	header->size = (UINT)size;
+	header->nodeCount = count;
+	header->stringsOffset = sizeof(VDFImageHeader) + VDF_IMAGE_COLUMNS * VDF_IMAGE_COLUMN_SIZE(count);
+
+	SetColumns();
+	memset(parent, 0xFF, VDF_IMAGE_COLUMNS * VDF_IMAGE_COLUMN_SIZE(count));
+	data[header->stringsOffset] = '\0';
+
+	// last node seen in each level, reset whenever a new branch starts
+	levelLast = NULL;
+	levelSize = 0;
+	EnsureArraySize(levelLast, levelSize, 2);
+	levelLast[0] = VDF_IMAGE_NONE;
+
+	stringOffset = 1;
+	depth = 0;
+	ind = 0;
+
+	for(node = vdfTree->rootNode; node; node = VDFTree::GetNextTraverseStep(node, depth), ind++) {
+
+		EnsureArraySize(levelLast, levelSize, depth + 2);
+		levelLast[depth + 1] = VDF_IMAGE_NONE;
+
+		parent[ind] = depth ? levelLast[depth - 1] : VDF_IMAGE_NONE;
+
+		if(levelLast[depth] != VDF_IMAGE_NONE)
+			next[levelLast[depth]] = ind;
+		else if(parent[ind] != VDF_IMAGE_NONE)
+			child[parent[ind]] = ind;
+
+		levelLast[depth] = ind;
+
+		key[ind] = value[ind] = 0;
+
+		if(node->key) {
+			len = strlen(node->key) + 1;
+			memcpy(data + header->stringsOffset + stringOffset, node->key, len);
+			key[ind] = stringOffset;
+			stringOffset += (UINT)len;
+		}
+		if(node->value) {
+			len = strlen(node->value) + 1;
+			memcpy(data + header->stringsOffset + stringOffset, node->value, len);
+			value[ind] = stringOffset;
+			stringOffset += (UINT)len;
+		}
+	}
+
+	FinalizeArray(levelLast);
+
+	return true;
+}
+
+/**
+ *	Creates regular nodes for all image nodes.
+ *	@param	nodes	Receives the nodes, indexed as image nodes
+ *					(GetNodeCount() slots).
+ */
+void VDFImage::Thaw(VDFNode **nodes)
+{
+	VDFNode	*node;
+	UINT	ind;
+	UINT	link;
+
+	for(ind = 0; ind < nodeCount; ind++)
+		nodes[ind] = new VDFNode;
+
+	for(ind = 0; ind < nodeCount; ind++) {
+		node = nodes[ind];
+
+		VDFTree::SetKeyPair(node, GetKey(ind), GetValue(ind));
+
+		if((link = GetParentNode(ind)) != VDF_IMAGE_NONE)
+			node->parentNode = nodes[link];
+		if((link = GetChildNode(ind)) != VDF_IMAGE_NONE)
+			node->childNode = nodes[link];
+		if((link = GetNextNode(ind)) != VDF_IMAGE_NONE) {
+			node->nextNode = nodes[link];
+			nodes[link]->previousNode = node;
+		}
+	}
+}
+
+/**
+ *	Gets the number of nodes in image.
+ */
+UINT VDFImage::GetNodeCount()
+{
+	return nodeCount;
+}
+
+/**
+ *	Gets the handle passed to plugins for an image node. It's the
+ *	address of node parent item, tagged with VDF_IMAGE_HANDLE_BIT.
+ *	@param	node	Node index.
+ *	@return			The handle, NULL if node is VDF_IMAGE_NONE.
+ */
+void *VDFImage::GetHandle(UINT node)
+{
+	if(node >= nodeCount)
+		return NULL;
+
+	return (void*)(((size_t)(parent + node)) | VDF_IMAGE_HANDLE_BIT);
+}
+
+/**
+ *	Gets the node index from a handle.
+ *	@param	handle	Handle given by GetHandle.
+ *	@param	node	Receives node index.
+ *	@return			false if handle doesn't belong to this image.
+ */
+bool VDFImage::GetHandleNode(const void *handle, UINT &node)
+{
+	size_t address;
+
+	address = ((size_t)handle) & ~((size_t)VDF_IMAGE_HANDLE_BIT);
+
+	if(parent == NULL || address < (size_t)parent || address >= (size_t)(parent + nodeCount)
+		|| (address - (size_t)parent) % sizeof(UINT))
+		return false;
+
+	node = (UINT)((address - (size_t)parent) / sizeof(UINT));
+	return true;
+}
+
+/**
+ *	Gets a string from pool.
+ *	@param	offset	String offset.
+ *	@return			The string or NULL if offset is 0 or out of bounds.
+ */
+const char *VDFImage::GetString(UINT offset)
+{
+	if(!offset || offset >= stringsSize)
+		return NULL;
+
+	return strings + offset;
+}
+
+/**
+ *	Gets the first node in image.
+ */
+UINT VDFImage::GetRootNode()
+{
+	return nodeCount ? 0 : VDF_IMAGE_NONE;
+}
+
+/*
+ *	Links are bounds checked on access. As nodes are in document order, parents
+ *	come before their nodes and children/siblings after them, so following
+ *	links never loops, even on broken images.
+ */
+
+UINT VDFImage::GetParentNode(UINT node)
+{
+	if(node >= nodeCount || parent[node] >= node)
+		return VDF_IMAGE_NONE;
+	return parent[node];
+}
+
+UINT VDFImage::GetChildNode(UINT node)
+{
+	if(node >= nodeCount || child[node] <= node || child[node] >= nodeCount)
+		return VDF_IMAGE_NONE;
+	return child[node];
+}
+
+UINT VDFImage::GetNextNode(UINT node)
+{
+	if(node >= nodeCount || next[node] <= node || next[node] >= nodeCount)
+		return VDF_IMAGE_NONE;
+	return next[node];
+}
+
+const char *VDFImage::GetKey(UINT node)
+{
+	return node < nodeCount ? GetString(key[node]) : NULL;
+}
+
+const char *VDFImage::GetValue(UINT node)
+{
+	return node < nodeCount ? GetString(value[node]) : NULL;
+}
+
+/**
+ *	Gets the first node from a given node level.
+ */
+UINT VDFImage::GetFirstNode(UINT node)
+{
+	UINT up;
+
+	if(node >= nodeCount)
+		return VDF_IMAGE_NONE;
+
+	if((up = GetParentNode(node)) == VDF_IMAGE_NONE)
+		return GetRootNode();
+
+	return GetChildNode(up);
+}
+
+/**
+ *	Gets the last node from a given node level.
+ */
+UINT VDFImage::GetLastNode(UINT node)
+{
+	UINT last;
+	UINT cur;
+
+	if(node >= nodeCount)
+		return VDF_IMAGE_NONE;
+
+	for(last = node; (cur = GetNextNode(last)) != VDF_IMAGE_NONE; last = cur)
+		;
+
+	return last;
+}
+
+/**
+ *	Gets the previous node in the same level. Siblings aren't linked
+ *	backwards, so it's searched from the first node.
+ */
+UINT VDFImage::GetPreviousNode(UINT node)
+{
+	UINT prev;
+	UINT cur;
+
+	prev = VDF_IMAGE_NONE;
+
+	for(cur = GetFirstNode(node); cur != VDF_IMAGE_NONE && cur != node; cur = GetNextNode(cur))
+		prev = cur;
+
+	return cur == node ? prev : VDF_IMAGE_NONE;
+}
+
+/**
+ *	Gets the next node in traverse. As nodes are stored in
+ *	document order it's just the following node.
+ *	@param	node	Origin of traverse.
+ *	@param	depth	Relative depth of the traverse node from the origin.
+ */
+UINT VDFImage::GetNextTraverseStep(UINT node, int &depth)
+{
+	UINT following;
+	UINT up;
+	UINT cur;
+
+	if(node >= nodeCount || (following = node + 1) >= nodeCount)
+		return VDF_IMAGE_NONE;
+
+	up = GetParentNode(following);
+
+	if(up == node) {
+		depth++;
+		return following;
+	}
+
+	// climb from node until reaching a sibling of the following node
+	for(cur = node; cur != VDF_IMAGE_NONE && GetParentNode(cur) != up; depth--)
+		cur = GetParentNode(cur);
+
+	return following;
+}
+
+/**
+ *	Gets the depth of a node, top level nodes are level 0.
+ */
+int VDFImage::GetNodeLevel(UINT node)
+{
+	int level;
+
+	if(node >= nodeCount)
+		return -1;
+
+	for(level = 0; (node = GetParentNode(node)) != VDF_IMAGE_NONE; level++)
+		;
+
+	return level;
+}
+
+/**
+ *	Gets the number of nodes in a given node level.
+ */
+size_t VDFImage::CountBranchNodes(UINT node)
+{
+	UINT first;
+	size_t counter;
+
+	counter = 0;
+	for(first = GetFirstNode(node); first != VDF_IMAGE_NONE; first = GetNextNode(first))
+		counter++;
+
+	return counter;
+}
@@ -0,0 +1,100 @@
+#ifndef __VDFIMAGE_H__
+#define __VDFIMAGE_H__
+
+#include "VDFTree.h"
+
+/** Frozen tree images (single relocatable block, native byte order) */
+#define VDF_IMAGE_MAGIC			"VDFI"
+#define VDF_IMAGE_VERSION		2
+
+/** Image node handles have this bit set, so they're told apart from VDFNode pointers */
+#define VDF_IMAGE_HANDLE_BIT	1
+
+/** Node index meaning "no node" */
+#define VDF_IMAGE_NONE			0xFFFFFFFF
+
+/** Node columns, each one is an array of nodeCount 32 bit items */
+#define VDF_IMAGE_PARENT		0
+#define VDF_IMAGE_CHILD			1
+#define VDF_IMAGE_NEXT			2
+#define VDF_IMAGE_KEY			3
+#define VDF_IMAGE_VALUE			4
+#define VDF_IMAGE_COLUMNS		5
+
+/**
+ *  Image header, it's at offset 0 of the block. It's followed by node
+ *	columns and then by the string pool.
+ */
+struct VDFImageHeader
+{
+	char		magic[4];
+	UINT		version;
+	UINT		size;
+	UINT		nodeCount;
+	UINT		stringsOffset;
+	UINT		reserved[3];
+};
+
+/**
+ *	Tree stored in one contiguous block. Nodes are numbered in document
+ *	order (preorder) and kept as separate arrays of 32 bit items: parent,
+ *	first child and next sibling indexes, key and value offsets in string
+ *	pool. So traversing a branch is a linear scan and the block is loaded
+ *	with a single read, without fix-ups. Images are read only,
+ *	VDFTree::Thaw converts them into regular trees.
+ */
+class VDFImage
+{
+public:
+						VDFImage			();
+						~VDFImage			();
+	bool				Load				(const char *filename);
+	bool				Save				(const char *filename);
+	bool				Build				(VDFTree *vdfTree);
+	void				Thaw				(VDFNode **nodes);
+	UINT				GetNodeCount		();
+	void				*GetHandle			(UINT node);
+	bool				GetHandleNode		(const void *handle, UINT &node);
+
+	static bool			IsImageVDF			(const char *filename);
+
+	UINT				GetRootNode			();
+	UINT				GetParentNode		(UINT node);
+	UINT				GetChildNode		(UINT node);
+	UINT				GetNextNode			(UINT node);
+	UINT				GetPreviousNode		(UINT node);
+	UINT				GetFirstNode		(UINT node);
+	UINT				GetLastNode			(UINT node);
+	UINT				GetNextTraverseStep	(UINT node, int &depth);
+	int					GetNodeLevel		(UINT node);
+	size_t				CountBranchNodes	(UINT node);
+	const char			*GetKey				(UINT node);
+	const char			*GetValue			(UINT node);
+
+protected:
+	const char			*GetString			(UINT offset);
+	bool				Validate			();
+	void				SetColumns			();
+
+public:
+	char				*data;
+	size_t				size;
+
+protected:
+	UINT				nodeCount;
+	UINT				*parent;
+	UINT				*child;
+	UINT				*next;
+	UINT				*key;
+	UINT				*value;
+	const char			*strings;
+	UINT				stringsSize;
+};
+
+inline bool IsImageHandle(const void *handle)
+{
+	return (((size_t)handle) & VDF_IMAGE_HANDLE_BIT) != 0;
+}
+
+
+#endif //__VDFIMAGE_H__
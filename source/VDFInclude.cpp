@@ -0,0 +1,198 @@
+/*
+*
+*  This program is free software; you can redistribute it and/or modify it
+*  under the terms of the GNU General Public License as published by the
+*  Free Software Foundation; either version 2 of the License, or (at
+*  your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful, but
+*  WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*  General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software Foundation,
+*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**  
+ *	@author		commonbullet
+ *	@version	1.07
+ */
+
+#include <string.h>
+
+#include "VDFInclude.h"
+
+
+// --- VDFIncludeCache implementation ---
+
+VDFIncludeCache::VDFIncludeCache()
+{
+	entries = NULL;
+	loadingEntry = NULL;
+	logger = NULL;
+}
+
+VDFIncludeCache::~VDFIncludeCache()
+{
+	Clear();
+}
+
+void VDFIncludeCache::SetLogger(IErrorLogger *logger)
+{
+	this->logger = logger;
+}
+
+/**
+ *	Frees all cached trees.
+ */
+void VDFIncludeCache::Clear()
+{
+	VDFIncludeEntry *next;
+
+	while(entries) {
+		next = entries->next;
+		FinalizeArray(entries->path);
+		FinalizeArray(entries->deps);
+		Finalize(entries->tree);
+		delete entries;
+		entries = next;
+	}
+}
+
+/**
+ *	Looks for the entry of a file.
+ *	@param	path	File path.
+ *	@return			The entry or NULL if file hasn't been read.
+ */
+VDFIncludeEntry *VDFIncludeCache::FindEntry(const char *path)
+{
+	VDFIncludeEntry *entry;
+
+	for(entry = entries; entry; entry = entry->next) {
+		if(!strcmp(entry->path, path))
+			return entry;
+	}
+	return NULL;
+}
+
+/**
+ *	Checks if a cached tree still matches its file and the files it includes.
+ *	@param	entry	Cached entry.
+ *	@return			false if any of them has changed.
+ */
+bool VDFIncludeCache::IsCurrent(VDFIncludeEntry *entry)
+{
+	VDFCacheKey	key;
+	size_t		i;
+
+	if(entry->tree == NULL || !VDFCache::GetSourceKey(entry->path, key))
+		return false;
+
+	if(key.size != entry->key.size || key.sizeHigh != entry->key.sizeHigh
+		|| key.mtime != entry->key.mtime || key.mtimeHigh != entry->key.mtimeHigh)
+		return false;
+
+	// dependencies can't be loading (they'd be a cycle)
+	for(i = 0; i < entry->depCount; i++) {
+		if(!IsCurrent(entry->deps[i]))
+			return false;
+	}
+	return true;
+}
+
+/**
+ *	Records that a file has been included by another one.
+ *	@param	entry	Including file entry.
+ *	@param	dep		Included file entry.
+ */
+void VDFIncludeCache::AddDependency(VDFIncludeEntry *entry, VDFIncludeEntry *dep)
+{
+	size_t i;
+
+	for(i = 0; i < entry->depCount; i++) {
+		if(entry->deps[i] == dep)
+			return;
+	}
+
+	EnsureArraySize(entry->deps, entry->depSize, entry->depCount + 1);
+	entry->deps[entry->depCount++] = dep;
+}
+
+/**
+ *	Gets the tree of an included file, it's parsed if it isn't cached
+ *	or if it has changed. Directives in included files are resolved
+ *	by this cache too.
+ *	@param	path	File path.
+ *	@return			The tree (owned by cache) or NULL if file can't be
+ *					read or if it includes itself.
+ */
+VDFTree *VDFIncludeCache::GetIncludedTree(const char *path)
+{
+	VDFTreeFile		parser = VDFTreeFile(logger);
+	VDFIncludeEntry	*entry;
+	VDFIncludeEntry	*including;
+
+	if(path == NULL)
+		return NULL;
+
+	if((entry = FindEntry(path)) == NULL) {
+		entry = new VDFIncludeEntry;
+		entry->path = new char[strlen(path) + 1];
+		strcpy(entry->path, path);
+		entry->tree = NULL;
+		entry->loading = false;
+		entry->deps = NULL;
+		entry->depCount = 0;
+		entry->depSize = 0;
+		entry->next = entries;
+		entries = entry;
+	}
+
+	if(entry->loading) {
+		if(logger)
+			logger->printError(path, "file includes itself");
+		return NULL;
+	}
+
+	if(loadingEntry)
+		AddDependency(loadingEntry, entry);
+
+	if(IsCurrent(entry))
+		return entry->tree;
+
+	Finalize(entry->tree);
+	entry->depCount = 0;
+
+	if(!VDFCache::GetSourceKey(path, entry->key))
+		return NULL;
+
+	including = loadingEntry;
+	loadingEntry = entry;
+	entry->loading = true;
+
+	parser.SetIncludeResolver(this);
+	parser.OpenVDF(entry->path, &entry->tree);
+
+	entry->loading = false;
+	loadingEntry = including;
+
+	return entry->tree;
+}
+
+/**
+ *	Adds up memory held by cached trees.
+ *	@param	usage	Receives byte counts (they're added to current values).
+ */
+void VDFIncludeCache::GetMemoryUsage(VDFMemoryUsage &usage)
+{
+	VDFIncludeEntry *entry;
+
+	for(entry = entries; entry; entry = entry->next) {
+		usage.indexBytes += sizeof(VDFIncludeEntry) + strlen(entry->path) + 1
+			+ entry->depSize * sizeof(VDFIncludeEntry*);
+		if(entry->tree)
+			entry->tree->GetMemoryUsage(usage);
+	}
+}
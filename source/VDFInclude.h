@@ -0,0 +1,48 @@
+#ifndef __VDFINCLUDE_H__
+#define __VDFINCLUDE_H__
+
+#include "VDFCache.h"
+
+/**
+ *  Included file entry. Entries read while another one is being
+ *  parsed are its dependencies.
+ */
+struct VDFIncludeEntry
+{
+	char				*path;
+	VDFCacheKey			key;
+	VDFTree				*tree;
+	bool				loading;
+	VDFIncludeEntry		**deps;
+	size_t				depCount;
+	size_t				depSize;
+	VDFIncludeEntry		*next;
+};
+
+/**
+ *	Keeps trees of files read by #include and #base directives, so each
+ *	file is parsed once while its path, size and modification time
+ *	(and those of the files it includes) don't change.
+ */
+class VDFIncludeCache : public IIncludeResolver
+{
+public:
+						VDFIncludeCache	();
+						~VDFIncludeCache();
+	VDFTree				*GetIncludedTree(const char *path);
+	void				SetLogger		(IErrorLogger *logger);
+	void				Clear			();
+	void				GetMemoryUsage	(VDFMemoryUsage &usage);
+
+protected:
+	VDFIncludeEntry		*FindEntry		(const char *path);
+	bool				IsCurrent		(VDFIncludeEntry *entry);
+	void				AddDependency	(VDFIncludeEntry *entry, VDFIncludeEntry *dep);
+
+	VDFIncludeEntry		*entries;
+	VDFIncludeEntry		*loadingEntry;
+	IErrorLogger		*logger;
+};
+
+
+#endif //__VDFINCLUDE_H__
@@ -0,0 +1,451 @@
+/*
+*
+*  This program is free software; you can redistribute it and/or modify it
+*  under the terms of the GNU General Public License as published by the
+*  Free Software Foundation; either version 2 of the License, or (at
+*  your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful, but
+*  WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*  General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software Foundation,
+*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**  
+ *	@author		commonbullet
+ *	@version	1.07
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "VDFIndex.h"
+#include "VDFCache.h"
+
+// --- VDFIndexReader class implementation ---
+
+VDFIndexReader::VDFIndexReader(IErrorLogger *logger): VDFReader(logger)
+{
+	output = NULL;
+	maxDepth = 0;
+	count = 0;
+	path = NULL;
+	pathSize = 0;
+	pathEnds = NULL;
+	pathEndsSize = 0;
+	starts = NULL;
+	startsSize = 0;
+	nodeLevel = 0;
+	nodePending = false;
+}
+
+VDFIndexReader::~VDFIndexReader()
+{
+	FinalizeArray(path);
+	FinalizeArray(pathEnds);
+	FinalizeArray(starts);
+}
+
+/**
+ *	Records the branches of a text source.
+ *	@param	data	Vdf text, it doesn't need to be null terminated.
+ *	@param	length	Text length in bytes.
+ *	@param	name	Name used in error messages.
+ *	@param	depth	Deepest level of indexed branch nodes (0 = root key).
+ *	@param	output	Branch records are appended to it.
+ *	@return			Number of records.
+ */
+UINT VDFIndexReader::Scan(const char *data, size_t length, const char *name,
+						  UINT depth, VDFBuffer &output)
+{
+	this->output = &output;
+	maxDepth = depth;
+	count = 0;
+	nodePending = false;
+
+	EnsureArraySize(starts, startsSize, (size_t)depth + 1);
+	EnsureArraySize(pathEnds, pathEndsSize, (size_t)depth + 1);
+
+	this->OpenString(data, length, name);
+
+	while(this->NextKeyValue());
+
+	this->Close();
+
+	return count;
+}
+
+void VDFIndexReader::DispatchToParser(const char *key, const char *value, UINT depth)
+{
+	size_t pos;
+	size_t len;
+
+	if(depth > maxDepth)
+		return;
+
+	pos = depth ? pathEnds[depth - 1] + 1 : 0;
+	len = key ? strlen(key) : 0;
+
+	EnsureArraySize(path, pathSize, pos + len + 1);
+
+	if(depth)
+		path[pos - 1] = '/';
+	memcpy(path + pos, key, len);
+	path[pos + len] = '\0';
+	pathEnds[depth] = pos + len;
+
+	nodeLevel = depth;
+	nodePending = true;
+
+	// deepest branches aren't tokenized
+	if(depth == maxDepth)
+		skipBranch = true;
+}
+
+void VDFIndexReader::HandleBranchOpen(size_t start)
+{
+	UINT level;
+
+	level = currentDepth - 1;
+
+	if(level <= maxDepth)
+		starts[level] = (nodePending && level == nodeLevel) ? (UINT)start : VDF_INDEX_NONE;
+
+	nodePending = false;
+}
+
+void VDFIndexReader::HandleBranchClose(size_t end)
+{
+	UINT level;
+
+	level = currentDepth - 1;
+
+	if(level <= maxDepth && starts[level] != VDF_INDEX_NONE) {
+		AddBranch(level, starts[level], end);
+		starts[level] = VDF_INDEX_NONE;
+	}
+}
+
+void VDFIndexReader::HandleSkippedBranch(size_t start, size_t end)
+{
+	UINT level;
+
+	// depth is back to branch node level
+	level = currentDepth;
+
+	if(level <= maxDepth && starts[level] != VDF_INDEX_NONE) {
+		AddBranch(level, start, end);
+		starts[level] = VDF_INDEX_NONE;
+	}
+}
+
+/**
+ *	Appends a branch record, path is the one of last node at that level.
+ */
+void VDFIndexReader::AddBranch(UINT level, size_t start, size_t end)
+{
+	output->AppendUInt((UINT)start);
+	output->AppendUInt((UINT)end);
+	output->AppendUInt((UINT)pathEnds[level]);
+	output->Append(path, pathEnds[level]);
+	output->AppendByte(0);
+	count++;
+}
+
+// --- VDFIndex class implementation ---
+
+VDFIndex::VDFIndex(IErrorLogger *logger)
+{
+	this->logger = logger;
+	data = NULL;
+	length = 0;
+}
+
+VDFIndex::~VDFIndex()
+{
+	FinalizeArray(data);
+}
+
+/**
+ *	Gets the index file name of a tree file.
+ *	@return		New string, freed by caller.
+ */
+char *VDFIndex::GetIndexPath(const char *filename)
+{
+	char *indexPath;
+
+	indexPath = new char[strlen(filename) + sizeof(VDF_INDEX_EXTENSION)];
+	sprintf(indexPath, "%s%s", filename, VDF_INDEX_EXTENSION);
+
+	return indexPath;
+}
+
+/**
+ *	Scans a text file and writes its index. Index is kept in memory even
+ *	if it can't be written.
+ *	@param	filename	Text file.
+ *	@param	depth		Deepest level of indexed branch nodes (0 = root key).
+ *	@return				false if file can't be read or if it's binary.
+ */
+bool VDFIndex::Build(const char *filename, UINT depth)
+{
+	VDFIndexReader	reader = VDFIndexReader(logger);
+	VDFBuffer		output;
+	VDFBuffer		records;
+	VDFCacheKey		key;
+	char			*source;
+	char			*indexPath;
+	char			*tempPath;
+	FILE			*pFile;
+	long			size;
+	UINT			count;
+	bool			ret;
+
+	if(!VDFCache::GetSourceKey(filename, key) || VDFReader::IsBinaryVDF(filename))
+		return false;
+
+	if((pFile = fopen(filename, "rb")) == NULL)
+		return false;
+
+	fseek(pFile, 0, SEEK_END);
+	size = ftell(pFile);
+	fseek(pFile, 0, SEEK_SET);
+
+	// offsets are stored in 32 bits
+	if(size < 0 || (unsigned long)size >= VDF_INDEX_NONE) {
+		fclose(pFile);
+		return false;
+	}
+
+	source = new char[size + 1];
+	size = (long)fread(source, 1, (size_t)size, pFile);
+	fclose(pFile);
+
+	count = reader.Scan(source, (size_t)size, filename, depth, records);
+	FinalizeArray(source);
+
+	output.Append(VDF_INDEX_MAGIC, 4);
+	output.AppendByte(VDF_INDEX_VERSION);
+	// strings depend on escape sequences setting
+	output.AppendByte(VDFReader::shared.escapes ? 1 : 0);
+	output.AppendByte(0);
+	output.AppendByte(0);
+	output.AppendUInt(key.size);
+	output.AppendUInt(key.sizeHigh);
+	output.AppendUInt(key.mtime);
+	output.AppendUInt(key.mtimeHigh);
+	output.AppendUInt(depth);
+	output.AppendUInt(count);
+	output.Append(records.data, records.length);
+
+	FinalizeArray(data);
+	data = new unsigned char[output.length];
+	memcpy(data, output.data, output.length);
+	length = output.length;
+
+	// written into a temporary file, it replaces old index when it's complete
+	indexPath = GetIndexPath(filename);
+	tempPath = new char[strlen(indexPath) + 5];
+	sprintf(tempPath, "%s.tmp", indexPath);
+
+	if((pFile = fopen(tempPath, "wb")) != NULL) {
+		ret = fwrite(output.data, 1, output.length, pFile) == output.length;
+		ret = (fclose(pFile) == 0) && ret;
+
+		if(ret) {
+			remove(indexPath);
+			ret = rename(tempPath, indexPath) == 0;
+		}
+		if(!ret)
+			remove(tempPath);
+	}
+
+	FinalizeArray(indexPath);
+	FinalizeArray(tempPath);
+
+	return true;
+}
+
+/**
+ *	Loads the index of a text file.
+ *	@param	filename	Text file.
+ *	@return				false if there's no index or if it doesn't match the file.
+ */
+bool VDFIndex::Load(const char *filename)
+{
+	VDFCacheKey	key;
+	char		*indexPath;
+	FILE		*pFile;
+	long		size;
+	bool		valid;
+
+	if(!VDFCache::GetSourceKey(filename, key))
+		return false;
+
+	indexPath = GetIndexPath(filename);
+	pFile = fopen(indexPath, "rb");
+	FinalizeArray(indexPath);
+
+	if(pFile == NULL)
+		return false;
+
+	fseek(pFile, 0, SEEK_END);
+	size = ftell(pFile);
+	fseek(pFile, 0, SEEK_SET);
+
+	if(size < VDF_INDEX_HEADER_SIZE) {
+		fclose(pFile);
+		return false;
+	}
+
+	FinalizeArray(data);
+	data = new unsigned char[size];
+	length = fread(data, 1, (size_t)size, pFile);
+	fclose(pFile);
+
+	valid = length == (size_t)size
+		&& memcmp(data, VDF_INDEX_MAGIC, 4) == 0
+		&& data[4] == VDF_INDEX_VERSION
+		&& data[5] == (VDFReader::shared.escapes ? 1 : 0)
+		&& ReadUInt(data + 8) == key.size
+		&& ReadUInt(data + 12) == key.sizeHigh
+		&& ReadUInt(data + 16) == key.mtime
+		&& ReadUInt(data + 20) == key.mtimeHigh;
+
+	if(!valid) {
+		FinalizeArray(data);
+		length = 0;
+	}
+
+	return valid;
+}
+
+/**
+ *	Finds the record of a branch path, or of its deepest indexed ancestor.
+ *	Paths are compared as written, first matching record is taken.
+ *	@param	path	Key path, keys joined by '/' from root key.
+ *	@param	start	Receives branch start.
+ *	@param	end		Receives branch end.
+ *	@return			Path of found record or NULL if there's none.
+ */
+const char *VDFIndex::Find(const char *path, UINT &start, UINT &end)
+{
+	const char	*found;
+	const char	*entry;
+	size_t		foundLength;
+	size_t		pos;
+	UINT		len;
+
+	found = NULL;
+	foundLength = 0;
+
+	for(pos = VDF_INDEX_HEADER_SIZE; pos + 12 < length; pos += 12 + len + 1) {
+		len = ReadUInt(data + pos + 8);
+
+		if(length - pos - 12 <= len)
+			break;
+
+		entry = (const char*)(data + pos + 12);
+
+		if(strncmp(path, entry, len) || (path[len] != '\0' && path[len] != '/'))
+			continue;
+
+		if(found == NULL || len > foundLength) {
+			found = entry;
+			foundLength = len;
+			start = ReadUInt(data + pos);
+			end = ReadUInt(data + pos + 4);
+
+			if(path[len] == '\0')
+				break;
+		}
+	}
+
+	return found;
+}
+
+/**
+ *	Reads a branch of a text file through its index, only the range of
+ *	the branch (or of its deepest indexed ancestor) is parsed. Index is
+ *	built first if there's none or if it's out of date.
+ *	@param	filename	Text file.
+ *	@param	path		Key path, keys joined by '/' from root key.
+ *	@param	depth		Deepest level of indexed branch nodes, if index is built.
+ *	@return				New tree whose root is the branch node, NULL if it's not found.
+ */
+VDFTree *VDFIndex::ReadPath(const char *filename, const char *path, UINT depth)
+{
+	VDFTreeFile	reader = VDFTreeFile(logger);
+	VDFTree		*tree;
+	VDFTree		*result;
+	VDFNode		*node;
+	const char	*found;
+	const char	*key;
+	const char	*next;
+	char		*range;
+	FILE		*pFile;
+	UINT		start;
+	UINT		end;
+	size_t		len;
+
+	if(filename == NULL || path == NULL)
+		return NULL;
+
+	if(!Load(filename) && !Build(filename, depth))
+		return NULL;
+
+	if((found = Find(path, start, end)) == NULL || end < start)
+		return NULL;
+
+	if((pFile = fopen(filename, "rb")) == NULL)
+		return NULL;
+
+	range = new char[end - start];
+
+	len = (fseek(pFile, (long)start, SEEK_SET) == 0) ? fread(range, 1, end - start, pFile) : 0;
+	fclose(pFile);
+
+	// branch node takes the last key of record path
+	key = strrchr(found, '/');
+	key = key ? key + 1 : found;
+
+	tree = new VDFTree;
+	tree->CreateTree();
+	VDFTree::SetKeyPair(tree->rootNode, key);
+
+	reader.ReadBranch(tree, tree->rootNode, range, len, filename);
+	FinalizeArray(range);
+
+	// rest of path is looked up in the branch
+	node = tree->rootNode;
+	key = path + strlen(found);
+
+	while(node && *key == '/') {
+		key++;
+		next = strchr(key, '/');
+		len = next ? (size_t)(next - key) : strlen(key);
+
+		for(node = node->childNode; node; node = node->nextNode) {
+			if(node->key && strlen(node->key) == len && !strncmp(node->key, key, len))
+				break;
+		}
+		key += len;
+	}
+
+	if(node == tree->rootNode)
+		return tree;
+
+	result = NULL;
+
+	if(node != NULL) {
+		result = new VDFTree;
+		result->rootNode = result->CloneBranch(node);
+	}
+
+	delete tree;
+
+	return result;
+}
@@ -0,0 +1,77 @@
+#ifndef __VDFINDEX_H__
+#define __VDFINDEX_H__
+
+#include "VDFParser.h"
+
+/** Sidecar indexes: header followed by branch records (start, end, path length, path) */
+#define VDF_INDEX_MAGIC			"VDFX"
+#define VDF_INDEX_VERSION		1
+#define VDF_INDEX_HEADER_SIZE	32
+#define VDF_INDEX_EXTENSION		".idx"
+#define VDF_INDEX_DEFAULT_DEPTH	2
+
+/** Branch start meaning "not indexed" */
+#define VDF_INDEX_NONE			0xFFFFFFFF
+
+/**
+ *	Scans a text file for the index: branches down to a given level are
+ *	recorded with their key path, deeper ones are skipped by brace matching.
+ */
+class VDFIndexReader : public VDFReader
+{
+public:
+				VDFIndexReader	(IErrorLogger *logger = NULL);
+				~VDFIndexReader	();
+	UINT		Scan			(const char *data, size_t length, const char *name,
+								 UINT depth, VDFBuffer &output);
+
+protected:
+	void		DispatchToParser	(const char* key = NULL, const char *value= NULL, UINT depth = 0);
+	void		HandleBranchOpen	(size_t start);
+	void		HandleBranchClose	(size_t end);
+	void		HandleSkippedBranch	(size_t start, size_t end);
+	void		AddBranch			(UINT level, size_t start, size_t end);
+
+	VDFBuffer	*output;
+	UINT		maxDepth;
+	UINT		count;
+	/** path of last node, pathEnds holds its length at each level */
+	char		*path;
+	size_t		pathSize;
+	size_t		*pathEnds;
+	size_t		pathEndsSize;
+	/** start of open branches at each level (VDF_INDEX_NONE if not indexed) */
+	UINT		*starts;
+	size_t		startsSize;
+	UINT		nodeLevel;
+	bool		nodePending;
+};
+
+/**
+ *	Sidecar file (tree file name plus VDF_INDEX_EXTENSION) that maps the key
+ *	path of each branch, down to a given level, to its byte range in a text
+ *	file. A branch is read by seeking to its range and parsing only that
+ *	range. Index is valid while size and modification time of the file
+ *	match its header, otherwise it's built again.
+ */
+class VDFIndex
+{
+public:
+				VDFIndex		(IErrorLogger *logger = NULL);
+				~VDFIndex		();
+	bool		Build			(const char *filename, UINT depth);
+	bool		Load			(const char *filename);
+	VDFTree		*ReadPath		(const char *filename, const char *path,
+								 UINT depth = VDF_INDEX_DEFAULT_DEPTH);
+
+protected:
+	const char	*Find			(const char *path, UINT &start, UINT &end);
+	static char	*GetIndexPath	(const char *filename);
+
+	unsigned char	*data;
+	size_t			length;
+	IErrorLogger	*logger;
+};
+
+
+#endif //__VDFINDEX_H__
@@ -0,0 +1,801 @@
+/*
+*
+*  This program is free software; you can redistribute it and/or modify it
+*  under the terms of the GNU General Public License as published by the
+*  Free Software Foundation; either version 2 of the License, or (at
+*  your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful, but
+*  WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*  General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software Foundation,
+*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**  
+ *	@author		commonbullet
+ *	@version	1.07
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "VDFJournal.h"
+#include "VDFCache.h"
+
+size_t VDFJournal::activeJournals = 0;
+
+
+// --- VDFJournal implementation ---
+
+VDFJournal::VDFJournal(IErrorLogger *logger)
+{
+	tree = NULL;
+	filename = NULL;
+	logPath = NULL;
+	pLog = NULL;
+	limit = VDF_JOURNAL_DEFAULT_LIMIT;
+	logSize = 0;
+	invalid = false;
+	levels = NULL;
+	levelsSize = 0;
+	positions = NULL;
+	positionsSize = 0;
+	positionCount = 0;
+	stamps = NULL;
+	stampsSize = 0;
+	stampCount = 0;
+	rootStamp = 0;
+	lastStamp = 0;
+	this->logger = logger;
+}
+
+VDFJournal::~VDFJournal()
+{
+	Stop();
+	FinalizeArray(levels);
+	FinalizeArray(positions);
+	FinalizeArray(stamps);
+}
+
+/**
+ *	Starts journaling a tree. An existing journal goes on if it applies to
+ *	current tree file (it should have been replayed when tree was opened),
+ *	otherwise tree is saved and the journal starts empty.
+ *
+ *	@param	tree		Tree to be journaled, it must not be frozen.
+ *	@param	filename	Tree file.
+ *	@param	limit		Journal size (bytes) that triggers compaction.
+ *	@return				false if journal can't be written.
+ */
+bool VDFJournal::Start(VDFTree *tree, const char *filename, size_t limit)
+{
+	Stop();
+
+	if(tree == NULL || filename == NULL)
+		return false;
+
+	this->tree = tree;
+	this->limit = limit;
+	this->filename = new char[strlen(filename) + 1];
+	strcpy(this->filename, filename);
+	logPath = new char[strlen(filename) + sizeof(VDF_JOURNAL_EXTENSION)];
+	sprintf(logPath, "%s%s", filename, VDF_JOURNAL_EXTENSION);
+	activeJournals++;
+	ResetPositions();
+
+	if(OpenLog(false))
+		return true;
+
+	return Compact();
+}
+
+/**
+ *	Writes pending records and stops journaling.
+ */
+void VDFJournal::Stop()
+{
+	if(tree == NULL)
+		return;
+
+	Sync();
+
+	if(pLog) {
+		fclose(pLog);
+		pLog = NULL;
+	}
+
+	FinalizeArray(filename);
+	FinalizeArray(logPath);
+	pending.Reset();
+	invalid = false;
+	tree = NULL;
+	activeJournals--;
+}
+
+/**
+ *	Appends pending records to journal file, tree is saved instead if
+ *	journal would pass its limit or if it's missed some change.
+ *
+ *	@return		false on write errors.
+ */
+bool VDFJournal::Sync()
+{
+	if(tree == NULL)
+		return false;
+
+	if(invalid || pLog == NULL || logSize + pending.length > limit)
+		return Compact();
+
+	if(pending.length == 0)
+		return true;
+
+	if(fwrite(pending.data, 1, pending.length, pLog) != pending.length || fflush(pLog) != 0) {
+		// a partial record would hide later ones
+		invalid = true;
+		return false;
+	}
+
+	logSize += pending.length;
+	pending.Reset();
+
+	return true;
+}
+
+/**
+ *	Saves the whole tree and starts an empty journal. If it's interrupted
+ *	after tree is saved, the old journal doesn't match the new file, so it
+ *	isn't replayed.
+ *
+ *	@return		false if tree or journal can't be written.
+ */
+bool VDFJournal::Compact()
+{
+	VDFTreeFile saver(logger);
+
+	if(tree == NULL)
+		return false;
+
+	if(pLog) {
+		fclose(pLog);
+		pLog = NULL;
+	}
+
+	if(!saver.SaveVDF(filename, tree)) {
+		invalid = true;
+		OpenLog(false);
+		return false;
+	}
+
+	pending.Reset();
+	invalid = false;
+
+	// changes that weren't recorded may have left cached indexes behind
+	ResetPositions();
+
+	return OpenLog(true);
+}
+
+/**
+ *	Opens journal file for appending.
+ *
+ *	@param	restart		If true journal is emptied, otherwise it's only
+ *						opened if it applies to current tree file.
+ *	@return				true if journal is open.
+ */
+bool VDFJournal::OpenLog(bool restart)
+{
+	char	header[128];
+	char	line[128];
+	FILE	*pFile;
+	bool	valid;
+
+	MakeHeader(filename, header, sizeof(header));
+
+	if(restart) {
+		if((pLog = fopen(logPath, "wb")) == NULL)
+			return false;
+		logSize = strlen(header);
+		if(fwrite(header, 1, logSize, pLog) != logSize || fflush(pLog) != 0) {
+			fclose(pLog);
+			pLog = NULL;
+			return false;
+		}
+		return true;
+	}
+
+	if((pFile = fopen(logPath, "rb")) == NULL)
+		return false;
+
+	valid = fgets(line, sizeof(line), pFile) != NULL && !strcmp(line, header);
+	fclose(pFile);
+
+	if(!valid || (pLog = fopen(logPath, "ab")) == NULL)
+		return false;
+
+	fseek(pLog, 0, SEEK_END);
+	logSize = (size_t)ftell(pLog);
+
+	return true;
+}
+
+/**
+ *	Builds journal header line for a tree file.
+ *	@param	filename	Tree file, its size and modification time are written.
+ *	@param	header		Output buffer.
+ *	@param	maxlen		Output buffer size.
+ */
+void VDFJournal::MakeHeader(const char *filename, char *header, size_t maxlen)
+{
+	VDFCacheKey key;
+
+	if(!VDFCache::GetSourceKey(filename, key))
+		memset(&key, 0, sizeof(key));
+
+	_snprintf(header, maxlen, "%s %d %u %u %u %u\n", VDF_JOURNAL_MAGIC, VDF_JOURNAL_VERSION,
+		key.size, key.sizeHigh, key.mtime, key.mtimeHigh);
+
+	header[maxlen - 1] = '\0';
+}
+
+/**
+ *	Records a key change, call it after the key is set.
+ */
+void VDFJournal::RecordKey(VDFNode *node)
+{
+	pending.AppendByte(VDF_JOURNAL_SET_KEY);
+	WritePosition(node);
+	WriteString(node->key);
+	pending.AppendByte('\n');
+}
+
+/**
+ *	Records a value change, call it after the value is set.
+ */
+void VDFJournal::RecordValue(VDFNode *node)
+{
+	pending.AppendByte(VDF_JOURNAL_SET_VALUE);
+	WritePosition(node);
+	WriteString(node->value);
+	pending.AppendByte('\n');
+}
+
+/**
+ *	Records a node appended as last child of its parent (or at root level),
+ *	call it once node is linked.
+ */
+void VDFJournal::RecordAppend(VDFNode *node)
+{
+	VDFJournalSlot	*slot;
+	UINT			stamp;
+	UINT			index;
+
+	pending.AppendByte(VDF_JOURNAL_APPEND);
+	if(node->parentNode)
+		WritePosition(node->parentNode);
+	else
+		pending.Append(" -", 2);
+	WriteString(node->key);
+	WriteString(node->value);
+	pending.AppendByte('\n');
+
+	// last node of a cached level (or first of a new one) gets its index
+	if(node->previousNode == NULL) {
+		SetLevelStamp(node->parentNode, ++lastStamp);
+		slot = AddSlot(positions, positionsSize, positionCount, node);
+		slot->index = 0;
+	} else if((stamp = GetLevelStamp(node->parentNode)) != 0
+		&& (slot = FindSlot(positions, positionsSize, node->previousNode)) != NULL
+		&& slot->node == node->previousNode && slot->stamp == stamp) {
+		index = slot->index + 1;
+		slot = AddSlot(positions, positionsSize, positionCount, node);
+		slot->index = index;
+	} else
+		return;
+
+	slot->parent = node->parentNode;
+	slot->stamp = GetLevelStamp(node->parentNode);
+}
+
+/**
+ *	Records a node deletion, call it before node is deleted.
+ */
+void VDFJournal::RecordDelete(VDFNode *node)
+{
+	pending.AppendByte(VDF_JOURNAL_DELETE);
+	WritePosition(node);
+	pending.AppendByte('\n');
+
+	SetLevelStamp(node->parentNode, 0);
+	ChangeBranch(node);
+}
+
+/**
+ *	Records a node moved next to another one (see <code>VDFTree::MoveToBranch</code>),
+ *	call it before node is moved.
+ */
+void VDFJournal::RecordMove(VDFNode *moveNode, VDFNode *refNode, UINT position)
+{
+	char num[16];
+
+	pending.AppendByte(VDF_JOURNAL_MOVE_TO_BRANCH);
+	WritePosition(moveNode);
+	WritePosition(refNode);
+	pending.Append(num, (size_t)sprintf(num, " %u", position));
+	pending.AppendByte('\n');
+
+	SetLevelStamp(moveNode->parentNode, 0);
+	SetLevelStamp(refNode->parentNode, 0);
+}
+
+/**
+ *	Records a node moved as last child of another one, call it before node is moved.
+ */
+void VDFJournal::RecordMoveAsChild(VDFNode *moveNode, VDFNode *parentNode)
+{
+	pending.AppendByte(VDF_JOURNAL_MOVE_AS_CHILD);
+	WritePosition(moveNode);
+	WritePosition(parentNode);
+	pending.AppendByte('\n');
+
+	SetLevelStamp(moveNode->parentNode, 0);
+	SetLevelStamp(parentNode, 0);
+}
+
+/**
+ *	Records a branch sort, call it before branch is sorted.
+ */
+void VDFJournal::RecordSort(VDFNode *refNode, bool byKey, bool byNumber)
+{
+	pending.AppendByte(VDF_JOURNAL_SORT);
+	WritePosition(refNode);
+	pending.Append(byKey ? " 1" : " 0", 2);
+	pending.Append(byNumber ? " 1" : " 0", 2);
+	pending.AppendByte('\n');
+
+	SetLevelStamp(refNode->parentNode, 0);
+}
+
+/**
+ *	Writes node position: its child index at each level, from root
+ *	level down to the node, separated by dots.
+ */
+void VDFJournal::WritePosition(VDFNode *node)
+{
+	size_t	depth;
+	char	num[16];
+
+	for(depth = 0; node; node = node->parentNode) {
+		EnsureArraySize(levels, levelsSize, depth + 1);
+		levels[depth++] = GetIndex(node);
+	}
+
+	pending.AppendByte(' ');
+	while(depth--)
+		pending.Append(num, (size_t)sprintf(num, depth ? "%u." : "%u", levels[depth]));
+}
+
+/**
+ *	Gets the child index of a node. If it isn't cached, its whole level
+ *	is indexed, so next records in that level don't count siblings.
+ */
+UINT VDFJournal::GetIndex(VDFNode *node)
+{
+	VDFJournalSlot	*slot;
+	VDFNode			*parent;
+	VDFNode			*sibling;
+	UINT			stamp;
+	UINT			index;
+	UINT			found;
+
+	parent = node->parentNode;
+
+	if((stamp = GetLevelStamp(parent)) != 0
+		&& (slot = FindSlot(positions, positionsSize, node)) != NULL
+		&& slot->node == node && slot->parent == parent && slot->stamp == stamp)
+		return slot->index;
+
+	// stamps are never reused, tables are emptied before they wrap
+	if(++lastStamp == 0) {
+		ResetPositions();
+		lastStamp = 1;
+	}
+
+	stamp = lastStamp;
+	SetLevelStamp(parent, stamp);
+
+	found = 0;
+	sibling = parent ? parent->childNode : tree->rootNode;
+
+	for(index = 0; sibling; sibling = sibling->nextNode, index++) {
+		slot = AddSlot(positions, positionsSize, positionCount, sibling);
+		slot->parent = parent;
+		slot->index = index;
+		slot->stamp = stamp;
+		if(sibling == node)
+			found = index;
+	}
+
+	return found;
+}
+
+/**
+ *	Gets the stamp of a level.
+ *	@param	parent	Parent of level, NULL for root level.
+ *	@return			Stamp, 0 if level isn't cached.
+ */
+UINT VDFJournal::GetLevelStamp(VDFNode *parent)
+{
+	VDFJournalSlot *slot;
+
+	if(parent == NULL)
+		return rootStamp;
+
+	slot = FindSlot(stamps, stampsSize, parent);
+
+	return (slot != NULL && slot->node == parent) ? slot->stamp : 0;
+}
+
+/**
+ *	Sets the stamp of a level, 0 drops its cached indexes.
+ *	@param	parent	Parent of level, NULL for root level.
+ *	@param	stamp	New stamp.
+ */
+void VDFJournal::SetLevelStamp(VDFNode *parent, UINT stamp)
+{
+	VDFJournalSlot *slot;
+
+	if(parent == NULL) {
+		rootStamp = stamp;
+		return;
+	}
+
+	if(!stamp) {
+		if((slot = FindSlot(stamps, stampsSize, parent)) != NULL && slot->node == parent)
+			slot->stamp = 0;
+		return;
+	}
+
+	AddSlot(stamps, stampsSize, stampCount, parent)->stamp = stamp;
+}
+
+/**
+ *	Drops cached levels inside a branch that's about to be deleted, so
+ *	nodes created later at the same addresses don't match them.
+ *	@param	node	Branch node.
+ */
+void VDFJournal::ChangeBranch(VDFNode *node)
+{
+	VDFCursor cursor;
+
+	if(!stampCount)
+		return;
+
+	for(cursor.Start(node, true); cursor.node; cursor.Next()) {
+		if(cursor.node->childNode)
+			SetLevelStamp(cursor.node, 0);
+	}
+}
+
+/**
+ *	Empties cached indexes.
+ */
+void VDFJournal::ResetPositions()
+{
+	if(positions)
+		memset(positions, 0, positionsSize * sizeof(VDFJournalSlot));
+	if(stamps)
+		memset(stamps, 0, stampsSize * sizeof(VDFJournalSlot));
+
+	positionCount = 0;
+	stampCount = 0;
+	rootStamp = 0;
+}
+
+/**
+ *	Looks for a node in a table (open addressing).
+ *	@return		Its slot, or the empty slot it'd take; NULL if table is empty.
+ */
+VDFJournalSlot *VDFJournal::FindSlot(VDFJournalSlot *table, size_t size, VDFNode *node)
+{
+	size_t ind;
+
+	if(!size)
+		return NULL;
+
+	for(ind = HashBytes(&node, sizeof(node)) & (size - 1); table[ind].node && table[ind].node != node;
+		ind = (ind + 1) & (size - 1));
+
+	return &table[ind];
+}
+
+/**
+ *	Gets the slot of a node in a table, it's added if it isn't there.
+ *	Table is kept at most half full.
+ *	@return		Node slot.
+ */
+VDFJournalSlot *VDFJournal::AddSlot(VDFJournalSlot *&table, size_t &size, size_t &count, VDFNode *node)
+{
+	VDFJournalSlot	*old;
+	VDFJournalSlot	*slot;
+	size_t			oldSize;
+	size_t			ind;
+
+	if((count + 1) * 2 > size) {
+		old = table;
+		oldSize = size;
+		size = size ? size * 2 : 256;
+		table = new VDFJournalSlot[size];
+		memset(table, 0, size * sizeof(VDFJournalSlot));
+
+		for(ind = 0; ind < oldSize; ind++) {
+			if(old[ind].node)
+				*FindSlot(table, size, old[ind].node) = old[ind];
+		}
+		FinalizeArray(old);
+	}
+
+	slot = FindSlot(table, size, node);
+
+	if(slot->node == NULL) {
+		slot->node = node;
+		count++;
+	}
+
+	return slot;
+}
+
+/**
+ *	Writes a quoted string, quotes, backslashes and line breaks are escaped.
+ */
+void VDFJournal::WriteString(const char *str)
+{
+	pending.Append(" \"", 2);
+
+	for(; str && *str; str++) {
+		switch(*str) {
+			case '"':	pending.Append("\\\"", 2);	break;
+			case '\\':	pending.Append("\\\\", 2);	break;
+			case '\n':	pending.Append("\\n", 2);	break;
+			case '\r':	pending.Append("\\r", 2);	break;
+			default:	pending.AppendByte((unsigned char)*str);
+		}
+	}
+
+	pending.AppendByte('"');
+}
+
+/**
+ *	Applies the journal of a tree file, if there's one. Records after an
+ *	incomplete or invalid one are skipped.
+ *
+ *	@param	tree		Tree read from that file, it's converted into
+ *						regular nodes if there are records.
+ *	@param	filename	Tree file.
+ *	@param	logger		Error logger (optional).
+ *	@return				false if journal doesn't apply to tree file, or on
+ *						invalid records.
+ */
+bool VDFJournal::Replay(VDFTree *tree, const char *filename, IErrorLogger *logger)
+{
+	char		header[128];
+	char		*logPath;
+	char		*data;
+	const char	*line;
+	const char	*end;
+	const char	*pos;
+	char		*key;
+	char		*value;
+	VDFNode		*node;
+	VDFNode		*target;
+	FILE		*pFile;
+	long		len;
+	int			lineNum;
+	bool		valid;
+
+	if(tree == NULL || filename == NULL)
+		return false;
+
+	logPath = new char[strlen(filename) + sizeof(VDF_JOURNAL_EXTENSION)];
+	sprintf(logPath, "%s%s", filename, VDF_JOURNAL_EXTENSION);
+	pFile = fopen(logPath, "rb");
+	FinalizeArray(logPath);
+
+	if(pFile == NULL)
+		return true;
+
+	fseek(pFile, 0, SEEK_END);
+	len = ftell(pFile);
+	fseek(pFile, 0, SEEK_SET);
+
+	data = new char[len + 1];
+	len = (long)fread(data, 1, (size_t)len, pFile);
+	data[len] = 0;
+	fclose(pFile);
+
+	MakeHeader(filename, header, sizeof(header));
+	if(strncmp(data, header, strlen(header))) {
+		if(logger)
+			logger->printError(filename, "journal doesn't match tree file, it's been ignored");
+		FinalizeArray(data);
+		return false;
+	}
+
+	line = data + strlen(header);
+	valid = true;
+
+	if(*line)
+		tree->Thaw();
+
+	// only complete lines are applied
+	for(lineNum = 2; valid && (end = strchr(line, '\n')) != NULL; line = end + 1, lineNum++) {
+		pos = line + 1;
+		key = NULL;
+		value = NULL;
+		target = NULL;
+		node = NULL;
+
+		switch(*line) {
+			case VDF_JOURNAL_SET_KEY:
+			case VDF_JOURNAL_SET_VALUE:
+				node = ReadPosition(tree, pos, valid);
+				if(!valid || node == NULL || (key = ReadString(pos)) == NULL) {
+					valid = false;
+					break;
+				}
+				if(*line == VDF_JOURNAL_SET_KEY)
+					VDFTree::SetKeyPair(node, key);
+				else
+					VDFTree::SetKeyPair(node, NULL, key);
+				break;
+
+			case VDF_JOURNAL_APPEND:
+				target = ReadPosition(tree, pos, valid);
+				if(!valid || (key = ReadString(pos)) == NULL || (value = ReadString(pos)) == NULL) {
+					valid = false;
+					break;
+				}
+				node = tree->CreateNode();
+				VDFTree::SetKeyPair(node, *key ? key : NULL, *value ? value : NULL);
+				if(target)
+					VDFTree::AppendChild(target, node);
+				else if(tree->rootNode)
+					VDFTree::AppendNode(tree->rootNode, node);
+				else
+					tree->rootNode = node;
+				break;
+
+			case VDF_JOURNAL_DELETE:
+				node = ReadPosition(tree, pos, valid);
+				if((valid = valid && node != NULL))
+					tree->DeleteNode(node);
+				break;
+
+			case VDF_JOURNAL_MOVE_TO_BRANCH:
+				node = ReadPosition(tree, pos, valid);
+				if(valid)
+					target = ReadPosition(tree, pos, valid);
+				if((valid = valid && node != NULL && target != NULL))
+					tree->MoveToBranch(target, node, (UINT)strtoul(pos, NULL, 10));
+				break;
+
+			case VDF_JOURNAL_MOVE_AS_CHILD:
+				node = ReadPosition(tree, pos, valid);
+				if(valid)
+					target = ReadPosition(tree, pos, valid);
+				if((valid = valid && node != NULL && target != NULL))
+					tree->MoveAsChild(target, node);
+				break;
+
+			case VDF_JOURNAL_SORT:
+				node = ReadPosition(tree, pos, valid);
+				if((valid = valid && node != NULL && pos[0] == ' ' && pos[2] == ' '))
+					tree->SortBranchNodes(node, pos[1] == '1', pos[3] == '1');
+				break;
+
+			default:
+				valid = false;
+		}
+
+		FinalizeArray(key);
+		FinalizeArray(value);
+	}
+
+	if(!valid && logger)
+		logger->printError(filename, "invalid journal record, later records have been skipped", lineNum - 1);
+
+	FinalizeArray(data);
+
+	return valid;
+}
+
+/**
+ *	Reads a node position written by <code>WritePosition</code>.
+ *
+ *	@param	tree	Journaled tree.
+ *	@param	data	Record data, it's moved past the position.
+ *	@param	valid	Set to false if position is invalid or node isn't there.
+ *	@return			The node, NULL for root level ("-").
+ */
+VDFNode *VDFJournal::ReadPosition(VDFTree *tree, const char *&data, bool &valid)
+{
+	VDFNode	*level;
+	VDFNode	*node;
+	UINT	index;
+	char	*end;
+
+	if(*data++ != ' ') {
+		valid = false;
+		return NULL;
+	}
+
+	if(*data == '-') {
+		data++;
+		return NULL;
+	}
+
+	for(node = NULL, level = tree->rootNode; ; level = node->childNode) {
+		index = (UINT)strtoul(data, &end, 10);
+		if(end == data) {
+			valid = false;
+			return NULL;
+		}
+		data = end;
+
+		for(node = level; node && index; index--)
+			node = node->nextNode;
+
+		if(node == NULL) {
+			valid = false;
+			return NULL;
+		}
+
+		if(*data != '.')
+			return node;
+		data++;
+	}
+}
+
+/**
+ *	Reads a string written by <code>WriteString</code>.
+ *
+ *	@param	data	Record data, it's moved past the string.
+ *	@return			New string or NULL if it's invalid.
+ */
+char *VDFJournal::ReadString(const char *&data)
+{
+	const char	*end;
+	char		*str;
+	size_t		len;
+
+	if(data[0] != ' ' || data[1] != '"')
+		return NULL;
+	data += 2;
+
+	for(end = data; *end != '"'; end++) {
+		if(*end == '\n' || *end == 0 || (*end == '\\' && (*++end == '\n' || *end == 0)))
+			return NULL;
+	}
+
+	str = new char[end - data + 1];
+
+	for(len = 0; data < end; data++) {
+		if(*data == '\\') {
+			switch(*++data) {
+				case 'n':	str[len++] = '\n';	break;
+				case 'r':	str[len++] = '\r';	break;
+				default:	str[len++] = *data;
+			}
+		}
+		else
+			str[len++] = *data;
+	}
+	str[len] = 0;
+	data = end + 1;
+
+	return str;
+}
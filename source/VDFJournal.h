@@ -0,0 +1,106 @@
+#ifndef __VDFJOURNAL_H__
+#define __VDFJOURNAL_H__
+
+#include "VDFParser.h"
+
+/** Change journals: sidecar file of text records replayed on open */
+#define VDF_JOURNAL_MAGIC			"VDFJ"
+#define VDF_JOURNAL_VERSION			1
+#define VDF_JOURNAL_EXTENSION		".journal"
+#define VDF_JOURNAL_DEFAULT_LIMIT	262144
+
+/** record types */
+#define VDF_JOURNAL_SET_KEY			'K'
+#define VDF_JOURNAL_SET_VALUE		'V'
+#define VDF_JOURNAL_APPEND			'A'
+#define VDF_JOURNAL_DELETE			'D'
+#define VDF_JOURNAL_MOVE_TO_BRANCH	'M'
+#define VDF_JOURNAL_MOVE_AS_CHILD	'C'
+#define VDF_JOURNAL_SORT			'S'
+
+/**
+ *  Cached child index of a node, valid while its level hasn't changed
+ *  (same stamp). Level stamps are kept in another table, keyed by parent.
+ */
+struct VDFJournalSlot
+{
+	VDFNode		*node;
+	VDFNode		*parent;
+	UINT		index;
+	UINT		stamp;
+};
+
+/**
+ *	Keeps tree changes in an append-only sidecar file (tree file name plus
+ *	VDF_JOURNAL_EXTENSION), so a few changes don't rewrite the whole tree.
+ *	Nodes are addressed by their child index at each level, from root.
+ *	Indexes are cached a whole level at a time and dropped when the
+ *	level changes, so records don't count siblings again.
+ *	The journal header holds size and modification time of the tree file it
+ *	applies to; once journal grows past its limit the tree is saved and the
+ *	journal starts again (compaction).
+ */
+class VDFJournal
+{
+public:
+					VDFJournal		(IErrorLogger *logger = NULL);
+					~VDFJournal		();
+	bool			Start			(VDFTree *tree, const char *filename, size_t limit);
+	void			Stop			();
+	bool			Sync			();
+	bool			Compact			();
+	void			Invalidate		() { invalid = true; }
+
+	void			RecordKey		(VDFNode *node);
+	void			RecordValue		(VDFNode *node);
+	void			RecordAppend	(VDFNode *node);
+	void			RecordDelete	(VDFNode *node);
+	void			RecordMove		(VDFNode *moveNode, VDFNode *refNode, UINT position);
+	void			RecordMoveAsChild(VDFNode *moveNode, VDFNode *parentNode);
+	void			RecordSort		(VDFNode *refNode, bool byKey, bool byNumber);
+
+	static bool		Replay			(VDFTree *tree, const char *filename, IErrorLogger *logger = NULL);
+
+	/** number of started journals */
+	static size_t	activeJournals;
+
+protected:
+	bool			OpenLog			(bool restart);
+	void			WritePosition	(VDFNode *node);
+	UINT			GetIndex		(VDFNode *node);
+	UINT			GetLevelStamp	(VDFNode *parent);
+	void			SetLevelStamp	(VDFNode *parent, UINT stamp);
+	void			ChangeBranch	(VDFNode *node);
+	void			ResetPositions	();
+	static VDFJournalSlot *FindSlot	(VDFJournalSlot *table, size_t size, VDFNode *node);
+	static VDFJournalSlot *AddSlot	(VDFJournalSlot *&table, size_t &size, size_t &count, VDFNode *node);
+	void			WriteString		(const char *str);
+	static void		MakeHeader		(const char *filename, char *header, size_t maxlen);
+	static VDFNode	*ReadPosition	(VDFTree *tree, const char *&data, bool &valid);
+	static char		*ReadString		(const char *&data);
+
+	VDFTree			*tree;
+	char			*filename;
+	char			*logPath;
+	FILE			*pLog;
+	size_t			limit;
+	size_t			logSize;
+	bool			invalid;
+	VDFBuffer		pending;
+	UINT			*levels;
+	size_t			levelsSize;
+
+	/** cached node indexes and level stamps (0 if level isn't cached) */
+	VDFJournalSlot	*positions;
+	size_t			positionsSize;
+	size_t			positionCount;
+	VDFJournalSlot	*stamps;
+	size_t			stampsSize;
+	size_t			stampCount;
+	UINT			rootStamp;
+	UINT			lastStamp;
+	IErrorLogger	*logger;
+};
+
+
+#endif //__VDFJOURNAL_H__
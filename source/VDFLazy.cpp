@@ -0,0 +1,244 @@
+/*
+*
+*  This program is free software; you can redistribute it and/or modify it
+*  under the terms of the GNU General Public License as published by the
+*  Free Software Foundation; either version 2 of the License, or (at
+*  your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful, but
+*  WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*  General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software Foundation,
+*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**  
+ *	@author		commonbullet
+ *	@version	1.07
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "VDFLazy.h"
+
+size_t VDFLazySource::activeSources = 0;
+VDFLazySource *VDFLazySource::sources = NULL;
+
+VDFLazySource::VDFLazySource(IErrorLogger *logger)
+{
+	this->logger = logger;
+	data = NULL;
+	length = 0;
+	filename = NULL;
+	branches = NULL;
+	branchCount = 0;
+	branchSize = 0;
+	pending = 0;
+	tree = NULL;
+	next = sources;
+	sources = this;
+	activeSources++;
+}
+
+VDFLazySource::~VDFLazySource()
+{
+	VDFLazySource **link;
+
+	for(link = &sources; *link != this; link = &(*link)->next);
+	*link = next;
+
+	FinalizeArray(data);
+	FinalizeArray(filename);
+	FinalizeArray(branches);
+	activeSources--;
+}
+
+/**
+ *	Reads a whole file into memory.
+ *	@param	filename	File to be read.
+ *	@return				false if it can't be read.
+ */
+bool VDFLazySource::Load(const char *filename)
+{
+	FILE	*pFile;
+	long	size;
+
+	if((pFile = fopen(filename, "rb")) == NULL)
+		return false;
+
+	fseek(pFile, 0, SEEK_END);
+	size = ftell(pFile);
+	fseek(pFile, 0, SEEK_SET);
+
+	if(size < 0) {
+		fclose(pFile);
+		return false;
+	}
+
+	FinalizeArray(data);
+	data = new char[size + 1];
+	length = fread(data, 1, (size_t)size, pFile);
+	data[length] = '\0';
+	fclose(pFile);
+
+	FinalizeArray(this->filename);
+	this->filename = new char[strlen(filename) + 1];
+	strcpy(this->filename, filename);
+
+	return true;
+}
+
+/**
+ *	Keeps a node read above skipped branches (or at their level) and flags it,
+ *	it has no branch to be read. Nodes must be sorted once they're all added.
+ *	@param	node	Node read from source.
+ */
+void VDFLazySource::AddNode(VDFNode *node)
+{
+	EnsureArraySize(branches, branchSize, branchCount + 1);
+
+	branches[branchCount].node = node;
+	branches[branchCount].start = 0;
+	branches[branchCount].end = 0;
+	branches[branchCount].loaded = true;
+	branchCount++;
+	node->flags |= VDF_NODE_LAZY;
+}
+
+/**
+ *	Keeps a skipped branch. Branches must be sorted once they're all added.
+ *	@param	node	Node the branch belongs to, it may be the last node added.
+ *	@param	start	Offset of opening brace.
+ *	@param	end		Offset after closing brace.
+ */
+void VDFLazySource::AddBranch(VDFNode *node, size_t start, size_t end)
+{
+	if(!branchCount || branches[branchCount - 1].node != node)
+		AddNode(node);
+
+	branches[branchCount - 1].start = start;
+	branches[branchCount - 1].end = end;
+	branches[branchCount - 1].loaded = false;
+	pending++;
+}
+
+static int CompareBranches(const void *a, const void *b)
+{
+	const VDFNode *nodeA = ((const VDFLazyBranch*)a)->node;
+	const VDFNode *nodeB = ((const VDFLazyBranch*)b)->node;
+
+	return (nodeA < nodeB) ? -1 : (nodeA > nodeB);
+}
+
+/**
+ *	Sorts branches by node, so they're found by binary search.
+ */
+void VDFLazySource::Sort()
+{
+	qsort(branches, branchCount, sizeof(VDFLazyBranch), CompareBranches);
+}
+
+/**
+ *	Finds the branch of a node.
+ *	@param	node	Node to look for.
+ *	@return			The branch or NULL if node hasn't got one.
+ */
+VDFLazyBranch *VDFLazySource::Find(VDFNode *node)
+{
+	VDFLazyBranch key;
+
+	key.node = node;
+
+	return (VDFLazyBranch*)bsearch(&key, branches, branchCount, sizeof(VDFLazyBranch), CompareBranches);
+}
+
+/**
+ *	Reads the nodes of a branch, if they haven't been read yet.
+ *	@param	tree	Tree that holds the node.
+ *	@param	node	Branch node.
+ *	@return			true if the branch has been read now.
+ */
+bool VDFLazySource::LoadBranch(VDFTree *tree, VDFNode *node)
+{
+	VDFTreeFile		reader = VDFTreeFile(logger);
+	VDFLazyBranch	*branch;
+
+	if(!pending || (branch = Find(node)) == NULL || branch->loaded)
+		return false;
+
+	branch->loaded = true;
+	pending--;
+
+	reader.ReadBranch(tree, node, data + branch->start, branch->end - branch->start, filename);
+
+	if(!pending)
+		ClearFlags();
+
+	return true;
+}
+
+/**
+ *	Reads all branches that haven't been read yet.
+ *	@param	tree	Tree that holds the branches.
+ */
+void VDFLazySource::LoadAll(VDFTree *tree)
+{
+	VDFTreeFile	reader = VDFTreeFile(logger);
+	size_t		i;
+
+	for(i = 0; i < branchCount && pending; i++) {
+		if(branches[i].loaded)
+			continue;
+
+		branches[i].loaded = true;
+		pending--;
+
+		reader.ReadBranch(tree, branches[i].node, data + branches[i].start,
+			branches[i].end - branches[i].start, filename);
+	}
+
+	ClearFlags();
+}
+
+/**
+ *	Unflags kept nodes, once there's no branch left to be read.
+ */
+void VDFLazySource::ClearFlags()
+{
+	size_t i;
+
+	for(i = 0; i < branchCount; i++)
+		branches[i].node->flags &= ~VDF_NODE_LAZY;
+}
+
+/**
+ *	Finds the tree a node flagged VDF_NODE_LAZY has been read into. Lazy
+ *	trees are few, each source is searched by node address.
+ *	@param	node	Flagged node.
+ *	@return			The tree or NULL if node isn't kept by any source.
+ */
+VDFTree *VDFLazySource::FindTree(VDFNode *node)
+{
+	VDFLazySource *source;
+
+	for(source = sources; source; source = source->next) {
+		if(source->tree != NULL && source->Find(node) != NULL)
+			return source->tree;
+	}
+
+	return NULL;
+}
+
+/**
+ *	Adds up memory held by source (retained file is counted as image).
+ *	@param	usage	Receives byte counts (they're added to current values).
+ */
+void VDFLazySource::GetMemoryUsage(VDFMemoryUsage &usage)
+{
+	usage.imageBytes += sizeof(VDFLazySource) + length + 1;
+	usage.indexBytes += branchSize * sizeof(VDFLazyBranch);
+}
@@ -0,0 +1,68 @@
+#ifndef __VDFLAZY_H__
+#define __VDFLAZY_H__
+
+#include "VDFParser.h"
+
+/**
+ *  Branch of a lazy tree that may not have been read yet. Offsets
+ *	are positions of its braces in lazy source. Nodes above skipped
+ *	branches are kept too (as loaded branches), so any node flagged
+ *	VDF_NODE_LAZY is found in its source.
+ */
+struct VDFLazyBranch
+{
+	VDFNode						*node;
+	size_t						start;
+	size_t						end;
+	bool						loaded;
+};
+
+/**
+ *	Source of a tree opened in lazy mode. File is kept in memory and
+ *	branches of nodes at a given level are skipped when it's opened (by
+ *	brace matching only), their nodes are read on first access. Branches
+ *	that are never accessed don't take any node.
+ */
+class VDFLazySource
+{
+public:
+						VDFLazySource	(IErrorLogger *logger = NULL);
+						~VDFLazySource	();
+	bool				Load			(const char *filename);
+	void				AddNode			(VDFNode *node);
+	void				AddBranch		(VDFNode *node, size_t start, size_t end);
+	void				Sort			();
+	bool				LoadBranch		(VDFTree *tree, VDFNode *node);
+	void				LoadAll			(VDFTree *tree);
+	bool				IsLoaded		() { return pending == 0; }
+	void				GetMemoryUsage	(VDFMemoryUsage &usage);
+	static VDFTree		*FindTree		(VDFNode *node);
+
+	/** number of lazy sources, node accesses don't look them up if there's none */
+	static size_t		activeSources;
+
+	char				*data;
+	size_t				length;
+
+	/** tree that keeps this source, NULL while it's being read */
+	VDFTree				*tree;
+
+protected:
+	VDFLazyBranch		*Find			(VDFNode *node);
+	void				ClearFlags		();
+
+	/** all lazy sources, linked */
+	static VDFLazySource *sources;
+	VDFLazySource		*next;
+
+	char				*filename;
+	IErrorLogger		*logger;
+	/** branches sorted by node address */
+	VDFLazyBranch		*branches;
+	size_t				branchCount;
+	size_t				branchSize;
+	size_t				pending;
+};
+
+
+#endif //__VDFLAZY_H__
@@ -1,383 +1,2236 @@
-/*
-*
-*  This program is free software; you can redistribute it and/or modify it
-*  under the terms of the GNU General Public License as published by the
-*  Free Software Foundation; either version 2 of the License, or (at
-*  your option) any later version.
-*
-*  This program is distributed in the hope that it will be useful, but
-*  WITHOUT ANY WARRANTY; without even the implied warranty of
-*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
-*  General Public License for more details.
-*
-*  You should have received a copy of the GNU General Public License
-*  along with this program; if not, write to the Free Software Foundation,
-*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
-*/
-
-/**  
- *	@author		commonbullet
- *	@version	1.07
- */
-
-#include <string.h>
-#include <stdio.h>
-#include <ctype.h>
-#include "VDFParser.h"
-
-static int spaceChars[256] = {0};
-
-
-
-
-/**
- * Finds the next symbol in current parsing file
- * @param 
- *
- */
-int VDFReader::GetNextSymbol(char **target, int tokenMax)
-{
-	//Token newToken = {0};
-	int tokenPos = 0;
-	//int lineLength = (int) strlen( (line + cursor ) );
-	bool tokenOpened = false;
-
-	for(;line[cursor]; cursor++) 
-	{
-
-		if(!tokenOpened)
-		{
-			// eat spaces
-			while(line[cursor] && spaceChars[(int)line[cursor]]) cursor++;
-
-			// new kv string starting
-			if(line[cursor] == '\"')
-			{
-				tokenOpened = true;
-				*target = &line[cursor + 1];
-				continue;
-			}
-			// closing branch
-			if(line[cursor] == '}') {cursor++; return KV_CLOSE;}
-			// opening branch
-			if(line[cursor] == '{') {cursor++; return KV_OPEN;}
-
-			if(line[cursor] == '/' && line[cursor + 1] == '/')
-			{
-				return KV_NONE;
-			}
-
-		} else 
-		{
-			// end of kv string
-			if(line[cursor] == '\"')
-			{
-				*( *target + tokenPos ) = '\0';
-				cursor++;
-				
-				return KV_NEWSTRING;
-			}
-			// add char to current string marker
-			if (tokenPos < tokenMax) {
-				tokenPos++;					
-			}
-		}		
-
-	}
-	return KV_NONE;
-}
-
-VDFReader::VDFReader(IErrorLogger *logger)
-{
-	this->pFile = NULL;
-	this->logger = logger;
-	spaceChars[(int)'\t'] = 1;
-	spaceChars[(int)' '] = 1;
-}
-
-void VDFReader::Open()
-{
-	this->Close();
-	
-	if(filename) this->pFile = fopen(filename, "r");
-	else this->pFile = NULL;
-
-	this->currentDepth = 0;
-	line[0] = '\0';
-	lineLength = 0;
-	lineCounter = 0;
-	status = 1 << KV_EXP_NEWKV;
-}
-
-void VDFReader::Open(const char* filename)
-{
-	this->filename = filename;
-	this->Open();
-}					
-
-void VDFReader::Close()
-{
-	if(this->pFile)
-	{
-		fclose(pFile);
-		pFile = NULL;
-	}
-}
-
-
-bool VDFReader::NextKeyValue()
-{
-	unsigned int max;
-	char **target;
-	bool keyRead;
-	int res;
-
-	if(!pFile) return false;
-
-	char *pKey = NULL;
-	char *pValue = NULL;
-
-	keyRead = false;	
-
-	while(true)
-	{		
-		if(! (*line) ||  cursor >= lineLength) {
-			if(!fgets(line, MAX_LINE_SIZE, pFile)) break;
-			lineCounter++;
-			lineLength = strlen(line);
-			cursor = 0;
-		}
-		
-		if(strlen(line) == 0) {
-			continue;
-		}
-
-		if(keyRead) {
-			max = 512;
-			target = &pValue;
-		} else {
-			max = 256;
-			target = &pKey;
-		}
-		
-		res = GetNextSymbol(target, max);
-
-		if(res <= KV_NEWSTRING && (! (status & (1 << res))) )
-		{
-			if(this->logger)
-				logger->printError(this->filename, "unexpected symbol", lineCounter, cursor);
-			// TODO: keep parsing on error should be an option in this class.
-			continue;
-		}
-	
-		switch(res)
-		{
-			case KV_CLOSE :
-				if(currentDepth > 0) 
-				{
-					currentDepth --;
-					if( currentDepth == 0) return false;
-					status = 1 << KV_EXP_CLOSE | 1 << KV_EXP_NEWKV;
-					keyRead = false;
-					
-				} else {
-					// error
-				}
-				break;
-			case KV_OPEN :		
-				currentDepth++;
-				status = 1 << KV_EXP_CLOSE | 1 << KV_EXP_NEWKV;
-				if(keyRead) {
-					DispatchToParser(pKey, pValue, currentDepth - 1);
-					keyRead = false;
-					return true;
-				} else {
-					
-				}
-				break;
-			case KV_NEWSTRING :
-				if(keyRead) 
-				{
-					status = 1 << KV_EXP_CLOSE | 1 << KV_EXP_NEWKV;
-					DispatchToParser(pKey, pValue, currentDepth);
-					keyRead = false;
-					return true;
-				} else
-				{
-					status = 1 << KV_EXP_OPEN | 1 << KV_EXP_CLOSE | 1 << KV_EXP_NEWKV;
-					keyRead = true;
-				}
-				break;
-			case KV_NONE :
-				*line = '\0';
-				if(keyRead)						{
-					DispatchToParser(pKey, pValue, currentDepth);						
-					return true;
-				}
-		}
-	}
-	return false;
-}
-
-bool VDFEventReader::ParseVDF(const char *filename, ParseForward *pFW)
-{
-	if(pFW == NULL)
-		return false;
-
-	this->currentParser = pFW;
-
-	if(filename == NULL || pFW->pfnParser == NULL)
-		return false;
-
-	this->Open(filename);
-	if(!this->pFile) return false;
-
-	this->returnVal = RETURN_VDFPARSER_CONTINUE;
-
-	if(pFW->pfnStart != NULL)
-		(*(pFW->pfnStart))(pFW->fwidStart, pFW->mdFilename);	
-
-	while(this->NextKeyValue()) {
-		if(this->returnVal == RETURN_VDFPARSER_STOP) break;
-	}
-
-	if(pFW->pfnEnd != NULL)
-		(*(pFW->pfnEnd))(pFW->fwidEnd, pFW->mdFilename);
-
-	this->Close();
-
-	return true;
-
-}
-
-void VDFEventReader::DispatchToParser(const char *key, const char *value, UINT depth)
-{	
-	this->returnVal = (*(currentParser->pfnParser))(currentParser->fwidParser, currentParser->mdFilename, key, value, depth);
-}
-
-
-bool VDFTreeFile::OpenVDF(const char *filename, VDFTree **vdfTree, OpenForward *openFW)
-{	
-
-	if(filename == NULL) {
-		return false;
-	}
-	
-	this->Open(filename);
-	if(this->pFile == NULL) return false;
-
-	this->currentParser = openFW;
-
-	// make sure output tree is empty
-	if(*vdfTree) {
-		delete(*vdfTree);
-		*vdfTree = NULL;
-	}
-
-	*vdfTree = new VDFTree;
-	this->currentTree = *vdfTree;
-	this->returnVal = RETURN_TREEPARSER_CONTINUE;
-
-	this->currentNode = (*vdfTree)->rootNode;
-	this->currentDepth = 0;
-
-	while(this->NextKeyValue()) {
-		if(this->returnVal == RETURN_TREEPARSER_BREAK) break;
-	}
-
-	this->Close();
-
-	if(!currentTree->rootNode) currentTree->CreateTree();
-
-	return true;
-
-}
-
-void VDFTreeFile::DispatchToParser(const char *key, const char *value, UINT depth)
-{	
-
-	VDFNode *refNode = currentNode;
-	currentNode = this->currentTree->CreateNode();
-	VDFTree::SetKeyPair(currentNode, key, value);
-	
-	if(depth > currentDepth)
-	{	
-		VDFTree::AppendChild(refNode, currentNode);		
-	} else if(depth < currentDepth)
-	{
-		while(depth < currentDepth--)
-			refNode = refNode->parentNode;
-		VDFTree::AppendNode(refNode, currentNode);
-	} else
-	{
-		if(!depth) currentTree->rootNode = currentNode;
-		else VDFTree::AppendNode(refNode, currentNode);
-	}
-
-	currentDepth = depth;
-
-	if(currentParser && this->returnVal != RETURN_TREEPARSER_SILENT)
-	{		
-		this->returnVal = (*(currentParser->pfnOpen))(currentParser->fwdid, currentParser->mdFilename, currentTree, currentNode, depth);
-	}
-}
-
-
- 
-bool VDFTreeFile::SaveVDF(const char *filename, VDFTree *vdfTree)
-{
-	FILE*   pFile;
-	VDFNode *node;
-	int     depth;
-	int		bufferLen = 0;
-	char	tabs[256] = {'\t'};
-	char	buffer[2048];
-
-	node   =  vdfTree->rootNode;
-
-	if(filename == NULL || node == NULL)
-		return false;
-
-	TabFill tabFill = TabFill(tabs);	
-	depth  =  0;
-	currentDepth = 0;
-	
-	pFile = fopen(filename, "w+");
-	if(!pFile)
-		return false;	
-	
-
-	while(node != NULL || currentDepth != 0 )
-	{
-		*buffer = '\0';
-		bufferLen = 0;
-
-		if((int) currentDepth < depth)
-		{
-			tabFill.SetTabPos(depth - 1);
-			bufferLen += sprintf(buffer, "\n%s{", tabs);
-		} else if( (int) currentDepth > depth)
-		{
-			while( (int) currentDepth-- > depth)
-			{
-				tabFill.SetTabPos(currentDepth);
-				bufferLen += sprintf(buffer + bufferLen, "\n%s}", tabs);
-			}
-		}
-		tabFill.SetTabPos(depth);
-		currentDepth = depth;
-
-		if(node && node->key && *(node->key))
-		{
-			bufferLen += sprintf(buffer + bufferLen, "%s%s\"%s\"", (currentDepth == 0 ? "" : "\n"), tabs, node->key);
-			if(node->value && *(node->value))
-			{
-				bufferLen += sprintf(buffer + bufferLen, " \"%s\"", node->value);
-			}
-			node = VDFTree::GetNextTraverseStep(node, depth);
-		}
-		fputs(buffer, pFile);
-	}
-	fclose(pFile);
-	return true;
-}
+/*
+*
+*  This program is free software; you can redistribute it and/or modify it
+*  under the terms of the GNU General Public License as published by the
+*  Free Software Foundation; either version 2 of the License, or (at
+*  your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful, but
+*  WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*  General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software Foundation,
+*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**  
+ *	@author		commonbullet
+ *	@version	1.07
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include "VDFParser.h"
+#include "VDFImage.h"
+#include "VDFLazy.h"
+
+static int spaceChars[256] = {0};
+
+/** chars that matter when a branch is skipped */
+static int branchChars[256] = {0};
+
+/** output is flushed to file in chunks of this size */
+#define VDF_WRITE_CHUNK 65536
+
+
+
+
+/** settings of main thread, changed by natives */
+VDFReaderSettings VDFReader::shared;
+
+/**
+ *	Finds where a quoted string ends: closing quote, backslash (if escape
+ *	sequences are enabled) or end of line. Plain chars are skipped 8 at a time.
+ *	@param	line	Line buffer.
+ *	@param	pos		First char of string.
+ *	@param	size	Line buffer size, words are only read inside it.
+ *	@param	escapes	Whether escape sequences are enabled.
+ *	@return			Position of the char found.
+ */
+static inline size_t FindStringEnd(const char *line, size_t pos, size_t size, bool escapes)
+{
+	VDFWORD word;
+	VDFWORD found;
+
+	for(; pos + sizeof(word) <= size; pos += sizeof(word)) {
+		memcpy(&word, line + pos, sizeof(word));
+		found = VDF_SWAR_HASZERO(word) | VDF_SWAR_HASZERO(word ^ VDF_SWAR_BYTES('"'));
+		if(escapes)
+			found |= VDF_SWAR_HASZERO(word ^ VDF_SWAR_BYTES('\\'));
+		if(found)
+			break;
+	}
+
+	while(line[pos] && line[pos] != '"' && !(line[pos] == '\\' && escapes))
+		pos++;
+
+	return pos;
+}
+
+/**
+ *	Removes escape sequences from a string in place, starting at
+ *	its first backslash.
+ *	@param	line	Line buffer.
+ *	@param	pos		Position of first backslash.
+ *	@param	write	Receives string end position after unescaping.
+ *	@return			Position of closing quote (or of end of line).
+ */
+static size_t UnescapeString(char *line, size_t pos, size_t &write)
+{
+	write = pos;
+
+	while(line[pos] && line[pos] != '"') {
+		if(line[pos] != '\\' || !line[pos + 1]) {
+			line[write++] = line[pos++];
+			continue;
+		}
+
+		switch(line[pos + 1]) {
+			case 'n':	line[write++] = '\n';	break;
+			case 't':	line[write++] = '\t';	break;
+			case '\\':	line[write++] = '\\';	break;
+			case '"':	line[write++] = '"';	break;
+			default:
+				// unknown sequences are kept (e.g. paths)
+				line[write++] = '\\';
+				line[write++] = line[pos + 1];
+		}
+		pos += 2;
+	}
+
+	return pos;
+}
+
+/**
+ * Reads the quoted string at cursor.
+ * Strings are returned in place (pointing to line buffer), they're
+ * only moved when escape sequences are found.
+ * @param	target		Receives string start.
+ * @param	tokenMax	Strings are cut at this length.
+ * @return				KV_NEWSTRING, or KV_NONE if string isn't terminated.
+ */
+int VDFReader::ReadString(char **target, int tokenMax)
+{
+	size_t start;
+	size_t end;
+	size_t length;
+
+	start = cursor + 1;
+	end = FindStringEnd(line, start, sizeof(line), settings->escapes);
+
+	if(line[end] == '\\')
+		end = UnescapeString(line, end, length);
+	else
+		length = end;
+
+	// unterminated string
+	if(!line[end]) {
+		if(this->logger)
+			logger->printError(this->filename, "unterminated string", lineCounter, (int)start);
+		cursor = (UINT)end;
+		return KV_NONE;
+	}
+
+	length -= start;
+	if(length > (size_t)tokenMax)
+		length = (size_t)tokenMax;
+
+	*target = &line[start];
+	line[start + length] = '\0';
+	cursor = (UINT)end + 1;
+
+	return KV_NEWSTRING;
+}
+
+/**
+ * Reads an #include or #base directive at cursor.
+ * @param	target		Receives the quoted path.
+ * @return				KV_DIRECTIVE, KV_NONE if path is missing or
+ *						KV_ERROR if it isn't a known directive.
+ */
+int VDFReader::ReadDirective(char **target)
+{
+	if(!strncmp(&line[cursor], "#include", 8)) {
+		directive = VDF_DIRECTIVE_INCLUDE;
+		cursor += 8;
+	} else if(!strncmp(&line[cursor], "#base", 5)) {
+		directive = VDF_DIRECTIVE_BASE;
+		cursor += 5;
+	} else
+		return KV_ERROR;
+
+	while(line[cursor] && spaceChars[(int)line[cursor]]) cursor++;
+
+	if(line[cursor] != '\"' || ReadString(target, VDF_MAX_PATH - 1) != KV_NEWSTRING) {
+		if(this->logger)
+			logger->printError(this->filename, "directive without path", lineCounter, cursor);
+		return KV_NONE;
+	}
+
+	return KV_DIRECTIVE;
+}
+
+/**
+ * Compares a defined flag with a flag name read from source (case insensitive).
+ * @param	flag	Defined flag.
+ * @param	name	Flag name, it isn't null terminated.
+ * @param	length	Name length.
+ */
+static bool MatchCondition(const char *flag, const char *name, size_t length)
+{
+	size_t i;
+
+	for(i = 0; i < length; i++) {
+		if(tolower((unsigned char)flag[i]) != tolower((unsigned char)name[i]))
+			return false;
+	}
+	return flag[length] == '\0';
+}
+
+/**
+ * Reads a [condition] at cursor and evaluates it against defined flags.
+ * Terms are flag names (prefixed by $ or not), negated by !, and joined
+ * by && and || (&& is evaluated first), e.g. [$LINUX && !$LAN].
+ * Invalid conditions are never met.
+ * @return				KV_CONDITION, result is kept in conditionMet.
+ */
+int VDFReader::ReadCondition()
+{
+	size_t	start;
+	bool	anyMet;
+	bool	allMet;
+	bool	negate;
+	bool	valid;
+
+	conditionsRead = true;
+	anyMet = false;
+	allMet = true;
+	valid = false;
+	cursor++;
+
+	while(true) {
+		while(line[cursor] && spaceChars[(int)line[cursor]]) cursor++;
+
+		negate = (line[cursor] == '!');
+		if(negate) cursor++;
+		if(line[cursor] == '$') cursor++;
+
+		start = cursor;
+		while(isalnum((unsigned char)line[cursor]) || line[cursor] == '_') cursor++;
+		if(cursor == start)
+			break;
+
+		if(settings->IsConditionSet(&line[start], cursor - start) == negate)
+			allMet = false;
+
+		while(line[cursor] && spaceChars[(int)line[cursor]]) cursor++;
+
+		if(line[cursor] == '&' && line[cursor + 1] == '&') {
+			cursor += 2;
+		} else if(line[cursor] == '|' && line[cursor + 1] == '|') {
+			anyMet = anyMet || allMet;
+			allMet = true;
+			cursor += 2;
+		} else {
+			valid = (line[cursor] == ']');
+			break;
+		}
+	}
+
+	if(!valid && this->logger)
+		logger->printError(this->filename, "invalid condition", lineCounter, cursor);
+
+	while(line[cursor] && line[cursor] != ']') cursor++;
+	if(line[cursor]) cursor++;
+
+	conditionMet = valid && (anyMet || allMet);
+
+	return KV_CONDITION;
+}
+
+/**
+ * Reads the condition following a value in the same line, if there's one.
+ * @return				false if condition isn't met.
+ */
+bool VDFReader::CheckTrailingCondition()
+{
+	while(line[cursor] && spaceChars[(int)line[cursor]]) cursor++;
+
+	if(line[cursor] != '[')
+		return true;
+
+	ReadCondition();
+
+	return conditionMet;
+}
+
+/**
+ * Finds the next symbol in current parsing file.
+ * @param	target		Receives string start on KV_NEWSTRING
+ *						(or directive path on KV_DIRECTIVE).
+ * @param	tokenMax	Strings are cut at this length.
+ */
+int VDFReader::GetNextSymbol(char **target, int tokenMax)
+{
+	int res;
+
+	for(;line[cursor]; cursor++) 
+	{
+		// eat spaces
+		while(line[cursor] && spaceChars[(int)line[cursor]]) cursor++;
+
+		// new kv string starting
+		if(line[cursor] == '\"')
+			return ReadString(target, tokenMax);
+
+		// unknown words are skipped as any other unquoted text
+		if(line[cursor] == '#' && (res = ReadDirective(target)) != KV_ERROR)
+			return res;
+
+		if(line[cursor] == '[')
+			return ReadCondition();
+
+		// closing branch
+		if(line[cursor] == '}') {cursor++; return KV_CLOSE;}
+		// opening branch
+		if(line[cursor] == '{') {cursor++; return KV_OPEN;}
+
+		if(line[cursor] == '/' && line[cursor + 1] == '/')
+		{
+			return KV_NONE;
+		}
+
+		if(!line[cursor])
+			break;
+	}
+	return KV_NONE;
+}
+
+VDFReaderSettings::VDFReaderSettings()
+{
+	// escape sequences are off by default, backslashes in old files are plain chars
+	escapes = false;
+	conditions = NULL;
+	conditionCount = 0;
+	conditionSize = 0;
+}
+
+VDFReaderSettings::~VDFReaderSettings()
+{
+	ClearConditions();
+}
+
+/**
+ *	Defines or undefines a flag checked by [$FLAG] conditions.
+ *	@param	flag		Flag name, leading $ is optional.
+ *	@param	defined		true to define it, false to remove it.
+ */
+void VDFReaderSettings::SetCondition(const char *flag, bool defined)
+{
+	size_t length;
+	size_t i;
+
+	if(flag == NULL)
+		return;
+
+	if(flag[0] == '$')
+		flag++;
+
+	length = strlen(flag);
+
+	for(i = 0; i < conditionCount; i++) {
+		if(MatchCondition(conditions[i], flag, length))
+			break;
+	}
+
+	if(defined && i == conditionCount && length) {
+		EnsureArraySize(conditions, conditionSize, conditionCount + 1);
+		conditions[conditionCount] = new char[length + 1];
+		strcpy(conditions[conditionCount++], flag);
+	} else if(!defined && i < conditionCount) {
+		FinalizeArray(conditions[i]);
+		conditions[i] = conditions[--conditionCount];
+	}
+}
+
+/**
+ *	Checks if a flag is defined.
+ *	@param	flag		Flag name (without $), it doesn't need to be null terminated.
+ *	@param	length		Name length.
+ */
+bool VDFReaderSettings::IsConditionSet(const char *flag, size_t length) const
+{
+	size_t i;
+
+	for(i = 0; i < conditionCount; i++) {
+		if(MatchCondition(conditions[i], flag, length))
+			return true;
+	}
+	return false;
+}
+
+/**
+ *	Removes all flags.
+ */
+void VDFReaderSettings::ClearConditions()
+{
+	while(conditionCount)
+		FinalizeArray(conditions[--conditionCount]);
+
+	FinalizeArray(conditions);
+	conditionSize = 0;
+}
+
+/**
+ *	Replaces these settings with a copy of other ones.
+ *	@param	source		Settings to be copied.
+ */
+void VDFReaderSettings::Copy(const VDFReaderSettings &source)
+{
+	size_t i;
+
+	if(&source == this)
+		return;
+
+	ClearConditions();
+	escapes = source.escapes;
+
+	if(source.conditionCount) {
+		EnsureArraySize(conditions, conditionSize, source.conditionCount);
+		for(i = 0; i < source.conditionCount; i++) {
+			conditions[i] = new char[strlen(source.conditions[i]) + 1];
+			strcpy(conditions[i], source.conditions[i]);
+		}
+		conditionCount = source.conditionCount;
+	}
+}
+
+/**
+ *	Enables or disables escape sequences (\" \\ \n \t) in reading and writing.
+ *	@param	enabled		New setting.
+ */
+void VDFReader::SetEscapes(bool enabled)
+{
+	shared.escapes = enabled;
+}
+
+/**
+ *	Defines or undefines a flag in shared settings.
+ *	@param	flag		Flag name, leading $ is optional.
+ *	@param	defined		true to define it, false to remove it.
+ */
+void VDFReader::SetCondition(const char *flag, bool defined)
+{
+	shared.SetCondition(flag, defined);
+}
+
+/**
+ *	Checks if a flag is defined in shared settings.
+ *	@param	flag		Flag name (without $), it doesn't need to be null terminated.
+ *	@param	length		Name length.
+ */
+bool VDFReader::IsConditionSet(const char *flag, size_t length)
+{
+	return shared.IsConditionSet(flag, length);
+}
+
+/**
+ *	Removes all flags from shared settings.
+ */
+void VDFReader::ClearConditions()
+{
+	shared.ClearConditions();
+}
+
+/**
+ *	Makes this reader use other settings than the shared ones, they must
+ *	be kept while it reads. Readers on other threads must use a copy, as
+ *	shared settings are changed by main thread.
+ *	@param	settings	Settings to be used, NULL for the shared ones.
+ */
+void VDFReader::UseSettings(const VDFReaderSettings *settings)
+{
+	this->settings = settings ? settings : &shared;
+}
+
+VDFReader::VDFReader(IErrorLogger *logger)
+{
+	this->filename = NULL;
+	this->pFile = NULL;
+	this->binData = NULL;
+	this->memData = NULL;
+	this->binPending = NULL;
+	this->binPendingSize = 0;
+	this->binDepth = 0;
+	this->conditionsRead = false;
+	this->skipDepth = 0;
+	this->skipNextBlock = false;
+	this->skipBranch = false;
+	this->logger = logger;
+	this->settings = &shared;
+
+	// tables are written once, readers on other threads only read them
+	if(spaceChars[(int)' '])
+		return;
+
+	spaceChars[(int)'\t'] = 1;
+	spaceChars[(int)' '] = 1;
+	branchChars[(int)'"'] = 1;
+	branchChars[(int)'{'] = 1;
+	branchChars[(int)'}'] = 1;
+	branchChars[(int)'/'] = 1;
+	branchChars[(int)'\n'] = 1;
+}
+
+VDFReader::~VDFReader()
+{
+	this->Close();
+	FinalizeArray(binPending);
+}
+
+/**
+ *	Resets tokenizer state for a new source.
+ */
+void VDFReader::ResetState()
+{
+	this->currentDepth = 0;
+	line[0] = '\0';
+	lineLength = 0;
+	lineCounter = 0;
+	readBytes = 0;
+	status = 1 << KV_EXP_NEWKV;
+	skipDepth = 0;
+	skipNextBlock = false;
+	skipBranch = false;
+	conditionsRead = false;
+}
+
+void VDFReader::Open()
+{
+	this->Close();
+	this->ResetState();
+
+	if(filename == NULL)
+		return;
+
+	if(IsBinaryVDF(filename))
+		this->LoadBinary(0);
+	else
+		this->pFile = fopen(filename, "r");
+}
+
+/**
+ *	Opens binary vdf data stored in a file after a given offset
+ *	(e.g. behind a cache header).
+ *	@param	filename	File to be read.
+ *	@param	offset		Position of binary vdf signature in file.
+ */
+void VDFReader::OpenBinary(const char *filename, long offset)
+{
+	this->filename = filename;
+	this->Close();
+	this->ResetState();
+
+	if(filename != NULL)
+		this->LoadBinary(offset);
+}
+
+/**
+ *	Opens vdf data stored in memory (text or binary format).
+ *	Text data isn't copied, it must be kept until reading is over.
+ *	@param	data	Vdf data, it doesn't need to be null terminated.
+ *	@param	length	Data length in bytes.
+ *	@param	name	Name used in error messages (optional).
+ */
+void VDFReader::OpenString(const char *data, size_t length, const char *name)
+{
+	this->filename = name ? name : "<string>";
+	this->Close();
+	this->ResetState();
+
+	if(data == NULL)
+		return;
+
+	if(length >= 4 && memcmp(data, VDF_BINARY_MAGIC, 4) == 0) {
+		binData = new unsigned char[length];
+		memcpy(binData, data, length);
+		binLength = length;
+		InitBinary();
+		return;
+	}
+
+	memData = data;
+	memLength = length;
+	memCursor = 0;
+}
+
+void VDFReader::Open(const char* filename)
+{
+	this->filename = filename;
+	this->Open();
+}					
+
+void VDFReader::Close()
+{
+	if(this->pFile)
+	{
+		fclose(pFile);
+		pFile = NULL;
+	}
+	memData = NULL;
+	FinalizeArray(binData);
+	binDepth = 0;
+}
+
+/**
+ *	Checks if a file is stored in binary vdf format.
+ *	@param	filename	File to be checked.
+ *	@return				true if the file starts with binary vdf signature.
+ */
+bool VDFReader::IsBinaryVDF(const char *filename)
+{
+	FILE *binFile;
+	char magic[4];
+	bool ret;
+
+	if((binFile = fopen(filename, "rb")) == NULL)
+		return false;
+
+	ret = fread(magic, 1, 4, binFile) == 4 && memcmp(magic, VDF_BINARY_MAGIC, 4) == 0;
+	fclose(binFile);
+
+	return ret;
+}
+
+/**
+ *	Loads a whole binary file into memory, nodes are read
+ *	straight from this buffer (no tokenizing is required).
+ *	@param	offset	Position of binary vdf signature in file.
+ *	@return			false if the file can't be read or if it's got an invalid header.
+ */
+bool VDFReader::LoadBinary(long offset)
+{
+	FILE *binFile;
+	long size;
+
+	if((binFile = fopen(filename, "rb")) == NULL)
+		return false;
+
+	fseek(binFile, 0, SEEK_END);
+	size = ftell(binFile) - offset;
+	fseek(binFile, offset, SEEK_SET);
+
+	if(size < VDF_BINARY_HEADER_SIZE) {
+		fclose(binFile);
+		return false;
+	}
+
+	binData = new unsigned char[size];
+	binLength = fread(binData, 1, size, binFile);
+	fclose(binFile);
+
+	return InitBinary();
+}
+
+/**
+ *	Checks binary data header and prepares reading.
+ *	@return		false if it's got an invalid header (data is freed).
+ */
+bool VDFReader::InitBinary()
+{
+	if(binLength < VDF_BINARY_HEADER_SIZE || memcmp(binData, VDF_BINARY_MAGIC, 4) != 0
+		|| binData[4] != VDF_BINARY_VERSION) {
+		if(this->logger)
+			logger->printError(this->filename, "unsupported binary format");
+		FinalizeArray(binData);
+		return false;
+	}
+
+	binCursor = VDF_BINARY_HEADER_SIZE;
+	binDepth = 0;
+	PushBinaryLevel(ReadUInt(binData + 8));
+
+	return true;
+}
+
+/**
+ *	Adds a level to binary reading stack.
+ *	@param	childCount	Number of nodes to be read in the new level.
+ */
+void VDFReader::PushBinaryLevel(UINT childCount)
+{
+	EnsureArraySize(binPending, binPendingSize, binDepth + 1);
+	binPending[binDepth++] = childCount;
+}
+
+/**
+ *	Reads a length prefixed string from binary data.
+ *	@param	target	Receives a pointer to the string (it's null terminated in buffer).
+ *	@return			false if data is truncated.
+ */
+bool VDFReader::ReadBinaryString(char **target)
+{
+	UINT len;
+
+	if(binLength - binCursor < 4)
+		return false;
+
+	len = ReadUInt(binData + binCursor);
+	binCursor += 4;
+
+	if(binLength - binCursor <= len || binData[binCursor + len] != '\0')
+		return false;
+
+	*target = (char*)(binData + binCursor);
+	binCursor += len + 1;
+
+	return true;
+}
+
+/**
+ *	Reads a binary node record.
+ *	@param	key			Receives node key (NULL if node has no key).
+ *	@param	value		Receives node value (NULL if node has no value).
+ *	@param	childCount	Receives number of children.
+ *	@return				false if data is truncated.
+ */
+bool VDFReader::ReadBinaryNode(char **key, char **value, UINT *childCount)
+{
+	unsigned char type;
+
+	if(binCursor >= binLength)
+		return false;
+
+	type = binData[binCursor++];
+
+	if((type & VDF_BINARY_HASKEY) && !ReadBinaryString(key))
+		return false;
+	if((type & VDF_BINARY_HASVALUE) && !ReadBinaryString(value))
+		return false;
+
+	if(binLength - binCursor < 4)
+		return false;
+
+	*childCount = ReadUInt(binData + binCursor);
+	binCursor += 4;
+
+	return true;
+}
+
+/**
+ *	Binary version of NextKeyValue. Nodes are stored in document order
+ *	and each one carries its child count, so depth is tracked by a stack
+ *	of pending nodes per level.
+ */
+bool VDFReader::NextBinaryKeyValue()
+{
+	char *pKey = NULL;
+	char *pValue = NULL;
+	UINT childCount;
+	UINT depth;
+
+	while(binDepth && !binPending[binDepth - 1]) {
+		binDepth--;
+		// depth is the level of branch children, as in text reading
+		if(binDepth) {
+			currentDepth = binDepth;
+			HandleBranchClose(binCursor);
+		}
+	}
+
+	if(!binDepth)
+		return false;
+
+	if(!ReadBinaryNode(&pKey, &pValue, &childCount)) {
+		if(this->logger)
+			logger->printError(this->filename, "corrupted binary data", 0, (int)binCursor);
+		binDepth = 0;
+		return false;
+	}
+
+	binPending[binDepth - 1]--;
+	depth = binDepth - 1;
+
+	skipBranch = false;
+	DispatchToParser(pKey, pValue, depth);
+
+	if(childCount) {
+		currentDepth = depth + 1;
+		HandleBranchOpen(binCursor);
+
+		if(skipBranch)
+			SkipBinaryBranch(childCount);
+		else
+			PushBinaryLevel(childCount);
+	}
+
+	return true;
+}
+
+/**
+ *	Skips the records of a binary branch, nothing in it is dispatched.
+ *	Each record carries its child count, so no level stack is needed.
+ *	@param	childCount	Child count of branch node.
+ */
+void VDFReader::SkipBinaryBranch(UINT childCount)
+{
+	char	*pKey;
+	char	*pValue;
+	UINT	count;
+	size_t	start;
+
+	skipBranch = false;
+	start = binCursor;
+
+	while(childCount) {
+		if(!ReadBinaryNode(&pKey, &pValue, &count)) {
+			if(this->logger)
+				logger->printError(this->filename, "corrupted binary data", 0, (int)binCursor);
+			binDepth = 0;
+			return;
+		}
+		childCount += count - 1;
+	}
+
+	HandleSkippedBranch(start, binCursor);
+}
+
+
+/**
+ *	Reads next line from current source (at most MAX_LINE_SIZE - 1 chars,
+ *	line break included).
+ *	@return		false if there's nothing left.
+ */
+bool VDFReader::ReadLine()
+{
+	const char	*start;
+	const char	*end;
+	size_t		len;
+
+	if(pFile)
+		return fgets(line, MAX_LINE_SIZE, pFile) != NULL;
+
+	if(memCursor >= memLength)
+		return false;
+
+	start = memData + memCursor;
+	len = memLength - memCursor;
+
+	if(len > MAX_LINE_SIZE - 1)
+		len = MAX_LINE_SIZE - 1;
+
+	if((end = (const char*)memchr(start, '\n', len)) != NULL)
+		len = (size_t)(end - start) + 1;
+
+	memcpy(line, start, len);
+	line[len] = '\0';
+	memCursor += len;
+
+	return true;
+}
+
+/**
+ *	Finds the brace that closes a branch. Quoted strings and comments
+ *	are recognized, so braces in them don't count (strings end at line
+ *	break, as in tokenizer).
+ *	@param	data	Text to be scanned.
+ *	@param	pos		Scan start.
+ *	@param	length	Text length.
+ *	@param	level	Open braces, it's updated while scanning.
+ *	@param	lines	Line breaks found are added to it.
+ *	@param	escapes	Whether escape sequences are enabled.
+ *	@return			Position after closing brace (level is 0 then),
+ *					or length if it isn't found.
+ */
+static size_t FindBranchEnd(const char *data, size_t pos, size_t length, UINT &level, UINT &lines, bool escapes)
+{
+	while(pos < length) {
+		while(pos < length && !branchChars[(unsigned char)data[pos]])
+			pos++;
+
+		if(pos >= length)
+			break;
+
+		switch(data[pos++]) {
+			case '\n':
+				lines++;
+				break;
+			case '"':
+				while(pos < length && data[pos] != '"' && data[pos] != '\n') {
+					if(data[pos] == '\\' && escapes
+						&& pos + 1 < length && data[pos + 1] != '\n')
+						pos++;
+					pos++;
+				}
+				if(pos < length && data[pos] == '"')
+					pos++;
+				break;
+			case '/':
+				if(pos < length && data[pos] == '/') {
+					while(pos < length && data[pos] != '\n')
+						pos++;
+				}
+				break;
+			case '{':
+				level++;
+				break;
+			case '}':
+				if(--level == 0)
+					return pos;
+		}
+	}
+	return length;
+}
+
+/**
+ *	Skips the branch whose opening brace has just been read, by brace
+ *	matching only: nothing in it is tokenized or dispatched. Memory
+ *	sources are scanned in place, files line by line.
+ *	@param	start	Receives source offset of the opening brace.
+ *	@param	end		Receives source offset after the closing brace
+ *					(source length if branch isn't closed).
+ */
+void VDFReader::SkipBranch(size_t &start, size_t &end)
+{
+	UINT	level;
+	UINT	lines;
+	size_t	pos;
+
+	start = readBytes - lineLength + cursor - 1;
+	level = 1;
+	lines = 0;
+	currentDepth--;
+
+	if(memData) {
+		end = FindBranchEnd(memData, start + 1, memLength, level, lines, settings->escapes);
+
+		// rest of closing line is read as a new line
+		memCursor = end;
+		readBytes = end;
+		lineCounter += lines - 1;
+		*line = '\0';
+		lineLength = 0;
+		cursor = 0;
+		return;
+	}
+
+	pos = cursor;
+
+	while(true) {
+		pos = FindBranchEnd(line, pos, lineLength, level, lines, settings->escapes);
+
+		if(!level) {
+			cursor = (UINT)pos;
+			end = readBytes - lineLength + pos;
+			return;
+		}
+
+		if(!ReadLine()) {
+			*line = '\0';
+			lineLength = 0;
+			cursor = 0;
+			end = readBytes;
+			return;
+		}
+
+		lineCounter++;
+		lineLength = strlen(line);
+		readBytes += lineLength;
+		pos = 0;
+	}
+}
+
+/**
+ *	Skips the branch just opened, as its key handler asked for it
+ *	(see <code>skipBranch</code>).
+ */
+void VDFReader::SkipRequestedBranch()
+{
+	size_t start;
+	size_t end;
+
+	skipBranch = false;
+	SkipBranch(start, end);
+	status = currentDepth ? (1 << KV_EXP_CLOSE | 1 << KV_EXP_NEWKV) : 1 << KV_EXP_NEWKV;
+	HandleSkippedBranch(start, end);
+}
+
+bool VDFReader::NextKeyValue()
+{
+	unsigned int max;
+	char **target;
+	bool keyRead;
+	bool rejected;
+	int res;
+
+	if(binData) return NextBinaryKeyValue();
+	if(!pFile && !memData) return false;
+
+	char *pKey = NULL;
+	char *pValue = NULL;
+
+	keyRead = false;	
+	rejected = false;
+
+	while(true)
+	{		
+		if(! (*line) ||  cursor >= lineLength) {
+			if(!ReadLine()) break;
+			lineCounter++;
+			lineLength = strlen(line);
+			readBytes += lineLength;
+			cursor = 0;
+		}
+		
+		if(strlen(line) == 0) {
+			continue;
+		}
+
+		if(keyRead) {
+			max = 512;
+			target = &pValue;
+		} else {
+			max = 256;
+			target = &pKey;
+		}
+		
+		res = GetNextSymbol(target, max);
+
+		if(res <= KV_NEWSTRING && (! (status & (1 << res))) )
+		{
+			if(this->logger)
+				logger->printError(this->filename, "unexpected symbol", lineCounter, cursor);
+			// TODO: keep parsing on error should be an option in this class.
+			continue;
+		}
+	
+		switch(res)
+		{
+			case KV_CLOSE :
+				skipNextBlock = false;
+				skipBranch = false;
+				if(currentDepth > 0) 
+				{
+					if(currentDepth == skipDepth)
+						skipDepth = 0;
+					else if(!skipDepth)
+						HandleBranchClose(readBytes - lineLength + cursor);
+					currentDepth --;
+					// root level keys may follow (e.g. keys added by #include)
+					status = currentDepth ? (1 << KV_EXP_CLOSE | 1 << KV_EXP_NEWKV) : 1 << KV_EXP_NEWKV;
+					keyRead = false;
+					
+				} else {
+					// error
+				}
+				break;
+			case KV_OPEN :		
+				currentDepth++;
+				status = 1 << KV_EXP_CLOSE | 1 << KV_EXP_NEWKV;
+				// branch of a rejected key, nothing in it is dispatched
+				if(!skipDepth && (skipNextBlock || (keyRead && rejected)))
+					skipDepth = currentDepth;
+				skipNextBlock = false;
+				if(keyRead && !skipDepth) {
+					skipBranch = false;
+					DispatchToParser(pKey, pValue, currentDepth - 1);
+					keyRead = false;
+					HandleBranchOpen(readBytes - lineLength + cursor - 1);
+					if(skipBranch)
+						SkipRequestedBranch();
+					return true;
+				}
+				// its key (if any) was dispatched at line end
+				if(!skipDepth) {
+					HandleBranchOpen(readBytes - lineLength + cursor - 1);
+					if(skipBranch)
+						SkipRequestedBranch();
+				}
+				keyRead = false;
+				rejected = false;
+				break;
+			case KV_NEWSTRING :
+				skipNextBlock = false;
+				skipBranch = false;
+				if(keyRead) 
+				{
+					status = 1 << KV_EXP_CLOSE | 1 << KV_EXP_NEWKV;
+					keyRead = false;
+					if(!CheckTrailingCondition() || rejected || skipDepth) {
+						rejected = false;
+						break;
+					}
+					DispatchToParser(pKey, pValue, currentDepth);
+					return true;
+				} else
+				{
+					status = 1 << KV_EXP_OPEN | 1 << KV_EXP_CLOSE | 1 << KV_EXP_NEWKV;
+					keyRead = true;
+				}
+				break;
+			case KV_DIRECTIVE :
+				if(keyRead || currentDepth > 0) {
+					if(this->logger)
+						logger->printError(this->filename, "directive inside a section", lineCounter, cursor);
+				} else
+					HandleDirective(directive, *target);
+				break;
+			case KV_CONDITION :
+				if(!keyRead) {
+					if(this->logger)
+						logger->printError(this->filename, "condition without key", lineCounter, cursor);
+				} else if(!conditionMet)
+					rejected = true;
+				break;
+			case KV_NONE :
+				*line = '\0';
+				if(keyRead && (rejected || skipDepth)) {
+					// its branch may start in next line
+					skipNextBlock = rejected;
+					keyRead = false;
+					rejected = false;
+				} else if(keyRead) {
+					DispatchToParser(pKey, pValue, currentDepth);						
+					return true;
+				}
+		}
+	}
+	return false;
+}
+
+VDFEventReader::VDFEventReader(IErrorLogger *logger) : VDFReader(logger)
+{
+	currentParser = NULL;
+	trackPath = false;
+	path = NULL;
+	pathSize = 0;
+	branchEnds = NULL;
+	branchEndsSize = 0;
+	keyEnd = 0;
+	keyLevel = 0;
+	keyPending = false;
+}
+
+VDFEventReader::~VDFEventReader()
+{
+	FinalizeArray(path);
+	FinalizeArray(branchEnds);
+}
+
+bool VDFEventReader::ParseVDF(const char *filename, ParseForward *pFW)
+{
+	if(pFW == NULL)
+		return false;
+
+	this->currentParser = pFW;
+
+	if(filename == NULL || pFW->pfnParser == NULL)
+		return false;
+
+	this->Open(filename);
+	return Parse(pFW);
+}
+
+/**
+ *	Parses vdf data stored in memory using event model.
+ *	@param	data	Vdf data, it doesn't need to be null terminated.
+ *	@param	length	Data length in bytes.
+ *	@param	pFW		Event forwards.
+ *	@return			false if there's no data or no key pair forward.
+ */
+bool VDFEventReader::ParseVDFString(const char *data, size_t length, ParseForward *pFW)
+{
+	if(pFW == NULL || data == NULL || pFW->pfnParser == NULL)
+		return false;
+
+	this->currentParser = pFW;
+
+	this->OpenString(data, length, pFW->mdFilename);
+	return Parse(pFW);
+}
+
+/**
+ *	Reads all key pairs from the opened source, firing event forwards.
+ *	@param	pFW		Event forwards.
+ *	@return			false if reader isn't opened.
+ */
+bool VDFEventReader::Parse(ParseForward *pFW)
+{
+	if(!this->IsOpen()) return false;
+
+	this->returnVal = RETURN_VDFPARSER_CONTINUE;
+	this->trackPath = pFW->pfnEnter != NULL || pFW->pfnLeave != NULL;
+	this->keyPending = false;
+
+	if(pFW->pfnStart != NULL)
+		(*(pFW->pfnStart))(pFW->fwidStart, pFW->mdFilename);	
+
+	while(this->NextKeyValue()) {
+		if(this->returnVal == RETURN_VDFPARSER_STOP) break;
+	}
+
+	if(pFW->pfnEnd != NULL)
+		(*(pFW->pfnEnd))(pFW->fwidEnd, pFW->mdFilename);
+
+	this->Close();
+
+	return true;
+
+}
+
+/**
+ *	Fires key pair event. Returning RETURN_VDFPARSER_SKIP skips the
+ *	branch of the key, if it's got one.
+ */
+void VDFEventReader::DispatchToParser(const char *key, const char *value, UINT depth)
+{	
+	size_t pos;
+	size_t len;
+
+	// a branch event may have stopped parsing while reader was going on
+	if(this->returnVal == RETURN_VDFPARSER_STOP)
+		return;
+
+	if(trackPath) {
+		pos = depth ? branchEnds[depth - 1] : 0;
+		len = key ? strlen(key) : 0;
+
+		EnsureArraySize(path, pathSize, pos + len + 2);
+
+		if(pos)
+			path[pos++] = '/';
+		memcpy(path + pos, key, len);
+		path[pos + len] = '\0';
+
+		keyEnd = pos + len;
+		keyLevel = depth;
+		keyPending = true;
+	}
+
+	this->returnVal = (*(currentParser->pfnParser))(currentParser->fwidParser, currentParser->mdFilename, key, value, depth);
+
+	if(this->returnVal == RETURN_VDFPARSER_SKIP) {
+		this->returnVal = RETURN_VDFPARSER_CONTINUE;
+		skipBranch = true;
+	}
+}
+
+/**
+ *	Fires enter branch event with the key path of the branch (keys joined
+ *	by '/' from root key). Returning RETURN_VDFPARSER_SKIP skips the branch,
+ *	no event is fired for its content nor for leaving it.
+ */
+void VDFEventReader::HandleBranchOpen(size_t start)
+{
+	UINT	level;
+	int		ret;
+
+	if(!trackPath)
+		return;
+
+	level = currentDepth - 1;
+
+	EnsureArraySize(branchEnds, branchEndsSize, (size_t)level + 1);
+
+	// a branch without key takes the path of its parent
+	if(keyPending && keyLevel == level)
+		branchEnds[level] = keyEnd;
+	else
+		branchEnds[level] = level ? branchEnds[level - 1] : 0;
+
+	keyPending = false;
+
+	if(skipBranch || currentParser->pfnEnter == NULL || this->returnVal == RETURN_VDFPARSER_STOP)
+		return;
+
+	EnsureArraySize(path, pathSize, branchEnds[level] + 1);
+	path[branchEnds[level]] = '\0';
+
+	ret = (*(currentParser->pfnEnter))(currentParser->fwidEnter, currentParser->mdFilename, path, level);
+
+	if(ret == RETURN_VDFPARSER_SKIP)
+		skipBranch = true;
+	else
+		this->returnVal = ret;
+}
+
+/**
+ *	Fires leave branch event with the key path of the branch.
+ */
+void VDFEventReader::HandleBranchClose(size_t end)
+{
+	UINT level;
+
+	if(!trackPath || currentParser->pfnLeave == NULL || this->returnVal == RETURN_VDFPARSER_STOP)
+		return;
+
+	level = currentDepth - 1;
+	path[branchEnds[level]] = '\0';
+
+	this->returnVal = (*(currentParser->pfnLeave))(currentParser->fwidLeave, currentParser->mdFilename, path, level);
+
+	if(this->returnVal == RETURN_VDFPARSER_SKIP)
+		this->returnVal = RETURN_VDFPARSER_CONTINUE;
+}
+
+
+VDFTreeFile::VDFTreeFile(IErrorLogger *logger): VDFReader(logger)
+{
+	resolver = NULL;
+	directives = NULL;
+	lastDirective = NULL;
+	lazySource = NULL;
+	lazyDepth = 0;
+}
+
+VDFTreeFile::~VDFTreeFile()
+{
+	ClearDirectives();
+}
+
+bool VDFTreeFile::OpenVDF(const char *filename, VDFTree **vdfTree, OpenForward *openFW)
+{	
+
+	if(filename == NULL) {
+		return false;
+	}
+	
+	this->Open(filename);
+	return BuildTree(vdfTree, openFW);
+}
+
+/**
+ *	Opens a tree from vdf data stored in memory (text or binary format).
+ *	@param	data		Vdf data, it doesn't need to be null terminated.
+ *	@param	length		Data length in bytes.
+ *	@param	vdfTree		Receives the new tree.
+ *	@param	openFW		Node addition forward (optional).
+ *	@return				true on success.
+ */
+bool VDFTreeFile::OpenVDFString(const char *data, size_t length, VDFTree **vdfTree, OpenForward *openFW)
+{
+	if(data == NULL) {
+		return false;
+	}
+
+	this->OpenString(data, length, openFW ? openFW->mdFilename : NULL);
+	return BuildTree(vdfTree, openFW);
+}
+
+/**
+ *	Opens a tree in lazy mode: branches of nodes at a given level are
+ *	skipped (file is kept in memory), their nodes are read on first access
+ *	(see <code>VDFTree::LoadBranch</code>). Binary files are fully read.
+ *	@param	filename	File to be read.
+ *	@param	depth		Level of nodes whose branches are skipped (1 = top-level
+ *						sections, root children).
+ *	@param	vdfTree		Receives the new tree.
+ *	@return				true on success.
+ */
+bool VDFTreeFile::OpenVDFLazy(const char *filename, UINT depth, VDFTree **vdfTree)
+{
+	VDFLazySource	*source;
+	bool			ret;
+
+	if(filename == NULL)
+		return false;
+
+	if(IsBinaryVDF(filename))
+		return OpenVDF(filename, vdfTree);
+
+	source = new VDFLazySource(logger);
+
+	if(!source->Load(filename)) {
+		delete source;
+		return false;
+	}
+
+	this->OpenString(source->data, source->length, filename);
+
+	lazySource = source;
+	lazyDepth = depth ? depth : 1;
+
+	ret = BuildTree(vdfTree, NULL);
+
+	lazySource = NULL;
+	lazyDepth = 0;
+
+	if(ret && !source->IsLoaded()) {
+		source->Sort();
+		source->tree = *vdfTree;
+		(*vdfTree)->lazy = source;
+	} else {
+		if(ret)
+			source->LoadAll(*vdfTree);
+		delete source;
+	}
+
+	return ret;
+}
+
+/**
+ *	Reads the nodes of a branch stored in memory as children of
+ *	a node (it's used by lazy trees).
+ *	@param	vdfTree		Tree that holds the node.
+ *	@param	node		Node that gets the nodes.
+ *	@param	data		Branch text, from its opening brace.
+ *	@param	length		Text length in bytes.
+ *	@param	name		Name used in error messages (optional).
+ */
+void VDFTreeFile::ReadBranch(VDFTree *vdfTree, VDFNode *node, const char *data, size_t length,
+							 const char *name)
+{
+	this->OpenString(data, length, name);
+
+	// branch opens without a key
+	this->status = 1 << KV_EXP_OPEN;
+	this->currentParser = NULL;
+	this->currentTree = vdfTree;
+	this->currentNode = node;
+	this->currentDepth = 0;
+	this->returnVal = RETURN_TREEPARSER_CONTINUE;
+
+	while(this->NextKeyValue());
+
+	this->Close();
+}
+
+/**
+ *	Opens a tree from binary vdf data stored after a given offset in a file.
+ *	@param	filename	File to be read.
+ *	@param	offset		Position of binary data in file.
+ *	@param	vdfTree		Receives the new tree.
+ *	@param	openFW		Node addition forward (optional).
+ *	@return				true on success.
+ */
+bool VDFTreeFile::OpenBinaryVDF(const char *filename, long offset, VDFTree **vdfTree, OpenForward *openFW)
+{
+	if(filename == NULL) {
+		return false;
+	}
+
+	this->OpenBinary(filename, offset);
+	return BuildTree(vdfTree, openFW);
+}
+
+/**
+ *	Reads all nodes from the opened source into a new tree.
+ *	@param	vdfTree		Receives the new tree.
+ *	@param	openFW		Node addition forward (optional).
+ *	@return				false if reader isn't opened.
+ */
+bool VDFTreeFile::BuildTree(VDFTree **vdfTree, OpenForward *openFW)
+{
+	if(!BeginTree(vdfTree, openFW))
+		return false;
+
+	StepTree(0, 0);
+
+	return true;
+}
+
+/**
+ *	Prepares a new tree to be filled from the opened source.
+ *	@param	vdfTree		Receives the new tree.
+ *	@param	openFW		Node addition forward (optional).
+ *	@return				false if reader isn't opened.
+ */
+bool VDFTreeFile::BeginTree(VDFTree **vdfTree, OpenForward *openFW)
+{
+	if(!this->IsOpen()) return false;
+
+	this->currentParser = openFW;
+	ClearDirectives();
+
+	// make sure output tree is empty
+	if(*vdfTree) {
+		delete(*vdfTree);
+		*vdfTree = NULL;
+	}
+
+	*vdfTree = new VDFTree;
+	this->currentTree = *vdfTree;
+	this->returnVal = RETURN_TREEPARSER_CONTINUE;
+
+	this->currentNode = (*vdfTree)->rootNode;
+	this->currentDepth = 0;
+
+	return true;
+}
+
+/**
+ *	Reads nodes into the tree prepared by <code>BeginTree</code>.
+ *	Source is closed once it's all read.
+ *	@param	budgetUs	Time limit in microseconds, 0 for no limit.
+ *	@param	budgetBytes	Read bytes limit, 0 for no limit.
+ *	@return				VDF_JOB_RUNNING if a limit was hit, otherwise VDF_JOB_DONE.
+ */
+int VDFTreeFile::StepTree(double budgetUs, size_t budgetBytes)
+{
+	double	start;
+	size_t	startPos;
+	UINT	count;
+
+	start = (budgetUs > 0) ? GetMicroseconds() : 0;
+	startPos = GetReadPosition();
+
+	for(count = 1; ; count++)
+	{
+		if(!this->NextKeyValue() || this->returnVal == RETURN_TREEPARSER_BREAK)
+			break;
+
+		if(budgetBytes && GetReadPosition() - startPos >= budgetBytes)
+			return VDF_JOB_RUNNING;
+
+		// clock is read once every few nodes
+		if(budgetUs > 0 && !(count & 63) && GetMicroseconds() - start >= budgetUs)
+			return VDF_JOB_RUNNING;
+	}
+
+	ApplyDirectives();
+	this->Close();
+
+	if(!currentTree->rootNode) currentTree->CreateTree();
+
+	return VDF_JOB_DONE;
+}
+
+/**
+ *	Keeps a directive read from source, its path is made relative
+ *	to the directory of current file.
+ *	@param	type	VDF_DIRECTIVE_INCLUDE or VDF_DIRECTIVE_BASE.
+ *	@param	path	Path as written in source.
+ */
+void VDFTreeFile::HandleDirective(int type, const char *path)
+{
+	VDFDirective	*newDirective;
+	size_t			dirLength;
+
+	dirLength = 0;
+
+	if(filename && path[0] != '/' && path[0] != '\\' && !(path[0] && path[1] == ':')) {
+		for(dirLength = strlen(filename); dirLength > 0; dirLength--) {
+			if(filename[dirLength - 1] == '/' || filename[dirLength - 1] == '\\')
+				break;
+		}
+	}
+
+	newDirective = new VDFDirective;
+	newDirective->type = type;
+	newDirective->line = lineCounter;
+	newDirective->next = NULL;
+	newDirective->path = new char[dirLength + strlen(path) + 1];
+	if(dirLength)
+		memcpy(newDirective->path, filename, dirLength);
+	strcpy(newDirective->path + dirLength, path);
+	newDirective->source = new char[strlen(path) + 12];
+	sprintf(newDirective->source, "%s \"%s\"", (type == VDF_DIRECTIVE_BASE) ? "#base" : "#include", path);
+
+	if(lastDirective)
+		lastDirective->next = newDirective;
+	else
+		directives = newDirective;
+
+	lastDirective = newDirective;
+}
+
+/**
+ *	Applies directives to the complete tree, following KeyValues rules:
+ *	keys of included files are appended after root, then base files
+ *	are merged into root (keys already in tree are kept).
+ *	Added branches are flagged VDF_NODE_INCLUDED and directive lines are
+ *	kept by the tree, so text saves write the directives back instead.
+ *	Directives aren't applied if there's no include resolver.
+ */
+void VDFTreeFile::ApplyDirectives()
+{
+	VDFDirective	*dir;
+	VDFTree			*included;
+	VDFNode			*node;
+	VDFNode			*copy;
+	size_t			length;
+	int				type;
+
+	for(length = 0, dir = directives; dir; dir = dir->next)
+		length += strlen(dir->source) + 1;
+
+	if(length) {
+		FinalizeArray(currentTree->directives);
+		currentTree->directives = new char[length + 1];
+		currentTree->directives[0] = '\0';
+		for(dir = directives; dir; dir = dir->next) {
+			strcat(currentTree->directives, dir->source);
+			strcat(currentTree->directives, "\n");
+		}
+	}
+
+	if(resolver == NULL)
+		return;
+
+	// merged keys may go into skipped branches, they're read first
+	if(lazySource && directives)
+		lazySource->LoadAll(currentTree);
+
+	for(type = VDF_DIRECTIVE_INCLUDE; type <= VDF_DIRECTIVE_BASE; type++) {
+		for(dir = directives; dir; dir = dir->next) {
+			if(dir->type != type)
+				continue;
+
+			included = resolver->GetIncludedTree(dir->path);
+
+			if(included == NULL || included->IsFrozen()) {
+				if(this->logger)
+					logger->printError(this->filename, "can't read included file", dir->line);
+				continue;
+			}
+
+			node = included->rootNode;
+
+			// empty file
+			if(node == NULL || (node->key == NULL && node->childNode == NULL && node->nextNode == NULL))
+				continue;
+
+			if(type == VDF_DIRECTIVE_BASE && currentTree->rootNode) {
+				VDFTree::MergeBranch(currentTree->rootNode, node, VDF_MERGE_KEEP, VDF_NODE_INCLUDED);
+				continue;
+			}
+
+			for(; node; node = node->nextNode) {
+				copy = VDFTree::CopyBranch(node);
+				copy->flags |= VDF_NODE_INCLUDED;
+				if(!currentTree->rootNode) currentTree->rootNode = copy;
+				else VDFTree::AppendNode(currentTree->rootNode, copy);
+			}
+		}
+	}
+}
+
+/**
+ *	Frees directives read from last source.
+ */
+void VDFTreeFile::ClearDirectives()
+{
+	VDFDirective *next;
+
+	while(directives) {
+		next = directives->next;
+		FinalizeArray(directives->path);
+		FinalizeArray(directives->source);
+		delete directives;
+		directives = next;
+	}
+
+	lastDirective = NULL;
+}
+
+void VDFTreeFile::DispatchToParser(const char *key, const char *value, UINT depth)
+{	
+
+	VDFNode *refNode = currentNode;
+	currentNode = this->currentTree->CreateNode();
+	VDFTree::SetKeyPair(currentNode, key, value);
+	
+	if(depth > currentDepth)
+	{	
+		VDFTree::AppendChild(refNode, currentNode);		
+	} else if(depth < currentDepth)
+	{
+		while(depth < currentDepth--)
+			refNode = refNode->parentNode;
+		VDFTree::AppendNode(refNode, currentNode);
+	} else
+	{
+		if(!currentTree->rootNode) currentTree->rootNode = currentNode;
+		else VDFTree::AppendNode(refNode, currentNode);
+	}
+
+	currentDepth = depth;
+
+	if(lazySource && depth <= lazyDepth)
+		lazySource->AddNode(currentNode);
+
+	if(lazySource && depth == lazyDepth)
+		skipBranch = true;
+
+	if(currentParser && this->returnVal != RETURN_TREEPARSER_SILENT)
+	{		
+		this->returnVal = (*(currentParser->pfnOpen))(currentParser->fwdid, currentParser->mdFilename, currentTree, currentNode, depth);
+	}
+}
+
+
+/**
+ *	Keeps the branch skipped in lazy mode, it belongs to last read node.
+ *	@param	start	Offset of opening brace.
+ *	@param	end		Offset after closing brace.
+ */
+void VDFTreeFile::HandleSkippedBranch(size_t start, size_t end)
+{
+	if(lazySource)
+		lazySource->AddBranch(currentNode, start, end);
+}
+ 
+/**
+ *	Saves a tree as text.
+ *	@param	filename	Target file.
+ *	@param	vdfTree		Tree to be saved.
+ *	@return				true on success.
+ */
+bool VDFTreeFile::SaveVDF(const char *filename, VDFTree *vdfTree)
+{
+	VDFSaveJob job;
+
+	if(!job.Begin(filename, vdfTree))
+		return false;
+
+	return job.Step(0) == VDF_JOB_DONE;
+}
+
+/**
+ *	Writes a branch as text into a buffer.
+ *	@param	node		Branch node.
+ *	@param	output		Receives the text (appended, not null terminated).
+ *	@param	compact		If true, no indentation is written and braces
+ *						are kept next to their keys.
+ *	@return				false if node is NULL.
+ */
+bool VDFTreeFile::DumpVDF(VDFNode *node, VDFBuffer &output, bool compact)
+{
+	VDFSaveJob job;
+
+	if(node == NULL)
+		return false;
+
+	job.Start(node, true, compact, &output);
+
+	return job.Step(0) == VDF_JOB_DONE;
+}
+
+/**
+ *	Saves a tree in binary format. Nodes are written in document order,
+ *	each one tagged with its type and followed by its child count.
+ *	@param	filename	Target file.
+ *	@param	vdfTree		Tree to be saved.
+ *	@return				true on success.
+ */
+bool VDFTreeFile::SaveBinaryVDF(const char *filename, VDFTree *vdfTree)
+{
+	FILE		*pFile;
+	bool		ret;
+
+	if(filename == NULL || vdfTree->rootNode == NULL)
+		return false;
+
+	pFile = fopen(filename, "wb");
+	if(!pFile)
+		return false;
+
+	ret = WriteBinary(pFile, vdfTree);
+
+	fclose(pFile);
+	return ret;
+}
+
+/**
+ *	Writes a tree in binary format at current position of an opened file.
+ *	@param	pFile		Target file (opened in binary mode).
+ *	@param	vdfTree		Tree to be written.
+ *	@return				true on success.
+ */
+bool VDFTreeFile::WriteBinary(FILE *pFile, VDFTree *vdfTree)
+{
+	VDFNode		*node;
+	VDFNode		*child;
+	VDFBuffer	buffer;
+	UINT		count;
+	UINT		len;
+	int			depth;
+	bool		ret;
+
+	buffer.Append(VDF_BINARY_MAGIC, 4);
+	buffer.AppendByte(VDF_BINARY_VERSION);
+	buffer.AppendByte(0);
+	buffer.AppendByte(0);
+	buffer.AppendByte(0);
+	buffer.AppendUInt((UINT)VDFTree::CountBranchNodes(vdfTree->rootNode));
+
+	ret = true;
+	depth = 0;
+
+	for(node = vdfTree->rootNode; node; node = VDFTree::GetNextTraverseStep(node, depth))
+	{
+		buffer.AppendByte((node->key ? VDF_BINARY_HASKEY : 0) | (node->value ? VDF_BINARY_HASVALUE : 0));
+
+		if(node->key) {
+			len = (UINT)strlen(node->key);
+			buffer.AppendUInt(len);
+			buffer.Append(node->key, len + 1);
+		}
+		if(node->value) {
+			len = (UINT)strlen(node->value);
+			buffer.AppendUInt(len);
+			buffer.Append(node->value, len + 1);
+		}
+
+		for(count = 0, child = node->childNode; child; child = child->nextNode)
+			count++;
+		buffer.AppendUInt(count);
+
+		if(buffer.length >= VDF_WRITE_CHUNK) {
+			ret = fwrite(buffer.data, 1, buffer.length, pFile) == buffer.length;
+			buffer.Reset();
+			if(!ret)
+				break;
+		}
+	}
+
+	if(ret && buffer.length)
+		ret = fwrite(buffer.data, 1, buffer.length, pFile) == buffer.length;
+
+	return ret;
+}
+
+
+// --- VDFParseJob class implementation ---
+
+VDFParseJob::VDFParseJob(IErrorLogger *logger): VDFTreeFile(logger)
+{
+	jobFile = NULL;
+	tree = NULL;
+	jobId = 0;
+	state = VDF_JOB_FAILED;
+}
+
+VDFParseJob::~VDFParseJob()
+{
+	this->Close();
+	Finalize(tree);
+	FinalizeArray(jobFile);
+}
+
+/**
+ *	Opens a file to be read in steps. Frozen images are loaded at once,
+ *	as they take a single read.
+ *	@param	filename	File to be read.
+ *	@return				false if file can't be read.
+ */
+bool VDFParseJob::Begin(const char *filename)
+{
+	this->Close();
+	Finalize(tree);
+	FinalizeArray(jobFile);
+	state = VDF_JOB_FAILED;
+
+	if(filename == NULL)
+		return false;
+
+	// reader keeps a pointer to the name
+	jobFile = new char[strlen(filename) + 1];
+	strcpy(jobFile, filename);
+
+	if(VDFImage::IsImageVDF(jobFile)) {
+		tree = new VDFTree;
+		if(!tree->LoadImage(jobFile)) {
+			Finalize(tree);
+			return false;
+		}
+		state = VDF_JOB_DONE;
+		return true;
+	}
+
+	this->Open(jobFile);
+
+	if(!BeginTree(&tree, NULL))
+		return false;
+
+	state = VDF_JOB_RUNNING;
+	return true;
+}
+
+/**
+ *	Reads the next nodes.
+ *	@param	budgetUs	Time limit in microseconds, 0 for no limit.
+ *	@param	budgetBytes	Read bytes limit, 0 for no limit.
+ *	@return				VDF_JOB_RUNNING while there's data left, VDF_JOB_DONE
+ *						when tree is complete, VDF_JOB_FAILED if job wasn't started.
+ */
+int VDFParseJob::Step(double budgetUs, size_t budgetBytes)
+{
+	if(state == VDF_JOB_RUNNING)
+		state = StepTree(budgetUs, budgetBytes);
+
+	return state;
+}
+
+/**
+ *	Hands the complete tree over to the caller.
+ *	@return		The tree, or NULL if job isn't done.
+ */
+VDFTree *VDFParseJob::TakeTree()
+{
+	VDFTree *ret;
+
+	if(state != VDF_JOB_DONE)
+		return NULL;
+
+	ret = tree;
+	tree = NULL;
+	state = VDF_JOB_FAILED;
+
+	return ret;
+}
+
+// --- VDFSaveJob class implementation ---
+
+/**
+ *	Gets the indentation written for a level, it's capped at VDF_MAX_INDENT
+ *	so deep trees are read back.
+ */
+static inline size_t Indent(int depth)
+{
+	return (depth < VDF_MAX_INDENT) ? (size_t)depth : VDF_MAX_INDENT;
+}
+
+VDFSaveJob::VDFSaveJob()
+{
+	tree = NULL;
+	jobId = 0;
+	jobFile = NULL;
+	pFile = NULL;
+	onCopy = false;
+	currentDepth = 0;
+	compact = false;
+	started = false;
+	skipIncluded = false;
+	escapes = false;
+	worker = false;
+}
+
+VDFSaveJob::~VDFSaveJob()
+{
+	Close();
+	FinalizeArray(jobFile);
+}
+
+/**
+ *	Opens target file and places the job at tree root. The tree is
+ *	written as it is now, later changes don't affect the job. Directives
+ *	of the tree are written first, branches they added aren't written.
+ *	@param	filename	Target file.
+ *	@param	vdfTree		Tree to be saved.
+ *	@return				true on success.
+ */
+bool VDFSaveJob::Begin(const char *filename, VDFTree *vdfTree)
+{
+	Close();
+
+	if(filename == NULL || vdfTree == NULL || vdfTree->rootNode == NULL)
+		return false;
+
+	pFile = fopen(filename, "w+");
+	if(!pFile)
+		return false;
+
+	tree = vdfTree;
+	FinalizeArray(jobFile);
+	jobFile = new char[strlen(filename) + 1];
+	strcpy(jobFile, filename);
+	snapshot.Take(tree);
+	Start(snapshot.GetRootNode());
+
+	if(tree->directives)
+		writer.Write(tree->directives, strlen(tree->directives));
+	skipIncluded = true;
+
+	return true;
+}
+
+/**
+ *	Places the job at a node, output is kept in buffer unless
+ *	a file has been opened by <code>Begin</code>.
+ *	@param	origin		First node to be written.
+ *	@param	single		If true, origin siblings aren't written.
+ *	@param	compact		If true, no indentation is written and braces
+ *						are kept next to their keys.
+ *	@param	output		Buffer to be appended instead of job buffer (optional).
+ */
+void VDFSaveJob::Start(VDFNode *origin, bool single, bool compact, VDFBuffer *output)
+{
+	currentDepth = 0;
+	onCopy = false;
+	started = false;
+	skipIncluded = false;
+	escapes = VDFReader::shared.escapes;
+	this->compact = compact;
+	buffer.Reset();
+	writer.SetTarget(pFile, output ? output : &buffer);
+	cursor.Start(origin, single);
+}
+
+/**
+ *	Writes the rest of a job started by <code>Begin</code> on a worker
+ *	thread. Tree may be changed on main thread meanwhile, steps just report
+ *	job state; <code>Close</code> stops the worker if it's still running.
+ *	@return		false if worker can't be started (e.g. on Windows builds),
+ *				job is then written by steps.
+ */
+bool VDFSaveJob::StartWorker()
+{
+#if !defined _WIN32
+	if(worker || pFile == NULL)
+		return false;
+
+	stopWorker = false;
+	workerState = VDF_JOB_RUNNING;
+
+	if(pthread_create(&thread, NULL, WorkerMain, this) != 0)
+		return false;
+
+	worker = true;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ *	Writes the next nodes, or gets the state of a job written by a worker.
+ *	@param	budget	Maximum number of nodes to be written, 0 writes all.
+ *	@return			VDF_JOB_RUNNING while there are nodes left, VDF_JOB_DONE
+ *					when output is complete or VDF_JOB_FAILED on write errors.
+ *					File and snapshot are released when job is done or failed.
+ */
+int VDFSaveJob::Step(size_t budget)
+{
+	int ret;
+
+#if !defined _WIN32
+	if(worker)
+		return PollWorker();
+#endif
+
+	ret = Write(budget);
+
+	if(ret != VDF_JOB_RUNNING)
+		snapshot.Release();
+
+	return ret;
+}
+
+/**
+ *	Writes the next nodes; workers call it holding the snapshot lock.
+ *	@param	budget	Maximum number of nodes to be written, 0 writes all.
+ *	@return			Job state, see <code>Step</code>. File is closed
+ *					when job is done or failed.
+ */
+int VDFSaveJob::Write(size_t budget)
+{
+	VDFNode *node;
+	int		depth;
+	size_t	count;
+	bool	ret;
+
+	// file jobs are closed once they're over
+	if(pFile == NULL && tree != NULL)
+		return VDF_JOB_FAILED;
+
+	// tree has changed since last step; shared nodes may be gone, so
+	// traverse goes on in snapshot copy at the same node
+	if(!onCopy && snapshot.copy) {
+		onCopy = true;
+		if(cursor.node)
+			cursor.Resume(snapshot.GetCopiedNode(), cursor.depth);
+	}
+
+	for(count = 0; !budget || count < budget; count++)
+	{
+		node = cursor.node;
+
+		// included keys are read again from their files
+		if(skipIncluded && node && (node->flags & VDF_NODE_INCLUDED)) {
+			cursor.Next(true);
+			continue;
+		}
+
+		depth = node ? cursor.depth : 0;
+
+		if(currentDepth < depth)
+		{
+			if(!compact) {
+				writer.Put('\n');
+				writer.Fill('\t', Indent(depth - 1));
+			}
+			writer.Put('{');
+		}
+		else while(currentDepth > depth)
+		{
+			currentDepth--;
+			writer.Put('\n');
+			if(!compact)
+				writer.Fill('\t', Indent(currentDepth));
+			writer.Put('}');
+		}
+		currentDepth = depth;
+
+		if(node == NULL) {
+			ret = writer.Flush();
+			if(pFile)
+				CloseFile();
+			return ret ? VDF_JOB_DONE : VDF_JOB_FAILED;
+		}
+
+		// keys without value are ended by line breaks, root level siblings too
+		if(currentDepth || started)
+			writer.Put('\n');
+		if(!compact)
+			writer.Fill('\t', Indent(currentDepth));
+		started = true;
+
+		writer.Put('"');
+		if(node->key)
+			WriteString(node->key);
+		writer.Put('"');
+
+		if(node->value && *(node->value))
+		{
+			writer.Write(" \"", 2);
+			WriteString(node->value);
+			writer.Put('"');
+		}
+
+		cursor.Next();
+	}
+
+	if(writer.failed) {
+		CloseFile();
+		return VDF_JOB_FAILED;
+	}
+
+	// written nodes aren't copied if tree changes
+	if(!onCopy)
+		snapshot.Keep(cursor.node);
+
+	return VDF_JOB_RUNNING;
+}
+
+/**
+ *	Writes a key or value, escaping quotes, backslashes, line breaks
+ *	and tabs if escape sequences are enabled. Strings without those
+ *	chars are copied as they are.
+ *	@param	str		String to be written.
+ */
+void VDFSaveJob::WriteString(const char *str)
+{
+	size_t len;
+	size_t pos;
+
+	len = strlen(str);
+
+	if(!escapes) {
+		writer.Write(str, len);
+		return;
+	}
+
+	while((pos = FindEscapeChar(str, len)) < len) {
+		writer.Write(str, pos);
+		writer.Put('\\');
+
+		switch(str[pos]) {
+			case '\n':	writer.Put('n');		break;
+			case '\t':	writer.Put('t');		break;
+			default:	writer.Put(str[pos]);
+		}
+
+		str += pos + 1;
+		len -= pos + 1;
+	}
+
+	writer.Write(str, len);
+}
+
+/**
+ *	Closes target file, pending output is discarded.
+ *	A running worker is stopped first.
+ */
+void VDFSaveJob::Close()
+{
+#if !defined _WIN32
+	if(worker) {
+		snapshot.Lock();
+		stopWorker = true;
+		snapshot.Unlock();
+		pthread_join(thread, NULL);
+		worker = false;
+	}
+#endif
+
+	CloseFile();
+	snapshot.Release();
+}
+
+/**
+ *	Closes target file once job is over; snapshot is kept until
+ *	main thread releases it, but tree changes don't copy it anymore.
+ */
+void VDFSaveJob::CloseFile()
+{
+	if(pFile) {
+		fclose(pFile);
+		pFile = NULL;
+	}
+
+	snapshot.Finish();
+}
+
+#if !defined _WIN32
+
+/**
+ *	Gets the state of a worker job, the worker is joined and
+ *	snapshot is released once it's over.
+ *	@return		Job state, see <code>Step</code>.
+ */
+int VDFSaveJob::PollWorker()
+{
+	int state;
+
+	snapshot.Lock();
+	state = workerState;
+	snapshot.Unlock();
+
+	if(state == VDF_JOB_RUNNING)
+		return state;
+
+	pthread_join(thread, NULL);
+	worker = false;
+	snapshot.Release();
+
+	return state;
+}
+
+/**
+ *	Writes job nodes in chunks, holding the snapshot lock during each,
+ *	so tree changes on main thread copy the snapshot between chunks.
+ */
+void VDFSaveJob::RunWorker()
+{
+	int state;
+
+	do {
+		snapshot.Lock();
+		state = stopWorker ? VDF_JOB_FAILED : Write(VDF_SAVE_WORKER_CHUNK);
+		workerState = state;
+		snapshot.Unlock();
+	} while(state == VDF_JOB_RUNNING);
+}
+
+void *VDFSaveJob::WorkerMain(void *job)
+{
+	static_cast<VDFSaveJob*>(job)->RunWorker();
+	return NULL;
+}
+
+#endif
@@ -1,174 +1,433 @@
-#ifndef __VDFPARSER_H__
-#define __VDFPARSER_H__
-
-
-#include "VDFTree.h"
-
-//typedef void (*VDFReaderFW) (const char* key, const char *value, UINT depth);
-
-
-/** Constants used in event parser */
-enum
-{
-	RETURN_VDFPARSER_CONTINUE = 0,
-	RETURN_VDFPARSER_STOP
-};
-
-/** Constants used in tree parser */
-enum
-{
-	RETURN_TREEPARSER_CONTINUE = 0,
-	RETURN_TREEPARSER_SILENT,
-	RETURN_TREEPARSER_BREAK
-};
-
-class IErrorLogger
-{
-public:
-	virtual void printError(const char *filename, const char *message, int line = 0, int charpos = 0) {};
-};
-
-/**
- *	Abstract class for reading vdf files.
- *	All required methods for reading are implemented,
- *  the inheriting class must implement the event handler method.
- */
-class VDFReader
-{
-protected:
-	const char *filename;
-	//VDFReaderFW parser;
-	FILE *pFile;
-	UINT currentDepth;
-	UINT lineCounter;
-	IErrorLogger *logger;
-
-	
-	char line[1024];
-	UINT cursor;
-	size_t lineLength;
-	int status;
-
-	/** constants for file 'symbols' return by "GetNextSymbol" method */
-	enum VdfSymbols
-	{
-		KV_CLOSE = 0,
-		KV_OPEN,
-		KV_NEWSTRING,
-		KV_NONE,
-		KV_ERROR
-	};
-
-	enum VdfReaderStatus
-	{
-		KV_EXP_CLOSE = 0,
-		KV_EXP_NEWKV = 2,
-		KV_EXP_OPEN = 1
-		
-	};
-
-	int GetNextSymbol              (char **target, int tokenMax);
-	virtual void DispatchToParser  (const char* key = NULL, const char *value= NULL, UINT depth = 0) {};
-
-public:
-	//VDFReader          (const char *filename, VDFReaderFW parser = NULL);
-	VDFReader		   (IErrorLogger *logger = NULL);
-	void Open          ();
-	void Open          (const char* filename);
-	void Close         ();
-	bool NextKeyValue  ();
-	/*virtual ~VDFReader () {};*/
-	
-	/*struct ReaderStatus
-	{
-		ReaderStatus(){};
-		UINT cursor;
-		size_t lineLength;
-		int currentStatus;
-	}*/
-
-};
-
-/* definition for vdf object parsing forward */
-typedef int (*PFN_VDFOPEN)			(int fwid, const char* filename, VDFTree* tree,
-									 VDFNode* node, int level);
-
-/* definition for vdf event parser forward */
-typedef int (*PFN_VDFPARSE_KPAIR)	(int fwid, const char *filename,
-									 const char* key,
-									 const char* value,
-									 int level);
-
-/* parser forward definition for "start" event */
-typedef int	(*PFN_VDFPARSE_BOF)		(int fwid, const char *filename);
-
-/* parser forward definition for "end" event*/
-typedef int (*PFN_VDFPARSE_EOF)		(int fwid, const char *filename);
-
-/**
- *	Container for parse forwards
- */
-struct ParseForward
-{
-	int fwidParser;
-	int fwidStart;
-	int	fwidEnd;
-	char *mdFilename;
-	PFN_VDFPARSE_KPAIR	pfnParser;
-	PFN_VDFPARSE_BOF	pfnStart;
-	PFN_VDFPARSE_EOF	pfnEnd;
-};
-
-/**
- *	Container for open forwards
- */
-struct OpenForward
-{
-	int fwdid;
-	char *mdFilename;
-	PFN_VDFOPEN pfnOpen;
-};
-
-class VDFTreeFile : public VDFReader
-{
-private:
-	int returnVal;
-	OpenForward *currentParser;
-	VDFTree *currentTree;
-	VDFNode *currentNode;
-	UINT currentDepth;
-	void DispatchToParser(const char* key = NULL, const char *value= NULL, UINT depth = 0);
-	class TabFill
-	{
-	public:
-		TabFill(char *tabs) : tabs(tabs), currentPos(-1) {}
-		char *tabs;
-		int currentPos;	
-		void SetTabPos(int pos) {
-			if(currentPos > -1) {
-				tabs[currentPos] = '\t';
-			}
-			currentPos = pos;
-			tabs[pos] = '\0';
-		}
-	};
-public:
-	bool OpenVDF	(const char *filename, VDFTree **vdfTree, OpenForward *openFW = NULL);
-	bool SaveVDF	(const char *filename, VDFTree *vdfTree);
-	VDFTreeFile		(IErrorLogger *logger = NULL): VDFReader(logger) {};
-	
-};
-
-class VDFEventReader : public VDFReader
-{
-private:
-	int returnVal;
-	ParseForward *currentParser;
-	void DispatchToParser(const char* key = NULL, const char *value= NULL, UINT depth = 0);
-public:	
-	VDFEventReader (IErrorLogger *logger = NULL) : VDFReader(logger) {currentParser = NULL;};
-	bool ParseVDF  (const char *filename, ParseForward *parseFW = NULL);	
-};
-
-
-#endif //__VDFPARSER_H__
+#ifndef __VDFPARSER_H__
+#define __VDFPARSER_H__
+
+
+#include "VDFTree.h"
+
+//typedef void (*VDFReaderFW) (const char* key, const char *value, UINT depth);
+
+
+/** Constants used in event parser */
+enum
+{
+	RETURN_VDFPARSER_CONTINUE = 0,
+	RETURN_VDFPARSER_STOP,
+	RETURN_VDFPARSER_SKIP
+};
+
+/** Binary vdf format (type tagged nodes, length prefixed strings) */
+#define VDF_BINARY_MAGIC		"VDFB"
+#define VDF_BINARY_VERSION		1
+#define VDF_BINARY_HEADER_SIZE	12
+
+/** Saves indent deeper levels as this one, so lines with the longest keys
+	and values read (255 + 511 chars) fit in reader line buffer */
+#define VDF_MAX_INDENT			128
+
+/** Nodes save workers write per snapshot lock, main thread changes
+	to the tree wait at most for one of these chunks */
+#define VDF_SAVE_WORKER_CHUNK	256
+
+/** Binary node type flags */
+enum
+{
+	VDF_BINARY_HASKEY = 1 << 0,
+	VDF_BINARY_HASVALUE = 1 << 1
+};
+
+/** States returned by budgeted jobs */
+enum
+{
+	VDF_JOB_DONE = 0,
+	VDF_JOB_RUNNING,
+	VDF_JOB_FAILED
+};
+
+/** Directives read before root key (KeyValues style) */
+enum
+{
+	VDF_DIRECTIVE_INCLUDE = 0,
+	VDF_DIRECTIVE_BASE
+};
+
+/** Constants used in tree parser */
+enum
+{
+	RETURN_TREEPARSER_CONTINUE = 0,
+	RETURN_TREEPARSER_SILENT,
+	RETURN_TREEPARSER_BREAK
+};
+
+class IErrorLogger
+{
+public:
+	virtual void printError(const char *filename, const char *message, int line = 0, int charpos = 0) {};
+};
+
+/**
+ *	Provides the trees of files named by #include and #base directives.
+ */
+class IIncludeResolver
+{
+public:
+	virtual VDFTree *GetIncludedTree(const char *path) = 0;
+};
+
+/**
+ *	Reading settings: escape sequences and flags checked by [$FLAG]
+ *	conditions. Readers use the shared settings (<code>VDFReader::shared</code>)
+ *	unless they're given a copy, e.g. to read files on another thread.
+ */
+class VDFReaderSettings
+{
+public:
+			VDFReaderSettings	();
+			~VDFReaderSettings	();
+	void	SetCondition		(const char *flag, bool defined = true);
+	bool	IsConditionSet		(const char *flag, size_t length) const;
+	void	ClearConditions		();
+	void	Copy				(const VDFReaderSettings &source);
+
+	/** escape sequences setting, shared by readers and writers */
+	bool	escapes;
+
+	/** flags defined for conditions */
+	char	**conditions;
+	size_t	conditionCount;
+	size_t	conditionSize;
+};
+
+/**
+ *	Abstract class for reading vdf files.
+ *	All required methods for reading are implemented,
+ *  the inheriting class must implement the event handler method.
+ */
+class VDFReader
+{
+protected:
+	const char *filename;
+	//VDFReaderFW parser;
+	FILE *pFile;
+	UINT currentDepth;
+	UINT lineCounter;
+	IErrorLogger *logger;
+
+	/** escapes and conditions used by this reader */
+	const VDFReaderSettings *settings;
+	
+	char line[1024];
+	UINT cursor;
+	size_t lineLength;
+	int status;
+	size_t readBytes;
+	int directive;
+
+	/** conditions state: depth of branch being skipped (0 if none) */
+	bool conditionMet;
+	bool conditionsRead;
+	bool skipNextBlock;
+	UINT skipDepth;
+
+	/** set by handlers to skip the branch of the key just dispatched */
+	bool skipBranch;
+
+	/** memory source, text lines are copied from it instead of a file */
+	const char *memData;
+	size_t memLength;
+	size_t memCursor;
+
+	/** binary mode data (whole file is loaded, no tokenizing) */
+	unsigned char *binData;
+	size_t binLength;
+	size_t binCursor;
+	UINT *binPending;
+	size_t binPendingSize;
+	UINT binDepth;
+
+	/** constants for file 'symbols' return by "GetNextSymbol" method */
+	enum VdfSymbols
+	{
+		KV_CLOSE = 0,
+		KV_OPEN,
+		KV_NEWSTRING,
+		KV_NONE,
+		KV_ERROR,
+		KV_DIRECTIVE,
+		KV_CONDITION
+	};
+
+	enum VdfReaderStatus
+	{
+		KV_EXP_CLOSE = 0,
+		KV_EXP_NEWKV = 2,
+		KV_EXP_OPEN = 1
+		
+	};
+
+	int GetNextSymbol              (char **target, int tokenMax);
+	int ReadString                 (char **target, int tokenMax);
+	int ReadDirective              (char **target);
+	int ReadCondition              ();
+	bool CheckTrailingCondition    ();
+	bool ReadLine                  ();
+	void ResetState                ();
+	bool LoadBinary                (long offset);
+	bool InitBinary                ();
+	bool ReadBinaryString          (char **target);
+	bool ReadBinaryNode            (char **key, char **value, UINT *childCount);
+	void PushBinaryLevel           (UINT childCount);
+	bool NextBinaryKeyValue        ();
+	void SkipBranch                (size_t &start, size_t &end);
+	void SkipRequestedBranch       ();
+	void SkipBinaryBranch          (UINT childCount);
+	virtual void DispatchToParser  (const char* key = NULL, const char *value= NULL, UINT depth = 0) {};
+	virtual void HandleDirective   (int type, const char *path) {};
+	virtual void HandleSkippedBranch (size_t start, size_t end) {};
+	virtual void HandleBranchOpen  (size_t start) {};
+	virtual void HandleBranchClose (size_t end) {};
+
+public:
+	//VDFReader          (const char *filename, VDFReaderFW parser = NULL);
+	VDFReader		   (IErrorLogger *logger = NULL);
+	virtual ~VDFReader ();
+	void Open          ();
+	void Open          (const char* filename);
+	void OpenBinary    (const char* filename, long offset);
+	void OpenString    (const char* data, size_t length, const char *name = NULL);
+	void Close         ();
+	bool NextKeyValue  ();
+	bool IsOpen        () { return pFile != NULL || binData != NULL || memData != NULL; }
+	bool IsBinary      () { return binData != NULL; }
+	size_t GetReadPosition () { return binData ? binCursor : readBytes; }
+	static bool IsBinaryVDF (const char *filename);
+	bool HasConditions () { return conditionsRead; }
+	void UseSettings   (const VDFReaderSettings *settings);
+	static void SetEscapes  (bool enabled);
+	static void SetCondition    (const char *flag, bool defined = true);
+	static bool IsConditionSet  (const char *flag, size_t length);
+	static void ClearConditions ();
+
+	/** settings used by readers unless they're given others, and by writers */
+	static VDFReaderSettings shared;
+	
+	/*struct ReaderStatus
+	{
+		ReaderStatus(){};
+		UINT cursor;
+		size_t lineLength;
+		int currentStatus;
+	}*/
+
+};
+
+/* definition for vdf object parsing forward */
+typedef int (*PFN_VDFOPEN)			(int fwid, const char* filename, VDFTree* tree,
+									 VDFNode* node, int level);
+
+/* definition for vdf event parser forward */
+typedef int (*PFN_VDFPARSE_KPAIR)	(int fwid, const char *filename,
+									 const char* key,
+									 const char* value,
+									 int level);
+
+/* parser forward definition for "start" event */
+typedef int	(*PFN_VDFPARSE_BOF)		(int fwid, const char *filename);
+
+/* parser forward definition for "end" event*/
+typedef int (*PFN_VDFPARSE_EOF)		(int fwid, const char *filename);
+
+/* parser forward definition for "enter branch" and "leave branch" events */
+typedef int (*PFN_VDFPARSE_BRANCH)	(int fwid, const char *filename,
+									 const char *path,
+									 int level);
+
+/**
+ *	Container for parse forwards
+ */
+struct ParseForward
+{
+	int fwidParser;
+	int fwidStart;
+	int	fwidEnd;
+	int fwidEnter;
+	int fwidLeave;
+	char *mdFilename;
+	PFN_VDFPARSE_KPAIR	pfnParser;
+	PFN_VDFPARSE_BOF	pfnStart;
+	PFN_VDFPARSE_EOF	pfnEnd;
+	PFN_VDFPARSE_BRANCH	pfnEnter;
+	PFN_VDFPARSE_BRANCH	pfnLeave;
+};
+
+/**
+ *	Container for open forwards
+ */
+struct OpenForward
+{
+	int fwdid;
+	char *mdFilename;
+	PFN_VDFOPEN pfnOpen;
+};
+
+/**
+ *	Directive read from a tree source, path is resolved
+ *	against the directory of the source file.
+ */
+struct VDFDirective
+{
+	int type;
+	char *path;
+	/** directive as it was read, e.g. #include "file.vdf" */
+	char *source;
+	UINT line;
+	VDFDirective *next;
+};
+
+class VDFLazySource;
+
+class VDFTreeFile : public VDFReader
+{
+protected:
+	int returnVal;
+	OpenForward *currentParser;
+	VDFTree *currentTree;
+	VDFNode *currentNode;
+	UINT currentDepth;
+	IIncludeResolver *resolver;
+	VDFDirective *directives;
+	VDFDirective *lastDirective;
+	/** lazy mode: branches of nodes at lazyDepth are kept in source */
+	VDFLazySource *lazySource;
+	UINT lazyDepth;
+	void DispatchToParser(const char* key = NULL, const char *value= NULL, UINT depth = 0);
+	void HandleDirective(int type, const char *path);
+	void HandleSkippedBranch(size_t start, size_t end);
+	void ApplyDirectives();
+	void ClearDirectives();
+	bool BuildTree(VDFTree **vdfTree, OpenForward *openFW);
+	bool BeginTree(VDFTree **vdfTree, OpenForward *openFW);
+	int  StepTree (double budgetUs, size_t budgetBytes);
+public:
+	bool OpenVDF	(const char *filename, VDFTree **vdfTree, OpenForward *openFW = NULL);
+	bool OpenBinaryVDF	(const char *filename, long offset, VDFTree **vdfTree, OpenForward *openFW = NULL);
+	bool OpenVDFString	(const char *data, size_t length, VDFTree **vdfTree, OpenForward *openFW = NULL);
+	bool OpenVDFLazy	(const char *filename, UINT depth, VDFTree **vdfTree);
+	void ReadBranch		(VDFTree *vdfTree, VDFNode *node, const char *data, size_t length,
+						 const char *name = NULL);
+	bool SaveVDF	(const char *filename, VDFTree *vdfTree);
+	bool SaveBinaryVDF	(const char *filename, VDFTree *vdfTree);
+	bool WriteBinary	(FILE *pFile, VDFTree *vdfTree);
+	static bool DumpVDF	(VDFNode *node, VDFBuffer &output, bool compact = false);
+	bool WasInterrupted	() { return returnVal == RETURN_TREEPARSER_BREAK; }
+	bool HasDirectives	() { return directives != NULL; }
+	void SetIncludeResolver	(IIncludeResolver *resolver) { this->resolver = resolver; }
+	VDFTreeFile		(IErrorLogger *logger = NULL);
+	~VDFTreeFile	();
+	
+};
+
+/**
+ *	Builds a tree from a file across several steps, each one limited
+ *	by time or by read bytes, so huge files don't stall a frame.
+ */
+class VDFParseJob : public VDFTreeFile
+{
+public:
+				VDFParseJob		(IErrorLogger *logger = NULL);
+				~VDFParseJob	();
+	bool		Begin			(const char *filename);
+	int			Step			(double budgetUs, size_t budgetBytes = 0);
+	VDFTree		*TakeTree		();
+
+	char		*jobFile;
+	VDFTree		*tree;
+	UINT		jobId;
+	int			state;
+};
+
+/**
+ *	Writes a tree as text, a limited number of nodes per step,
+ *	so huge trees can be saved across several frames.
+ *	Jobs started by <code>Begin</code> write a snapshot, so the tree may be
+ *	changed or removed while they're running, and they may be written by
+ *	a worker thread (<code>StartWorker</code>); other jobs need the tree
+ *	unchanged. Without a target file, output is kept in <code>buffer</code>
+ *	(complete once job is done).
+ */
+class VDFSaveJob
+{
+public:
+				VDFSaveJob		();
+				~VDFSaveJob		();
+	bool		Begin			(const char *filename, VDFTree *vdfTree);
+	void		Start			(VDFNode *origin, bool single = false, bool compact = false,
+								 VDFBuffer *output = NULL);
+	bool		StartWorker		();
+	int			Step			(size_t budget);
+	void		Close			();
+
+	VDFTree		*tree;
+	UINT		jobId;
+	char		*jobFile;
+	VDFBuffer	buffer;
+
+protected:
+	int			Write			(size_t budget);
+	void		WriteString		(const char *str);
+	void		CloseFile		();
+
+	FILE		*pFile;
+	VDFCursor	cursor;
+	VDFWriter	writer;
+	VDFSnapshot	snapshot;
+	bool		onCopy;
+	int			currentDepth;
+	bool		compact;
+	bool		started;
+	/** file saves write directives instead of the branches they added */
+	bool		skipIncluded;
+	/** escape setting when job started, workers don't read shared settings */
+	bool		escapes;
+	/** job is written by a worker thread, steps only report its state */
+	bool		worker;
+
+#if !defined _WIN32
+	int			PollWorker		();
+	void		RunWorker		();
+	static void	*WorkerMain		(void *job);
+
+	pthread_t	thread;
+	/** set by main thread under snapshot lock to stop worker */
+	bool		stopWorker;
+	/** job state reported by worker under snapshot lock */
+	int			workerState;
+#endif
+};
+
+class VDFEventReader : public VDFReader
+{
+private:
+	int returnVal;
+	ParseForward *currentParser;
+	/** key path of last node and of open branches (only kept for branch events) */
+	bool trackPath;
+	char *path;
+	size_t pathSize;
+	size_t *branchEnds;
+	size_t branchEndsSize;
+	size_t keyEnd;
+	UINT keyLevel;
+	bool keyPending;
+	void DispatchToParser(const char* key = NULL, const char *value= NULL, UINT depth = 0);
+	void HandleBranchOpen(size_t start);
+	void HandleBranchClose(size_t end);
+	bool Parse     (ParseForward *parseFW);
+public:	
+	VDFEventReader (IErrorLogger *logger = NULL);
+	~VDFEventReader ();
+	bool ParseVDF  (const char *filename, ParseForward *parseFW = NULL);	
+	bool ParseVDFString (const char *data, size_t length, ParseForward *parseFW = NULL);
+};
+
+
+#endif //__VDFPARSER_H__
@@ -0,0 +1,132 @@
+/*
+*
+*  This program is free software; you can redistribute it and/or modify it
+*  under the terms of the GNU General Public License as published by the
+*  Free Software Foundation; either version 2 of the License, or (at
+*  your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful, but
+*  WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*  General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software Foundation,
+*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**  
+ *	@author		commonbullet
+ *	@version	1.07
+ */
+
+
+#include <string.h>
+
+#include "VDFStats.h"
+
+
+// --- VDFStats implementation ---
+
+VDFStats::VDFStats()
+{
+	enabled = false;
+	stats = NULL;
+	count = 0;
+}
+
+VDFStats::~VDFStats()
+{
+	FinalizeArray(stats);
+}
+
+/**
+ *	Allocates counters.
+ *	@param	count	Number of natives.
+ */
+void VDFStats::Setup(size_t count)
+{
+	FinalizeArray(stats);
+
+	this->count = count;
+	stats = new VDFNativeStat[count];
+	memset(stats, 0, count * sizeof(VDFNativeStat));
+}
+
+/**
+ *	Sets the name shown for a native.
+ */
+void VDFStats::SetName(size_t index, const char *name)
+{
+	if(index < count)
+		stats[index].name = name;
+}
+
+/**
+ *	Records a native call.
+ *	@param	index		Native index.
+ *	@param	elapsed		Call time in microseconds.
+ */
+void VDFStats::Record(size_t index, double elapsed)
+{
+	VDFNativeStat *stat;
+
+	if(index >= count)
+		return;
+
+	stat = &stats[index];
+	stat->calls++;
+	stat->totalTime += elapsed;
+	if(elapsed > stat->maxTime)
+		stat->maxTime = elapsed;
+	stat->buckets[GetBucket(elapsed)]++;
+}
+
+/**
+ *	Clears all counters, names are kept.
+ */
+void VDFStats::Reset()
+{
+	size_t i;
+
+	for(i = 0; i < count; i++) {
+		stats[i].calls = 0;
+		stats[i].totalTime = 0;
+		stats[i].maxTime = 0;
+		memset(stats[i].buckets, 0, sizeof(stats[i].buckets));
+	}
+}
+
+VDFNativeStat *VDFStats::GetStat(size_t index)
+{
+	return (index < count) ? &stats[index] : NULL;
+}
+
+/**
+ *	Gets the histogram bucket of a call time. Bucket 0 holds calls
+ *	under 1us, bucket n holds [2^(n-1), 2^n) us, last one holds the rest.
+ *	@param	elapsed		Call time in microseconds.
+ */
+int VDFStats::GetBucket(double elapsed)
+{
+	int		bucket;
+	double	limit;
+
+	for(bucket = 0, limit = 1.0; bucket < VDF_STATS_BUCKETS - 1; bucket++, limit *= 2.0) {
+		if(elapsed < limit)
+			break;
+	}
+
+	return bucket;
+}
+
+/**
+ *	Gets the upper limit of a bucket in microseconds (0 for the last one).
+ */
+double VDFStats::GetBucketLimit(int bucket)
+{
+	if(bucket < 0 || bucket >= VDF_STATS_BUCKETS - 1)
+		return 0;
+
+	return (double)(1 << bucket);
+}
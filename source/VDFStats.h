@@ -0,0 +1,49 @@
+#ifndef __VDFSTATS_H__
+#define __VDFSTATS_H__
+
+#include "common.h"
+
+/** Latency histogram buckets: <1us, then powers of 2 up to >= 16ms */
+#define VDF_STATS_BUCKETS		16
+
+/**
+ *  Counters of a single native.
+ */
+struct VDFNativeStat
+{
+	const char	*name;
+	UINT		calls;
+	double		totalTime;
+	double		maxTime;
+	UINT		buckets[VDF_STATS_BUCKETS];
+};
+
+/**
+ *	Per native call counters, total/max time and latency
+ *	histogram. Recording is skipped while disabled.
+ */
+class VDFStats
+{
+public:
+					VDFStats		();
+					~VDFStats		();
+	void			Setup			(size_t count);
+	void			SetName			(size_t index, const char *name);
+	void			Record			(size_t index, double elapsed);
+	void			Reset			();
+	size_t			GetCount		() { return count; }
+	VDFNativeStat	*GetStat		(size_t index);
+
+	static int		GetBucket		(double elapsed);
+	static double	GetBucketLimit	(int bucket);
+
+public:
+	bool			enabled;
+
+protected:
+	VDFNativeStat	*stats;
+	size_t			count;
+};
+
+
+#endif //__VDFSTATS_H__
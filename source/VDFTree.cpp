@@ -1,622 +1,1727 @@
-/*
-*
-*  This program is free software; you can redistribute it and/or modify it
-*  under the terms of the GNU General Public License as published by the
-*  Free Software Foundation; either version 2 of the License, or (at
-*  your option) any later version.
-*
-*  This program is distributed in the hope that it will be useful, but
-*  WITHOUT ANY WARRANTY; without even the implied warranty of
-*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
-*  General Public License for more details.
-*
-*  You should have received a copy of the GNU General Public License
-*  along with this program; if not, write to the Free Software Foundation,
-*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
-*/
-
-/**  
- *	@author		commonbullet
- *	@version	1.07
- */
-
-#include <stdlib.h>
-#include <string.h>
-
-#include "VDFTree.h"
-
-
-// --- VDFTree class implementation ---
-
-VDFTree::VDFTree()
-{
-	nodeCount    =  0;
-	rootNode     =  NULL;
-	nodeIndex	 =  NULL;
-	treeId		 =  0;
-}
-
-VDFTree::~VDFTree()
-{
-	DestroyTree();
-}
-
-
-/**
- *  Initializes tree root node
- */
-void VDFTree::CreateTree()
-{
-	if(rootNode != NULL) {
-		DestroyTree();
-	}
-	rootNode = CreateNode();
-}
-
-/**
- * 	Creates an empty node and adds it to node index
- *
- * 	@param	parentNode	node's parent, not required (default = NULL)
- * 	@return				The created node or NULL if it fails.
- */
-VDFNode *VDFTree::CreateNode(VDFNode *parentNode)
-{
-	VDFNode  *node;
-	node = new VDFNode;
-	return node;
-}
-
-/**
- *  Appends a new node into a given node level
- *
- *	@param	Node		pointer to node to get the level
- *	@param	newNode		pointer to node to be added
- */
-void VDFTree::AppendNode(VDFNode *Node, VDFNode *newNode)
-{
-	VDFNode *lastNode;
-	
-	if(Node == NULL)
-		return;
-
-	lastNode = GetLastNode(Node);
-	lastNode->nextNode = newNode;
-	newNode->parentNode = lastNode->parentNode;
-	newNode->previousNode = lastNode;
-}
-
-/**
- *	Adds a child node into a given node.
- *
- *  @param	Node		node pointer which the child will be added, 
- *						if the node already has a child,<br>
- *						it's appended to node's child level.
- *  @param	childNode	pointer to the noded to be appended as a child
- */
-void VDFTree::AppendChild(VDFNode *Node, VDFNode *childNode)
-{
-	if(Node == NULL)
-		return;
-
-	childNode->parentNode = Node;
-
-	if(Node->childNode)
-		AppendNode(Node->childNode, childNode);
-	else
-		Node->childNode = childNode;
-}
-
-/**
- *  Tree memory freeing.
- */
-void VDFTree::DestroyTree()
-{
-	if(this->rootNode)
-	{
-
-		DeleteNode(this->rootNode);
-		FinalizeArray(rootNode->key);
-		FinalizeArray(rootNode->value);
-		delete this->rootNode;
-
-		this->rootNode = NULL;
-	}
-
-}
-
-/**
- *	Get the node in tree index
- *
- *  @param	id		index of the node.
- *  @return			The target node or NULL if not valid or not found.
- */
-VDFNode *VDFTree::GetNodeById(UINT id)
-{
-	if(id < nodeCount)
-		return nodeIndex[id];
-	return NULL;
-}
-
-/**
- *	Gets the node next to a given one.
- *
- *  @param	Node		node to get the next one.	
- *  @return				Returns the next node or NULL if it doesn't
- *						have a next node.
- */ 
-VDFNode *VDFTree::GetNextNode(VDFNode *Node)
-{
-	return Node->nextNode;
-}
-
-/**
- *	Gets the first node from a given node level.
- *
- *	@param	Node		node to get level in tree
- *  @return				The first node in that level.
- */
-VDFNode *VDFTree::GetFirstNode(VDFNode *Node)
-{
-	VDFNode *firstNode;
-	firstNode = (Node->parentNode) ? Node->parentNode->childNode : VDFTree::GetRootNode(Node);
-	return firstNode;
-}
-
-/**
- *	Gets the last node from a given node level
- *
- *	@param	Node		node to get level in tree
- *  @return				The last node in that level.
- */
-VDFNode *VDFTree::GetLastNode(VDFNode *Node)
-{
-	VDFNode *lastNode;
-	
-	lastNode = Node;
-
-	while(true) {
-		if(!lastNode->nextNode)
-			break;
-		lastNode = lastNode->nextNode;
-	}
-	return lastNode;
-}
-
-/**
- *	Although the tree object has a 'rootNode' pointer, this static
- *	function is designed to<br>find the rootNode without the 
- *  vdf tree information.
- *
- *	@param	Node		Node to get the previous one.
- *  @return				The previous node or NULL if there's no previous.
- */
-VDFNode *VDFTree::GetRootNode(VDFNode *Node)
-{
-	VDFNode *rootNode;
-	rootNode = Node;
-	while(rootNode->parentNode)
-		rootNode = rootNode->parentNode;
-	while(rootNode->previousNode)
-		rootNode = rootNode->previousNode;
-	return rootNode;
-}
-
-/**
- *	Gets the previous node from a given node.
- *
- *	@param	Node		Node to get the previous one.
- *  @return				The previous node or NULL if there's no previous.
- */
-VDFNode *VDFTree::GetPreviousNode(VDFNode *Node)
-{
-	return Node->previousNode;
-}
-
-/**
- *	Gets the next node in traverse.
- *  @param  node    Origin of traverse
- *  @param  depth   Relative depth of the traverse node from the origin (1st parameter)
- */
-VDFNode  *VDFTree::GetNextTraverseStep(VDFNode *node, int &depth)
-{
-	VDFNode* trav;
-	VDFNode* temp;
-
-	trav = node;	
-	
-	if( (temp = trav->childNode) ) {
-		trav = temp;
-		depth++;
-	}
-	else {		
-		if(! (temp = trav->nextNode) ) {
-
-			for(temp = NULL; temp == NULL; temp = trav->nextNode) {
-				trav = trav->parentNode;
-				if(trav == NULL || trav == node) break;
-				depth --;
-			}
-		}
-		trav = temp;		
-	}
-
-	return trav;
-}
-
-/**
- *	Gets the number of a nodes on a given node.
- *
- *	@param	refNode		Node to check level.
- *  @return				The previous node or NULL if there's no previous.
- */
-size_t VDFTree::CountBranchNodes(VDFNode *refNode)
-{
-	VDFNode *firstNode;
-	size_t counter;
-
-	firstNode = GetFirstNode(refNode);
-	counter = 0;
-
-	while(firstNode) {
-		counter++;
-		firstNode = firstNode->nextNode;
-	}
-
-	return counter;
-}
-
-/**
- *	Sorts nodes in a branch.
- *	@param	refNode		Pick up the branch of this node
- *	@param	byKey		If true sort nodes by key, otherwise use values.
- *	@param	byNumber	If true keys/values are considered as numbers (integers) for sorting.
-*/
-void VDFTree::SortBranchNodes(VDFNode *refNode, bool byKey, bool byNumber)
-{
-	VDFNode *firstNode;
-	VDFNode *parentNode;
-	VDFNode *Node;
-	VDFNode **sort;
-	size_t length;
-	int	 ind;
-	char *comp1;
-	char *comp2;
-	int	 guide;
-	int	 p,q;
-	int p1;
-	bool comp;
-
-	
-
-	firstNode = VDFTree::GetFirstNode(refNode);
-
-	if(firstNode == NULL)
-		return;
-
-	parentNode = firstNode->parentNode;
-	length = VDFTree::CountBranchNodes(firstNode);
-	
-	if(!length)
-		return;
-	
-	sort = new VDFNode*[length];
-	memset(sort, 0, length * sizeof(VDFNode*));
-	
-	Node = firstNode;
-	ind = 0;
-
-	for(;Node; Node = Node->nextNode)
-		sort[ind++] = Node;
-
-	/*while(Node) {
-		sort[ind++] = Node;
-		Node = Node->nextNode;
-	}*/
-	
-	
-	// shell sort
-	guide = 1;
-
-	while(guide < (int)length)
-		guide *= 2;
-
-	while(guide /= 2) {
-		
-		for(p = 0; p < (int)length - guide; p++) {
-			
-			p1 = p;
-
-			while(p1 > -1) {
-
-				q = p1 + guide;
-				
-				if(q >= (int)length)
-					break;			
-				
-				
-				comp2 = (byKey) ? sort[p1]->key : sort[p1]->value;
-				comp1 = (byKey) ? sort[q]->key : sort[q]->value;
-
-				if(comp1 == NULL)
-					continue;
-				
-				comp = (comp2 == NULL) ? false : (!byNumber) ? (strcmp(comp1, comp2) < 0) 
-						: atoi(comp1) < atoi(comp2);
-
-				if(comp) {
-					Node = sort[q];
-					sort[q] = sort[p1];
-					sort[p1] = Node;
-				}
-				p1 -= guide;
-			}
-		}
-	}
-
-	for(ind = 0; ind < (int)length; ind++) {		
-		sort[ind]->nextNode = (ind + 1 < (int)length) ? sort[ind + 1] : NULL;
-		sort[ind]->previousNode = (ind - 1 >= 0) ? sort[ind - 1] : NULL;
-	}
-
-	if(parentNode)
-		parentNode->childNode = sort[0];
-	else if(firstNode == rootNode)
-		this->rootNode = sort[0];
-
-	delete(sort);
-
-}
-
-bool VDFTree::IsTreeNode(VDFNode *node) {
-	
-	size_t count;
-	
-	for(count = 0; count < this->nodeCount; count++) {
-		if(this->nodeIndex[count] == node)
-			return true;
-	}
-
-	return false;
-
-}
-
-void VDFTree::MoveAsChild(VDFNode *parentNode, VDFNode *moveNode)
-{
-	VDFNode *childNode;
-	VDFNode *moveNext;
-	VDFNode *moveParent;	
-
-	if( parentNode == NULL ||
-		moveNode == NULL ||
-		moveNode->parentNode == parentNode)
-		return;
-
-	if(!IsTreeNode(moveNode) || !IsTreeNode(parentNode))
-		return;
-
-	moveNext = moveNode->nextNode;
-	moveParent = moveNode->parentNode;
-	childNode = parentNode->childNode;
-
-	if(childNode == NULL) {
-		parentNode->childNode = moveNode;
-		moveNode->nextNode = NULL;
-		moveNode->previousNode = NULL;
-	}
-
-	else {
-		childNode = VDFTree::GetLastNode(childNode);
-		childNode->nextNode = moveNode;
-		moveNode->nextNode = NULL;
-		moveNode->previousNode = childNode;
-	}
-
-	moveNode->parentNode = parentNode;
-
-	if(moveParent) {
-		if(moveNext) {
-			moveParent->childNode = moveNext;
-			moveNext->previousNode = NULL;
-		}
-		else
-			moveParent->childNode = NULL;
-	}
-}
-
-/**
- *	Moves a node to other branch.
- *	@param	refNode		Reference node.
- *	@param	moveNode	Node to be moved.
- *	@param	byNumber	If true keys/values are considered as numbers (integers) for sorting.
-*/
-void VDFTree::MoveToBranch(VDFNode *refNode, VDFNode *moveNode, UINT position)
-{
-	VDFNode *targetPrevious;
-	VDFNode *targetNext;
-	VDFNode *srcPrevious;
-	VDFNode *srcNext;
-
-	if(refNode == NULL || moveNode == NULL || refNode == moveNode)
-		return;
-
-	if(!IsTreeNode(refNode) || !IsTreeNode(moveNode))
-		return;
-	
-	targetPrevious = refNode->previousNode;
-	targetNext = refNode->nextNode;
-	srcPrevious = moveNode->previousNode;
-	srcNext = moveNode->nextNode;
-
-	if(position == VDF_MOVEPOS_AFTER) {
-
-		if(srcPrevious == NULL) {
-			if(moveNode->parentNode)
-				moveNode->parentNode->childNode = srcNext;
-		}
-
-		refNode->nextNode = moveNode;
-		moveNode->previousNode = refNode;
-		moveNode->nextNode = targetNext;
-		if(targetNext != NULL)
-			targetNext->previousNode = moveNode;
-		
-		if(moveNode == rootNode)
-			rootNode = GetRootNode(moveNode);
-
-	}	
-	else {
-		if(srcPrevious == NULL) {			
-			if(moveNode->parentNode)
-				moveNode->parentNode->childNode = srcNext;
-		}
-		
-		refNode->previousNode = moveNode;
-		moveNode->nextNode = refNode;
-		moveNode->previousNode = targetPrevious;
-		
-		if(moveNode == rootNode)
-			rootNode = GetRootNode(moveNode);
-		else if(refNode == rootNode)
-			rootNode = moveNode;
-
-	}
-	
-	if(srcNext)
-		srcNext->previousNode = srcPrevious;
-	
-	if(srcPrevious)
-		srcPrevious->nextNode = srcNext;
-
-}
-
-/**
- *	Gets the node depth in a tree
- *	@param	Node	Node to check.
- *	@return			Node depth.
- */
-size_t VDFTree::GetNodeLevel(VDFNode *Node)
-{
-	size_t counter;
-
-	counter = 0;
-
-	while((Node = Node->parentNode))
-		counter++;
-
-	return counter;
-}
-
-/**
- *	Deletes a node in a given tree's node index.
- *
- *	@param	index	Index of the node to be deleted.
- */
-/*void VDFTree::DeleteNode(UINT index)
-{
-	if(index < nodeCount) {
-		if(nodeIndex[index])
-			DeleteNode(nodeIndex[index]);
-	}
-}*/
-
-/**
- *	Deletes a node in vdf tree.
- *
- *	@param	Node	Node to be deleted.
- */
-void VDFTree::DeleteNode(VDFNode *Node)
-{
-	VDFNode *temp;
-	VDFNode *next;
-	
-	temp = Node;
-
-	while(Node != NULL && temp != NULL) {
-		if(temp->childNode) {
-			temp = temp->childNode;
-			continue;
-		}
-
-		if(temp == Node)
-		{
-			if( temp->parentNode ) {
-				if(temp->parentNode->childNode == temp) {
-					temp->parentNode->childNode = temp->nextNode;
-				}				
-			}
-			if(temp->nextNode) {
-				temp->nextNode->previousNode = temp->previousNode;
-				//if(Node == rootNode) rootNode = temp->nextNode;
-			} //else if(Node == rootNode) rootNode = this->CreateNode();
-			if(temp->previousNode) {
-				temp->previousNode->nextNode = temp->nextNode;
-			}
-			next = NULL;
-		} else {
-			if( temp->parentNode ) {
-				temp->parentNode->childNode = temp->nextNode;
-			}
-			if( temp->nextNode ) {
-				temp->nextNode->previousNode = NULL;
-				next = temp->nextNode;
-			} else {
-				next = temp->parentNode;
-			}
-		}
-
-		if(temp != rootNode) {
-			FinalizeArray(temp->key);
-			FinalizeArray(temp->value);	
-			Finalize(temp);
-		}
-
-		temp = next;
-
-
-	}
-}
-
-/**
- *	Gets the actual number of nodes in a tree.
- *
- *	@return		The number of nodes in a tree.
- */
-size_t VDFTree::GetLength()
-{
-	UINT ind;
-	size_t length;
-	length = 0;
-	for(ind = 0; ind < nodeCount; ind++) {
-		if(nodeIndex[ind])
-			length++;
-	}
-	return length;
-}
-
-
-/**
- *	Sets key/value in a tree. Use NULL if you need to set
- *	only key or only value.
- *
- *	@param	Node	Target node
- *	@param	key		Node key, if NULL it's ignored.
- *	@param	value	Node value, if NULL it's ignored.
- */
-void VDFTree::SetKeyPair(VDFNode *Node, const char *key, const char *value)
-{
-	if(key) {
-		if(Node->key)
-			delete(Node->key);
-		Node->key = new char[strlen(key) + 1];
-		strcpy(Node->key, key);
-	}
-
-	if(value) {
-		if(Node->value)
-			delete(Node->value);
-		Node->value = new char[strlen(value) + 1];
-		strcpy(Node->value, value);
-	}
-}
-
-
+/*
+*
+*  This program is free software; you can redistribute it and/or modify it
+*  under the terms of the GNU General Public License as published by the
+*  Free Software Foundation; either version 2 of the License, or (at
+*  your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful, but
+*  WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*  General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software Foundation,
+*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**  
+ *	@author		commonbullet
+ *	@version	1.07
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "VDFTree.h"
+#include "VDFImage.h"
+#include "VDFLazy.h"
+
+
+// --- VDFTree class implementation ---
+
+VDFNodeBlock **VDFTree::blocks = NULL;
+size_t VDFTree::blockCount = 0;
+size_t VDFTree::blockSize = 0;
+size_t VDFTree::pendingSnapshots = 0;
+
+/** marks keys that haven't got a place in a bulk copy yet */
+#define VDF_INTERN_NEW ((UINT)-1)
+
+/** key table limit for bulk copies, so it stays in cache (frequent keys come first anyway) */
+#define VDF_INTERN_MAX_SLOTS 16384
+
+/**
+ *  Key of a bulk copy, equal keys take a single string.
+ */
+struct VDFInternSlot
+{
+	const char	*key;
+	UINT		hash;
+	UINT		offset;
+};
+
+VDFTree::VDFTree()
+{
+	nodeCount    =  0;
+	rootNode     =  NULL;
+	nodeIndex	 =  NULL;
+	treeId		 =  0;
+	image		 =  NULL;
+	lazy		 =  NULL;
+	journal		 =  NULL;
+	directives	 =  NULL;
+	thawedNodes	 =  NULL;
+	deleteHead	 =  NULL;
+	deleteTail	 =  NULL;
+	deleteCursor =  NULL;
+	snapshots	 =  NULL;
+}
+
+VDFTree::~VDFTree()
+{
+	DestroyTree();
+	FinalizeArray(directives);
+}
+
+
+/**
+ *  Initializes tree root node
+ */
+void VDFTree::CreateTree()
+{
+	if(rootNode != NULL) {
+		DestroyTree();
+	}
+	rootNode = CreateNode();
+}
+
+/**
+ * 	Creates an empty node and adds it to node index
+ *
+ * 	@param	parentNode	node's parent, not required (default = NULL)
+ * 	@return				The created node or NULL if it fails.
+ */
+VDFNode *VDFTree::CreateNode(VDFNode *parentNode)
+{
+	VDFNode  *node;
+	node = new VDFNode;
+	return node;
+}
+
+/**
+ *  Appends a new node into a given node level
+ *
+ *	@param	Node		pointer to node to get the level
+ *	@param	newNode		pointer to node to be added
+ */
+void VDFTree::AppendNode(VDFNode *Node, VDFNode *newNode)
+{
+	VDFNode *lastNode;
+	
+	if(Node == NULL)
+		return;
+
+	lastNode = GetLastNode(Node);
+	lastNode->nextNode = newNode;
+	newNode->parentNode = lastNode->parentNode;
+	newNode->previousNode = lastNode;
+}
+
+/**
+ *	Adds a child node into a given node.
+ *
+ *  @param	Node		node pointer which the child will be added, 
+ *						if the node already has a child,<br>
+ *						it's appended to node's child level.
+ *  @param	childNode	pointer to the noded to be appended as a child
+ */
+void VDFTree::AppendChild(VDFNode *Node, VDFNode *childNode)
+{
+	if(Node == NULL)
+		return;
+
+	childNode->parentNode = Node;
+
+	if(Node->childNode)
+		AppendNode(Node->childNode, childNode);
+	else
+		Node->childNode = childNode;
+}
+
+/**
+ *  Tree memory freeing.
+ */
+void VDFTree::DestroyTree()
+{
+	VDFNode *next;
+
+	DetachSnapshots();
+
+	// root level can hold more keys (e.g. from included files)
+	while(this->rootNode)
+	{
+		next = rootNode->nextNode;
+
+		DeleteNode(this->rootNode);
+		FreeNode(this->rootNode);
+
+		this->rootNode = next;
+	}
+
+	// flush deferred deletions
+	FreeNodes(deleteHead, deleteCursor, 0);
+	deleteTail = NULL;
+
+	Finalize(image);
+	Finalize(lazy);
+	FinalizeArray(thawedNodes);
+}
+
+/**
+ *	Get the node in tree index
+ *
+ *  @param	id		index of the node.
+ *  @return			The target node or NULL if not valid or not found.
+ */
+VDFNode *VDFTree::GetNodeById(UINT id)
+{
+	if(id < nodeCount)
+		return nodeIndex[id];
+	return NULL;
+}
+
+/**
+ *	Gets the node next to a given one.
+ *
+ *  @param	Node		node to get the next one.	
+ *  @return				Returns the next node or NULL if it doesn't
+ *						have a next node.
+ */ 
+VDFNode *VDFTree::GetNextNode(VDFNode *Node)
+{
+	return Node->nextNode;
+}
+
+/**
+ *	Gets the first node from a given node level.
+ *
+ *	@param	Node		node to get level in tree
+ *  @return				The first node in that level.
+ */
+VDFNode *VDFTree::GetFirstNode(VDFNode *Node)
+{
+	VDFNode *firstNode;
+	firstNode = (Node->parentNode) ? Node->parentNode->childNode : VDFTree::GetRootNode(Node);
+	return firstNode;
+}
+
+/**
+ *	Gets the last node from a given node level
+ *
+ *	@param	Node		node to get level in tree
+ *  @return				The last node in that level.
+ */
+VDFNode *VDFTree::GetLastNode(VDFNode *Node)
+{
+	VDFNode *lastNode;
+	
+	lastNode = Node;
+
+	while(true) {
+		if(!lastNode->nextNode)
+			break;
+		lastNode = lastNode->nextNode;
+	}
+	return lastNode;
+}
+
+/**
+ *	Although the tree object has a 'rootNode' pointer, this static
+ *	function is designed to<br>find the rootNode without the 
+ *  vdf tree information.
+ *
+ *	@param	Node		Node to get the previous one.
+ *  @return				The previous node or NULL if there's no previous.
+ */
+VDFNode *VDFTree::GetRootNode(VDFNode *Node)
+{
+	VDFNode *rootNode;
+	rootNode = Node;
+	while(rootNode->parentNode)
+		rootNode = rootNode->parentNode;
+	while(rootNode->previousNode)
+		rootNode = rootNode->previousNode;
+	return rootNode;
+}
+
+/**
+ *	Gets the previous node from a given node.
+ *
+ *	@param	Node		Node to get the previous one.
+ *  @return				The previous node or NULL if there's no previous.
+ */
+VDFNode *VDFTree::GetPreviousNode(VDFNode *Node)
+{
+	return Node->previousNode;
+}
+
+/**
+ *	Gets the next node in traverse.
+ *  @param  node    Origin of traverse
+ *  @param  depth   Relative depth of the traverse node from the origin (1st parameter)
+ */
+VDFNode  *VDFTree::GetNextTraverseStep(VDFNode *node, int &depth)
+{
+	VDFNode* trav;
+	VDFNode* temp;
+
+	trav = node;	
+	
+	if( (temp = trav->childNode) ) {
+		trav = temp;
+		depth++;
+	}
+	else {		
+		if(! (temp = trav->nextNode) ) {
+
+			for(temp = NULL; temp == NULL; temp = trav->nextNode) {
+				trav = trav->parentNode;
+				if(trav == NULL || trav == node) break;
+				depth --;
+			}
+		}
+		trav = temp;		
+	}
+
+	return trav;
+}
+
+/**
+ *	Gets the number of a nodes on a given node.
+ *
+ *	@param	refNode		Node to check level.
+ *  @return				The previous node or NULL if there's no previous.
+ */
+size_t VDFTree::CountBranchNodes(VDFNode *refNode)
+{
+	VDFNode *firstNode;
+	size_t counter;
+
+	firstNode = GetFirstNode(refNode);
+	counter = 0;
+
+	while(firstNode) {
+		counter++;
+		firstNode = firstNode->nextNode;
+	}
+
+	return counter;
+}
+
+/**
+ *	Sorts nodes in a branch.
+ *	@param	refNode		Pick up the branch of this node
+ *	@param	byKey		If true sort nodes by key, otherwise use values.
+ *	@param	byNumber	If true keys/values are considered as numbers (integers) for sorting.
+*/
+void VDFTree::SortBranchNodes(VDFNode *refNode, bool byKey, bool byNumber)
+{
+	VDFNode *firstNode;
+	VDFNode *parentNode;
+	VDFNode *Node;
+	VDFNode **sort;
+	size_t length;
+	int	 ind;
+	char *comp1;
+	char *comp2;
+	int	 guide;
+	int	 p,q;
+	int p1;
+	bool comp;
+
+	
+
+	firstNode = VDFTree::GetFirstNode(refNode);
+
+	if(firstNode == NULL)
+		return;
+
+	parentNode = firstNode->parentNode;
+	length = VDFTree::CountBranchNodes(firstNode);
+	
+	if(!length)
+		return;
+	
+	sort = new VDFNode*[length];
+	memset(sort, 0, length * sizeof(VDFNode*));
+	
+	Node = firstNode;
+	ind = 0;
+
+	for(;Node; Node = Node->nextNode)
+		sort[ind++] = Node;
+
+	/*while(Node) {
+		sort[ind++] = Node;
+		Node = Node->nextNode;
+	}*/
+	
+	
+	// shell sort
+	guide = 1;
+
+	while(guide < (int)length)
+		guide *= 2;
+
+	while(guide /= 2) {
+		
+		for(p = 0; p < (int)length - guide; p++) {
+			
+			p1 = p;
+
+			while(p1 > -1) {
+
+				q = p1 + guide;
+				
+				if(q >= (int)length)
+					break;			
+				
+				
+				comp2 = (byKey) ? sort[p1]->key : sort[p1]->value;
+				comp1 = (byKey) ? sort[q]->key : sort[q]->value;
+
+				if(comp1 == NULL)
+					break;
+				
+				comp = (comp2 == NULL) ? false : (!byNumber) ? (strcmp(comp1, comp2) < 0) 
+						: atoi(comp1) < atoi(comp2);
+
+				// this gap sequence is already in order before p1
+				if(!comp)
+					break;
+
+				Node = sort[q];
+				sort[q] = sort[p1];
+				sort[p1] = Node;
+				p1 -= guide;
+			}
+		}
+	}
+
+	for(ind = 0; ind < (int)length; ind++) {		
+		sort[ind]->nextNode = (ind + 1 < (int)length) ? sort[ind + 1] : NULL;
+		sort[ind]->previousNode = (ind - 1 >= 0) ? sort[ind - 1] : NULL;
+	}
+
+	if(parentNode)
+		parentNode->childNode = sort[0];
+	else if(firstNode == rootNode)
+		this->rootNode = sort[0];
+
+	delete(sort);
+
+}
+
+bool VDFTree::IsTreeNode(VDFNode *node) {
+	
+	size_t count;
+	
+	for(count = 0; count < this->nodeCount; count++) {
+		if(this->nodeIndex[count] == node)
+			return true;
+	}
+
+	return false;
+
+}
+
+void VDFTree::MoveAsChild(VDFNode *parentNode, VDFNode *moveNode)
+{
+	VDFNode *childNode;
+	VDFNode *moveNext;
+	VDFNode *moveParent;	
+
+	if( parentNode == NULL ||
+		moveNode == NULL ||
+		moveNode->parentNode == parentNode)
+		return;
+
+	if(!IsTreeNode(moveNode) || !IsTreeNode(parentNode))
+		return;
+
+	moveNext = moveNode->nextNode;
+	moveParent = moveNode->parentNode;
+	childNode = parentNode->childNode;
+
+	if(childNode == NULL) {
+		parentNode->childNode = moveNode;
+		moveNode->nextNode = NULL;
+		moveNode->previousNode = NULL;
+	}
+
+	else {
+		childNode = VDFTree::GetLastNode(childNode);
+		childNode->nextNode = moveNode;
+		moveNode->nextNode = NULL;
+		moveNode->previousNode = childNode;
+	}
+
+	moveNode->parentNode = parentNode;
+
+	if(moveParent) {
+		if(moveNext) {
+			moveParent->childNode = moveNext;
+			moveNext->previousNode = NULL;
+		}
+		else
+			moveParent->childNode = NULL;
+	}
+}
+
+/**
+ *	Moves a node to other branch.
+ *	@param	refNode		Reference node.
+ *	@param	moveNode	Node to be moved.
+ *	@param	byNumber	If true keys/values are considered as numbers (integers) for sorting.
+*/
+void VDFTree::MoveToBranch(VDFNode *refNode, VDFNode *moveNode, UINT position)
+{
+	VDFNode *targetPrevious;
+	VDFNode *targetNext;
+	VDFNode *srcPrevious;
+	VDFNode *srcNext;
+
+	if(refNode == NULL || moveNode == NULL || refNode == moveNode)
+		return;
+
+	if(!IsTreeNode(refNode) || !IsTreeNode(moveNode))
+		return;
+	
+	targetPrevious = refNode->previousNode;
+	targetNext = refNode->nextNode;
+	srcPrevious = moveNode->previousNode;
+	srcNext = moveNode->nextNode;
+
+	if(position == VDF_MOVEPOS_AFTER) {
+
+		if(srcPrevious == NULL) {
+			if(moveNode->parentNode)
+				moveNode->parentNode->childNode = srcNext;
+		}
+
+		refNode->nextNode = moveNode;
+		moveNode->previousNode = refNode;
+		moveNode->nextNode = targetNext;
+		if(targetNext != NULL)
+			targetNext->previousNode = moveNode;
+		
+		if(moveNode == rootNode)
+			rootNode = GetRootNode(moveNode);
+
+	}	
+	else {
+		if(srcPrevious == NULL) {			
+			if(moveNode->parentNode)
+				moveNode->parentNode->childNode = srcNext;
+		}
+		
+		refNode->previousNode = moveNode;
+		moveNode->nextNode = refNode;
+		moveNode->previousNode = targetPrevious;
+		
+		if(moveNode == rootNode)
+			rootNode = GetRootNode(moveNode);
+		else if(refNode == rootNode)
+			rootNode = moveNode;
+
+	}
+	
+	if(srcNext)
+		srcNext->previousNode = srcPrevious;
+	
+	if(srcPrevious)
+		srcPrevious->nextNode = srcNext;
+
+}
+
+/**
+ *	Gets the node depth in a tree
+ *	@param	Node	Node to check.
+ *	@return			Node depth.
+ */
+size_t VDFTree::GetNodeLevel(VDFNode *Node)
+{
+	size_t counter;
+
+	counter = 0;
+
+	while((Node = Node->parentNode))
+		counter++;
+
+	return counter;
+}
+
+/**
+ *	Deletes a node in a given tree's node index.
+ *
+ *	@param	index	Index of the node to be deleted.
+ */
+/*void VDFTree::DeleteNode(UINT index)
+{
+	if(index < nodeCount) {
+		if(nodeIndex[index])
+			DeleteNode(nodeIndex[index]);
+	}
+}*/
+
+/**
+ *	Deletes a node in vdf tree. Deleting the root node only deletes its children.
+ *
+ *	@param	Node	Node to be deleted.
+ */
+void VDFTree::DeleteNode(VDFNode *Node)
+{
+	VDFNode *branch;
+	VDFNode *cursor;
+
+	if(Node == NULL)
+		return;
+
+	branch = DetachBranch(Node, NULL);
+	cursor = NULL;
+
+	FreeNodes(branch, cursor, 0);
+}
+
+/**
+ *	Unlinks a node from the tree right away and queues it to be freed
+ *	by <code>ProcessDeletes</code>, so huge branches can be released
+ *	across several calls.
+ *
+ *	@param	Node	Node to be deleted.
+ */
+void VDFTree::DeleteNodeDeferred(VDFNode *Node)
+{
+	VDFNode *branch;
+	VDFNode *last;
+
+	if(Node == NULL || (branch = DetachBranch(Node, &last)) == NULL)
+		return;
+
+	if(deleteTail)
+		deleteTail->nextNode = branch;
+	else
+		deleteHead = branch;
+
+	deleteTail = last;
+}
+
+/**
+ *	Frees nodes queued by <code>DeleteNodeDeferred</code>.
+ *
+ *	@param	budget	Maximum number of nodes to be freed, 0 frees all.
+ *	@return			true if there are still nodes waiting.
+ */
+bool VDFTree::ProcessDeletes(size_t budget)
+{
+	FreeNodes(deleteHead, deleteCursor, budget);
+
+	if(deleteHead == NULL)
+		deleteTail = NULL;
+
+	return deleteHead != NULL;
+}
+
+/**
+ *	Unlinks a node from its parent and siblings.
+ *	If node is the root node, its children are unlinked instead.
+ *
+ *	@param	Node	Node to be detached.
+ *	@param	last	If not NULL, receives the last top level node of the
+ *					detached chain.
+ *	@return			First top level node of the detached chain.
+ */
+VDFNode *VDFTree::DetachBranch(VDFNode *Node, VDFNode **last)
+{
+	VDFNode *branch;
+	VDFNode *temp;
+
+	if(Node == rootNode) {
+		branch = Node->childNode;
+		Node->childNode = NULL;
+
+		for(temp = branch; temp; temp = temp->nextNode) {
+			temp->parentNode = NULL;
+			if(last)
+				*last = temp;
+		}
+		return branch;
+	}
+
+	if(Node->parentNode && Node->parentNode->childNode == Node)
+		Node->parentNode->childNode = Node->nextNode;
+	if(Node->nextNode)
+		Node->nextNode->previousNode = Node->previousNode;
+	if(Node->previousNode)
+		Node->previousNode->nextNode = Node->nextNode;
+
+	Node->parentNode = NULL;
+	Node->nextNode = NULL;
+	Node->previousNode = NULL;
+
+	if(last)
+		*last = Node;
+
+	return Node;
+}
+
+/**
+ *	Frees a chain of detached branches, children first. Position is kept
+ *	in a cursor node, so no walking is repeated between calls.
+ *
+ *	@param	head	First top level node of the chain, updated as nodes are freed.
+ *	@param	cursor	Resume position (NULL to start at head).
+ *	@param	budget	Maximum number of nodes to be freed, 0 frees all.
+ *	@return			Number of freed nodes.
+ */
+size_t VDFTree::FreeNodes(VDFNode *&head, VDFNode *&cursor, size_t budget)
+{
+	VDFNode *next;
+	size_t	freed;
+
+	freed = 0;
+
+	if(cursor == NULL)
+		cursor = head;
+
+	while(cursor != NULL) {
+		if(cursor->childNode) {
+			cursor = cursor->childNode;
+			continue;
+		}
+
+		if(budget && freed >= budget)
+			break;
+
+		if(cursor->parentNode) {
+			cursor->parentNode->childNode = cursor->nextNode;
+			next = cursor->nextNode ? cursor->nextNode : cursor->parentNode;
+		}
+		else {
+			// top level nodes are always freed in chain order
+			head = cursor->nextNode;
+			next = head;
+		}
+
+		FreeNode(cursor);
+
+		cursor = next;
+		freed++;
+	}
+
+	return freed;
+}
+
+/**
+ *	Gets the actual number of nodes in a tree.
+ *
+ *	@return		The number of nodes in a tree.
+ */
+size_t VDFTree::GetLength()
+{
+	UINT ind;
+	size_t length;
+	length = 0;
+	for(ind = 0; ind < nodeCount; ind++) {
+		if(nodeIndex[ind])
+			length++;
+	}
+	return length;
+}
+
+
+/**
+ *	Sets key/value in a tree. Use NULL if you need to set
+ *	only key or only value.
+ *
+ *	@param	Node	Target node
+ *	@param	key		Node key, if NULL it's ignored.
+ *	@param	value	Node value, if NULL it's ignored.
+ */
+void VDFTree::SetKeyPair(VDFNode *Node, const char *key, const char *value)
+{
+	if(key) {
+		FreeString(Node->key, (Node->flags & VDF_NODE_BLOCK_KEY) != 0);
+		Node->flags &= ~VDF_NODE_BLOCK_KEY;
+		Node->key = new char[strlen(key) + 1];
+		strcpy(Node->key, key);
+	}
+
+	if(value) {
+		FreeString(Node->value, (Node->flags & VDF_NODE_BLOCK_VALUE) != 0);
+		Node->flags &= ~VDF_NODE_BLOCK_VALUE;
+		Node->value = new char[strlen(value) + 1];
+		strcpy(Node->value, value);
+	}
+}
+
+
+/**
+ *	Copies a branch (node and its children, siblings aren't copied).
+ *	The copy isn't linked to any tree.
+ *
+ *	@param	source	Branch node.
+ *	@return			The copied node or NULL if source is NULL.
+ */
+VDFNode *VDFTree::CopyBranch(VDFNode *source)
+{
+	VDFCursor	cursor;
+	VDFNode		*copy;
+	VDFNode		*last;
+	VDFNode		*node;
+	int			lastDepth;
+
+	copy = NULL;
+	last = NULL;
+	lastDepth = 0;
+
+	for(cursor.Start(source, true); cursor.node; cursor.Next()) {
+		node = new VDFNode;
+		SetKeyPair(node, cursor.node->key, cursor.node->value);
+
+		if(last == NULL) {
+			copy = node;
+		} else if(cursor.depth > lastDepth) {
+			node->parentNode = last;
+			last->childNode = node;
+		} else {
+			while(lastDepth > cursor.depth) {
+				last = last->parentNode;
+				lastDepth--;
+			}
+			// linked right after the last copied sibling
+			node->parentNode = last->parentNode;
+			node->previousNode = last;
+			last->nextNode = node;
+		}
+		last = node;
+		lastDepth = cursor.depth;
+	}
+	return copy;
+}
+
+/**
+ *	Looks for a key in a merge table, a node can be added if it isn't there.
+ *
+ *	@param	table	Open addressing table, its size is a power of two.
+ *	@param	mask	Table size - 1.
+ *	@param	key		Key to look for.
+ *	@param	node	Node added if key isn't found (NULL just to look for it).
+ *	@return			Node holding the key or NULL if it wasn't there.
+ */
+static VDFNode *FindMergeKey(VDFNode **table, size_t mask, const char *key, VDFNode *node)
+{
+	size_t slot;
+
+	for(slot = HashBytes(key, strlen(key)) & mask; table[slot]; slot = (slot + 1) & mask) {
+		if(!strcmp(table[slot]->key, key))
+			return table[slot];
+	}
+
+	if(node)
+		table[slot] = node;
+
+	return NULL;
+}
+
+/**
+ *	Merges the children of a node into another one. Keys are matched
+ *	through a hash table of destination children, so each level is merged
+ *	in linear time. Keys missing in destination are copied. For keys found in both:
+ *	<li>VDF_MERGE_OVERWRITE - source value replaces destination value.</li>
+ *	<li>VDF_MERGE_KEEP - destination value is kept (KeyValues #base rules).</li>
+ *	<li>VDF_MERGE_APPEND - source keys without children are copied anyway,
+ *	so lists keep the items of both nodes.</li>
+ *	In all cases subsections with the same key are merged the same way.
+ *
+ *	@param	dst			Destination node.
+ *	@param	src			Source node, it isn't changed.
+ *	@param	policy		Merge policy.
+ *	@param	copyFlags	Flags set on copied branches (e.g. VDF_NODE_INCLUDED).
+ */
+void VDFTree::MergeBranch(VDFNode *dst, VDFNode *src, int policy, UINT copyFlags)
+{
+	VDFNode		**pending;
+	VDFNode		**table;
+	size_t		pendingSize;
+	size_t		tableSize;
+	size_t		count;
+	size_t		mask;
+	size_t		children;
+	VDFNode		*child;
+	VDFNode		*match;
+	VDFNode		*last;
+	VDFNode		*copy;
+
+	if(dst == NULL || src == NULL)
+		return;
+
+	// pairs of destination/source nodes waiting to be merged
+	pending = NULL;
+	pendingSize = 0;
+	table = NULL;
+	tableSize = 0;
+	count = 0;
+
+	EnsureArraySize(pending, pendingSize, 2);
+	pending[count++] = dst;
+	pending[count++] = src;
+
+	while(count) {
+		src = pending[--count];
+		dst = pending[--count];
+
+		last = NULL;
+		children = 0;
+
+		for(child = dst->childNode; child; child = child->nextNode) {
+			last = child;
+			children++;
+		}
+
+		// open addressing, table is kept at most half full
+		for(mask = 16; mask < children * 2; mask <<= 1);
+
+		EnsureArraySize(table, tableSize, mask);
+		memset(table, 0, mask * sizeof(VDFNode*));
+		mask--;
+
+		for(child = dst->childNode; child; child = child->nextNode) {
+			if(child->key != NULL)
+				FindMergeKey(table, mask, child->key, child);
+		}
+
+		for(child = src->childNode; child; child = child->nextNode) {
+			match = NULL;
+
+			if(child->key != NULL && (policy != VDF_MERGE_APPEND || child->childNode))
+				match = FindMergeKey(table, mask, child->key, NULL);
+
+			if(match == NULL) {
+				// copies are linked after the last child, no sibling walk
+				copy = CopyBranch(child);
+				copy->flags |= copyFlags;
+				copy->parentNode = dst;
+				copy->previousNode = last;
+				if(last)
+					last->nextNode = copy;
+				else
+					dst->childNode = copy;
+				last = copy;
+				continue;
+			}
+
+			if(policy == VDF_MERGE_OVERWRITE && child->value)
+				SetKeyPair(match, NULL, child->value);
+
+			if(child->childNode) {
+				EnsureArraySize(pending, pendingSize, count + 2);
+				pending[count++] = match;
+				pending[count++] = child;
+			}
+		}
+	}
+
+	FinalizeArray(table);
+	FinalizeArray(pending);
+}
+
+/**
+ *	Merges another tree into this one, root level keys are matched
+ *	as children of a node (see <code>MergeBranch</code>).
+ *
+ *	@param	source	Tree to be merged, it isn't changed.
+ *	@param	policy	Merge policy.
+ */
+void VDFTree::MergeTree(VDFTree *source, int policy)
+{
+	VDFNode	dst;
+	VDFNode	src;
+	VDFNode	*node;
+
+	if(source == NULL || source->rootNode == NULL)
+		return;
+
+	// root levels are hung from temporary parents
+	dst.childNode = rootNode;
+	src.childNode = source->rootNode;
+
+	MergeBranch(&dst, &src, policy);
+
+	rootNode = dst.childNode;
+
+	for(node = rootNode; node; node = node->nextNode)
+		node->parentNode = NULL;
+}
+
+/**
+ *	Looks for a key in a bulk copy table, adding it if it isn't there.
+ *	Table grows when it's half full, up to VDF_INTERN_MAX_SLOTS.
+ *
+ *	@param	table		Open addressing table, its size is a power of two.
+ *	@param	tableSize	Table size.
+ *	@param	used		Number of keys in table.
+ *	@param	key			Key to look for.
+ *	@param	add			If false, key isn't added.
+ *	@return				Key slot (its offset is VDF_INTERN_NEW if it's been added),
+ *						or NULL if key isn't there and it can't be added.
+ */
+static VDFInternSlot *InternKey(VDFInternSlot *&table, size_t &tableSize, size_t &used, const char *key, bool add)
+{
+	VDFInternSlot	*oldTable;
+	size_t			oldSize;
+	size_t			slot;
+	size_t			ind;
+	UINT			hash;
+
+	if(add && (used + 1) * 2 > tableSize && tableSize < VDF_INTERN_MAX_SLOTS) {
+		oldTable = table;
+		oldSize = tableSize;
+		tableSize = oldSize ? oldSize * 2 : 256;
+		table = new VDFInternSlot[tableSize];
+		memset(table, 0, tableSize * sizeof(VDFInternSlot));
+
+		for(ind = 0; ind < oldSize; ind++) {
+			if(oldTable[ind].key == NULL)
+				continue;
+			for(slot = oldTable[ind].hash & (tableSize - 1); table[slot].key; slot = (slot + 1) & (tableSize - 1));
+			table[slot] = oldTable[ind];
+		}
+		FinalizeArray(oldTable);
+	}
+
+	if(table == NULL)
+		return NULL;
+
+	hash = HashBytes(key, strlen(key));
+
+	for(slot = hash & (tableSize - 1); table[slot].key; slot = (slot + 1) & (tableSize - 1)) {
+		if(table[slot].hash == hash && !strcmp(table[slot].key, key))
+			return &table[slot];
+	}
+
+	// table is full, key is stored by itself
+	if(!add || (used + 1) * 2 > tableSize)
+		return NULL;
+
+	table[slot].key = key;
+	table[slot].hash = hash;
+	table[slot].offset = VDF_INTERN_NEW;
+	used++;
+
+	return &table[slot];
+}
+
+/**
+ *	Copies a branch into a single block: nodes and strings take one
+ *	allocation and equal keys share one string. Nodes are flagged, so
+ *	freeing them doesn't look the block up unless it's a block node,
+ *	and the block is released with its last node.
+ *	Nodes are stored in traverse order, so a copied node can be found
+ *	by the traverse position of its source.
+ *
+ *	@param	source		Branch node.
+ *	@param	siblings	If true, following siblings of source are copied too.
+ *	@param	keepFlags	Source node flags kept in copies (e.g. VDF_NODE_INCLUDED).
+ *	@return				The copied node (not linked to tree) or NULL if source is NULL.
+ */
+VDFNode *VDFTree::CloneBranch(VDFNode *source, bool siblings, UINT keepFlags)
+{
+	VDFCursor		cursor;
+	VDFInternSlot	*table;
+	VDFInternSlot	*slot;
+	VDFNodeBlock	*block;
+	VDFNode			*nodes;
+	VDFNode			*node;
+	VDFNode			*last;
+	char			*strings;
+	size_t			tableSize;
+	size_t			used;
+	size_t			count;
+	size_t			internBytes;
+	size_t			otherBytes;
+	size_t			len;
+	size_t			ind;
+	int				lastDepth;
+
+	if(source == NULL)
+		return NULL;
+
+	table = NULL;
+	tableSize = 0;
+	used = 0;
+	count = 0;
+	internBytes = 0;
+	otherBytes = 0;
+
+	// sizes first, so block is allocated once
+	for(cursor.Start(source, !siblings); cursor.node; cursor.Next()) {
+		count++;
+		if(cursor.node->key) {
+			if((slot = InternKey(table, tableSize, used, cursor.node->key, true)) == NULL) {
+				otherBytes += strlen(cursor.node->key) + 1;
+			} else if(slot->offset == VDF_INTERN_NEW) {
+				slot->offset = (UINT)internBytes;
+				internBytes += strlen(cursor.node->key) + 1;
+			}
+		}
+		if(cursor.node->value)
+			otherBytes += strlen(cursor.node->value) + 1;
+	}
+
+	block = new VDFNodeBlock;
+	block->size = count * sizeof(VDFNode) + internBytes + otherBytes;
+	block->data = new char[block->size];
+	block->liveNodes = count;
+	AddBlock(block);
+
+	nodes = reinterpret_cast<VDFNode*>(block->data);
+
+	// interned keys are stored first, then the other strings
+	strings = block->data + count * sizeof(VDFNode);
+
+	for(ind = 0; ind < tableSize; ind++) {
+		if(table[ind].key != NULL)
+			strcpy(strings + table[ind].offset, table[ind].key);
+	}
+
+	otherBytes = internBytes;
+	node = nodes;
+	last = NULL;
+	lastDepth = 0;
+
+	for(cursor.Start(source, !siblings); cursor.node; cursor.Next(), node++) {
+		*node = VDFNode();
+		node->flags = VDF_NODE_BLOCK | (cursor.node->flags & keepFlags);
+
+		if(cursor.node->key) {
+			node->flags |= VDF_NODE_BLOCK_KEY;
+			if((slot = InternKey(table, tableSize, used, cursor.node->key, false)) != NULL) {
+				node->key = strings + slot->offset;
+			} else {
+				len = strlen(cursor.node->key) + 1;
+				node->key = strings + otherBytes;
+				memcpy(node->key, cursor.node->key, len);
+				otherBytes += len;
+			}
+		}
+		if(cursor.node->value) {
+			node->flags |= VDF_NODE_BLOCK_VALUE;
+			len = strlen(cursor.node->value) + 1;
+			node->value = strings + otherBytes;
+			memcpy(node->value, cursor.node->value, len);
+			otherBytes += len;
+		}
+
+		if(last == NULL) {
+			// first node
+		} else if(cursor.depth > lastDepth) {
+			node->parentNode = last;
+			last->childNode = node;
+		} else {
+			while(lastDepth > cursor.depth) {
+				last = last->parentNode;
+				lastDepth--;
+			}
+			node->parentNode = last->parentNode;
+			node->previousNode = last;
+			last->nextNode = node;
+		}
+		last = node;
+		lastDepth = cursor.depth;
+	}
+
+	FinalizeArray(table);
+
+	return nodes;
+}
+
+/**
+ *	Copies the whole tree (see <code>CloneBranch</code>), with its directives.
+ *	Frozen trees must be converted first.
+ *
+ *	@return		The new tree.
+ */
+VDFTree *VDFTree::Clone()
+{
+	VDFTree *copy;
+
+	copy = new VDFTree;
+	copy->rootNode = copy->CloneBranch(rootNode, true, VDF_NODE_INCLUDED);
+
+	if(copy->rootNode == NULL)
+		copy->CreateTree();
+
+	if(directives) {
+		copy->directives = new char[strlen(directives) + 1];
+		strcpy(copy->directives, directives);
+	}
+
+	return copy;
+}
+
+/**
+ *	Copies the part of the tree a traverse from root hasn't reached yet:
+ *	a node, the rest of its branch and the following siblings of its
+ *	ancestors. Ancestors themselves are copied as stubs (without key pair),
+ *	so a cursor climbs from the copied node as it would in the tree.
+ *	Frozen trees must be converted first.
+ *
+ *	@param	from	Next node of the traverse, NULL copies the whole tree.
+ *	@param	copied	Receives the copy of from node.
+ *	@return			The new tree.
+ */
+VDFTree *VDFTree::CloneRemainder(VDFNode *from, VDFNode **copied)
+{
+	VDFTree *copy;
+	VDFNode *branch;
+	VDFNode *stub;
+	VDFNode *node;
+
+	if(from == NULL) {
+		copy = Clone();
+		*copied = copy->rootNode;
+		return copy;
+	}
+
+	copy = new VDFTree;
+	branch = copy->CloneBranch(from, true, VDF_NODE_INCLUDED);
+	*copied = branch;
+
+	// each level is linked under a stub of its parent, up to root level
+	for(; from->parentNode; from = from->parentNode) {
+		stub = new VDFNode;
+		stub->childNode = branch;
+		for(node = branch; node; node = node->nextNode)
+			node->parentNode = stub;
+
+		if(from->parentNode->nextNode) {
+			stub->nextNode = copy->CloneBranch(from->parentNode->nextNode, true, VDF_NODE_INCLUDED);
+			stub->nextNode->previousNode = stub;
+		}
+		branch = stub;
+	}
+
+	copy->rootNode = branch;
+
+	return copy;
+}
+
+/**
+ *	Takes the content of another tree, current nodes are freed (running
+ *	snapshots get their copy first). Source tree is left empty.
+ *
+ *	@param	source	Tree to take nodes from.
+ */
+void VDFTree::Replace(VDFTree *source)
+{
+	if(source == NULL || source == this)
+		return;
+
+	DestroyTree();
+	FinalizeArray(nodeIndex);
+
+	rootNode = source->rootNode;
+	nodeCount = source->nodeCount;
+	nodeIndex = source->nodeIndex;
+	image = source->image;
+	lazy = source->lazy;
+	if(lazy != NULL)
+		lazy->tree = this;
+	FinalizeArray(directives);
+	directives = source->directives;
+	thawedNodes = source->thawedNodes;
+	deleteHead = source->deleteHead;
+	deleteTail = source->deleteTail;
+	deleteCursor = source->deleteCursor;
+
+	source->rootNode = NULL;
+	source->nodeCount = 0;
+	source->nodeIndex = NULL;
+	source->image = NULL;
+	source->lazy = NULL;
+	source->directives = NULL;
+	source->thawedNodes = NULL;
+	source->deleteHead = NULL;
+	source->deleteTail = NULL;
+	source->deleteCursor = NULL;
+}
+
+/**
+ *	Gives pending snapshots their own copy of the tree, as it's about
+ *	to change. Only the part their readers haven't reached is copied.
+ *	It must be called on main thread before any change while snapshots
+ *	are pending (frozen trees must be converted first). Readers holding
+ *	a snapshot lock are waited for.
+ */
+void VDFTree::DetachSnapshots()
+{
+	VDFSnapshot *snapshot;
+
+	while((snapshot = snapshots) != NULL) {
+		snapshots = snapshot->next;
+		snapshot->next = NULL;
+		pendingSnapshots--;
+
+		snapshot->Lock();
+		snapshot->source = NULL;
+		if(!snapshot->finished)
+			snapshot->copy = CloneRemainder(snapshot->keepNode, &snapshot->copiedNode);
+		snapshot->keepNode = NULL;
+		snapshot->Unlock();
+	}
+}
+
+/**
+ *	Adds a bulk copy block to the block list, which is kept sorted by
+ *	address so the block of a node can be searched.
+ *
+ *	@param	block	New block.
+ */
+void VDFTree::AddBlock(VDFNodeBlock *block)
+{
+	size_t ind;
+
+	EnsureArraySize(blocks, blockSize, blockCount + 1);
+
+	ind = FindBlock(block->data);
+	ind = (ind == blockCount) ? 0 : ind + 1;
+
+	memmove(blocks + ind + 1, blocks + ind, (blockCount - ind) * sizeof(VDFNodeBlock*));
+	blocks[ind] = block;
+	blockCount++;
+}
+
+/**
+ *	Finds the last block starting at or before an address.
+ *
+ *	@param	address		Node address.
+ *	@return				Block position, or blockCount if there isn't any.
+ */
+size_t VDFTree::FindBlock(const void *address)
+{
+	size_t low;
+	size_t high;
+	size_t mid;
+
+	low = 0;
+	high = blockCount;
+
+	// first block starting after address
+	while(low < high) {
+		mid = (low + high) / 2;
+		if((const char*)address < blocks[mid]->data)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+
+	return low ? low - 1 : blockCount;
+}
+
+/**
+ *	Frees a node and its strings. Block nodes are counted off
+ *	their block, which is released with its last node.
+ *
+ *	@param	node	Node to be freed.
+ */
+void VDFTree::FreeNode(VDFNode *node)
+{
+	VDFNodeBlock	*block;
+	size_t			ind;
+
+	FreeString(node->key, (node->flags & VDF_NODE_BLOCK_KEY) != 0);
+	FreeString(node->value, (node->flags & VDF_NODE_BLOCK_VALUE) != 0);
+
+	if(!(node->flags & VDF_NODE_BLOCK)) {
+		delete node;
+		return;
+	}
+
+	if((ind = FindBlock(node)) == blockCount)
+		return;
+
+	block = blocks[ind];
+
+	if(--block->liveNodes)
+		return;
+
+	blockCount--;
+	memmove(blocks + ind, blocks + ind + 1, (blockCount - ind) * sizeof(VDFNodeBlock*));
+
+	FinalizeArray(block->data);
+	delete block;
+
+	if(!blockCount) {
+		FinalizeArray(blocks);
+		blockSize = 0;
+	}
+}
+
+/**
+ *	Frees a node string, unless it's stored in a bulk copy block.
+ *
+ *	@param	str			String to be freed, it's set to NULL.
+ *	@param	inBlock		If true, string is part of a block.
+ */
+void VDFTree::FreeString(char *&str, bool inBlock)
+{
+	if(inBlock)
+		str = NULL;
+	else
+		FinalizeArray(str);
+}
+
+/**
+ *	Loads a frozen image as tree content. Nodes aren't created,
+ *	they're read from the image until the tree is changed.
+ *
+ *	@param	filename	Image file.
+ *	@return				false if it isn't a valid image.
+ */
+bool VDFTree::LoadImage(const char *filename)
+{
+	DestroyTree();
+
+	image = new VDFImage;
+
+	if(!image->Load(filename)) {
+		Finalize(image);
+		return false;
+	}
+	return true;
+}
+
+/**
+ *	Checks if tree content is still stored in a frozen image.
+ *
+ *	@return		true if tree hasn't been converted.
+ */
+bool VDFTree::IsFrozen()
+{
+	return image != NULL && thawedNodes == NULL;
+}
+
+/**
+ *	Converts a frozen image into regular nodes (copy-on-write). The image
+ *	is kept, so handles of its nodes are still translated by GetThawedNode.
+ *	Lazy trees get all their branches read.
+ */
+void VDFTree::Thaw()
+{
+	if(lazy != NULL) {
+		lazy->LoadAll(this);
+		Finalize(lazy);
+	}
+
+	if(!IsFrozen())
+		return;
+
+	thawedNodes = new VDFNode*[image->GetNodeCount()];
+	image->Thaw(thawedNodes);
+	rootNode = thawedNodes[0];
+}
+
+/**
+ *	Reads the branch of a node of a lazy tree, if it hasn't been read yet.
+ *	Source is released once all branches are read.
+ *
+ *	@param	node	Node to be accessed.
+ */
+void VDFTree::LoadBranch(VDFNode *node)
+{
+	if(lazy == NULL || !lazy->LoadBranch(this, node))
+		return;
+
+	if(lazy->IsLoaded())
+		Finalize(lazy);
+}
+
+/**
+ *	Gets the regular node created from an image node.
+ *
+ *	@param	node	Node index in tree image.
+ *	@return			The node or NULL if tree hasn't been converted.
+ */
+VDFNode *VDFTree::GetThawedNode(UINT node)
+{
+	if(thawedNodes == NULL || image == NULL || node >= image->GetNodeCount())
+		return NULL;
+
+	return thawedNodes[node];
+}
+
+/**
+ *	Adds up memory held by tree. Frozen trees are measured by their
+ *	image, regular ones are walked (it's linear in node count).
+ *
+ *	@param	usage	Receives byte counts (they're added to current values).
+ */
+void VDFTree::GetMemoryUsage(VDFMemoryUsage &usage)
+{
+	VDFNode	*node;
+	int		depth;
+
+	usage.nodeBytes += sizeof(VDFTree);
+
+	if(nodeIndex)
+		usage.indexBytes += nodeCount * sizeof(VDFNode*);
+
+	if(image) {
+		usage.imageBytes += sizeof(VDFImage) + image->size;
+		if(thawedNodes)
+			usage.indexBytes += image->GetNodeCount() * sizeof(VDFNode*);
+	}
+
+	if(lazy)
+		lazy->GetMemoryUsage(usage);
+
+	if(IsFrozen()) {
+		usage.nodeCount += image->GetNodeCount();
+		return;
+	}
+
+	depth = 0;
+
+	for(node = rootNode; node; node = GetNextTraverseStep(node, depth)) {
+		usage.nodeCount++;
+		usage.nodeBytes += sizeof(VDFNode);
+		if(node->key)
+			usage.stringBytes += strlen(node->key) + 1;
+		if(node->value)
+			usage.stringBytes += strlen(node->value) + 1;
+	}
+}
+
+
+// --- VDFSnapshot class implementation ---
+
+VDFSnapshot::VDFSnapshot()
+{
+	source = NULL;
+	copy = NULL;
+	next = NULL;
+	keepNode = NULL;
+	copiedNode = NULL;
+	finished = false;
+
+#if !defined _WIN32
+	pthread_mutex_init(&mutex, NULL);
+#endif
+}
+
+VDFSnapshot::~VDFSnapshot()
+{
+	Release();
+
+#if !defined _WIN32
+	pthread_mutex_destroy(&mutex);
+#endif
+}
+
+/**
+ *	Takes a snapshot of a tree, a former one is released.
+ *
+ *	@param	tree	Tree to be kept, it must not be frozen.
+ */
+void VDFSnapshot::Take(VDFTree *tree)
+{
+	Release();
+
+	if(tree == NULL)
+		return;
+
+	source = tree;
+	finished = false;
+	next = tree->snapshots;
+	tree->snapshots = this;
+	VDFTree::pendingSnapshots++;
+}
+
+/**
+ *	Releases the snapshot, its copy is freed. Readers on other threads
+ *	must be over.
+ */
+void VDFSnapshot::Release()
+{
+	VDFSnapshot **link;
+
+	if(source) {
+		for(link = &source->snapshots; *link; link = &(*link)->next) {
+			if(*link == this) {
+				*link = next;
+				VDFTree::pendingSnapshots--;
+				break;
+			}
+		}
+		source = NULL;
+		next = NULL;
+	}
+
+	keepNode = NULL;
+	copiedNode = NULL;
+	finished = false;
+	Finalize(copy);
+}
+
+/**
+ *	Sets where readers are: nodes they've gone past aren't needed anymore,
+ *	so they aren't copied when the tree changes.
+ *
+ *	@param	node	Next node readers will get in a traverse from root
+ *					(NULL keeps the whole tree).
+ */
+void VDFSnapshot::Keep(VDFNode *node)
+{
+	if(source)
+		keepNode = node;
+}
+
+/**
+ *	Marks readers as done, so tree changes don't copy anything
+ *	until the snapshot is released.
+ */
+void VDFSnapshot::Finish()
+{
+	finished = true;
+	keepNode = NULL;
+}
+
+/**
+ *	Locks the snapshot against copies, for readers on other threads.
+ */
+void VDFSnapshot::Lock()
+{
+#if !defined _WIN32
+	pthread_mutex_lock(&mutex);
+#endif
+}
+
+void VDFSnapshot::Unlock()
+{
+#if !defined _WIN32
+	pthread_mutex_unlock(&mutex);
+#endif
+}
+
+/**
+ *	Gets the first root level node of the snapshot. Once it's got a copy,
+ *	nodes before the kept one are stubs (see <code>Keep</code>).
+ *
+ *	@return		The node or NULL if there's no snapshot.
+ */
+VDFNode *VDFSnapshot::GetRootNode()
+{
+	if(copy)
+		return copy->rootNode;
+
+	return source ? source->rootNode : NULL;
+}
+
+/**
+ *	Gets the copy of the kept node, where readers go on once the
+ *	snapshot has got its copy.
+ *
+ *	@return		The copied node or NULL if snapshot hasn't got a copy.
+ */
+VDFNode *VDFSnapshot::GetCopiedNode()
+{
+	return copy ? copiedNode : NULL;
+}
+
+
+// --- VDFCursor class implementation ---
+
+VDFCursor::VDFCursor()
+{
+	node = NULL;
+	depth = 0;
+	stack = NULL;
+	stackSize = 0;
+	single = false;
+}
+
+VDFCursor::~VDFCursor()
+{
+	FinalizeArray(stack);
+}
+
+/**
+ *	Places cursor at traverse origin.
+ *	@param	origin	First node of traverse.
+ *	@param	single	If true, only origin and its descendants are visited.
+ */
+void VDFCursor::Start(VDFNode *origin, bool single)
+{
+	node = origin;
+	depth = 0;
+	this->single = single;
+}
+
+/**
+ *	Places cursor at a node of a running traverse, ancestors are taken
+ *	from parent links. Traverse options are kept.
+ *	@param	position	Node to continue from.
+ *	@param	depth		Node depth relative to the origin.
+ */
+void VDFCursor::Resume(VDFNode *position, int depth)
+{
+	VDFNode *parent;
+	int level;
+
+	node = position;
+	this->depth = depth;
+
+	if(depth > 0)
+		EnsureArraySize(stack, stackSize, (size_t)depth);
+
+	for(level = depth - 1, parent = position; level >= 0; level--) {
+		parent = parent->parentNode;
+		stack[level] = parent;
+	}
+}
+
+/**
+ *	Moves to next node in traverse; <code>depth</code> is updated
+ *	relative to the origin.
+ *	@param	skipChildren	If true, current node's children aren't visited.
+ *	@return					Next node or NULL when traverse is over.
+ */
+VDFNode *VDFCursor::Next(bool skipChildren)
+{
+	if(node == NULL)
+		return NULL;
+
+	if(!skipChildren && node->childNode) {
+		EnsureArraySize(stack, stackSize, (size_t)depth + 1);
+		stack[depth++] = node;
+		node = node->childNode;
+		return node;
+	}
+
+	while(node->nextNode == NULL || (single && depth == 0)) {
+		if(depth == 0) {
+			node = NULL;
+			return NULL;
+		}
+		node = stack[--depth];
+	}
+
+	node = node->nextNode;
+
+	return node;
+}
+
+/**
+ *	Gets an ancestor of current node.
+ *	@param	level	Ancestor depth, from 0 (origin level) to depth - 1.
+ *	@return			Ancestor node or NULL if level is out of range.
+ */
+VDFNode *VDFCursor::GetAncestor(int level)
+{
+	if(level < 0 || level >= depth)
+		return NULL;
+
+	return stack[level];
+}
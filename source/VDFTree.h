@@ -1,71 +1,248 @@
-#ifndef __VDFTREE_H__
-#define __VDFTREE_H__
-
-#include "common.h"
-
-enum
-{
-	VDF_MOVEPOS_AFTER = 0,
-	VDF_MOVEPOS_BEFORE,
-};
-
-/**
- *  Simple node structure
- */
-struct VDFNode
-{
-	VDFNode(): nextNode(NULL), childNode(NULL), parentNode(NULL), previousNode(NULL), key(NULL), value(NULL) {}
-	VDFNode						*nextNode;
-	VDFNode						*childNode;
-	VDFNode						*parentNode;
-	VDFNode						*previousNode;
-	char						*key;
-	char						*value;
-};
-
-/**
- *  VDF tree handling.
- */
-class VDFTree
-{
-public:	
-					VDFTree			     ();
-					~VDFTree		     ();
-	void			CreateTree		     ();
-	void			DestroyTree		     ();
-	size_t			GetLength		     ();
-	VDFNode			*CreateNode		     (VDFNode *parentNode = NULL);
-	VDFNode			*GetNodeById	     (UINT id);
-	void			DeleteNode		     (VDFNode *Node);
-	
-	static void		AppendNode		     (VDFNode *Node, VDFNode *newNode);
-	static void		AppendChild		     (VDFNode *Node, VDFNode *childNode);	
-	static void		SetKeyPair	         (VDFNode *Node, const char *key = NULL, const char *value = NULL);
-	void			SortBranchNodes	     (VDFNode *refNode, bool byKey = true, bool byNumber = false);
-	static VDFNode	*GetRootNode	     (VDFNode *Node);
-	static VDFNode	*GetLastNode	     (VDFNode *Node);
-	static VDFNode	*GetPreviousNode     (VDFNode *Node);
-	static VDFNode	*GetFirstNode        (VDFNode *Node);
-	static VDFNode	*GetNextNode         (VDFNode *Node);
-	static VDFNode  *GetNextTraverseStep (VDFNode *Node, int &depth);
-	static size_t	CountBranchNodes     (VDFNode *refNode);
-	static size_t	GetNodeLevel	     (VDFNode *Node);
-	void			MoveToBranch	     (VDFNode *anchorNode, VDFNode *moveNode, UINT position);
-	void			MoveAsChild		     (VDFNode *parentNode, VDFNode *moveNode);
-
-protected:
-	inline bool		IsTreeNode		   (VDFNode *node);
-
-public:
-	VDFNode		*rootNode;
-	size_t		nodeCount;
-	UINT		treeId;
-
-protected:
-	VDFNode					**nodeIndex;
-};
-
-
-
-
-#endif //__VDFPARSER_H__
+#ifndef __VDFTREE_H__
+#define __VDFTREE_H__
+
+#include "common.h"
+
+#if !defined _WIN32
+#include <pthread.h>
+#endif
+
+enum
+{
+	VDF_MOVEPOS_AFTER = 0,
+	VDF_MOVEPOS_BEFORE,
+};
+
+/** Merge policies for keys found in both trees */
+enum
+{
+	VDF_MERGE_OVERWRITE = 0,
+	VDF_MERGE_KEEP,
+	VDF_MERGE_APPEND
+};
+
+/** Node flags */
+enum
+{
+	/** node is stored in a bulk copy block */
+	VDF_NODE_BLOCK = 1 << 0,
+	/** key string is stored in a bulk copy block */
+	VDF_NODE_BLOCK_KEY = 1 << 1,
+	/** value string is stored in a bulk copy block */
+	VDF_NODE_BLOCK_VALUE = 1 << 2,
+	/** node read when its tree was opened in lazy mode, it's kept by tree source */
+	VDF_NODE_LAZY = 1 << 3,
+	/** branch added by an #include or #base directive, text saves write the directive instead */
+	VDF_NODE_INCLUDED = 1 << 4
+};
+
+/**
+ *  Simple node structure
+ */
+struct VDFNode
+{
+	VDFNode(): nextNode(NULL), childNode(NULL), parentNode(NULL), previousNode(NULL), key(NULL), value(NULL), flags(0) {}
+	VDFNode						*nextNode;
+	VDFNode						*childNode;
+	VDFNode						*parentNode;
+	VDFNode						*previousNode;
+	char						*key;
+	char						*value;
+	UINT						flags;
+};
+
+/**
+ *  Memory used by trees and searches, in bytes.
+ */
+struct VDFMemoryUsage
+{
+	VDFMemoryUsage(): nodeCount(0), nodeBytes(0), stringBytes(0), indexBytes(0), imageBytes(0), searchBytes(0) {}
+	size_t GetTotal() { return nodeBytes + stringBytes + indexBytes + imageBytes + searchBytes; }
+	size_t						nodeCount;
+	size_t						nodeBytes;
+	size_t						stringBytes;
+	size_t						indexBytes;
+	size_t						imageBytes;
+	size_t						searchBytes;
+};
+
+class VDFImage;
+class VDFTree;
+class VDFJournal;
+class VDFLazySource;
+
+/**
+ *  Nodes and strings of a bulk copy, allocated at once.
+ *  The block is released when its last node is freed.
+ */
+struct VDFNodeBlock
+{
+	char						*data;
+	size_t						size;
+	/** nodes that haven't been freed yet */
+	size_t						liveNodes;
+};
+
+/**
+ *  Preorder traverse cursor. Ancestors are kept in an explicit stack,
+ *  so walking and climbing don't depend on tree depth or the C stack.
+ *  The origin's following siblings are part of the walk (level 0),
+ *  unless it's started on a single branch.
+ */
+class VDFCursor
+{
+public:
+					VDFCursor	();
+					~VDFCursor	();
+	void			Start		(VDFNode *origin, bool single = false);
+	void			Resume		(VDFNode *position, int depth);
+	VDFNode			*Next		(bool skipChildren = false);
+	VDFNode			*GetAncestor(int level);
+
+	VDFNode			*node;
+	int				depth;
+
+protected:
+	VDFNode			**stack;
+	size_t			stackSize;
+	bool			single;
+};
+
+/**
+ *  Read-only view of a tree as it was when it's been taken, for readers
+ *  walking it in traverse order (e.g. save jobs). Taking it is O(1): nodes
+ *  are shared until the tree is about to change, then the snapshot gets its
+ *  own copy of the part readers haven't reached yet (see <code>Keep</code>
+ *  and <code>VDFTree::DetachSnapshots</code>).
+ *  Taking and releasing it, like changing the tree, is done on the main
+ *  thread. A reader may walk it on a worker thread as long as it holds the
+ *  snapshot lock while it reads nodes and calls <code>Keep</code>: the copy
+ *  is made under that lock, so shared nodes aren't changed while they're
+ *  read, and readers go on in the copy once it's there.
+ */
+class VDFSnapshot
+{
+public:
+					VDFSnapshot		();
+					~VDFSnapshot	();
+	void			Take			(VDFTree *tree);
+	void			Release			();
+	void			Keep			(VDFNode *node);
+	void			Finish			();
+	void			Lock			();
+	void			Unlock			();
+	VDFNode			*GetRootNode	();
+	VDFNode			*GetCopiedNode	();
+
+	/** tree while nodes are shared, NULL once it's got a copy */
+	VDFTree			*source;
+	VDFTree			*copy;
+	VDFSnapshot		*next;
+
+protected:
+	/** first node readers still need, NULL for the whole tree */
+	VDFNode			*keepNode;
+	/** copy of keepNode */
+	VDFNode			*copiedNode;
+	/** readers are done, tree changes don't need a copy */
+	bool			finished;
+
+#if !defined _WIN32
+	pthread_mutex_t	mutex;
+#endif
+
+	friend class VDFTree;
+};
+
+/**
+ *  VDF tree handling.
+ */
+class VDFTree
+{
+public:	
+					VDFTree			     ();
+					~VDFTree		     ();
+	void			CreateTree		     ();
+	void			DestroyTree		     ();
+	size_t			GetLength		     ();
+	VDFNode			*CreateNode		     (VDFNode *parentNode = NULL);
+	VDFNode			*GetNodeById	     (UINT id);
+	void			DeleteNode		     (VDFNode *Node);
+	void			DeleteNodeDeferred   (VDFNode *Node);
+	bool			ProcessDeletes	     (size_t budget);
+	
+	static void		AppendNode		     (VDFNode *Node, VDFNode *newNode);
+	static void		AppendChild		     (VDFNode *Node, VDFNode *childNode);	
+	static void		SetKeyPair	         (VDFNode *Node, const char *key = NULL, const char *value = NULL);
+	static VDFNode	*CopyBranch		     (VDFNode *source);
+	static void		MergeBranch		     (VDFNode *dst, VDFNode *src, int policy, UINT copyFlags = 0);
+	void			MergeTree		     (VDFTree *source, int policy);
+	VDFNode			*CloneBranch	     (VDFNode *source, bool siblings = false, UINT keepFlags = 0);
+	VDFTree			*Clone			     ();
+	VDFTree			*CloneRemainder	     (VDFNode *from, VDFNode **copied);
+	void			Replace			     (VDFTree *source);
+	void			DetachSnapshots	     ();
+	void			SortBranchNodes	     (VDFNode *refNode, bool byKey = true, bool byNumber = false);
+	static VDFNode	*GetRootNode	     (VDFNode *Node);
+	static VDFNode	*GetLastNode	     (VDFNode *Node);
+	static VDFNode	*GetPreviousNode     (VDFNode *Node);
+	static VDFNode	*GetFirstNode        (VDFNode *Node);
+	static VDFNode	*GetNextNode         (VDFNode *Node);
+	static VDFNode  *GetNextTraverseStep (VDFNode *Node, int &depth);
+	static size_t	CountBranchNodes     (VDFNode *refNode);
+	static size_t	GetNodeLevel	     (VDFNode *Node);
+	void			MoveToBranch	     (VDFNode *anchorNode, VDFNode *moveNode, UINT position);
+	void			MoveAsChild		     (VDFNode *parentNode, VDFNode *moveNode);
+	bool			LoadImage		     (const char *filename);
+	bool			IsFrozen		     ();
+	void			Thaw			     ();
+	void			LoadBranch		     (VDFNode *node);
+	VDFNode			*GetThawedNode	     (UINT node);
+	void			GetMemoryUsage	     (VDFMemoryUsage &usage);
+
+protected:
+	inline bool		IsTreeNode		   (VDFNode *node);
+	VDFNode			*DetachBranch	   (VDFNode *Node, VDFNode **last);
+	size_t			FreeNodes		   (VDFNode *&head, VDFNode *&cursor, size_t budget);
+	static void		FreeNode		   (VDFNode *node);
+	static void		FreeString		   (char *&str, bool inBlock);
+	static void		AddBlock		   (VDFNodeBlock *block);
+	static size_t	FindBlock		   (const void *address);
+
+public:
+	VDFNode		*rootNode;
+	size_t		nodeCount;
+	UINT		treeId;
+	VDFImage	*image;
+	/** source of branches that haven't been read (lazy trees) */
+	VDFLazySource	*lazy;
+	/** change journal, it's owned by collection */
+	VDFJournal	*journal;
+	/** #include and #base lines read before root key, text saves write them back */
+	char		*directives;
+
+protected:
+	VDFNode					**nodeIndex;
+	VDFNode					**thawedNodes;
+
+	/** detached branches waiting to be freed, oldest first */
+	VDFNode					*deleteHead;
+	VDFNode					*deleteTail;
+	VDFNode					*deleteCursor;
+
+	/** bulk copy blocks of all trees, sorted by address */
+	static VDFNodeBlock		**blocks;
+	static size_t			blockCount;
+	static size_t			blockSize;
+
+public:
+	/** snapshots sharing tree nodes; list and counter are changed on main
+		thread only, readers on other threads just lock their snapshot */
+	VDFSnapshot				*snapshots;
+	static size_t			pendingSnapshots;
+};
+
+
+
+
+#endif //__VDFPARSER_H__
@@ -0,0 +1,667 @@
+/*
+*
+*  This program is free software; you can redistribute it and/or modify it
+*  under the terms of the GNU General Public License as published by the
+*  Free Software Foundation; either version 2 of the License, or (at
+*  your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful, but
+*  WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*  General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software Foundation,
+*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**  
+ *	@author		commonbullet
+ *	@version	1.07
+ */
+
+#include <string.h>
+
+#if !defined _WIN32
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#include "VDFWatch.h"
+#include "VDFImage.h"
+
+
+// --- VDFWatchLogger implementation ---
+
+VDFWatchLogger::VDFWatchLogger()
+{
+	errors = NULL;
+	errorCount = 0;
+	errorSize = 0;
+}
+
+VDFWatchLogger::~VDFWatchLogger()
+{
+	Clear();
+}
+
+/**
+ *	Keeps an error to be logged later.
+ */
+void VDFWatchLogger::printError(const char *filename, const char *message, int line, int charpos)
+{
+	VDFWatchError *error;
+
+	if(errorCount >= VDF_WATCH_MAX_ERRORS)
+		return;
+
+	EnsureArraySize(errors, errorSize, errorCount + 1);
+	error = &errors[errorCount++];
+
+	error->filename = new char[strlen(filename ? filename : "") + 1];
+	strcpy(error->filename, filename ? filename : "");
+	error->message = new char[strlen(message ? message : "") + 1];
+	strcpy(error->message, message ? message : "");
+	error->line = line;
+	error->charpos = charpos;
+}
+
+/**
+ *	Moves errors kept by another logger to this one.
+ *
+ *	@param	source		Logger whose errors are moved, it's left empty.
+ */
+void VDFWatchLogger::Take(VDFWatchLogger &source)
+{
+	size_t i;
+
+	for(i = 0; i < source.errorCount; i++) {
+		if(errorCount < VDF_WATCH_MAX_ERRORS) {
+			EnsureArraySize(errors, errorSize, errorCount + 1);
+			errors[errorCount++] = source.errors[i];
+		}
+		else {
+			FinalizeArray(source.errors[i].filename);
+			FinalizeArray(source.errors[i].message);
+		}
+	}
+
+	source.errorCount = 0;
+}
+
+/**
+ *	Logs kept errors and removes them.
+ *
+ *	@param	logger		Logger they're passed to.
+ */
+void VDFWatchLogger::Flush(IErrorLogger *logger)
+{
+	size_t i;
+
+	for(i = 0; logger && i < errorCount; i++)
+		logger->printError(errors[i].filename, errors[i].message, errors[i].line, errors[i].charpos);
+
+	Clear();
+}
+
+/**
+ *	Removes kept errors.
+ */
+void VDFWatchLogger::Clear()
+{
+	while(errorCount) {
+		errorCount--;
+		FinalizeArray(errors[errorCount].filename);
+		FinalizeArray(errors[errorCount].message);
+	}
+
+	FinalizeArray(errors);
+	errorSize = 0;
+}
+
+
+// --- VDFWatcher implementation ---
+
+VDFWatcher::VDFWatcher()
+{
+	entries = NULL;
+	lastId = 0;
+	garbage = NULL;
+	garbageCount = 0;
+	garbageSize = 0;
+
+#if !defined _WIN32
+	pthread_mutex_init(&mutex, NULL);
+	running = false;
+	notifyFd = -1;
+	wakeFds[0] = -1;
+	wakeFds[1] = -1;
+#endif
+}
+
+VDFWatcher::~VDFWatcher()
+{
+	Stop();
+	FinalizeArray(garbage);
+
+#if !defined _WIN32
+	pthread_mutex_destroy(&mutex);
+#endif
+}
+
+/**
+ *	Starts watching a tree file.
+ *
+ *	@param	tree		Tree read from that file.
+ *	@param	filename	Tree file.
+ *	@param	forward		Id handed back when tree is reloaded.
+ *	@return				false if tree is already watched or file can't be watched.
+ */
+bool VDFWatcher::Watch(VDFTree *tree, const char *filename, int forward)
+{
+	VDFWatchEntry	*entry;
+	const char		*name;
+#if !defined _WIN32
+	char			*directory;
+	size_t			len;
+#endif
+
+	if(tree == NULL || filename == NULL || FindEntry(tree) != NULL)
+		return false;
+
+	entry = new VDFWatchEntry;
+	entry->id = ++lastId;
+	entry->tree = tree;
+	entry->forward = forward;
+	entry->wd = -1;
+	entry->pendingTree = NULL;
+	entry->reparse = false;
+	entry->filename = new char[strlen(filename) + 1];
+	strcpy(entry->filename, filename);
+
+	for(name = entry->name = entry->filename; *name; name++) {
+		if(*name == '/' || *name == '\\')
+			entry->name = name + 1;
+	}
+
+	if(!VDFCache::GetSourceKey(filename, entry->key))
+		memset(&entry->key, 0, sizeof(VDFCacheKey));
+
+#if !defined _WIN32
+	if(!running && !StartThread()) {
+		FreeEntry(entry);
+		return false;
+	}
+
+	// editors often replace files, so their directory is watched
+	len = (size_t)(entry->name - entry->filename);
+	directory = new char[len + 2];
+	if(len) {
+		memcpy(directory, entry->filename, len);
+		directory[len] = 0;
+	}
+	else
+		strcpy(directory, ".");
+
+	entry->wd = inotify_add_watch(notifyFd, directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+	FinalizeArray(directory);
+
+	if(entry->wd < 0) {
+		FreeEntry(entry);
+		return false;
+	}
+#endif
+
+	Lock();
+	entry->next = entries;
+	entries = entry;
+	Unlock();
+
+	return true;
+}
+
+/**
+ *	Stops watching a tree file.
+ *
+ *	@param	tree	Watched tree.
+ *	@return			Forward id passed to <code>Watch</code>, -1 if tree isn't watched.
+ */
+int VDFWatcher::Unwatch(VDFTree *tree)
+{
+	VDFWatchEntry	**link;
+	VDFWatchEntry	*entry;
+	int				forward;
+#if !defined _WIN32
+	VDFWatchEntry	*other;
+#endif
+
+	Lock();
+	for(link = &entries; *link && (*link)->tree != tree; link = &(*link)->next);
+	if((entry = *link) != NULL)
+		*link = entry->next;
+	Unlock();
+
+	if(entry == NULL)
+		return -1;
+
+#if !defined _WIN32
+	// directory watch is shared by files in the same directory
+	for(other = entries; other && other->wd != entry->wd; other = other->next);
+	if(other == NULL)
+		inotify_rm_watch(notifyFd, entry->wd);
+#endif
+
+	forward = entry->forward;
+	FreeEntry(entry);
+
+	return forward;
+}
+
+/**
+ *	Tells that module has written a tree file, so it isn't reloaded
+ *	for that change.
+ *
+ *	@param	tree	Tree whose file has been written.
+ */
+void VDFWatcher::SetWritten(VDFTree *tree)
+{
+	VDFWatchEntry	*entry;
+
+	if((entry = FindEntry(tree)) == NULL)
+		return;
+
+	Lock();
+	if(!VDFCache::GetSourceKey(entry->filename, entry->key))
+		memset(&entry->key, 0, sizeof(VDFCacheKey));
+	Unlock();
+}
+
+/**
+ *	Sets reader settings for files read on watcher thread, it must be
+ *	called when main thread settings change.
+ *
+ *	@param	settings	Settings to be copied.
+ */
+void VDFWatcher::SetReaderSettings(const VDFReaderSettings &settings)
+{
+	Lock();
+	this->settings.Copy(settings);
+	Unlock();
+}
+
+/**
+ *	Replaces the next changed tree with the content of its file.
+ *	It must be called on main thread. Errors found while reading files
+ *	on watcher thread are logged here.
+ *
+ *	@param	resolver	Included files provider for trees read on main thread.
+ *	@param	logger		Error logger for trees read on main thread.
+ *	@return				Entry of the reloaded tree, or NULL if no watched
+ *						file has changed.
+ */
+VDFWatchEntry *VDFWatcher::NextReload(IIncludeResolver *resolver, IErrorLogger *logger)
+{
+	VDFWatchEntry	*entry;
+	VDFTree			*tree;
+	VDFCacheKey		key;
+	VDFWatchLogger	found;
+	bool			reparse;
+
+	EmptyGarbage();
+
+	Lock();
+	found.Take(errors);
+	Unlock();
+	found.Flush(logger);
+
+#if defined _WIN32
+	for(entry = entries; entry; entry = entry->next) {
+		if(VDFCache::GetSourceKey(entry->filename, key) && !IsSameFile(key, entry->key))
+			entry->reparse = true;
+	}
+#endif
+
+	for(;;) {
+		Lock();
+		for(entry = entries; entry && !entry->pendingTree && !entry->reparse; entry = entry->next);
+
+		if(entry == NULL) {
+			Unlock();
+			return NULL;
+		}
+
+		tree = entry->pendingTree;
+		key = entry->pendingKey;
+		reparse = entry->reparse;
+		entry->pendingTree = NULL;
+		entry->reparse = false;
+		Unlock();
+
+		if(reparse) {
+			Finalize(tree);
+			if(VDFCache::GetSourceKey(entry->filename, key))
+				tree = ReadTree(entry->filename, resolver, logger);
+		}
+
+		// file may have been written by module since it's been read
+		if(tree == NULL || IsSameFile(key, entry->key)) {
+			Finalize(tree);
+			continue;
+		}
+
+		entry->tree->Replace(tree);
+		entry->key = key;
+		delete tree;
+
+		return entry;
+	}
+}
+
+/**
+ *	Stops watcher thread and all watches.
+ */
+void VDFWatcher::Stop()
+{
+	VDFWatchEntry *entry;
+
+#if !defined _WIN32
+	ssize_t written;
+
+	// thread must be gone before anything is freed: if wake pipe can't
+	// be written, closing its write end wakes the thread too (POLLHUP)
+	if(running) {
+		while((written = write(wakeFds[1], "", 1)) < 0 && errno == EINTR);
+		if(written != 1) {
+			close(wakeFds[1]);
+			wakeFds[1] = -1;
+		}
+		pthread_join(thread, NULL);
+		running = false;
+		close(notifyFd);
+		close(wakeFds[0]);
+		if(wakeFds[1] >= 0)
+			close(wakeFds[1]);
+		notifyFd = -1;
+		wakeFds[0] = -1;
+		wakeFds[1] = -1;
+	}
+#endif
+
+	while((entry = entries) != NULL) {
+		entries = entry->next;
+		FreeEntry(entry);
+	}
+
+	EmptyGarbage();
+	errors.Clear();
+}
+
+/**
+ *	Finds the watch entry of a tree.
+ */
+VDFWatchEntry *VDFWatcher::FindEntry(VDFTree *tree)
+{
+	VDFWatchEntry *entry;
+
+	for(entry = entries; entry && entry->tree != tree; entry = entry->next);
+
+	return entry;
+}
+
+/**
+ *	Frees an entry that's no longer linked.
+ */
+void VDFWatcher::FreeEntry(VDFWatchEntry *entry)
+{
+	Finalize(entry->pendingTree);
+	FinalizeArray(entry->filename);
+	delete entry;
+}
+
+/**
+ *	Queues a tree to be freed on main thread, lock must be held.
+ */
+void VDFWatcher::Discard(VDFTree *tree)
+{
+	if(tree == NULL)
+		return;
+
+	EnsureArraySize(garbage, garbageSize, garbageCount + 1);
+	garbage[garbageCount++] = tree;
+}
+
+/**
+ *	Frees discarded trees, it must be called on main thread.
+ */
+void VDFWatcher::EmptyGarbage()
+{
+	Lock();
+	while(garbageCount)
+		Finalize(garbage[--garbageCount]);
+	Unlock();
+}
+
+/**
+ *	Compares two file stamps (size and modification time).
+ */
+bool VDFWatcher::IsSameFile(const VDFCacheKey &a, const VDFCacheKey &b)
+{
+	return a.size == b.size && a.sizeHigh == b.sizeHigh
+		&& a.mtime == b.mtime && a.mtimeHigh == b.mtimeHigh;
+}
+
+/**
+ *	Reads a tree file on main thread.
+ *
+ *	@param	filename	Tree file (text or binary format).
+ *	@param	resolver	Included files provider.
+ *	@param	logger		Error logger.
+ *	@return				The tree or NULL on fail.
+ */
+VDFTree *VDFWatcher::ReadTree(const char *filename, IIncludeResolver *resolver, IErrorLogger *logger)
+{
+	VDFTreeFile	parser(logger);
+	VDFTree		*tree;
+
+	tree = NULL;
+	parser.SetIncludeResolver(resolver);
+
+	if(VDFImage::IsImageVDF(filename)) {
+		tree = new VDFTree;
+		if(!tree->LoadImage(filename))
+			Finalize(tree);
+	}
+	else if(!parser.OpenVDF(filename, &tree))
+		return NULL;
+
+	return tree;
+}
+
+void VDFWatcher::Lock()
+{
+#if !defined _WIN32
+	pthread_mutex_lock(&mutex);
+#endif
+}
+
+void VDFWatcher::Unlock()
+{
+#if !defined _WIN32
+	pthread_mutex_unlock(&mutex);
+#endif
+}
+
+#if !defined _WIN32
+
+/**
+ *	Starts inotify and the thread that waits for its events.
+ *	@return		false if they can't be started.
+ */
+bool VDFWatcher::StartThread()
+{
+	if((notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+		return false;
+
+	if(pipe(wakeFds) != 0) {
+		close(notifyFd);
+		notifyFd = -1;
+		return false;
+	}
+
+	if(pthread_create(&thread, NULL, ThreadMain, this) != 0) {
+		close(notifyFd);
+		close(wakeFds[0]);
+		close(wakeFds[1]);
+		notifyFd = -1;
+		return false;
+	}
+
+	running = true;
+
+	return true;
+}
+
+void *VDFWatcher::ThreadMain(void *watcher)
+{
+	static_cast<VDFWatcher*>(watcher)->Run();
+	return NULL;
+}
+
+/**
+ *	Watcher thread: waits for inotify events, until <code>Stop</code>
+ *	writes into wake pipe, and reads changed files.
+ */
+void VDFWatcher::Run()
+{
+	struct inotify_event	*event;
+	struct pollfd			fds[2];
+	VDFWatchEntry			*entry;
+	UINT					*ids;
+	size_t					idsSize;
+	size_t					count;
+	size_t					i;
+	ssize_t					len;
+	ssize_t					pos;
+	char					buffer[VDF_WATCH_EVENT_BUFFER]
+								__attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+	ids = NULL;
+	idsSize = 0;
+
+	for(;;) {
+		fds[0].fd = notifyFd;
+		fds[0].events = POLLIN;
+		fds[1].fd = wakeFds[0];
+		fds[1].events = POLLIN;
+
+		if(poll(fds, 2, -1) < 0) {
+			if(errno == EINTR)
+				continue;
+			break;
+		}
+
+		if(fds[1].revents)
+			break;
+
+		// several events of a file (or a burst of writes) make one read
+		count = 0;
+		while((len = read(notifyFd, buffer, sizeof(buffer))) > 0) {
+			for(pos = 0; pos < len; pos += sizeof(struct inotify_event) + event->len) {
+				event = reinterpret_cast<struct inotify_event*>(buffer + pos);
+				if(event->len == 0)
+					continue;
+
+				Lock();
+				for(entry = entries; entry; entry = entry->next) {
+					if(entry->wd != event->wd || strcmp(entry->name, event->name))
+						continue;
+					for(i = 0; i < count && ids[i] != entry->id; i++);
+					if(i == count) {
+						EnsureArraySize(ids, idsSize, count + 1);
+						ids[count++] = entry->id;
+					}
+				}
+				Unlock();
+			}
+		}
+
+		ReadChanges(ids, count);
+	}
+
+	FinalizeArray(ids);
+}
+
+/**
+ *	Reads changed files on watcher thread. Entries are looked up by id,
+ *	as they may be removed meanwhile. Trees aren't freed here. Files are
+ *	read with a copy of main thread settings, and errors are kept until
+ *	main thread logs them.
+ *
+ *	@param	ids		Ids of changed entries.
+ *	@param	count	Number of ids.
+ */
+void VDFWatcher::ReadChanges(UINT *ids, size_t count)
+{
+	VDFWatchEntry		*entry;
+	VDFReaderSettings	readSettings;
+	VDFWatchLogger		found;
+	VDFTreeFile			parser(&found);
+	VDFTree				*tree;
+	VDFCacheKey			key;
+	char				*filename;
+	size_t				i;
+	bool				reparse;
+
+	for(i = 0; i < count; i++) {
+		Lock();
+		for(entry = entries; entry && entry->id != ids[i]; entry = entry->next);
+		if(entry == NULL) {
+			Unlock();
+			continue;
+		}
+		filename = new char[strlen(entry->filename) + 1];
+		strcpy(filename, entry->filename);
+		readSettings.Copy(settings);
+		Unlock();
+
+		parser.UseSettings(&readSettings);
+
+		tree = NULL;
+		reparse = false;
+
+		// images and included trees are handled on main thread
+		if(VDFCache::GetSourceKey(filename, key)) {
+			if(VDFImage::IsImageVDF(filename))
+				reparse = true;
+			else if(parser.OpenVDF(filename, &tree))
+				reparse = parser.HasDirectives();
+		}
+
+		FinalizeArray(filename);
+
+		Lock();
+		for(entry = entries; entry && entry->id != ids[i]; entry = entry->next);
+
+		// files read again on main thread log their errors there
+		if(reparse)
+			found.Clear();
+		else
+			errors.Take(found);
+
+		if(entry == NULL || reparse || tree == NULL || IsSameFile(key, entry->key)) {
+			if(entry && reparse)
+				entry->reparse = true;
+			Discard(tree);
+		}
+		else {
+			Discard(entry->pendingTree);
+			entry->pendingTree = tree;
+			entry->pendingKey = key;
+		}
+		Unlock();
+	}
+}
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef __VDFWATCH_H__
+#define __VDFWATCH_H__
+
+#include "VDFCache.h"
+
+#if !defined _WIN32
+#include <pthread.h>
+#endif
+
+/** inotify event buffer size */
+#define VDF_WATCH_EVENT_BUFFER	4096
+
+/** errors kept until main thread logs them, later ones are dropped */
+#define VDF_WATCH_MAX_ERRORS	64
+
+/**
+ *  Error found while reading a file on watcher thread.
+ */
+struct VDFWatchError
+{
+	char			*filename;
+	char			*message;
+	int				line;
+	int				charpos;
+};
+
+/**
+ *	Keeps errors found on watcher thread, module logger can only be
+ *	used on main thread (see <code>VDFWatcher::NextReload</code>).
+ */
+class VDFWatchLogger : public IErrorLogger
+{
+public:
+					VDFWatchLogger	();
+					~VDFWatchLogger	();
+	void			printError		(const char *filename, const char *message,
+									 int line = 0, int charpos = 0);
+	void			Take			(VDFWatchLogger &source);
+	void			Flush			(IErrorLogger *logger);
+	void			Clear			();
+
+protected:
+	VDFWatchError	*errors;
+	size_t			errorCount;
+	size_t			errorSize;
+};
+
+/**
+ *  Watched tree file.
+ */
+struct VDFWatchEntry
+{
+	UINT			id;
+	VDFTree			*tree;
+	char			*filename;
+	/** file name without its directory, as inotify reports it */
+	const char		*name;
+	int				forward;
+	int				wd;
+
+	/** file as it was last read or written by module */
+	VDFCacheKey		key;
+
+	/** tree read off-thread, waiting to replace current one */
+	VDFTree			*pendingTree;
+	VDFCacheKey		pendingKey;
+	/** file must be read on main thread (directives, or no watcher thread) */
+	bool			reparse;
+
+	VDFWatchEntry	*next;
+};
+
+/**
+ *	Reloads tree files when they're changed. On linux a thread waits for
+ *	inotify events and reads changed files, so main thread only swaps trees;
+ *	elsewhere files are checked (size and modification time) when reloads are
+ *	requested, and read on main thread. Files with #include or #base directives
+ *	are always read on main thread, as included trees are cached there.
+ */
+class VDFWatcher
+{
+public:
+					VDFWatcher		();
+					~VDFWatcher		();
+	bool			Watch			(VDFTree *tree, const char *filename, int forward);
+	int				Unwatch			(VDFTree *tree);
+	void			SetWritten		(VDFTree *tree);
+	VDFWatchEntry	*NextReload		(IIncludeResolver *resolver, IErrorLogger *logger);
+	void			Stop			();
+	bool			IsWatched		(VDFTree *tree) { return FindEntry(tree) != NULL; }
+	void			SetReaderSettings (const VDFReaderSettings &settings);
+
+protected:
+	VDFWatchEntry	*FindEntry		(VDFTree *tree);
+	void			FreeEntry		(VDFWatchEntry *entry);
+	void			Discard			(VDFTree *tree);
+	void			EmptyGarbage	();
+	static bool		IsSameFile		(const VDFCacheKey &a, const VDFCacheKey &b);
+	static VDFTree	*ReadTree		(const char *filename, IIncludeResolver *resolver,
+									 IErrorLogger *logger);
+	void			Lock			();
+	void			Unlock			();
+
+	VDFWatchEntry	*entries;
+	UINT			lastId;
+
+	/** trees to be freed on main thread */
+	VDFTree			**garbage;
+	size_t			garbageCount;
+	size_t			garbageSize;
+
+	/** copy of main thread reader settings, for files read on watcher thread */
+	VDFReaderSettings settings;
+
+	/** errors found on watcher thread, not logged yet */
+	VDFWatchLogger	errors;
+
+#if !defined _WIN32
+	bool			StartThread		();
+	void			Run				();
+	void			ReadChanges		(UINT *ids, size_t count);
+	static void		*ThreadMain		(void *watcher);
+
+	pthread_t		thread;
+	pthread_mutex_t	mutex;
+	bool			running;
+	int				notifyFd;
+	int				wakeFds[2];
+#endif
+};
+
+
+#endif //__VDFWATCH_H__
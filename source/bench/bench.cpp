@@ -0,0 +1,384 @@
+/*
+*
+*  This program is free software; you can redistribute it and/or modify it
+*  under the terms of the GNU General Public License as published by the
+*  Free Software Foundation; either version 2 of the License, or (at
+*  your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful, but
+*  WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*  General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software Foundation,
+*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**  
+ *	@author		commonbullet
+ *	@version	1.07
+ */
+
+/**
+ *	Module core benchmark (no SDK required). Synthetic files are generated
+ *	for each shape and size, then parse, open, search, sort, save, dump
+ *	(text output kept in memory) and teardown are timed. disk_write is plain
+ *	sequential writing of the same size, the upper bound for save. A tree
+ *	far deeper than saves indent, with root level siblings, is saved and read
+ *	back first; bench fails if any node is lost.
+ *	Results are printed as CSV:
+ *
+ *	<code>shape,size_mb,bytes,nodes,metric,value,unit</code>
+ *
+ *	usage: bench [workdir] [sizes_mb]		(e.g. bench /tmp 1,10,100)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../VDFParser.h"
+#include "../VDFSearch.h"
+
+#define BENCH_DEFAULT_DIR		"."
+#define BENCH_DEFAULT_SIZES		"1,10,100"
+#define BENCH_MB				(1024 * 1024)
+
+/** Every shape has "item" leaves, so searches always have matches */
+#define BENCH_SEARCH_KEY		"item"
+
+enum
+{
+	BENCH_WIDE = 0,
+	BENCH_DEEP,
+	BENCH_LONG,
+	BENCH_SHAPES
+};
+
+static const char *shapeNames[BENCH_SHAPES] = {"wide", "deep", "long"};
+
+/** Nesting of deep shape, kept below SaveVDF indentation limit */
+#define BENCH_DEEP_LEVELS		32
+
+/** Nesting of saved and reloaded tree, far beyond VDF_MAX_INDENT */
+#define BENCH_ROUNDTRIP_LEVELS	10000
+
+static void WriteTabs(FILE *pFile, int count)
+{
+	while(count-- > 0)
+		fputc('\t', pFile);
+}
+
+/**
+ *	Writes a synthetic vdf file.
+ *	@param	filename	Target file.
+ *	@param	shape		BENCH_WIDE: one huge flat branch with small groups,
+ *						BENCH_DEEP: chains of nested branches,
+ *						BENCH_LONG: long keys and values.
+ *	@param	size		Approximate file size in bytes.
+ *	@return				Bytes written, 0 on error.
+ */
+static long WriteSynthetic(const char *filename, int shape, long size)
+{
+	FILE	*pFile;
+	char	longKey[201];
+	char	longValue[481];
+	UINT	counter;
+	int		level;
+	long	written;
+
+	if((pFile = fopen(filename, "wb")) == NULL)
+		return 0;
+
+	memset(longKey, 'k', sizeof(longKey) - 1);
+	longKey[sizeof(longKey) - 1] = '\0';
+	memset(longValue, 'v', sizeof(longValue) - 1);
+	longValue[sizeof(longValue) - 1] = '\0';
+
+	fprintf(pFile, "\"%s\"\n{\n", shapeNames[shape]);
+
+	for(counter = 0; ftell(pFile) < size; counter++) {
+
+		switch(shape) {
+
+			case BENCH_WIDE:
+				if(counter % 64 == 0)
+					fprintf(pFile, "\t\"group%u\"\n\t{\n\t\t\"item\"\t\"%u\"\n\t\t\"name\"\t\"group %u\"\n\t}\n",
+						counter, counter, counter);
+				fprintf(pFile, "\t\"key%u\"\t\"value %u\"\n", counter, counter);
+				break;
+
+			case BENCH_DEEP:
+				for(level = 1; level <= BENCH_DEEP_LEVELS; level++) {
+					WriteTabs(pFile, level);
+					fprintf(pFile, "\"level%d\"\n", level);
+					WriteTabs(pFile, level);
+					fprintf(pFile, "{\n");
+					WriteTabs(pFile, level + 1);
+					fprintf(pFile, "\"item\"\t\"%u\"\n", counter);
+				}
+				for(level = BENCH_DEEP_LEVELS; level >= 1; level--) {
+					WriteTabs(pFile, level);
+					fprintf(pFile, "}\n");
+				}
+				break;
+
+			case BENCH_LONG:
+				if(counter % 32 == 0)
+					fprintf(pFile, "\t\"item\"\t\"%u\"\n", counter);
+				fprintf(pFile, "\t\"%s%u\"\t\"%s\"\n", longKey, counter, longValue);
+				break;
+		}
+	}
+
+	fprintf(pFile, "}\n");
+	written = ftell(pFile);
+	fclose(pFile);
+
+	return written;
+}
+
+static int nullParser(int fwid, const char *filename, const char *key, const char *value, int level)
+{
+	return RETURN_VDFPARSER_CONTINUE;
+}
+
+/**
+ *	Prints a result line.
+ */
+static void Report(int shape, long sizeMB, long bytes, size_t nodes, const char *metric,
+				   double value, const char *unit)
+{
+	printf("%s,%ld,%ld,%u,%s,%.3f,%s\n", shapeNames[shape], sizeMB, bytes, (UINT)nodes, metric, value, unit);
+	fflush(stdout);
+}
+
+static double Rate(long bytes, double elapsed)
+{
+	return elapsed > 0 ? ((double)bytes / BENCH_MB) / (elapsed / 1000000.0) : 0;
+}
+
+/**
+ *	Measures plain sequential writing, the upper bound for saving.
+ *	@return		Elapsed time in microseconds.
+ */
+static double DiskWriteTime(const char *filename, long bytes)
+{
+	FILE	*pFile;
+	char	*chunk;
+	long	left;
+	size_t	len;
+	double	start;
+
+	if((pFile = fopen(filename, "wb")) == NULL)
+		return 0;
+
+	chunk = new char[VDF_WRITER_FILE_SIZE];
+	memset(chunk, ' ', VDF_WRITER_FILE_SIZE);
+
+	start = GetMicroseconds();
+	for(left = bytes; left > 0; left -= (long)len) {
+		len = (left < VDF_WRITER_FILE_SIZE) ? (size_t)left : VDF_WRITER_FILE_SIZE;
+		fwrite(chunk, 1, len, pFile);
+	}
+	fclose(pFile);
+
+	delete [] chunk;
+
+	return GetMicroseconds() - start;
+}
+
+static size_t CountNodes(VDFTree *tree)
+{
+	VDFNode	*node;
+	size_t	count;
+	int		depth;
+
+	depth = 0;
+	count = 0;
+	for(node = tree->rootNode; node; node = VDFTree::GetNextTraverseStep(node, depth))
+		count++;
+
+	return count;
+}
+
+/**
+ *	Saves a very deep tree followed by root level siblings (one of them
+ *	without value) and reads it back.
+ *	@return		false if read tree hasn't got all nodes.
+ */
+static bool CheckRoundtrip(const char *workdir)
+{
+	char		filename[VDF_MAX_PATH];
+	VDFTreeFile	treeFile;
+	VDFTree		*tree;
+	VDFTree		*copy;
+	VDFNode		*node;
+	VDFNode		*child;
+	size_t		saved;
+	size_t		read;
+	int			level;
+
+	_snprintf(filename, sizeof(filename), "%s/bench_roundtrip.vdf", workdir);
+
+	tree = new VDFTree;
+	tree->CreateTree();
+	VDFTree::SetKeyPair(tree->rootNode, "deep");
+
+	for(node = tree->rootNode, level = 1; level <= BENCH_ROUNDTRIP_LEVELS; level++) {
+		if(level % 5 == 0) {
+			child = tree->CreateNode();
+			VDFTree::SetKeyPair(child, BENCH_SEARCH_KEY, "1");
+			VDFTree::AppendChild(node, child);
+		}
+		child = tree->CreateNode();
+		VDFTree::SetKeyPair(child, "level");
+		VDFTree::AppendChild(node, child);
+		node = child;
+	}
+
+	child = tree->CreateNode();
+	VDFTree::SetKeyPair(child, "a");
+	VDFTree::AppendNode(tree->rootNode, child);
+	child = tree->CreateNode();
+	VDFTree::SetKeyPair(child, "b", "2");
+	VDFTree::AppendNode(tree->rootNode, child);
+
+	copy = NULL;
+	saved = CountNodes(tree);
+	read = (treeFile.SaveVDF(filename, tree) && treeFile.OpenVDF(filename, &copy)) ? CountNodes(copy) : 0;
+
+	Report(BENCH_DEEP, 0, 0, saved, "roundtrip_nodes", (double)read, "nodes");
+
+	if(read != saved)
+		fprintf(stderr, "bench: %u of %u nodes read back from %s\n", (UINT)read, (UINT)saved, filename);
+
+	delete tree;
+	if(copy)
+		delete copy;
+	remove(filename);
+
+	return read == saved;
+}
+
+static void RunShape(const char *workdir, int shape, long sizeMB)
+{
+	char			filename[VDF_MAX_PATH];
+	char			saveName[VDF_MAX_PATH];
+	VDFEventReader	reader;
+	VDFTreeFile		treeFile;
+	ParseForward	parseFW;
+	VDFTree			*tree;
+	VDFSearch		search;
+	VDFNode			*node;
+	VDFMemoryUsage	usage;
+	VDFBuffer		dump;
+	char			searchKey[] = BENCH_SEARCH_KEY;
+	long			bytes;
+	double			start;
+	double			parseTime;
+	double			openTime;
+	double			elapsed;
+	size_t			matches;
+
+	_snprintf(filename, sizeof(filename), "%s/bench_%s_%ldmb.vdf", workdir, shapeNames[shape], sizeMB);
+	_snprintf(saveName, sizeof(saveName), "%s/bench_%s_%ldmb.out.vdf", workdir, shapeNames[shape], sizeMB);
+
+	if((bytes = WriteSynthetic(filename, shape, sizeMB * BENCH_MB)) == 0) {
+		fprintf(stderr, "bench: can't write %s\n", filename);
+		return;
+	}
+
+	// tokenizing only
+	memset(&parseFW, 0, sizeof(parseFW));
+	parseFW.pfnParser = nullParser;
+
+	start = GetMicroseconds();
+	reader.ParseVDF(filename, &parseFW);
+	parseTime = GetMicroseconds() - start;
+
+	// tokenizing and tree building
+	tree = NULL;
+	start = GetMicroseconds();
+	if(!treeFile.OpenVDF(filename, &tree) || tree == NULL) {
+		fprintf(stderr, "bench: can't open %s\n", filename);
+		remove(filename);
+		return;
+	}
+	openTime = GetMicroseconds() - start;
+
+	tree->GetMemoryUsage(usage);
+
+	Report(shape, sizeMB, bytes, usage.nodeCount, "parse", Rate(bytes, parseTime), "MB/s");
+	Report(shape, sizeMB, bytes, usage.nodeCount, "open", Rate(bytes, openTime), "MB/s");
+	Report(shape, sizeMB, bytes, usage.nodeCount, "build", (openTime > parseTime ? openTime - parseTime : 0) / 1000.0, "ms");
+	Report(shape, sizeMB, bytes, usage.nodeCount, "memory", (double)usage.GetTotal() / BENCH_MB, "MB");
+
+	search.SetSearch(tree, searchKey, VDF_MATCH_KEY);
+	matches = 0;
+	start = GetMicroseconds();
+	for(node = search.FindNextNode(NULL); node; node = search.FindNextNode(node))
+		matches++;
+	elapsed = GetMicroseconds() - start;
+	Report(shape, sizeMB, bytes, usage.nodeCount, "search", elapsed / 1000.0, "ms");
+	Report(shape, sizeMB, bytes, usage.nodeCount, "search_matches", (double)matches, "nodes");
+
+	start = GetMicroseconds();
+	if(tree->rootNode && tree->rootNode->childNode)
+		tree->SortBranchNodes(tree->rootNode->childNode);
+	elapsed = GetMicroseconds() - start;
+	Report(shape, sizeMB, bytes, usage.nodeCount, "sort", elapsed / 1000.0, "ms");
+
+	start = GetMicroseconds();
+	treeFile.SaveVDF(saveName, tree);
+	elapsed = GetMicroseconds() - start;
+	Report(shape, sizeMB, bytes, usage.nodeCount, "save", Rate(bytes, elapsed), "MB/s");
+
+	// formatting only, output kept in memory
+	dump.Reserve((size_t)bytes);
+	start = GetMicroseconds();
+	VDFTreeFile::DumpVDF(tree->rootNode, dump);
+	elapsed = GetMicroseconds() - start;
+	Report(shape, sizeMB, bytes, usage.nodeCount, "dump", Rate(bytes, elapsed), "MB/s");
+
+	elapsed = DiskWriteTime(saveName, bytes);
+	Report(shape, sizeMB, bytes, usage.nodeCount, "disk_write", Rate(bytes, elapsed), "MB/s");
+
+	start = GetMicroseconds();
+	delete tree;
+	elapsed = GetMicroseconds() - start;
+	Report(shape, sizeMB, bytes, usage.nodeCount, "teardown", elapsed / 1000.0, "ms");
+
+	remove(saveName);
+	remove(filename);
+}
+
+int main(int argc, char **argv)
+{
+	const char	*workdir;
+	const char	*sizes;
+	long		sizeMB;
+	int			shape;
+
+	workdir = (argc > 1) ? argv[1] : BENCH_DEFAULT_DIR;
+	sizes = (argc > 2) ? argv[2] : BENCH_DEFAULT_SIZES;
+
+	printf("shape,size_mb,bytes,nodes,metric,value,unit\n");
+
+	if(!CheckRoundtrip(workdir))
+		return 1;
+
+	while(*sizes) {
+		if((sizeMB = strtol(sizes, NULL, 10)) > 0) {
+			for(shape = 0; shape < BENCH_SHAPES; shape++)
+				RunShape(workdir, shape, sizeMB);
+		}
+		while(*sizes && *sizes != ',')
+			sizes++;
+		if(*sizes == ',')
+			sizes++;
+	}
+
+	return 0;
+}
@@ -0,0 +1,158 @@
+/*
+*
+*  This program is free software; you can redistribute it and/or modify it
+*  under the terms of the GNU General Public License as published by the
+*  Free Software Foundation; either version 2 of the License, or (at
+*  your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful, but
+*  WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*  General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software Foundation,
+*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**  
+ *	@author		commonbullet
+ *	@version	1.07
+ */
+
+/**
+ *	Node layout microbenchmark: full tree traversal over regular
+ *	(pointer) nodes against frozen image (index arrays) nodes.
+ *
+ *	usage: layout_bench [nodes] [fanout] [passes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../VDFTree.h"
+#include "../VDFImage.h"
+
+#define BENCH_DEFAULT_NODES		1000000
+#define BENCH_DEFAULT_FANOUT	8
+#define BENCH_DEFAULT_PASSES	10
+
+static size_t	created;
+static size_t	target;
+static size_t	fanout;
+
+/**
+ *	Creates a branch in document order, the same way parser does.
+ */
+static void AddChildren(VDFNode *node, int level, int maxLevel)
+{
+	VDFNode	*child;
+	VDFNode	*last;
+	char	key[32];
+	char	value[32];
+	size_t	i;
+
+	last = NULL;
+
+	for(i = 0; i < fanout && created < target; i++) {
+		child = new VDFNode;
+		_snprintf(key, sizeof(key), "key%u", (UINT)created);
+		_snprintf(value, sizeof(value), "value%u", (UINT)created);
+		VDFTree::SetKeyPair(child, key, (level < maxLevel) ? NULL : value);
+		created++;
+
+		child->parentNode = node;
+		if(last) {
+			last->nextNode = child;
+			child->previousNode = last;
+		}
+		else
+			node->childNode = child;
+		last = child;
+
+		if(level < maxLevel)
+			AddChildren(child, level + 1, maxLevel);
+	}
+}
+
+static double Seconds(clock_t start)
+{
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char **argv)
+{
+	VDFTree		tree;
+	VDFImage	image;
+	VDFNode		*node;
+	UINT		ind;
+	clock_t		start;
+	double		treeTime;
+	double		imageTime;
+	size_t		level;
+	size_t		passes;
+	size_t		pass;
+	size_t		visited;
+	UINT		sum;
+	int			depth;
+	int			maxLevel;
+
+	target = (argc > 1) ? strtoul(argv[1], NULL, 10) : BENCH_DEFAULT_NODES;
+	fanout = (argc > 2) ? strtoul(argv[2], NULL, 10) : BENCH_DEFAULT_FANOUT;
+	passes = (argc > 3) ? strtoul(argv[3], NULL, 10) : BENCH_DEFAULT_PASSES;
+
+	if(target < 2 || fanout < 2 || passes < 1) {
+		printf("usage: layout_bench [nodes] [fanout] [passes]\n");
+		return 1;
+	}
+
+	// smallest depth that holds all nodes
+	maxLevel = 0;
+	for(level = fanout; level < target; level = level * fanout + fanout)
+		maxLevel++;
+
+	tree.rootNode = new VDFNode;
+	VDFTree::SetKeyPair(tree.rootNode, "root");
+	created = 1;
+	AddChildren(tree.rootNode, 0, maxLevel);
+
+	image.Build(&tree);
+
+	sum = 0;
+	visited = 0;
+	start = clock();
+
+	for(pass = 0; pass < passes; pass++) {
+		depth = 0;
+		for(node = tree.rootNode; node; node = VDFTree::GetNextTraverseStep(node, depth)) {
+			sum += (UINT)node->key[0] + (UINT)depth;
+			visited++;
+		}
+	}
+
+	treeTime = Seconds(start);
+	start = clock();
+
+	for(pass = 0; pass < passes; pass++) {
+		depth = 0;
+		for(ind = image.GetRootNode(); ind != VDF_IMAGE_NONE; ind = image.GetNextTraverseStep(ind, depth)) {
+			sum -= (UINT)image.GetKey(ind)[0] + (UINT)depth;
+			visited--;
+		}
+	}
+
+	imageTime = Seconds(start);
+
+	// both traversals must visit the same nodes at the same depths
+	if(sum || visited) {
+		printf("layout mismatch\n");
+		return 1;
+	}
+
+	printf("nodes=%u fanout=%u passes=%u\n", (UINT)created, (UINT)fanout, (UINT)passes);
+	printf("tree  %.3f s %.2f ns/node\n", treeTime, treeTime * 1e9 / ((double)created * passes));
+	printf("image %.3f s %.2f ns/node\n", imageTime, imageTime * 1e9 / ((double)created * passes));
+
+	return 0;
+}
@@ -1,40 +1,324 @@
-/*
-*
-*  This program is free software; you can redistribute it and/or modify it
-*  under the terms of the GNU General Public License as published by the
-*  Free Software Foundation; either version 2 of the License, or (at
-*  your option) any later version.
-*
-*  This program is distributed in the hope that it will be useful, but
-*  WITHOUT ANY WARRANTY; without even the implied warranty of
-*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
-*  General Public License for more details.
-*
-*  You should have received a copy of the GNU General Public License
-*  along with this program; if not, write to the Free Software Foundation,
-*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
-*/
-
-/**  
- *	@author		commonbullet
- *	@version	1.07
- */
-
-#include <stdlib.h>
-#include <string.h>
-#include <ctype.h>
-
-#include "common.h"
-
-/**
- *	Converts a c string to lower case.
- *	@param	src		Source string.
- *	@param	dest	Target string.
- */
-void ToLowerCase(char *src, char *dest)
-{
-	while(*src)
-		*dest++ = tolower(*(src++));
-	(*dest) = '\0';
-}
-
+/*
+*
+*  This program is free software; you can redistribute it and/or modify it
+*  under the terms of the GNU General Public License as published by the
+*  Free Software Foundation; either version 2 of the License, or (at
+*  your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful, but
+*  WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*  General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software Foundation,
+*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**  
+ *	@author		commonbullet
+ *	@version	1.07
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#if defined _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "common.h"
+
+/**
+ *	Converts a c string to lower case.
+ *	@param	src		Source string.
+ *	@param	dest	Target string.
+ */
+void ToLowerCase(char *src, char *dest)
+{
+	while(*src)
+		*dest++ = tolower(*(src++));
+	(*dest) = '\0';
+}
+
+
+/**
+ *	Reads a 32 bit little endian unsigned integer.
+ *	@param	src		Source bytes (at least 4).
+ *	@return			The integer value.
+ */
+UINT ReadUInt(const unsigned char *src)
+{
+	return (UINT)src[0] | ((UINT)src[1] << 8) | ((UINT)src[2] << 16) | ((UINT)src[3] << 24);
+}
+
+/**
+ *	Hashes a block of memory (FNV-1a).
+ *	@param	data	Source bytes.
+ *	@param	len		Number of bytes.
+ *	@param	hash	Previous hash value, allows hashing in several steps.
+ *	@return			The hash value.
+ */
+UINT HashBytes(const void *data, size_t len, UINT hash)
+{
+	const unsigned char *src = (const unsigned char*)data;
+
+	while(len--) {
+		hash ^= *src++;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+
+// --- VDFBuffer implementation ---
+
+VDFBuffer::VDFBuffer()
+{
+	data = NULL;
+	length = 0;
+	capacity = 0;
+}
+
+VDFBuffer::~VDFBuffer()
+{
+	FinalizeArray(data);
+}
+
+/**
+ *	Makes sure there's room for a number of bytes after current length.
+ *	@param	len		Number of bytes to be appended.
+ */
+void VDFBuffer::Reserve(size_t len)
+{
+	char *cache;
+
+	if(length + len <= capacity)
+		return;
+
+	if(!capacity)
+		capacity = 256;
+
+	while(capacity < length + len)
+		capacity *= 2;
+
+	cache = data;
+	data = new char[capacity];
+
+	if(cache) {
+		memcpy(data, cache, length);
+		FinalizeArray(cache);
+	}
+}
+
+/**
+ *	Appends raw bytes.
+ *	@param	src		Source bytes.
+ *	@param	len		Number of bytes.
+ */
+void VDFBuffer::Append(const void *src, size_t len)
+{
+	Reserve(len);
+	memcpy(data + length, src, len);
+	length += len;
+}
+
+/**
+ *	Appends a single byte.
+ *	@param	byte	Byte to be appended.
+ */
+void VDFBuffer::AppendByte(unsigned char byte)
+{
+	Reserve(1);
+	data[length++] = (char)byte;
+}
+
+/**
+ *	Appends a 32 bit unsigned integer (little endian).
+ *	@param	value	Integer to be appended.
+ */
+void VDFBuffer::AppendUInt(UINT value)
+{
+	Reserve(4);
+	data[length++] = (char)(value & 0xFF);
+	data[length++] = (char)((value >> 8) & 0xFF);
+	data[length++] = (char)((value >> 16) & 0xFF);
+	data[length++] = (char)((value >> 24) & 0xFF);
+}
+
+/**
+ *	Empties the buffer, keeping allocated memory.
+ */
+void VDFBuffer::Reset()
+{
+	length = 0;
+}
+
+/**
+ *	Finds the first char that must be escaped in vdf text
+ *	(quote, backslash, line break or tab). Plain chars are skipped
+ *	8 at a time.
+ *	@param	src		Source string.
+ *	@param	len		String length.
+ *	@return			Position of first char to be escaped, len if there's none.
+ */
+size_t FindEscapeChar(const char *src, size_t len)
+{
+	VDFWORD	word;
+	size_t	pos;
+
+	for(pos = 0; pos + sizeof(word) <= len; pos += sizeof(word)) {
+		memcpy(&word, src + pos, sizeof(word));
+		if(VDF_SWAR_HASZERO(word ^ VDF_SWAR_BYTES('"')) | VDF_SWAR_HASZERO(word ^ VDF_SWAR_BYTES('\\'))
+			| VDF_SWAR_HASZERO(word ^ VDF_SWAR_BYTES('\n')) | VDF_SWAR_HASZERO(word ^ VDF_SWAR_BYTES('\t')))
+			break;
+	}
+
+	for(; pos < len; pos++) {
+		if(src[pos] == '"' || src[pos] == '\\' || src[pos] == '\n' || src[pos] == '\t')
+			break;
+	}
+
+	return pos;
+}
+
+// --- VDFWriter implementation ---
+
+VDFWriter::VDFWriter()
+{
+	data = NULL;
+	cursor = NULL;
+	end = NULL;
+	size = 0;
+	pFile = NULL;
+	output = NULL;
+	failed = false;
+}
+
+VDFWriter::~VDFWriter()
+{
+	FinalizeArray(data);
+}
+
+/**
+ *	Sets where output goes. Pending bytes are discarded.
+ *	@param	pFile	Target file, or NULL to write into output buffer.
+ *	@param	output	Target buffer, used when there's no file.
+ */
+void VDFWriter::SetTarget(FILE *pFile, VDFBuffer *output)
+{
+	size_t needed;
+
+	needed = pFile ? VDF_WRITER_FILE_SIZE : VDF_WRITER_MEMORY_SIZE;
+
+	if(size != needed) {
+		FinalizeArray(data);
+		data = new char[needed];
+		size = needed;
+	}
+
+	this->pFile = pFile;
+	this->output = output;
+	cursor = data;
+	end = data + size;
+	failed = false;
+}
+
+/**
+ *	Writes a string of bytes.
+ *	@param	src		Source bytes.
+ *	@param	len		Number of bytes.
+ */
+void VDFWriter::Write(const char *src, size_t len)
+{
+	size_t space;
+
+	while(len > (space = (size_t)(end - cursor))) {
+		memcpy(cursor, src, space);
+		cursor += space;
+		src += space;
+		len -= space;
+		Drain();
+	}
+
+	memcpy(cursor, src, len);
+	cursor += len;
+}
+
+/**
+ *	Writes a char repeatedly (e.g. indentation).
+ *	@param	c		Char to be written.
+ *	@param	count	Number of times.
+ */
+void VDFWriter::Fill(char c, size_t count)
+{
+	size_t space;
+
+	while(count > (space = (size_t)(end - cursor))) {
+		memset(cursor, c, space);
+		cursor += space;
+		count -= space;
+		Drain();
+	}
+
+	memset(cursor, c, count);
+	cursor += count;
+}
+
+/**
+ *	Hands pending bytes to target.
+ *	@return		false if any write has failed.
+ */
+bool VDFWriter::Flush()
+{
+	Drain();
+	return !failed;
+}
+
+/**
+ *	Empties the buffer into target.
+ */
+void VDFWriter::Drain()
+{
+	size_t len;
+
+	len = (size_t)(cursor - data);
+	cursor = data;
+
+	if(!len || failed)
+		return;
+
+	if(pFile)
+		failed = fwrite(data, 1, len, pFile) != len;
+	else if(output)
+		output->Append(data, len);
+}
+
+/**
+ *	Gets a monotonic time stamp, used to measure short intervals.
+ *	@return		Time in microseconds from an arbitrary origin.
+ */
+double GetMicroseconds()
+{
+#if defined _WIN32
+	static double	frequency = 0;
+	LARGE_INTEGER	counter;
+
+	if(frequency == 0) {
+		QueryPerformanceFrequency(&counter);
+		frequency = (double)counter.QuadPart / 1000000.0;
+	}
+	QueryPerformanceCounter(&counter);
+
+	return (double)counter.QuadPart / frequency;
+#else
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double)now.tv_sec * 1000000.0 + (double)now.tv_nsec / 1000.0;
+#endif
+}
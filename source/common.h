@@ -1,69 +1,180 @@
-#ifndef __VDFCOMMON_H__
-#define __VDFCOMMON_H__
-
-#include <stdio.h>
-#include <string.h>
-#include <stdlib.h>
-
-#define MAX_LINE_SIZE 1024
-#define MAX_OPEN_FORWARDS 8
-#define MAX_PARSE_FORWARDS 8
-
-typedef unsigned int UINT;
-
-/*
- *  Macro for vdf indentation
- */
-#define TABFILL(tabStr, tabNum)\
-	memset(tabStr, '\t', tabNum);\
-	tabStr[tabNum] = '\0';\
-
-
-template <typename T>
-void Finalize(T &pTarget)
-{
-	if(pTarget == NULL)
-		return;
-
-	delete (T*) pTarget;
-	pTarget = NULL;
-}
-
-template <typename T>
-void FinalizeArray(T &pTarget)
-{
-	if(pTarget == NULL)
-		return;
-
-	delete [] pTarget;
-	pTarget = NULL;
-}
-
-/**
- *	Adds a slot to a pointer array
- *	@param	target		target pointer Array
- *	@param	curLength	current size of pointer Array
- */
-template <typename T>
-void GrowPArray(T ***target, size_t &curLength)
-{
-	T **cache;
-
-	cache = *target;
-
-	*target = new T*[sizeof(T*) * curLength + 1];
-
-	if(curLength)
-	{
-		memcpy(*target, cache, curLength * sizeof(T*));
-		FinalizeArray(cache);
-	}
-
-	(*target)[curLength] = NULL;
-}
-
-
-void ToLowerCase(char *src, char *dest);
-
-
-#endif //__VDFCOMMON_H__
+#ifndef __VDFCOMMON_H__
+#define __VDFCOMMON_H__
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define MAX_LINE_SIZE 1024
+#define VDF_MAX_PATH 512
+#define MAX_OPEN_FORWARDS 8
+#define MAX_PARSE_FORWARDS 8
+
+/** FNV-1a hash seed */
+#define VDF_HASH_SEED 2166136261U
+
+typedef unsigned int UINT;
+
+/** 64 bit word, used to scan strings 8 bytes at a time */
+#if defined _MSC_VER
+typedef unsigned __int64 VDFWORD;
+#else
+typedef unsigned long long VDFWORD;
+#endif
+
+#define VDF_SWAR_ONES			((VDFWORD)0x0101010101010101ULL)
+#define VDF_SWAR_HIGHS			((VDFWORD)0x8080808080808080ULL)
+/** word with all bytes set to c */
+#define VDF_SWAR_BYTES(c)		(VDF_SWAR_ONES * (VDFWORD)(unsigned char)(c))
+/** non zero if any byte of v is zero */
+#define VDF_SWAR_HASZERO(v)		(((v) - VDF_SWAR_ONES) & ~(v) & VDF_SWAR_HIGHS)
+
+#if defined __GNUC__
+#define _snprintf snprintf
+#endif
+
+/*
+ *  Macro for vdf indentation
+ */
+#define TABFILL(tabStr, tabNum)\
+	memset(tabStr, '\t', tabNum);\
+	tabStr[tabNum] = '\0';\
+
+
+template <typename T>
+void Finalize(T &pTarget)
+{
+	if(pTarget == NULL)
+		return;
+
+	delete pTarget;
+	pTarget = NULL;
+}
+
+template <typename T>
+void FinalizeArray(T &pTarget)
+{
+	if(pTarget == NULL)
+		return;
+
+	delete [] pTarget;
+	pTarget = NULL;
+}
+
+/**
+ *	Adds a slot to a pointer array
+ *	@param	target		target pointer Array
+ *	@param	curLength	current size of pointer Array
+ */
+template <typename T>
+void GrowPArray(T ***target, size_t &curLength)
+{
+	T **cache;
+
+	cache = *target;
+
+	*target = new T*[sizeof(T*) * curLength + 1];
+
+	if(curLength)
+	{
+		memcpy(*target, cache, curLength * sizeof(T*));
+		FinalizeArray(cache);
+	}
+
+	(*target)[curLength] = NULL;
+}
+
+
+/**
+ *	Makes sure an array (of plain data) can hold a number of items,
+ *	keeping its contents.
+ *	@param	target		target Array
+ *	@param	capacity	current capacity, updated if array grows
+ *	@param	needed		required number of items
+ */
+template <typename T>
+void EnsureArraySize(T *&target, size_t &capacity, size_t needed)
+{
+	T		*cache;
+	size_t	oldCapacity;
+
+	if(needed <= capacity)
+		return;
+
+	cache = target;
+	oldCapacity = capacity;
+
+	if(!capacity)
+		capacity = 32;
+
+	while(capacity < needed)
+		capacity *= 2;
+
+	target = new T[capacity];
+
+	if(cache) {
+		memcpy(target, cache, oldCapacity * sizeof(T));
+		FinalizeArray(cache);
+	}
+}
+
+/**
+ *	Growable byte buffer, used by serializers.
+ */
+class VDFBuffer
+{
+public:
+				VDFBuffer		();
+				~VDFBuffer		();
+	void		Reserve			(size_t len);
+	void		Append			(const void *src, size_t len);
+	void		AppendByte		(unsigned char byte);
+	void		AppendUInt		(UINT value);
+	void		Reset			();
+
+	char		*data;
+	size_t		length;
+	size_t		capacity;
+};
+
+/** writer buffer sizes, output reaches its target in chunks of this size */
+#define VDF_WRITER_FILE_SIZE	262144
+#define VDF_WRITER_MEMORY_SIZE	4096
+
+/**
+ *	Output stage for text serializers. Bytes are gathered in a fixed
+ *	buffer and handed to a file, or to a growable buffer, once it's full.
+ */
+class VDFWriter
+{
+public:
+				VDFWriter		();
+				~VDFWriter		();
+	void		SetTarget		(FILE *pFile, VDFBuffer *output = NULL);
+	void		Write			(const char *src, size_t len);
+	void		Fill			(char c, size_t count);
+	bool		Flush			();
+	inline void	Put				(char c) { if(cursor == end) Drain(); *cursor++ = c; }
+
+	bool		failed;
+
+protected:
+	void		Drain			();
+
+	char		*data;
+	char		*cursor;
+	char		*end;
+	size_t		size;
+	FILE		*pFile;
+	VDFBuffer	*output;
+};
+
+
+void ToLowerCase(char *src, char *dest);
+UINT ReadUInt(const unsigned char *src);
+UINT HashBytes(const void *data, size_t len, UINT hash = VDF_HASH_SEED);
+double GetMicroseconds();
+size_t FindEscapeChar(const char *src, size_t len);
+
+
+#endif //__VDFCOMMON_H__
@@ -0,0 +1,343 @@
+/*
+*
+*  This program is free software; you can redistribute it and/or modify it
+*  under the terms of the GNU General Public License as published by the
+*  Free Software Foundation; either version 2 of the License, or (at
+*  your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful, but
+*  WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*  General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software Foundation,
+*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**  
+ *	@author		commonbullet
+ *	@version	1.07
+ */
+
+/**
+ *	Synthetic vdf corpus generator. Output only depends on parameters and
+ *	seed (it has its own random generator), so files can be rebuilt anywhere.
+ *
+ *	usage: vdfgen [options]
+ *
+ *	<li>-o file			output file (default stdout)</li>
+ *	<li>-seed n			random seed (default 1)</li>
+ *	<li>-nodes n		node count, root included (default 1000)</li>
+ *	<li>-depth n		maximum depth (default 8)</li>
+ *	<li>-branch r		chance of a node being a branch, 0..1 (default 0.3)</li>
+ *	<li>-fanout dist	children per branch (default 1-8)</li>
+ *	<li>-keylen dist	key length (default 4-16)</li>
+ *	<li>-valuelen dist	value length (default 1-32)</li>
+ *	<li>-comments r		chance of a comment line before a node (default 0)</li>
+ *	<li>-dupkeys r		chance of repeating previous sibling key (default 0)</li>
+ *	<li>-indent 0|1		tab indentation (default 1)</li>
+ *
+ *	Distributions are "n" (fixed), "a-b" (uniform) or "a-b:s" (skewed towards
+ *	a, a + (b - a) * u^s; s > 1 gives many small and a few large values).
+ *	Note that the reader truncates keys over 255 and values over 511 chars.
+ *
+ *	Examples:
+ *	<li>daily_maps.txt-like: vdfgen -nodes 200 -depth 2 -branch 0.1 -fanout 7 -valuelen 4-12</li>
+ *	<li>million nodes: vdfgen -nodes 1000000 -depth 6 -fanout 2-64:2 -comments 0.05</li>
+ *	<li>10k deep: vdfgen -nodes 20000 -depth 10000 -branch 1 -fanout 1 -indent 0</li>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../common.h"
+
+#define GEN_MAX_STRING		4096
+
+/**
+ *	Value distribution parsed from "n", "a-b" or "a-b:s".
+ */
+struct GenRange
+{
+	UINT	low;
+	UINT	high;
+	double	skew;
+};
+
+/**
+ *	Open branch in generation stack.
+ */
+struct GenLevel
+{
+	UINT	pending;
+	char	*lastKey;
+};
+
+static UINT randomState;
+
+/**
+ *	xorshift32, same sequence on every platform.
+ */
+static UINT NextRandom()
+{
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 17;
+	randomState ^= randomState << 5;
+	return randomState;
+}
+
+static double NextUnit()
+{
+	return (double)(NextRandom() >> 8) / (double)(1 << 24);
+}
+
+static bool Chance(double ratio)
+{
+	return ratio > 0 && NextUnit() < ratio;
+}
+
+/**
+ *	Draws a value from a distribution.
+ */
+static UINT Draw(const GenRange &range)
+{
+	double u;
+
+	if(range.high <= range.low)
+		return range.low;
+
+	u = NextUnit();
+	if(range.skew != 1.0)
+		u = pow(u, range.skew);
+
+	return range.low + (UINT)(u * (range.high - range.low + 1));
+}
+
+/**
+ *	Parses a distribution.
+ *	@param	spec	"n", "a-b" or "a-b:s".
+ *	@param	range	Receives the distribution.
+ *	@return			false on syntax error.
+ */
+static bool ParseRange(const char *spec, GenRange &range)
+{
+	char *end;
+
+	range.low = (UINT)strtoul(spec, &end, 10);
+	range.high = range.low;
+	range.skew = 1.0;
+
+	if(end == spec)
+		return false;
+
+	if(*end == '-') {
+		spec = end + 1;
+		range.high = (UINT)strtoul(spec, &end, 10);
+		if(end == spec || range.high < range.low)
+			return false;
+	}
+
+	if(*end == ':') {
+		spec = end + 1;
+		range.skew = strtod(spec, &end);
+		if(end == spec || range.skew <= 0)
+			return false;
+	}
+
+	return *end == '\0';
+}
+
+/**
+ *	Fills a random string.
+ *	@param	target	Buffer (GEN_MAX_STRING chars).
+ *	@param	len		String length.
+ *	@param	chars	Allowed characters.
+ */
+static void RandomString(char *target, UINT len, const char *chars)
+{
+	size_t count;
+	UINT i;
+
+	if(len >= GEN_MAX_STRING)
+		len = GEN_MAX_STRING - 1;
+
+	count = strlen(chars);
+
+	for(i = 0; i < len; i++)
+		target[i] = chars[NextRandom() % count];
+
+	target[len] = '\0';
+}
+
+static void WriteIndent(FILE *pFile, size_t depth, bool indent)
+{
+	if(!indent)
+		return;
+
+	while(depth--)
+		fputc('\t', pFile);
+}
+
+int main(int argc, char **argv)
+{
+	const char	*outName;
+	FILE		*pFile;
+	GenLevel	*levels;
+	GenLevel	*level;
+	size_t		levelSize;
+	size_t		depth;
+	size_t		deepest;
+	GenRange	fanout;
+	GenRange	keyLength;
+	GenRange	valueLength;
+	double		branchRatio;
+	double		commentRatio;
+	double		dupRatio;
+	UINT		maxDepth;
+	UINT		nodes;
+	UINT		created;
+	bool		indent;
+	char		key[GEN_MAX_STRING];
+	char		value[GEN_MAX_STRING];
+	int			i;
+
+	outName = NULL;
+	randomState = 1;
+	nodes = 1000;
+	maxDepth = 8;
+	branchRatio = 0.3;
+	commentRatio = 0;
+	dupRatio = 0;
+	indent = true;
+	ParseRange("1-8", fanout);
+	ParseRange("4-16", keyLength);
+	ParseRange("1-32", valueLength);
+
+	for(i = 1; i < argc; i++) {
+
+		if(i + 1 >= argc) {
+			fprintf(stderr, "vdfgen: missing value for %s\n", argv[i]);
+			return 1;
+		}
+
+		if(!strcmp(argv[i], "-o"))
+			outName = argv[++i];
+		else if(!strcmp(argv[i], "-seed"))
+			randomState = (UINT)strtoul(argv[++i], NULL, 10);
+		else if(!strcmp(argv[i], "-nodes"))
+			nodes = (UINT)strtoul(argv[++i], NULL, 10);
+		else if(!strcmp(argv[i], "-depth"))
+			maxDepth = (UINT)strtoul(argv[++i], NULL, 10);
+		else if(!strcmp(argv[i], "-branch"))
+			branchRatio = atof(argv[++i]);
+		else if(!strcmp(argv[i], "-comments"))
+			commentRatio = atof(argv[++i]);
+		else if(!strcmp(argv[i], "-dupkeys"))
+			dupRatio = atof(argv[++i]);
+		else if(!strcmp(argv[i], "-indent"))
+			indent = atoi(argv[++i]) != 0;
+		else if((!strcmp(argv[i], "-fanout") && ParseRange(argv[i + 1], fanout))
+			|| (!strcmp(argv[i], "-keylen") && ParseRange(argv[i + 1], keyLength))
+			|| (!strcmp(argv[i], "-valuelen") && ParseRange(argv[i + 1], valueLength)))
+			i++;
+		else {
+			fprintf(stderr, "vdfgen: bad option %s %s\n", argv[i], argv[i + 1]);
+			return 1;
+		}
+	}
+
+	// xorshift state can't be 0
+	if(!randomState)
+		randomState = 1;
+
+	if(outName == NULL)
+		pFile = stdout;
+	else if((pFile = fopen(outName, "wb")) == NULL) {
+		fprintf(stderr, "vdfgen: can't write %s\n", outName);
+		return 1;
+	}
+
+	levels = NULL;
+	levelSize = 0;
+	EnsureArraySize(levels, levelSize, 1);
+
+	// single top level branch, reader stops at its closing brace
+	fprintf(pFile, "\"root\"\n{\n");
+	levels[0].pending = 0;
+	levels[0].lastKey = NULL;
+	depth = 1;
+	deepest = 1;
+	created = 1;
+
+	while(depth) {
+
+		level = &levels[depth - 1];
+
+		// root keeps growing until node count is reached
+		if(depth == 1 && !level->pending && created < nodes && maxDepth > 0) {
+			level->pending = Draw(fanout);
+
+			if(!level->pending)
+				level->pending = 1;
+		}
+
+		if(!level->pending || created >= nodes) {
+			FinalizeArray(level->lastKey);
+			depth--;
+			WriteIndent(pFile, depth, indent);
+			fprintf(pFile, "}\n");
+			continue;
+		}
+
+		level->pending--;
+		created++;
+
+		if(Chance(commentRatio)) {
+			RandomString(value, Draw(valueLength), "abcdefghijklmnopqrstuvwxyz ");
+			WriteIndent(pFile, depth, indent);
+			fprintf(pFile, "// %s\n", value);
+		}
+
+		if(level->lastKey != NULL && Chance(dupRatio))
+			strcpy(key, level->lastKey);
+		else {
+			RandomString(key, Draw(keyLength), "abcdefghijklmnopqrstuvwxyz_");
+			FinalizeArray(level->lastKey);
+			level->lastKey = new char[strlen(key) + 1];
+			strcpy(level->lastKey, key);
+		}
+
+		WriteIndent(pFile, depth, indent);
+
+		if(depth < maxDepth && Chance(branchRatio)) {
+			fprintf(pFile, "\"%s\"\n", key);
+			WriteIndent(pFile, depth, indent);
+			fprintf(pFile, "{\n");
+
+			EnsureArraySize(levels, levelSize, depth + 1);
+			levels[depth].pending = Draw(fanout);
+			levels[depth].lastKey = NULL;
+			depth++;
+
+			if(depth > deepest)
+				deepest = depth;
+		}
+		else {
+			RandomString(value, Draw(valueLength), "abcdefghijklmnopqrstuvwxyz0123456789 .");
+			fprintf(pFile, "\"%s\"\t\"%s\"\n", key, value);
+		}
+	}
+
+	fprintf(stderr, "vdfgen: %u nodes, depth %u, %ld bytes\n", created, (UINT)deepest,
+		(pFile == stdout) ? 0L : ftell(pFile));
+
+	if(pFile != stdout)
+		fclose(pFile);
+
+	FinalizeArray(levels);
+
+	return 0;
+}
@@ -1,1070 +1,2405 @@
-/*
-*
-*  This program is free software; you can redistribute it and/or modify it
-*  under the terms of the GNU General Public License as published by the
-*  Free Software Foundation; either version 2 of the License, or (at
-*  your option) any later version.
-*
-*  This program is distributed in the hope that it will be useful, but
-*  WITHOUT ANY WARRANTY; without even the implied warranty of
-*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
-*  General Public License for more details.
-*
-*  You should have received a copy of the GNU General Public License
-*  along with this program; if not, write to the Free Software Foundation,
-*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
-*/
-
-/**  
- *	@version	1.07
- */
-
-
-#include "sdk/amxxmodule.h"
-#include "VDFCollection.h"
-
-
-#if defined __GNUC__
-#define _snprintf snprintf
-#endif
-
-class VDFErrorLogger: public IErrorLogger
-{
-private:
-	AMX *context;
-	//char errorMessage[512];
-public:
-	void SetAmxContext(AMX *amx)
-	{
-		context = amx;
-	}
-	void printError(const char *filename, const char *message, int line = 0, int charpos = 0)
-	{
-		//sprintf(errorMessage, "Error parsing %s - %s at line %d\n", filename, message, line);
-		MF_LogError(context, AMX_ERR_FORMAT, "Error parsing %s - %s at line %d", filename, message, line);
-	}
-};
-
-
-VDFCollection vdfCollection;
-VDFErrorLogger logger;
-
-
-/**
- *	Converts String to Float
- *	Taken from default amxx str_to_float native
- *	by AMXModX Team
- */
-cell StringToFloat(char *str)
-{
-	bool neg = false;
-	unsigned long part1 = 0;
-
-	if (*str == '-') 
-	{
-		neg = true;
-		++str;
-	}
-	else if (*str == '+')
-		++str;
-
-	while (*str)
-	{
-		if (*str == '.')
-		{
-			++str;
-			break;
-		}
-		
-		if (*str < '0' || *str > '9')
-		{
-			REAL fl = neg ? -static_cast<REAL>(part1) : static_cast<REAL>(part1);
-			return amx_ftoc(fl);
-		}
-
-		part1 *= 10;
-		part1 += *str - '0';
-
-		++str;
-	}
-
-	unsigned long part2 = 0;
-	unsigned long div = 1;
-	
-	while (*str)
-	{
-		if (*str < '0' || *str > '9')
-			break;
-
-		part2 *= 10;
-		part2 += *str - '0';
-		div *= 10;
-		++str;
-	}
-
-	REAL fl = static_cast<REAL>(part1) + (static_cast<REAL>(part2) / div);
-	
-	if (neg)
-		fl = -fl;
-	
-	return amx_ftoc(fl);
-}
-
-/**
- *	Performs "keypairs" forward.
- *	@param	fwid		Registered forward id (script).
- *	@param	filename	File being parsed.
- *	@param	key			Captured key.
- *	@param	value		Captured value;
- *	@param	level		Depth in tree.
- */
-int ExecParseForward(int fwid, const char *filename, const char *key,
-					 const char *value, int level)
-{
-	return MF_ExecuteForward(fwid, filename, key, value, level);
-}
-
-/**
- *	Fires parsing start event
- *	@param fwid			Registered forward id (script).
- *	@param filename		Name of the file being parsed.
- */
-int ExecParseBofForward(int fwid, const char *filename)
-{
-	return MF_ExecuteForward(fwid, filename);	
-}
-
-/** 
- *	Fires parsing end event
- *	@param fwid			Registered forward id (script).
- *	@param filename		Name of the file being parsed.
- */
-int ExecParseEofForward(int fwid, const char *filename)
-{
-	return MF_ExecuteForward(fwid, filename);
-}
-
-/*
- *	Fires "node added to tree" event
- *	@param	fwid			Registered forward id (script).
- *	@param	filename		Name of the file being opened.
- *	@param	tree			Tree being generated.
- *	@param	node			Node added.
- *	@param	level			Depth of the node in tree hierarchy.
- */
-int ExecOpenTreeForward(int fwid, const char* filename, VDFTree* tree,
-							VDFNode* node, int level)
-{
-	return MF_ExecuteForward(fwid, filename, tree, node, level);	
-}
-
-
-
-//vdf_parse(const filename[], const keypairs_func[], const start_func[] = "", const end_func = "")
-static cell AMX_NATIVE_CALL vdf_parse(AMX *amx, cell *params)
-{
-	char	*filename;
-	char	*mdFilename;
-	char	*keypairsFunc;
-	char	*startFunc;
-	char	*endFunc;
-	int		len;
-	FILE	*file;
-	ParseForward *pfw;
-	int		fwid;	
-
-
-	mdFilename = MF_GetAmxString(amx, params[1], 0, &len);
-	filename = g_fn_BuildPathname("%s", mdFilename);
-	keypairsFunc =  MF_GetAmxString(amx, params[2], 1, &len);
-
-	if(!len)
-		return 0;
-
-	if((file = fopen(filename, "r")) == NULL)
-		return 0;
-	fclose(file);
-
-	startFunc = MF_GetAmxString(amx, params[3], 2, &len);
-	endFunc = MF_GetAmxString(amx, params[4], 3, &len);
-	logger.SetAmxContext(amx);
-
-	if((fwid = vdfCollection.GetFreeParserID()) == -1)
-		return 0;
-	
-	vdfCollection.parseForward[fwid] = new ParseForward;
-	pfw = vdfCollection.parseForward[fwid];
-	
-	pfw->mdFilename = mdFilename;
-
-	// register forwards
-	pfw->fwidParser = MF_RegisterSPForwardByName(amx, keypairsFunc,
-		FP_STRING, FP_STRING, FP_STRING, FP_CELL, FP_DONE);
-	pfw->pfnParser = &ExecParseForward;
-
-	
-	if(*startFunc) {
-		pfw->fwidStart = MF_RegisterSPForwardByName(amx, startFunc,
-			FP_STRING, FP_DONE);
-		pfw->pfnStart = &ExecParseBofForward;
-	}
-	else
-		pfw->pfnStart = NULL;
-
-	if(*endFunc) {
-		pfw->fwidEnd = MF_RegisterSPForwardByName(amx, endFunc,
-			FP_STRING, FP_DONE);
-		pfw->pfnEnd = &ExecParseEofForward;
-	}
-	else
-		pfw->pfnEnd = NULL;
-
-	// parse
-	vdfCollection.ParseTree(filename, pfw);
-	
-	// unregister forwards
-	MF_UnregisterSPForward(pfw->fwidParser);
-	if(pfw->pfnStart != NULL)
-		MF_UnregisterSPForward(pfw->fwidStart);
-	if(pfw->pfnEnd != NULL)
-		MF_UnregisterSPForward(pfw->fwidEnd);
-	
-	delete(pfw);
-	vdfCollection.parseForward[fwid] = NULL;
-
-	return 1;
-
-}
-
-/**
- *	<code> native vdf_open(filename, const node_add_func[] = "") </code>
- *	@return	Returns the pointer of the vdf tree if suceeded.
- */
-static cell AMX_NATIVE_CALL vdf_open(AMX *amx, cell *params) 
-{
-	int len;
-	char *mdFilename;
-	char *filename;
-	char *openFunc;
-	OpenForward *openFW;
-	int fwid;
-	VDFTree *tree;
-	FILE *file;
-	
-	mdFilename = MF_GetAmxString(amx, params[1], 0, &len);
-	filename = g_fn_BuildPathname("%s", mdFilename);
-	openFunc = MF_GetAmxString(amx, params[2], 1, &len);
-	openFW = NULL;
-
-	file = fopen(filename, "r");	
-	if(file == NULL)
-		return 0;
-	fclose(file);
-	fwid = 0;
-
-	logger.SetAmxContext(amx);
-
-	if(*openFunc) {
-		if((fwid = vdfCollection.GetFreeOpenTreeID()) > -1) {
-			vdfCollection.openForward[fwid] = new OpenForward;
-			openFW = vdfCollection.openForward[fwid];
-			openFW->fwdid = MF_RegisterSPForwardByName(amx, openFunc, FP_STRING, FP_CELL,
-				FP_CELL, FP_CELL, FP_DONE);
-			openFW->mdFilename = mdFilename;
-			openFW->pfnOpen = &ExecOpenTreeForward;
-		}
-	}
-
-	tree = vdfCollection.AddTree(filename, false, openFW);
-
-	if(openFW) {
-		MF_UnregisterSPForward(openFW->fwdid);
-		delete(openFW);
-		vdfCollection.openForward[fwid] = NULL;
-	}
-	
-	return (cell)tree;
-}
-
-/**
- *	<code> native vdf_save(vdftree, saveas[] = "") </code>
- *	@return	Returns 1 if suceeded, 0 on fail.
- */
-static cell AMX_NATIVE_CALL vdf_save(AMX *amx, cell *params)
-{
-	int			len;
-	VDFTree*	vdfTree;
-	bool		ret;	
-	VDFTreeFile	fileHandler;
-
-	char		*saveAs = g_fn_BuildPathname("%s", MF_GetAmxString(amx, params[2], 0, &len));
-	
-	vdfTree = reinterpret_cast<VDFTree*>(params[1]);
-	ret	= 0;	
-
-	if(vdfTree == NULL)
-		return 0;
-
-	if(len)
-		ret = fileHandler.SaveVDF(saveAs, vdfTree);
-	else
-		ret = fileHandler.SaveVDF(vdfCollection.GetContainerById(vdfTree->treeId)->vdfFile,
-				vdfTree);	
-
-	return ret == true ? 1 : 0;
-}
-
-/**
- *	<code> native vdf_get_root_node(vdftree) </code>
- *	@return	Returns a pointer of the root node.
- */
-static cell AMX_NATIVE_CALL vdf_get_root_node(AMX *amx, cell *params)
-{
-	VDFTree *vdfTree;
-
-	vdfTree = reinterpret_cast<VDFTree*>(params[1]);
-	
-	if(vdfTree == NULL)
-		return 0;
-
-	return (cell)(vdfTree->rootNode);
-}
-
-/**
- *	<code> native vdf_get_first_node(node) </code>
- *	@return	Returns a pointer to first node in a branch.
- */
-static cell AMX_NATIVE_CALL vdf_get_first_node(AMX *amx, cell *params)
-{
-	VDFNode	*vdfNode;
-	
-	vdfNode = reinterpret_cast<VDFNode*>(params[1]);
-
-	if(vdfNode == NULL)
-		return 0;
-
-	return (cell)(VDFTree::GetFirstNode(vdfNode));
-}
-
-/**
- *	<code> native vdf_get_last_node(node) </code>
- *	@return	Returns a pointer to the last node in a branch.
- */
-static cell AMX_NATIVE_CALL vdf_get_last_node(AMX *amx, cell *params)
-{
-	VDFNode	*vdfNode;
-
-	vdfNode = reinterpret_cast<VDFNode*>(params[1]);
-
-	if(vdfNode == NULL)
-		return 0;
-
-	return (cell)(VDFTree::GetLastNode(vdfNode));
-}
-
-/**
- *	<code> native vdf_get_previous_node(node) </code>
- *	@return	Returns a pointer to the previous.
- */
-static cell AMX_NATIVE_CALL vdf_get_previous_node(AMX *amx, cell *params)
-{
-	VDFNode	*vdfNode;
-
-	vdfNode = reinterpret_cast<VDFNode*>(params[1]);
-
-	if(vdfNode == NULL)
-		return 0;
-
-	return (cell)(VDFTree::GetPreviousNode(vdfNode));
-}
-
-/**
- *	<code> native vdf_get_child_node(node) </code>
- *	@return	Returns a pointer to the last tree in a branch.
- */
-static cell AMX_NATIVE_CALL vdf_get_child_node(AMX *amx, cell *params)
-{
-	VDFNode	*vdfNode;
-
-	vdfNode = reinterpret_cast<VDFNode*>(params[1]);
-
-	if(vdfNode == NULL)
-		return 0;
-
-	return (cell)(vdfNode->childNode);
-}
-
-/**
- *	<code> native vdf_get_next_node(node) </code>
- *	@return	Returns a pointer to the next node.
- */
-static cell AMX_NATIVE_CALL vdf_get_next_node(AMX *amx, cell *params)
-{
-	VDFNode	*vdfNode;
-	
-	vdfNode = reinterpret_cast<VDFNode*>(params[1]);
-
-	if(vdfNode == NULL)
-		return 0;
-
-	return (cell)(vdfNode->nextNode);
-}
-
-/**
- *	<code>native vdf_get_parent_node(node)</code>
- *	@return	Returns a pointer to the parent node.
- */
-static cell AMX_NATIVE_CALL vdf_get_parent_node(AMX *amx, cell *params)
-{
-	VDFNode	*vdfNode;
-
-	vdfNode = reinterpret_cast<VDFNode*>(params[1]);
-
-	if(vdfNode == NULL)
-		return 0;
-
-	return (cell)(vdfNode->parentNode);
-}
-
-/**
- *	<code>native vdf_next_in_traverse(node)</code>
- *	@return	Returns a pointer to the next node in tree traverse.
- */
-static cell AMX_NATIVE_CALL vdf_next_in_traverse(AMX *amx, cell *params)
-{
-	VDFNode	*vdfNode;
-	cell *curDepth;
-	int  depth;
-	cell ret;
-
-	vdfNode = reinterpret_cast<VDFNode*>(params[1]);
-	curDepth = MF_GetAmxAddr(amx, params[2]);
-	depth = (int)(*curDepth);
-
-	if(vdfNode == NULL)
-		return 0;
-
-	ret = (cell)(VDFTree::GetNextTraverseStep(vdfNode, depth));
-	*curDepth = (cell)depth;
-
-	return ret;
-}
-
-/**
- *	<code> native vdf_delete_node(vdftree, node) </code>
- *	@return	Returns 1 if it's been delete or 0 if it's already been deleted
- */
-static cell AMX_NATIVE_CALL vdf_delete_node(AMX *amx, cell *params)
-{
-	VDFNode		*vdfNode;
-	VDFTree		*vdfTree;
-
-	vdfNode = reinterpret_cast<VDFNode*>(params[2]);
-	vdfTree = reinterpret_cast<VDFTree*>(params[1]);
-
-	if(vdfNode == NULL || vdfTree == NULL)
-		return 0;
-	
-	vdfTree->DeleteNode(vdfNode);
-	
-	return 1;
-}
-
-/**
- *	<code>native vdf_get_node_key(node, key[], maxlen)</code>
- *	@return	Returns 1 if succeeded
- */
-static cell AMX_NATIVE_CALL vdf_get_node_key(AMX *amx, cell *params)
-{
-	cell		*key;
-	char		*nodekey;
-	VDFNode		*vdfNode;
-	size_t		maxlen;
-
-	key     =  MF_GetAmxAddr(amx, params[2]);
-	vdfNode =  reinterpret_cast<VDFNode*>(params[1]);
-	maxlen  =  (size_t)params[3];
-	
-	if(vdfNode == NULL)
-		return 0;
-	
-	nodekey = vdfNode->key;
-
-	if(nodekey == NULL)
-		return 0;	
-
-	while(maxlen-- && nodekey)
-		*key++ = (cell)*nodekey++;
-	*key = 0;
-
-	return 1;		
-}
-
-/**
- *	<code> native vdf_get_node_value(node, value[], maxlen) </code>
- *	@return	Returns 1 if succeeded
- */
-static cell AMX_NATIVE_CALL vdf_get_node_value(AMX *amx, cell *params)
-{
-	cell		*value;
-	char		*nodevalue;
-	VDFNode		*vdfNode;
-	size_t		maxlen;
-	
-	char  blank[1] = {'\0'};
-
-	value   =  MF_GetAmxAddr(amx, params[2]);
-	vdfNode =  reinterpret_cast<VDFNode*>(params[1]);
-	maxlen  =  (size_t)params[3];
-	
-	if(vdfNode == NULL)
-		return 0;
-	
-	nodevalue = vdfNode->value;
-
-	if(nodevalue == NULL)
-		nodevalue = blank;	
-
-	while(maxlen-- && nodevalue)
-		*value++ = (cell)*nodevalue++;
-	*value = 0;
-
-	return 1;
-}
-
-/**
- *	<code> native vdf_create_tree(const filename[]) </code>
- *	@return	Returns a pointer to the new tree if succeeded, 0 on fail.
- */
-static cell AMX_NATIVE_CALL vdf_create_tree(AMX *amx, cell *params)
-{
-	int 	len;
-
-	char *vdfFile = g_fn_BuildPathname("%s", MF_GetAmxString(amx, params[1], 0, &len));
-	return (cell)vdfCollection.AddTree(vdfFile, true);
-}
-
-/**
- *	<code> native vdf_get_append_node(vdftree, node, key = "", value = "") </code>
- *	@return	Returns a pointer to the new appended node if succeeded, 0 on fail
- */
-static cell AMX_NATIVE_CALL vdf_append_node(AMX *amx, cell *params)
-{
-	char		*key   = NULL;
-	char		*value = NULL;
-	int			lenk, lenv;
-	VDFNode		*newNode;
-	VDFNode		*refNode;
-	VDFTree		*vdfTree;
-
-	vdfTree    = reinterpret_cast<VDFTree*>(params[1]);
-	refNode    = reinterpret_cast<VDFNode*>(params[2]);
-	key		   = MF_GetAmxString(amx, params[3], 0, &lenk);
-	value	   = MF_GetAmxString(amx, params[4], 1, &lenv);
-	
-	if(vdfTree == NULL || refNode == NULL)
-		return 0;
-
-	newNode = vdfTree->CreateNode();
-	
-	if(key && lenk)
-		vdfTree->SetKeyPair(newNode, key);
-	if(value && lenv)
-		vdfTree->SetKeyPair(newNode, NULL, value);
-
-	vdfTree->AppendNode(refNode, newNode);
-	
-	return (cell)newNode;
-}
-
-/**
- *	<code> native vdf_append_childnode(vdf, node, key[] = "", value[] = "") </code>
- *	@return	Returns a pointer to the new appended child if succeeded, 0 on fail.
- */
-static cell AMX_NATIVE_CALL vdf_append_child_node(AMX *amx, cell *params)
-{
-	char		*key   = NULL;
-	char		*value = NULL;
-	int			lenk, lenv;
-	VDFNode		*newNode;
-	VDFNode		*refNode;
-	VDFTree		*vdfTree;
-
-	vdfTree		= reinterpret_cast<VDFTree*>(params[1]);
-	refNode		= reinterpret_cast<VDFNode*>(params[2]);
-	key			= MF_GetAmxString(amx, params[3], 0, &lenk);
-	value		= MF_GetAmxString(amx, params[4], 1, &lenv);
-	
-	if(vdfTree == NULL || refNode == NULL)
-		return 0;
-
-	newNode = vdfTree->CreateNode();
-	
-	if(key != NULL && lenk)
-		vdfTree->SetKeyPair(newNode, key);
-	if(value != NULL && lenv)
-		vdfTree->SetKeyPair(newNode, NULL, value);
-
-	vdfTree->AppendChild(refNode, newNode);
-	
-	return (cell)newNode;
-}
-
-
-/**
- *	<code> native vdf_set_node_key(node, const key[]) </code>
- *	@return	Returns 1 if succeeded, 0 on fail
- */
-static cell AMX_NATIVE_CALL vdf_set_node_key(AMX *amx, cell *params)
-{
-	VDFNode *vdfNode;
-	int		lenk;
-	char	*key;
-
-	key		=  MF_GetAmxString(amx, params[2], 0, &lenk);
-	vdfNode =  reinterpret_cast<VDFNode*>(params[1]);
-	
-	if(vdfNode == NULL)
-		return 0;
-
-	VDFTree::SetKeyPair(vdfNode, key);
-	return 1;
-}
-
-/**
- *	<code> native vdf_set_node_value(node, const value[]) </code>
- */
-static cell AMX_NATIVE_CALL vdf_set_node_value(AMX *amx, cell *params)
-{
-	VDFNode *vdfNode;
-	int		lenv;
-	char	*value;
-
-	value		=  MF_GetAmxString(amx, params[2], 0, &lenv);
-	vdfNode		=  reinterpret_cast<VDFNode*>(params[1]);
-	
-	if(vdfNode == NULL)
-		return 0;
-
-	VDFTree::SetKeyPair(vdfNode, NULL, value);
-	return 1;
-}
-
-
-/**
- *	<code> native vdf_remove_tree(vdftree) </code>
- *	@return	Returns 1 if succeeded, 0 on fail
- */
-static cell AMX_NATIVE_CALL vdf_remove_tree(AMX *amx, cell *params)
-{
-	VDFTree *tree;
-	
-	tree = reinterpret_cast<VDFTree*>(params[1]);
-
-	if(tree == NULL)
-		return 0;
-	
-	vdfCollection.RemoveTree(&tree);
-	return 1; 
-}
-
-/**
- *	<code> native vdf_count_branch_nodes(node) <code>
- *	@return	Returns number of nodes in current branch.
- */
-static cell AMX_NATIVE_CALL vdf_count_branch_nodes(AMX *amx, cell *params)
-{
-	VDFNode *refNode;
-
-	refNode = reinterpret_cast<VDFNode*>(params[1]);
-	
-	if(refNode != NULL)
-		return VDFTree::CountBranchNodes(refNode);
-
-	return 0;
-}
-
-/**
- *	<code> vdf_create_search() </code>
- *	@return	Returns search pointer.
- */
-static cell AMX_NATIVE_CALL vdf_create_search(AMX *amx, cell *params)
-{
-	return (cell)vdfCollection.AddSearch();
-}
-
-// set_search
-
-/**
- *	<code> vdf_set_search(search, tree, const searchstr[], searchtype = 0,
- *							level = -1, ignorecase = 0) </code>
- */
-static cell AMX_NATIVE_CALL vdf_set_search(AMX *amx, cell *params)
-{
-	int			level;
-	UINT		searchType;
-	UINT		ignoreCase;
-	char		*searchStr;
-	VDFTree		*tree;
-	VDFSearch	*search;
-	int			len;
-
-	search		=	reinterpret_cast<VDFSearch*>(params[1]);
-	tree		=	reinterpret_cast<VDFTree*>(params[2]);
-	searchStr	=	MF_GetAmxString(amx, params[3], 0, &len);
-	searchType	=	(UINT)params[4];
-	level		=	(int)params[5];
-	ignoreCase	=	(UINT)params[6];
-
-	if(tree == NULL || search == NULL)
-		return 0;
-
-	vdfCollection.SetSearch(search, tree, searchStr, searchType,
-											  level, ignoreCase);
-
-	return 1;
-}
-
-
-/**
- *	<code>	vdf_find_next_match(search, startnode = 0)	</code>
- *	@return	Returns next node or 0 if nothing is found.
- */
-static cell AMX_NATIVE_CALL vdf_find_next_match(AMX *amx, cell *params)
-{
-	VDFSearch *search;
-	VDFNode   *node;
-	
-	search = reinterpret_cast<VDFSearch*>(params[1]);
-	node   = reinterpret_cast<VDFNode*>(params[2]);
-
-	if(search == NULL)
-		return 0;
-
-	node = search->FindNextNode(node);
-	
-	return (cell)node;
-}
-
-/**
- *	<code>	vdf_close_search(search)	</code>
- */
-static cell AMX_NATIVE_CALL vdf_close_search(AMX *amx, cell *params)
-{
-	VDFSearch *search;
-	
-	search = reinterpret_cast<VDFSearch*>(params[1]);
-	
-	if(search == NULL)
-		return 0;
-	
-	vdfCollection.RemoveSearch(search->searchId);
-	return 1;
-}
-
-/*
- * <code>	vdf_get_node_level(node) </code>
- *	@return	The level of a node. Because a node level 0 is valid, it returns -1 on error.
- */
-
-static cell AMX_NATIVE_CALL vdf_get_node_level(AMX *amx, cell *params)
-{
-	VDFNode	*vdfNode;
-
-	vdfNode = reinterpret_cast<VDFNode*>(params[1]);
-
-	if(vdfNode == NULL)
-		return -1;
-	
-
-	return (cell)(VDFTree::GetNodeLevel(vdfNode));
-}
-
-//vdf_get_node_value_int(node)
-static cell AMX_NATIVE_CALL vdf_get_node_value_num(AMX *amx, cell *params)
-{
-	VDFNode *vdfNode;
-
-	vdfNode = reinterpret_cast<VDFNode*>(params[1]);
-
-	if(vdfNode == NULL)
-		return 0;
-
-	return (cell)atoi(vdfNode->value);
-}
-
-//vdf_get_node_value_float(node, Float:value)
-static cell AMX_NATIVE_CALL vdf_get_node_value_float(AMX *amx, cell *params)
-{
-	VDFNode *vdfNode;
-
-	vdfNode = reinterpret_cast<VDFNode*>(params[1]);
-
-	if(vdfNode == NULL)
-		return 0;
-
-	return StringToFloat((vdfNode->value == NULL) ? 0 : vdfNode->value);	
-}
-
-//vdf_get_node_value_vector(node, Float:vector[3])
-static cell AMX_NATIVE_CALL vdf_get_node_value_vector(AMX *amx, cell *params)
-{
-	char	*value;
-	char	sep[4];
-	char	*token;
-	cell	*vec;
-	VDFNode *node;
-	size_t	len;
-	
-	vec = MF_GetAmxAddr(amx, params[2]);
-	node = reinterpret_cast<VDFNode*>(params[1]);
-
-	if(node == NULL)
-		return 0;
-	
-	if(node->value == NULL) {
-		vec[0] = 0;
-		vec[1] = 0;
-		vec[2] = 0;
-		return 0;
-	}
-	
-	value = new char[strlen(node->value) + 1];
-	strcpy(value, node->value);
-
-	sprintf(sep, " ,");
-	token = strtok(value, sep);
-	len = 0;
-	
-	while(len < 3 && token != NULL) {
-		vec[len++] = StringToFloat(token);
-		token = strtok(NULL, sep);
-	}
-	
-	delete(value);
-
-	if(len)
-		return 1;
-
-	return 0;
-}
-
-//vdf_set_node_value_num(VdfNode:node, value)
-static cell AMX_NATIVE_CALL vdf_set_node_value_num(AMX *amx, cell *params)
-{
-	char value[12];
-	VDFNode* node;
-
-	node = reinterpret_cast<VDFNode*>(params[1]);
-
-	if (node == NULL)
-		return 0;
-
-	_snprintf(value, 12, "%d", params[2]);
-	VDFTree::SetKeyPair(node, NULL, value);
-
-	return 1;
-}
-
-//vdf_set_node_value_float(VdfNode:node, Float:value)
-static cell AMX_NATIVE_CALL vdf_set_node_value_float(AMX *amx, cell *params)
-{
-	char	value[22];
-	VDFNode *node;
-
-	node = reinterpret_cast<VDFNode*>(params[1]);
-	
-	if(node == NULL)
-		return 0;
-
-	_snprintf(value, 22, "%f", amx_ctof(params[2]));
-	VDFTree::SetKeyPair(node, NULL, value);	
-
-	return 1;
-}
-
-//vdf_set_node_value_vector(VdfNode:node, Float:vector[3])
-static cell AMX_NATIVE_CALL vdf_set_node_value_vector(AMX *amx, cell *params)
-{
-	char		value[70];
-	int			len;
-	VDFNode		*node;
-	cell		*vector;
-
-	node = reinterpret_cast<VDFNode*>(params[1]);
-
-	if(node == NULL)
-		return 0;
-	
-	vector = MF_GetAmxAddr(amx, params[2]);
-
-	len = _snprintf(value, 22, "%f ", amx_ctof(vector[0]));
-	len += _snprintf(value + len, 22, "%f ", amx_ctof(vector[1]));
-	len += _snprintf(value + len, 21, "%f", amx_ctof(vector[2]));
-	
-	VDFTree::SetKeyPair(node, NULL, value);
-
-	return 1;
-
-}
-
-//vdf_set_node_value_vector(VdfNode:node, Float:vector[3])
-static cell AMX_NATIVE_CALL vdf_sort_branch(AMX *amx, cell *params)
-{
-	VDFTree *tree;
-	VDFNode *node;
-	UINT	byValue;
-	UINT	asNumber;
-
-	tree = reinterpret_cast<VDFTree*>(params[1]);
-	node = reinterpret_cast<VDFNode*>(params[2]);
-	byValue = (UINT)params[3];
-	asNumber = (UINT)params[4];
-
-	if(tree == NULL || node == NULL)
-		return 0;
-
-	tree->SortBranchNodes(node, byValue == 1, asNumber == 1);
-	return (cell) VDFTree::GetFirstNode(node);
-}
-
-//vdf_move_to_branch(VdfTree:tree, VdfNode:moveNode, anchorNode, bool:insertAfter = true) 
-static cell AMX_NATIVE_CALL vdf_move_to_branch(AMX *amx, cell *params)
-{
-	VDFTree *tree;
-	VDFNode *moveNode;
-	VDFNode *anchorNode;
-	UINT	insertAfter;
-
-	tree = reinterpret_cast<VDFTree*>(params[1]);
-	moveNode = reinterpret_cast<VDFNode*>(params[2]);
-	anchorNode = reinterpret_cast<VDFNode*>(params[3]);
-	insertAfter = (UINT)params[4];
-
-	if(moveNode == NULL || anchorNode == NULL || moveNode == anchorNode)
-		return 0;
-
-	tree->MoveToBranch(anchorNode, moveNode, (insertAfter) ? VDF_MOVEPOS_AFTER : VDF_MOVEPOS_BEFORE);
-	
-	return 1;
-
-}
-
-
-//vdf_move_as_child(VdfTree:tree, VdfNode:moveNode, VdfNode:parentNode) 
-static cell AMX_NATIVE_CALL vdf_move_as_child(AMX *amx, cell *params)
-{
-	VDFTree *tree;
-	VDFNode *moveNode;
-	VDFNode *parentNode;
-
-	tree = reinterpret_cast<VDFTree*>(params[1]);
-	moveNode = reinterpret_cast<VDFNode*>(params[2]);
-	parentNode = reinterpret_cast<VDFNode*>(params[3]);
-
-	if(moveNode == NULL || parentNode == NULL || moveNode->parentNode == parentNode)
-		return 0;
-
-	tree->MoveAsChild(parentNode, moveNode);
-	
-	return 1;
-
-}
-
-//VdfNode:vdf_find_in_branch(VdfNode:node, const schstring[], bool:bykey = true, bool ignorecase = false) 
-static cell AMX_NATIVE_CALL vdf_find_in_branch(AMX *amx, cell *params)
-{
-	VDFNode *startNode;
-	char	*sch;
-	char	*searchStr;
-	char	*cmp;
-	UINT	byKey;
-	UINT	ignoreCase;
-	int		len;
-
-	startNode = reinterpret_cast<VDFNode*>(params[1]);
-
-	if(startNode == NULL)
-		return 0;
-
-	sch	=	MF_GetAmxString(amx, params[2], 0, &len);
-	byKey = (UINT)params[3];
-	ignoreCase = (UINT)params[4];
-	
-
-	if(ignoreCase) {
-		searchStr = new char[strlen(sch) + 1];
-		ToLowerCase(sch, searchStr);
-	}
-	else
-		searchStr = sch;
-
-	while(startNode) {
-		
-		if((cmp = (byKey) ? startNode->key : startNode->value) != NULL) {			
-			if(strcmp(cmp, searchStr) == 0)
-				break;
-		}
-
-		startNode = startNode->nextNode;
-	}
-	
-	if(ignoreCase)
-		delete(searchStr);
-
-	return (cell)startNode;
-
-}
-
-
-AMX_NATIVE_INFO vdfNatives[] = 
-{
-	{"vdf_open",					vdf_open},
-	{"vdf_save",					vdf_save},
-	{"vdf_parse",					vdf_parse},
-	{"vdf_get_first_node",			vdf_get_first_node},
-	{"vdf_get_child_node",			vdf_get_child_node},
-	{"vdf_get_parent_node",			vdf_get_parent_node},
-	{"vdf_get_root_node",			vdf_get_root_node},
-	{"vdf_get_last_node",			vdf_get_last_node},
-	{"vdf_get_previous_node",		vdf_get_previous_node},
-	{"vdf_get_next_node",			vdf_get_next_node},
-	{"vdf_get_node_key",			vdf_get_node_key},
-	{"vdf_get_node_value",			vdf_get_node_value},
-	{"vdf_get_node_value_vector",	vdf_get_node_value_vector},
-	{"vdf_get_node_value_float",	vdf_get_node_value_float},
-	{"vdf_get_node_value_num",		vdf_get_node_value_num},
-	{"vdf_set_node_key",			vdf_set_node_key},
-	{"vdf_set_node_value",			vdf_set_node_value},
-	{"vdf_set_node_value_num",		vdf_set_node_value_num},
-	{"vdf_set_node_value_float",	vdf_set_node_value_float},
-	{"vdf_set_node_value_vector",	vdf_set_node_value_vector},
-	{"vdf_delete_node",				vdf_delete_node},
-	{"vdf_append_node",				vdf_append_node},
-	{"vdf_append_child_node",		vdf_append_child_node},
-	{"vdf_create_tree",				vdf_create_tree},
-	{"vdf_count_branch_nodes",		vdf_count_branch_nodes},
-	{"vdf_remove_tree",				vdf_remove_tree},
-	{"vdf_create_search",			vdf_create_search},
-	{"vdf_find_next_match",			vdf_find_next_match},
-	{"vdf_set_search",				vdf_set_search},
-	{"vdf_get_node_level",			vdf_get_node_level},
-	{"vdf_close_search",			vdf_close_search},
-	{"vdf_sort_branch",				vdf_sort_branch},
-	{"vdf_move_to_branch",			vdf_move_to_branch},
-	{"vdf_move_as_child",			vdf_move_as_child},
-	{"vdf_find_in_branch",			vdf_find_in_branch},
-	{"vdf_next_in_traverse",        vdf_next_in_traverse},
-	{NULL,							NULL},
-};
-
-void OnAmxxAttach()
-{
-	vdfCollection.SetLogger(&logger);
-	MF_AddNatives(vdfNatives);
-}
-
-void OnAmxxDetach()
-{
-	vdfCollection.Destroy();
-}
+/*
+*
+*  This program is free software; you can redistribute it and/or modify it
+*  under the terms of the GNU General Public License as published by the
+*  Free Software Foundation; either version 2 of the License, or (at
+*  your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful, but
+*  WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+*  General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program; if not, write to the Free Software Foundation,
+*  Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**  
+ *	@version	1.07
+ */
+
+
+#include "sdk/amxxmodule.h"
+#include "VDFCollection.h"
+#include "VDFStats.h"
+#include "VDFDiff.h"
+#include "VDFIndex.h"
+
+
+#if defined __GNUC__
+#define _snprintf snprintf
+#endif
+
+class VDFErrorLogger: public IErrorLogger
+{
+private:
+	AMX *context;
+	//char errorMessage[512];
+public:
+	void SetAmxContext(AMX *amx)
+	{
+		context = amx;
+	}
+	void printError(const char *filename, const char *message, int line = 0, int charpos = 0)
+	{
+		//sprintf(errorMessage, "Error parsing %s - %s at line %d\n", filename, message, line);
+		MF_LogError(context, AMX_ERR_FORMAT, "Error parsing %s - %s at line %d", filename, message, line);
+	}
+};
+
+
+VDFCollection vdfCollection;
+VDFErrorLogger logger;
+VDFStats nativeStats;
+
+
+/**
+ *	Converts String to Float
+ *	Taken from default amxx str_to_float native
+ *	by AMXModX Team
+ */
+cell StringToFloat(const char *str)
+{
+	bool neg = false;
+	unsigned long part1 = 0;
+
+	if (*str == '-') 
+	{
+		neg = true;
+		++str;
+	}
+	else if (*str == '+')
+		++str;
+
+	while (*str)
+	{
+		if (*str == '.')
+		{
+			++str;
+			break;
+		}
+		
+		if (*str < '0' || *str > '9')
+		{
+			REAL fl = neg ? -static_cast<REAL>(part1) : static_cast<REAL>(part1);
+			return amx_ftoc(fl);
+		}
+
+		part1 *= 10;
+		part1 += *str - '0';
+
+		++str;
+	}
+
+	unsigned long part2 = 0;
+	unsigned long div = 1;
+	
+	while (*str)
+	{
+		if (*str < '0' || *str > '9')
+			break;
+
+		part2 *= 10;
+		part2 += *str - '0';
+		div *= 10;
+		++str;
+	}
+
+	REAL fl = static_cast<REAL>(part1) + (static_cast<REAL>(part2) / div);
+	
+	if (neg)
+		fl = -fl;
+	
+	return amx_ftoc(fl);
+}
+
+/**
+ *	Performs "keypairs" forward.
+ *	@param	fwid		Registered forward id (script).
+ *	@param	filename	File being parsed.
+ *	@param	key			Captured key.
+ *	@param	value		Captured value;
+ *	@param	level		Depth in tree.
+ */
+int ExecParseForward(int fwid, const char *filename, const char *key,
+					 const char *value, int level)
+{
+	return MF_ExecuteForward(fwid, filename, key, value, level);
+}
+
+/**
+ *	Fires parsing start event
+ *	@param fwid			Registered forward id (script).
+ *	@param filename		Name of the file being parsed.
+ */
+int ExecParseBofForward(int fwid, const char *filename)
+{
+	return MF_ExecuteForward(fwid, filename);	
+}
+
+/** 
+ *	Fires parsing end event
+ *	@param fwid			Registered forward id (script).
+ *	@param filename		Name of the file being parsed.
+ */
+int ExecParseEofForward(int fwid, const char *filename)
+{
+	return MF_ExecuteForward(fwid, filename);
+}
+
+/**
+ *	Fires enter or leave branch event
+ *	@param	fwid		Registered forward id (script).
+ *	@param	filename	File being parsed.
+ *	@param	path		Keys from root to branch, joined by '/'.
+ *	@param	level		Depth of branch key in tree.
+ */
+int ExecParseBranchForward(int fwid, const char *filename, const char *path, int level)
+{
+	return MF_ExecuteForward(fwid, filename, path, level);
+}
+
+/*
+ *	Fires "node added to tree" event
+ *	@param	fwid			Registered forward id (script).
+ *	@param	filename		Name of the file being opened.
+ *	@param	tree			Tree being generated.
+ *	@param	node			Node added.
+ *	@param	level			Depth of the node in tree hierarchy.
+ */
+int ExecOpenTreeForward(int fwid, const char* filename, VDFTree* tree,
+							VDFNode* node, int level)
+{
+	return MF_ExecuteForward(fwid, filename, tree, node, level);	
+}
+
+
+
+/**
+ *	Gets a node from a native param for reading. Nodes of frozen trees are read
+ *	straight from the image, unless the tree has already been converted.
+ *	@param	param		Node handle.
+ *	@param	image		Receives the image if node must be read from it,
+ *						otherwise it's set to NULL.
+ *	@param	imageNode	Receives node index in image.
+ *	@return				The regular node or NULL.
+ */
+static VDFNode *GetReadableNode(cell param, VDFImage **image, UINT &imageNode)
+{
+	VDFTree *tree;
+
+	*image = NULL;
+
+	if(!IsImageHandle(reinterpret_cast<void*>(param)))
+		return reinterpret_cast<VDFNode*>(param);
+
+	if((tree = vdfCollection.GetImageOwner(reinterpret_cast<void*>(param), imageNode)) == NULL)
+		return NULL;
+
+	if(tree->IsFrozen())
+		*image = tree->image;
+
+	return tree->GetThawedNode(imageNode);
+}
+
+/**
+ *	Gets a regular node from a native param. If it's a node of a frozen
+ *	tree, the tree is converted into regular nodes first (copy-on-write).
+ *	@param	param		Node handle.
+ *	@return				The regular node or NULL.
+ */
+static VDFNode *GetRegularNode(cell param)
+{
+	VDFTree	*tree;
+	UINT	node;
+
+	if(!IsImageHandle(reinterpret_cast<void*>(param))) {
+		// lazy trees get all their branches read, unflagged nodes don't hold any
+		if(VDFLazySource::activeSources && param
+			&& (reinterpret_cast<VDFNode*>(param)->flags & VDF_NODE_LAZY)
+			&& (tree = VDFLazySource::FindTree(reinterpret_cast<VDFNode*>(param))) != NULL)
+			tree->Thaw();
+		return reinterpret_cast<VDFNode*>(param);
+	}
+
+	if((tree = vdfCollection.GetImageOwner(reinterpret_cast<void*>(param), node)) == NULL)
+		return NULL;
+
+	tree->Thaw();
+
+	return tree->GetThawedNode(node);
+}
+
+/**
+ *	Gets a regular node from a native param for writing. Running saves
+ *	of its tree get their own copy before it's changed.
+ *	@param	param		Node handle.
+ *	@return				The regular node or NULL.
+ */
+static VDFNode *GetWritableNode(cell param)
+{
+	VDFNode	*node;
+	VDFTree	*tree;
+
+	node = GetRegularNode(param);
+
+	if(node != NULL && VDFTree::pendingSnapshots
+		&& (tree = vdfCollection.GetNodeOwner(node)) != NULL)
+		tree->DetachSnapshots();
+
+	return node;
+}
+
+/**
+ *	Reads the branch of a regular node before its children are accessed,
+ *	if its tree has been opened in lazy mode. Only childless nodes flagged
+ *	by lazy trees may have a branch to be read.
+ *	@param	node	Node whose children are accessed.
+ */
+static void LoadLazyBranch(VDFNode *node)
+{
+	VDFTree *tree;
+
+	if(node == NULL || node->childNode != NULL || !(node->flags & VDF_NODE_LAZY))
+		return;
+
+	if((tree = VDFLazySource::FindTree(node)) != NULL)
+		tree->LoadBranch(node);
+}
+
+/**
+ *	Gets the journal a node move is recorded in. Moves between trees
+ *	can't be recorded, so both journals will save their trees instead.
+ *	@param	moveNode	Node to be moved.
+ *	@param	targetNode	Anchor or parent node.
+ *	@return				The journal or NULL if move isn't recorded.
+ */
+static VDFJournal *JournalMove(VDFNode *moveNode, VDFNode *targetNode)
+{
+	VDFJournal *source;
+	VDFJournal *target;
+
+	source = vdfCollection.GetNodeJournal(moveNode);
+	target = vdfCollection.GetNodeJournal(targetNode);
+
+	if(source == target)
+		return source;
+
+	if(source)
+		source->Invalidate();
+	if(target)
+		target->Invalidate();
+
+	return NULL;
+}
+
+/**
+ *	Gets key or value from a node handle (regular or image node).
+ *	@param	param		Node handle.
+ *	@param	key			If true gets the key, otherwise the value.
+ *	@param	valid		Set to false if param isn't a valid node.
+ *	@return				The string, NULL if node doesn't have it.
+ */
+static const char *GetNodeString(cell param, bool key, bool &valid)
+{
+	VDFNode		*vdfNode;
+	VDFImage	*image;
+	UINT		imageNode;
+
+	valid = true;
+
+	if((vdfNode = GetReadableNode(param, &image, imageNode)) != NULL)
+		return key ? vdfNode->key : vdfNode->value;
+
+	if(image != NULL)
+		return key ? image->GetKey(imageNode) : image->GetValue(imageNode);
+
+	valid = false;
+	return NULL;
+}
+
+/**
+ *	Copies a plugin string of any length (MF_GetAmxString buffers are limited).
+ *	@param	amx		Plugin.
+ *	@param	param	String address.
+ *	@param	length	Receives string length.
+ *	@return			New string, freed by caller.
+ */
+static char *CopyAmxString(AMX *amx, cell param, size_t &length)
+{
+	cell	*src;
+	char	*dest;
+	size_t	i;
+
+	src = MF_GetAmxAddr(amx, param);
+
+	for(length = 0; src[length]; length++);
+
+	dest = new char[length + 1];
+
+	for(i = 0; i < length; i++)
+		dest[i] = (char)src[i];
+	dest[length] = '\0';
+
+	return dest;
+}
+
+/**
+ *	Registers event forwards (params 2 to 6 of parsing natives) and parses
+ *	a file or, if data isn't NULL, vdf data in memory.
+ *	@return	Returns 1 if parsing has been performed.
+ */
+static cell ParseWithForwards(AMX *amx, cell *params, char *mdFilename, const char *filename,
+							  const char *data, size_t length)
+{
+	char	*keypairsFunc;
+	char	*startFunc;
+	char	*endFunc;
+	char	*branchFunc;
+	int		len;
+	ParseForward *pfw;
+	int		fwid;	
+
+	keypairsFunc =  MF_GetAmxString(amx, params[2], 1, &len);
+
+	if(!len)
+		return 0;
+
+	startFunc = MF_GetAmxString(amx, params[3], 2, &len);
+	endFunc = MF_GetAmxString(amx, params[4], 3, &len);
+	logger.SetAmxContext(amx);
+
+	if((fwid = vdfCollection.GetFreeParserID()) == -1)
+		return 0;
+	
+	vdfCollection.parseForward[fwid] = new ParseForward;
+	pfw = vdfCollection.parseForward[fwid];
+	
+	pfw->mdFilename = mdFilename;
+
+	// register forwards
+	pfw->fwidParser = MF_RegisterSPForwardByName(amx, keypairsFunc,
+		FP_STRING, FP_STRING, FP_STRING, FP_CELL, FP_DONE);
+	pfw->pfnParser = &ExecParseForward;
+
+	
+	if(*startFunc) {
+		pfw->fwidStart = MF_RegisterSPForwardByName(amx, startFunc,
+			FP_STRING, FP_DONE);
+		pfw->pfnStart = &ExecParseBofForward;
+	}
+	else
+		pfw->pfnStart = NULL;
+
+	if(*endFunc) {
+		pfw->fwidEnd = MF_RegisterSPForwardByName(amx, endFunc,
+			FP_STRING, FP_DONE);
+		pfw->pfnEnd = &ExecParseEofForward;
+	}
+	else
+		pfw->pfnEnd = NULL;
+
+	// branch forwards were added later, old plugins don't pass them
+	pfw->pfnEnter = NULL;
+	pfw->pfnLeave = NULL;
+
+	if(params[0] / sizeof(cell) >= 6) {
+		branchFunc = MF_GetAmxString(amx, params[5], 2, &len);
+		if(*branchFunc) {
+			pfw->fwidEnter = MF_RegisterSPForwardByName(amx, branchFunc,
+				FP_STRING, FP_STRING, FP_CELL, FP_DONE);
+			pfw->pfnEnter = &ExecParseBranchForward;
+		}
+
+		branchFunc = MF_GetAmxString(amx, params[6], 3, &len);
+		if(*branchFunc) {
+			pfw->fwidLeave = MF_RegisterSPForwardByName(amx, branchFunc,
+				FP_STRING, FP_STRING, FP_CELL, FP_DONE);
+			pfw->pfnLeave = &ExecParseBranchForward;
+		}
+	}
+
+	// parse
+	if(data != NULL)
+		vdfCollection.ParseString(data, length, pfw);
+	else
+		vdfCollection.ParseTree(filename, pfw);
+	
+	// unregister forwards
+	MF_UnregisterSPForward(pfw->fwidParser);
+	if(pfw->pfnStart != NULL)
+		MF_UnregisterSPForward(pfw->fwidStart);
+	if(pfw->pfnEnd != NULL)
+		MF_UnregisterSPForward(pfw->fwidEnd);
+	if(pfw->pfnEnter != NULL)
+		MF_UnregisterSPForward(pfw->fwidEnter);
+	if(pfw->pfnLeave != NULL)
+		MF_UnregisterSPForward(pfw->fwidLeave);
+	
+	delete(pfw);
+	vdfCollection.parseForward[fwid] = NULL;
+
+	return 1;
+}
+
+//vdf_parse(const filename[], const keypairs_func[], const start_func[] = "", const end_func = "",
+//		const enter_func[] = "", const leave_func[] = "")
+static cell AMX_NATIVE_CALL vdf_parse(AMX *amx, cell *params)
+{
+	char	*filename;
+	char	*mdFilename;
+	int		len;
+	FILE	*file;
+
+	mdFilename = MF_GetAmxString(amx, params[1], 0, &len);
+	filename = g_fn_BuildPathname("%s", mdFilename);
+
+	if((file = fopen(filename, "r")) == NULL)
+		return 0;
+	fclose(file);
+
+	return ParseWithForwards(amx, params, mdFilename, filename, NULL, 0);
+}
+
+/**
+ *	<code> native vdf_parse_string(const data[], const keypairs_func[], const start_func[] = "",
+ *							const end_func[] = "", const enter_func[] = "", const leave_func[] = "") </code>
+ *	@return	Returns 1 if data has been parsed.
+ */
+static cell AMX_NATIVE_CALL vdf_parse_string(AMX *amx, cell *params)
+{
+	char	*data;
+	size_t	length;
+	cell	ret;
+
+	data = CopyAmxString(amx, params[1], length);
+
+	ret = ParseWithForwards(amx, params, (char*)"", NULL, data, length);
+
+	FinalizeArray(data);
+
+	return ret;
+}
+
+/**
+ *	Registers node addition forward for tree opening natives.
+ *	@param	amx			Plugin.
+ *	@param	openFunc	Plugin function, no forward is registered if it's empty.
+ *	@param	mdFilename	File name passed to forward.
+ *	@param	fwid		Receives forward slot.
+ *	@return				Forward settings or NULL.
+ */
+static OpenForward *RegisterOpenForward(AMX *amx, char *openFunc, char *mdFilename, int &fwid)
+{
+	OpenForward *openFW;
+
+	openFW = NULL;
+	fwid = 0;
+
+	if(*openFunc) {
+		if((fwid = vdfCollection.GetFreeOpenTreeID()) > -1) {
+			vdfCollection.openForward[fwid] = new OpenForward;
+			openFW = vdfCollection.openForward[fwid];
+			openFW->fwdid = MF_RegisterSPForwardByName(amx, openFunc, FP_STRING, FP_CELL,
+				FP_CELL, FP_CELL, FP_DONE);
+			openFW->mdFilename = mdFilename;
+			openFW->pfnOpen = &ExecOpenTreeForward;
+		}
+	}
+
+	return openFW;
+}
+
+/**
+ *	Unregisters a forward set by <code>RegisterOpenForward</code>.
+ *	@param	openFW		Forward settings (can be NULL).
+ *	@param	fwid		Forward slot.
+ */
+static void ReleaseOpenForward(OpenForward *openFW, int fwid)
+{
+	if(openFW) {
+		MF_UnregisterSPForward(openFW->fwdid);
+		delete(openFW);
+		vdfCollection.openForward[fwid] = NULL;
+	}
+}
+
+/**
+ *	<code> native vdf_open(filename, const node_add_func[] = "") </code>
+ *	@return	Returns the pointer of the vdf tree if suceeded.
+ */
+static cell AMX_NATIVE_CALL vdf_open(AMX *amx, cell *params) 
+{
+	int len;
+	char *mdFilename;
+	char *filename;
+	char *openFunc;
+	OpenForward *openFW;
+	int fwid;
+	VDFTree *tree;
+	FILE *file;
+	
+	mdFilename = MF_GetAmxString(amx, params[1], 0, &len);
+	filename = g_fn_BuildPathname("%s", mdFilename);
+	openFunc = MF_GetAmxString(amx, params[2], 1, &len);
+
+	file = fopen(filename, "r");	
+	if(file == NULL)
+		return 0;
+	fclose(file);
+
+	logger.SetAmxContext(amx);
+
+	openFW = RegisterOpenForward(amx, openFunc, mdFilename, fwid);
+
+	tree = vdfCollection.AddTree(filename, false, openFW);
+
+	ReleaseOpenForward(openFW, fwid);
+	
+	return (cell)tree;
+}
+
+/**
+ *	<code> native VdfTree:vdf_open_lazy(const filename[], depth = 1) </code>
+ *	@return	Returns the vdf tree or 0 on fail.
+ */
+static cell AMX_NATIVE_CALL vdf_open_lazy(AMX *amx, cell *params)
+{
+	int len;
+	char *filename;
+	int depth;
+	FILE *file;
+
+	filename = g_fn_BuildPathname("%s", MF_GetAmxString(amx, params[1], 0, &len));
+	depth = (int)params[2];
+
+	file = fopen(filename, "r");
+	if(file == NULL)
+		return 0;
+	fclose(file);
+
+	logger.SetAmxContext(amx);
+
+	return (cell)vdfCollection.AddLazyTree(filename, depth < 1 ? 1 : (UINT)depth);
+}
+
+/**
+ *	<code> native vdf_build_index(const filename[], depth = 2) </code>
+ *	@return	Returns 1 if index has been built, 0 on fail.
+ */
+static cell AMX_NATIVE_CALL vdf_build_index(AMX *amx, cell *params)
+{
+	int len;
+	char *filename;
+	VDFIndex index(&logger);
+
+	filename = g_fn_BuildPathname("%s", MF_GetAmxString(amx, params[1], 0, &len));
+
+	if(params[2] < 0)
+		return 0;
+
+	logger.SetAmxContext(amx);
+
+	return index.Build(filename, (UINT)params[2]) ? 1 : 0;
+}
+
+/**
+ *	<code> native VdfTree:vdf_read_path(const filename[], const path[], index_depth = 2) </code>
+ *	@return	Returns a new tree holding the branch, or 0 if it's not found.
+ */
+static cell AMX_NATIVE_CALL vdf_read_path(AMX *amx, cell *params)
+{
+	int len;
+	char *filename;
+	char *path;
+	VDFTree *tree;
+	VDFIndex index(&logger);
+
+	filename = g_fn_BuildPathname("%s", MF_GetAmxString(amx, params[1], 0, &len));
+	path = MF_GetAmxString(amx, params[2], 1, &len);
+
+	if(params[3] < 0)
+		return 0;
+
+	logger.SetAmxContext(amx);
+
+	if((tree = index.ReadPath(filename, path, (UINT)params[3])) == NULL)
+		return 0;
+
+	// no file name, so the branch can't be saved over the whole file
+	return (cell)vdfCollection.RegisterTree(tree, "");
+}
+
+/**
+ *	<code> native VdfTree:vdf_open_from_string(const data[], const filename[] = "",
+ *							const node_added[] = "") </code>
+ *	@return	Returns the vdf tree or 0 on fail.
+ */
+static cell AMX_NATIVE_CALL vdf_open_from_string(AMX *amx, cell *params)
+{
+	int len;
+	char *mdFilename;
+	char *filename;
+	char *openFunc;
+	char *data;
+	size_t length;
+	OpenForward *openFW;
+	int fwid;
+	VDFTree *tree;
+
+	mdFilename = MF_GetAmxString(amx, params[2], 0, &len);
+	filename = len ? g_fn_BuildPathname("%s", mdFilename) : mdFilename;
+	openFunc = MF_GetAmxString(amx, params[3], 1, &len);
+	data = CopyAmxString(amx, params[1], length);
+
+	logger.SetAmxContext(amx);
+
+	openFW = RegisterOpenForward(amx, openFunc, mdFilename, fwid);
+
+	tree = vdfCollection.AddTreeFromString(data, length, filename, openFW);
+
+	ReleaseOpenForward(openFW, fwid);
+	FinalizeArray(data);
+
+	return (cell)tree;
+}
+
+/**
+ *	<code> native vdf_open_begin(const filename[]) </code>
+ *	@return	Returns a parse job, or 0 if file can't be read.
+ */
+static cell AMX_NATIVE_CALL vdf_open_begin(AMX *amx, cell *params)
+{
+	int len;
+	char *filename;
+
+	filename = g_fn_BuildPathname("%s", MF_GetAmxString(amx, params[1], 0, &len));
+
+	logger.SetAmxContext(amx);
+
+	return (cell)vdfCollection.AddParseJob(filename);
+}
+
+/**
+ *	<code> native vdf_open_step(parsejob, budget_us = 2000, budget_bytes = 0) </code>
+ *	@return	Returns 1 while there's data left, 0 when tree is complete or -1 on fail.
+ */
+static cell AMX_NATIVE_CALL vdf_open_step(AMX *amx, cell *params)
+{
+	VDFParseJob	*job;
+
+	job = reinterpret_cast<VDFParseJob*>(params[1]);
+
+	if(job == NULL || (params[2] < 1 && params[3] < 1))
+		return -1;
+
+	logger.SetAmxContext(amx);
+
+	switch(job->Step((double)params[2], params[3] > 0 ? (size_t)params[3] : 0)) {
+		case VDF_JOB_RUNNING:
+			return 1;
+		case VDF_JOB_DONE:
+			return 0;
+	}
+
+	return -1;
+}
+
+/**
+ *	<code> native VdfTree:vdf_open_end(parsejob) </code>
+ *	@return	Returns the tree if job is complete, otherwise job is cancelled and returns 0.
+ */
+static cell AMX_NATIVE_CALL vdf_open_end(AMX *amx, cell *params)
+{
+	VDFParseJob	*job;
+	VDFTree		*tree;
+
+	job = reinterpret_cast<VDFParseJob*>(params[1]);
+
+	if(job == NULL)
+		return 0;
+
+	if((tree = job->TakeTree()) != NULL) {
+		VDFJournal::Replay(tree, job->jobFile, &logger);
+		vdfCollection.RegisterTree(tree, job->jobFile);
+	}
+
+	vdfCollection.RemoveParseJob(job->jobId);
+
+	return (cell)tree;
+}
+
+/**
+ *	<code> native vdf_set_cache(bool:enabled = true, const directory[] = "") </code>
+ *	@return	Returns 1.
+ */
+static cell AMX_NATIVE_CALL vdf_set_cache(AMX *amx, cell *params)
+{
+	int		len;
+	char	*directory;
+
+	directory = MF_GetAmxString(amx, params[2], 0, &len);
+
+	vdfCollection.cache.SetEnabled(params[1] != 0);
+	vdfCollection.cache.SetDirectory(len ? g_fn_BuildPathname("%s", directory) : NULL);
+
+	return 1;
+}
+
+/**
+ *	<code> native vdf_set_escapes(bool:enabled = true) </code>
+ *	@return	Returns 1.
+ */
+static cell AMX_NATIVE_CALL vdf_set_escapes(AMX *amx, cell *params)
+{
+	VDFReader::SetEscapes(params[1] != 0);
+	vdfCollection.watcher.SetReaderSettings(VDFReader::shared);
+
+	// included trees were read with former setting
+	vdfCollection.includes.Clear();
+
+	return 1;
+}
+
+/**
+ *	<code> native vdf_set_condition(const flag[], bool:defined = true) </code>
+ *	@return	Returns 1.
+ */
+static cell AMX_NATIVE_CALL vdf_set_condition(AMX *amx, cell *params)
+{
+	int len;
+
+	VDFReader::SetCondition(MF_GetAmxString(amx, params[1], 0, &len), params[2] != 0);
+	vdfCollection.watcher.SetReaderSettings(VDFReader::shared);
+
+	// included trees were read with former flags
+	vdfCollection.includes.Clear();
+
+	return 1;
+}
+
+/**
+ *	<code> native vdf_clear_conditions() </code>
+ *	@return	Returns 1.
+ */
+static cell AMX_NATIVE_CALL vdf_clear_conditions(AMX *amx, cell *params)
+{
+	VDFReader::ClearConditions();
+	vdfCollection.watcher.SetReaderSettings(VDFReader::shared);
+	vdfCollection.includes.Clear();
+
+	return 1;
+}
+
+/**
+ *	<code> native vdf_save(vdftree, saveas[] = "") </code>
+ *	@return	Returns 1 if suceeded, 0 on fail.
+ */
+static cell AMX_NATIVE_CALL vdf_save(AMX *amx, cell *params)
+{
+	int			len;
+	VDFTree*	vdfTree;
+	bool		ret;	
+	VDFTreeFile	fileHandler;
+
+	char		*saveAs = g_fn_BuildPathname("%s", MF_GetAmxString(amx, params[2], 0, &len));
+	
+	vdfTree = reinterpret_cast<VDFTree*>(params[1]);
+	ret	= 0;	
+
+	if(vdfTree == NULL)
+		return 0;
+
+	// saving reads regular nodes
+	vdfTree->Thaw();
+
+	if(len)
+		ret = fileHandler.SaveVDF(saveAs, vdfTree);
+	else if(vdfTree->journal) {
+		// journal starts again along with the file
+		logger.SetAmxContext(amx);
+		ret = vdfTree->journal->Compact();
+	}
+	else
+		ret = fileHandler.SaveVDF(vdfCollection.GetContainerById(vdfTree->treeId)->vdfFile,
+				vdfTree);	
+
+	if(ret)
+		vdfCollection.SetTreeWritten(vdfTree,
+			len ? saveAs : vdfCollection.GetContainerById(vdfTree->treeId)->vdfFile);
+
+	return ret == true ? 1 : 0;
+}
+
+/**
+ *	<code> native vdf_save_begin(vdftree, saveas[] = "", bool:worker = false) </code>
+ *	@return	Returns a save job, or 0 on fail.
+ */
+static cell AMX_NATIVE_CALL vdf_save_begin(AMX *amx, cell *params)
+{
+	int			len;
+	VDFTree*	vdfTree;
+	VDFSaveJob	*job;
+	bool		ret;
+
+	char		*saveAs = g_fn_BuildPathname("%s", MF_GetAmxString(amx, params[2], 0, &len));
+
+	vdfTree = reinterpret_cast<VDFTree*>(params[1]);
+
+	// journal would be dropped once a stale snapshot replaces tree file
+	if(vdfTree == NULL || (!len && vdfTree->journal))
+		return 0;
+
+	// saving reads regular nodes
+	vdfTree->Thaw();
+
+	job = vdfCollection.AddSaveJob();
+
+	if(len)
+		ret = job->Begin(saveAs, vdfTree);
+	else
+		ret = job->Begin(vdfCollection.GetContainerById(vdfTree->treeId)->vdfFile, vdfTree);
+
+	if(!ret) {
+		vdfCollection.RemoveSaveJob(job->jobId);
+		return 0;
+	}
+
+	// worker param was added later, old plugins don't pass it;
+	// jobs are written by steps if worker can't be started
+	if(params[0] / sizeof(cell) >= 3 && params[3])
+		job->StartWorker();
+
+	return (cell)job;
+}
+
+/**
+ *	<code> native vdf_save_step(savejob, budget = 256) </code>
+ *	@return	Returns 1 while there are nodes left, 0 when file is
+ *			complete or -1 on fail. Jobs written by a worker
+ *			just report their state.
+ */
+static cell AMX_NATIVE_CALL vdf_save_step(AMX *amx, cell *params)
+{
+	VDFSaveJob	*job;
+
+	job = reinterpret_cast<VDFSaveJob*>(params[1]);
+
+	if(job == NULL || params[2] < 1)
+		return -1;
+
+	switch(job->Step((size_t)params[2])) {
+		case VDF_JOB_RUNNING:
+			return 1;
+		case VDF_JOB_DONE:
+			vdfCollection.SetTreeWritten(job->tree, job->jobFile);
+			return 0;
+	}
+
+	return -1;
+}
+
+/**
+ *	<code> native vdf_save_close(savejob) </code>
+ *	@return	Returns 1 if succeeded.
+ */
+static cell AMX_NATIVE_CALL vdf_save_close(AMX *amx, cell *params)
+{
+	VDFSaveJob	*job;
+
+	job = reinterpret_cast<VDFSaveJob*>(params[1]);
+
+	if(job == NULL)
+		return 0;
+
+	vdfCollection.RemoveSaveJob(job->jobId);
+	return 1;
+}
+
+/**
+ *	<code> native vdf_dump_to_string(vdftree, node, buffer[], maxlen, bool:compact = false) </code>
+ *	@return	Returns the length of the whole text (greater than maxlen if it's been cut),
+ *			-1 on fail.
+ */
+static cell AMX_NATIVE_CALL vdf_dump_to_string(AMX *amx, cell *params)
+{
+	VDFTree		*vdfTree;
+	VDFNode		*vdfNode;
+	VDFBuffer	output;
+
+	vdfTree = reinterpret_cast<VDFTree*>(params[1]);
+
+	if(vdfTree == NULL)
+		return -1;
+
+	// a frozen tree is thawed before its node is read
+	vdfTree->Thaw();
+
+	if(params[2])
+		vdfNode = GetRegularNode(params[2]);
+	else
+		vdfNode = vdfTree->rootNode;
+
+	if(!VDFTreeFile::DumpVDF(vdfNode, output, params[5] != 0))
+		return -1;
+
+	output.AppendByte('\0');
+	MF_SetAmxString(amx, params[3], output.data, params[4]);
+
+	return (cell)(output.length - 1);
+}
+
+/**
+ *	<code> native vdf_save_binary(vdftree, saveas[] = "") </code>
+ *	@return	Returns 1 if suceeded, 0 on fail.
+ */
+static cell AMX_NATIVE_CALL vdf_save_binary(AMX *amx, cell *params)
+{
+	int			len;
+	VDFTree*	vdfTree;
+	bool		ret;
+	VDFTreeFile	fileHandler;
+
+	char		*saveAs = g_fn_BuildPathname("%s", MF_GetAmxString(amx, params[2], 0, &len));
+
+	vdfTree = reinterpret_cast<VDFTree*>(params[1]);
+	ret	= 0;
+
+	if(vdfTree == NULL)
+		return 0;
+
+	// saving reads regular nodes
+	vdfTree->Thaw();
+
+	if(len)
+		ret = fileHandler.SaveBinaryVDF(saveAs, vdfTree);
+	else
+		ret = fileHandler.SaveBinaryVDF(vdfCollection.GetContainerById(vdfTree->treeId)->vdfFile,
+				vdfTree);
+
+	if(ret)
+		vdfCollection.SetTreeWritten(vdfTree,
+			len ? saveAs : vdfCollection.GetContainerById(vdfTree->treeId)->vdfFile);
+
+	return ret == true ? 1 : 0;
+}
+
+/**
+ *	<code> native vdf_save_image(vdftree, saveas[] = "") </code>
+ *	@return	Returns 1 if suceeded, 0 on fail.
+ */
+static cell AMX_NATIVE_CALL vdf_save_image(AMX *amx, cell *params)
+{
+	int			len;
+	VDFTree*	vdfTree;
+	VDFImage	vdfImage;
+	bool		ret;
+	char		*saveAs = g_fn_BuildPathname("%s", MF_GetAmxString(amx, params[2], 0, &len));
+
+	vdfTree = reinterpret_cast<VDFTree*>(params[1]);
+
+	if(vdfTree == NULL)
+		return 0;
+
+	if(!len)
+		saveAs = vdfCollection.GetContainerById(vdfTree->treeId)->vdfFile;
+
+	// a frozen tree already has its image
+	if(vdfTree->IsFrozen())
+		ret = vdfTree->image->Save(saveAs);
+	else {
+		vdfTree->Thaw();
+		ret = vdfImage.Build(vdfTree) && vdfImage.Save(saveAs);
+	}
+
+	if(ret)
+		vdfCollection.SetTreeWritten(vdfTree, saveAs);
+
+	return ret ? 1 : 0;
+}
+
+/**
+ *	<code> native vdf_get_root_node(vdftree) </code>
+ *	@return	Returns a pointer of the root node.
+ */
+static cell AMX_NATIVE_CALL vdf_get_root_node(AMX *amx, cell *params)
+{
+	VDFTree *vdfTree;
+
+	vdfTree = reinterpret_cast<VDFTree*>(params[1]);
+	
+	if(vdfTree == NULL)
+		return 0;
+
+	if(vdfTree->IsFrozen())
+		return (cell)(vdfTree->image->GetHandle(vdfTree->image->GetRootNode()));
+
+	return (cell)(vdfTree->rootNode);
+}
+
+/**
+ *	<code> native vdf_get_first_node(node) </code>
+ *	@return	Returns a pointer to first node in a branch.
+ */
+static cell AMX_NATIVE_CALL vdf_get_first_node(AMX *amx, cell *params)
+{
+	VDFNode			*vdfNode;
+	VDFImage		*image;
+	UINT			imageNode;
+	
+	vdfNode = GetReadableNode(params[1], &image, imageNode);
+
+	if(image != NULL)
+		return (cell)(image->GetHandle(image->GetFirstNode(imageNode)));
+
+	if(vdfNode == NULL)
+		return 0;
+
+	return (cell)(VDFTree::GetFirstNode(vdfNode));
+}
+
+/**
+ *	<code> native vdf_get_last_node(node) </code>
+ *	@return	Returns a pointer to the last node in a branch.
+ */
+static cell AMX_NATIVE_CALL vdf_get_last_node(AMX *amx, cell *params)
+{
+	VDFNode			*vdfNode;
+	VDFImage		*image;
+	UINT			imageNode;
+
+	vdfNode = GetReadableNode(params[1], &image, imageNode);
+
+	if(image != NULL)
+		return (cell)(image->GetHandle(image->GetLastNode(imageNode)));
+
+	if(vdfNode == NULL)
+		return 0;
+
+	return (cell)(VDFTree::GetLastNode(vdfNode));
+}
+
+/**
+ *	<code> native vdf_get_previous_node(node) </code>
+ *	@return	Returns a pointer to the previous.
+ */
+static cell AMX_NATIVE_CALL vdf_get_previous_node(AMX *amx, cell *params)
+{
+	VDFNode			*vdfNode;
+	VDFImage		*image;
+	UINT			imageNode;
+
+	vdfNode = GetReadableNode(params[1], &image, imageNode);
+
+	if(image != NULL)
+		return (cell)(image->GetHandle(image->GetPreviousNode(imageNode)));
+
+	if(vdfNode == NULL)
+		return 0;
+
+	return (cell)(VDFTree::GetPreviousNode(vdfNode));
+}
+
+/**
+ *	<code> native vdf_get_child_node(node) </code>
+ *	@return	Returns a pointer to the last tree in a branch.
+ */
+static cell AMX_NATIVE_CALL vdf_get_child_node(AMX *amx, cell *params)
+{
+	VDFNode			*vdfNode;
+	VDFImage		*image;
+	UINT			imageNode;
+
+	vdfNode = GetReadableNode(params[1], &image, imageNode);
+
+	if(image != NULL)
+		return (cell)(image->GetHandle(image->GetChildNode(imageNode)));
+
+	if(vdfNode == NULL)
+		return 0;
+
+	LoadLazyBranch(vdfNode);
+
+	return (cell)(vdfNode->childNode);
+}
+
+/**
+ *	<code> native vdf_get_next_node(node) </code>
+ *	@return	Returns a pointer to the next node.
+ */
+static cell AMX_NATIVE_CALL vdf_get_next_node(AMX *amx, cell *params)
+{
+	VDFNode			*vdfNode;
+	VDFImage		*image;
+	UINT			imageNode;
+	
+	vdfNode = GetReadableNode(params[1], &image, imageNode);
+
+	if(image != NULL)
+		return (cell)(image->GetHandle(image->GetNextNode(imageNode)));
+
+	if(vdfNode == NULL)
+		return 0;
+
+	return (cell)(vdfNode->nextNode);
+}
+
+/**
+ *	<code>native vdf_get_parent_node(node)</code>
+ *	@return	Returns a pointer to the parent node.
+ */
+static cell AMX_NATIVE_CALL vdf_get_parent_node(AMX *amx, cell *params)
+{
+	VDFNode			*vdfNode;
+	VDFImage		*image;
+	UINT			imageNode;
+
+	vdfNode = GetReadableNode(params[1], &image, imageNode);
+
+	if(image != NULL)
+		return (cell)(image->GetHandle(image->GetParentNode(imageNode)));
+
+	if(vdfNode == NULL)
+		return 0;
+
+	return (cell)(vdfNode->parentNode);
+}
+
+/**
+ *	<code>native vdf_next_in_traverse(node)</code>
+ *	@return	Returns a pointer to the next node in tree traverse.
+ */
+static cell AMX_NATIVE_CALL vdf_next_in_traverse(AMX *amx, cell *params)
+{
+	VDFNode			*vdfNode;
+	VDFImage		*image;
+	UINT			imageNode;
+	cell *curDepth;
+	int  depth;
+	cell ret;
+
+	vdfNode = GetReadableNode(params[1], &image, imageNode);
+	curDepth = MF_GetAmxAddr(amx, params[2]);
+	depth = (int)(*curDepth);
+
+	if(image != NULL)
+		ret = (cell)(image->GetHandle(image->GetNextTraverseStep(imageNode, depth)));
+	else if(vdfNode != NULL) {
+		LoadLazyBranch(vdfNode);
+		ret = (cell)(VDFTree::GetNextTraverseStep(vdfNode, depth));
+	}
+	else
+		return 0;
+
+	*curDepth = (cell)depth;
+
+	return ret;
+}
+
+/**
+ *	<code> native vdf_delete_node(vdftree, node) </code>
+ *	@return	Returns 1 if it's been delete or 0 if it's already been deleted
+ */
+static cell AMX_NATIVE_CALL vdf_delete_node(AMX *amx, cell *params)
+{
+	VDFNode		*vdfNode;
+	VDFTree		*vdfTree;
+	VDFJournal	*journal;
+
+	vdfNode = GetWritableNode(params[2]);
+	vdfTree = reinterpret_cast<VDFTree*>(params[1]);
+
+	if(vdfNode == NULL || vdfTree == NULL)
+		return 0;
+
+	if((journal = vdfCollection.GetNodeJournal(vdfNode)) != NULL)
+		journal->RecordDelete(vdfNode);
+	
+	vdfTree->DeleteNode(vdfNode);
+	
+	return 1;
+}
+
+/**
+ *	<code> native vdf_delete_node_deferred(vdftree, node) </code>
+ *	@return	Returns 1 if node has been unlinked.
+ */
+static cell AMX_NATIVE_CALL vdf_delete_node_deferred(AMX *amx, cell *params)
+{
+	VDFNode		*vdfNode;
+	VDFTree		*vdfTree;
+	VDFJournal	*journal;
+
+	vdfNode = GetWritableNode(params[2]);
+	vdfTree = reinterpret_cast<VDFTree*>(params[1]);
+
+	if(vdfNode == NULL || vdfTree == NULL)
+		return 0;
+
+	if((journal = vdfCollection.GetNodeJournal(vdfNode)) != NULL)
+		journal->RecordDelete(vdfNode);
+
+	vdfTree->DeleteNodeDeferred(vdfNode);
+
+	return 1;
+}
+
+/**
+ *	<code> native vdf_process_deletes(vdftree, budget = 256) </code>
+ *	@return	Returns 1 if there are still nodes waiting, 0 otherwise.
+ */
+static cell AMX_NATIVE_CALL vdf_process_deletes(AMX *amx, cell *params)
+{
+	VDFTree		*vdfTree;
+
+	vdfTree = reinterpret_cast<VDFTree*>(params[1]);
+
+	if(vdfTree == NULL || params[2] < 1)
+		return 0;
+
+	return vdfTree->ProcessDeletes((size_t)params[2]) ? 1 : 0;
+}
+
+/**
+ *	<code>native vdf_get_node_key(node, key[], maxlen)</code>
+ *	@return	Returns 1 if succeeded
+ */
+static cell AMX_NATIVE_CALL vdf_get_node_key(AMX *amx, cell *params)
+{
+	const char	*nodekey;
+	bool		valid;
+
+	nodekey = GetNodeString(params[1], true, valid);
+
+	if(nodekey == NULL)
+		return 0;	
+
+	MF_SetAmxString(amx, params[2], nodekey, (int)params[3]);
+
+	return 1;		
+}
+
+/**
+ *	<code> native vdf_get_node_value(node, value[], maxlen) </code>
+ *	@return	Returns 1 if succeeded
+ */
+static cell AMX_NATIVE_CALL vdf_get_node_value(AMX *amx, cell *params)
+{
+	const char	*nodevalue;
+	bool		valid;
+
+	nodevalue = GetNodeString(params[1], false, valid);
+	
+	if(!valid)
+		return 0;
+
+	MF_SetAmxString(amx, params[2], (nodevalue == NULL) ? "" : nodevalue, (int)params[3]);
+
+	return 1;
+}
+
+/**
+ *	<code> native vdf_create_tree(const filename[]) </code>
+ *	@return	Returns a pointer to the new tree if succeeded, 0 on fail.
+ */
+static cell AMX_NATIVE_CALL vdf_create_tree(AMX *amx, cell *params)
+{
+	int 	len;
+
+	char *vdfFile = g_fn_BuildPathname("%s", MF_GetAmxString(amx, params[1], 0, &len));
+	return (cell)vdfCollection.AddTree(vdfFile, true);
+}
+
+/**
+ *	<code> native vdf_clone_tree(VdfTree:tree, const filename[] = "") </code>
+ *	@return	Returns a pointer to the new tree if succeeded, 0 on fail.
+ */
+static cell AMX_NATIVE_CALL vdf_clone_tree(AMX *amx, cell *params)
+{
+	VDFTree	*vdfTree;
+	VDFEnum	*container;
+	char	*vdfFile;
+	int		len;
+
+	vdfTree = reinterpret_cast<VDFTree*>(params[1]);
+	vdfFile = MF_GetAmxString(amx, params[2], 0, &len);
+
+	if(vdfTree == NULL || (container = vdfCollection.GetContainerById(vdfTree->treeId)) == NULL)
+		return 0;
+
+	// source is read as regular nodes
+	vdfTree->Thaw();
+
+	return (cell)vdfCollection.RegisterTree(vdfTree->Clone(),
+		len ? g_fn_BuildPathname("%s", vdfFile) : container->vdfFile);
+}
+
+/**
+ *	<code> native vdf_copy_subtree(VdfTree:dsttree, VdfNode:dstparent, VdfNode:srcnode) </code>
+ *	@return	Returns a pointer to the copied node if succeeded, 0 on fail.
+ */
+static cell AMX_NATIVE_CALL vdf_copy_subtree(AMX *amx, cell *params)
+{
+	VDFTree		*vdfTree;
+	VDFNode		*parentNode;
+	VDFNode		*srcNode;
+	VDFNode		*newNode;
+	VDFJournal	*journal;
+
+	vdfTree		= reinterpret_cast<VDFTree*>(params[1]);
+	parentNode	= GetWritableNode(params[2]);
+	srcNode		= GetRegularNode(params[3]);
+
+	if(vdfTree == NULL || parentNode == NULL || srcNode == NULL
+		|| vdfCollection.GetNodeOwner(parentNode) != vdfTree)
+		return 0;
+
+	// copy is complete before it's linked, so a branch can be copied into itself
+	newNode = vdfTree->CloneBranch(srcNode);
+	vdfTree->AppendChild(parentNode, newNode);
+
+	// copies aren't recorded, tree is saved on next sync
+	if((journal = vdfCollection.GetNodeJournal(newNode)) != NULL)
+		journal->Invalidate();
+
+	return (cell)newNode;
+}
+
+/**
+ *	<code> native vdf_get_append_node(vdftree, node, key = "", value = "") </code>
+ *	@return	Returns a pointer to the new appended node if succeeded, 0 on fail
+ */
+static cell AMX_NATIVE_CALL vdf_append_node(AMX *amx, cell *params)
+{
+	char		*key   = NULL;
+	char		*value = NULL;
+	int			lenk, lenv;
+	VDFNode		*newNode;
+	VDFNode		*refNode;
+	VDFTree		*vdfTree;
+	VDFJournal	*journal;
+
+	vdfTree    = reinterpret_cast<VDFTree*>(params[1]);
+	refNode    = GetWritableNode(params[2]);
+	key		   = MF_GetAmxString(amx, params[3], 0, &lenk);
+	value	   = MF_GetAmxString(amx, params[4], 1, &lenv);
+	
+	if(vdfTree == NULL || refNode == NULL)
+		return 0;
+
+	vdfTree->Thaw();
+
+	newNode = vdfTree->CreateNode();
+	
+	if(key && lenk)
+		vdfTree->SetKeyPair(newNode, key);
+	if(value && lenv)
+		vdfTree->SetKeyPair(newNode, NULL, value);
+
+	vdfTree->AppendNode(refNode, newNode);
+
+	if((journal = vdfCollection.GetNodeJournal(newNode)) != NULL)
+		journal->RecordAppend(newNode);
+	
+	return (cell)newNode;
+}
+
+/**
+ *	<code> native vdf_append_childnode(vdf, node, key[] = "", value[] = "") </code>
+ *	@return	Returns a pointer to the new appended child if succeeded, 0 on fail.
+ */
+static cell AMX_NATIVE_CALL vdf_append_child_node(AMX *amx, cell *params)
+{
+	char		*key   = NULL;
+	char		*value = NULL;
+	int			lenk, lenv;
+	VDFNode		*newNode;
+	VDFNode		*refNode;
+	VDFTree		*vdfTree;
+	VDFJournal	*journal;
+
+	vdfTree		= reinterpret_cast<VDFTree*>(params[1]);
+	refNode		= GetWritableNode(params[2]);
+	key			= MF_GetAmxString(amx, params[3], 0, &lenk);
+	value		= MF_GetAmxString(amx, params[4], 1, &lenv);
+	
+	if(vdfTree == NULL || refNode == NULL)
+		return 0;
+
+	vdfTree->Thaw();
+
+	newNode = vdfTree->CreateNode();
+	
+	if(key != NULL && lenk)
+		vdfTree->SetKeyPair(newNode, key);
+	if(value != NULL && lenv)
+		vdfTree->SetKeyPair(newNode, NULL, value);
+
+	vdfTree->AppendChild(refNode, newNode);
+
+	if((journal = vdfCollection.GetNodeJournal(newNode)) != NULL)
+		journal->RecordAppend(newNode);
+	
+	return (cell)newNode;
+}
+
+
+/**
+ *	<code> native vdf_set_node_key(node, const key[]) </code>
+ *	@return	Returns 1 if succeeded, 0 on fail
+ */
+static cell AMX_NATIVE_CALL vdf_set_node_key(AMX *amx, cell *params)
+{
+	VDFNode		*vdfNode;
+	VDFJournal	*journal;
+	int			lenk;
+	char		*key;
+
+	key		=  MF_GetAmxString(amx, params[2], 0, &lenk);
+	vdfNode =  GetWritableNode(params[1]);
+	
+	if(vdfNode == NULL)
+		return 0;
+
+	VDFTree::SetKeyPair(vdfNode, key);
+
+	if((journal = vdfCollection.GetNodeJournal(vdfNode)) != NULL)
+		journal->RecordKey(vdfNode);
+
+	return 1;
+}
+
+/**
+ *	<code> native vdf_set_node_value(node, const value[]) </code>
+ */
+static cell AMX_NATIVE_CALL vdf_set_node_value(AMX *amx, cell *params)
+{
+	VDFNode		*vdfNode;
+	VDFJournal	*journal;
+	int			lenv;
+	char		*value;
+
+	value		=  MF_GetAmxString(amx, params[2], 0, &lenv);
+	vdfNode		=  GetWritableNode(params[1]);
+	
+	if(vdfNode == NULL)
+		return 0;
+
+	VDFTree::SetKeyPair(vdfNode, NULL, value);
+
+	if((journal = vdfCollection.GetNodeJournal(vdfNode)) != NULL)
+		journal->RecordValue(vdfNode);
+
+	return 1;
+}
+
+
+/**
+ *	<code> native vdf_remove_tree(vdftree) </code>
+ *	@return	Returns 1 if succeeded, 0 on fail
+ */
+static cell AMX_NATIVE_CALL vdf_remove_tree(AMX *amx, cell *params)
+{
+	VDFTree *tree;
+	int		forward;
+	
+	tree = reinterpret_cast<VDFTree*>(params[1]);
+
+	if(tree == NULL)
+		return 0;
+
+	if((forward = vdfCollection.watcher.Unwatch(tree)) >= 0)
+		MF_UnregisterSPForward(forward);
+	
+	vdfCollection.RemoveTree(&tree);
+	return 1; 
+}
+
+/**
+ *	<code> native vdf_count_branch_nodes(node) <code>
+ *	@return	Returns number of nodes in current branch.
+ */
+static cell AMX_NATIVE_CALL vdf_count_branch_nodes(AMX *amx, cell *params)
+{
+	VDFNode			*refNode;
+	VDFImage		*image;
+	UINT			imageNode;
+
+	refNode = GetReadableNode(params[1], &image, imageNode);
+	
+	if(image != NULL)
+		return image->CountBranchNodes(imageNode);
+
+	if(refNode != NULL)
+		return VDFTree::CountBranchNodes(refNode);
+
+	return 0;
+}
+
+/**
+ *	<code> vdf_create_search() </code>
+ *	@return	Returns search pointer.
+ */
+static cell AMX_NATIVE_CALL vdf_create_search(AMX *amx, cell *params)
+{
+	return (cell)vdfCollection.AddSearch();
+}
+
+// set_search
+
+/**
+ *	<code> vdf_set_search(search, tree, const searchstr[], searchtype = 0,
+ *							level = -1, ignorecase = 0) </code>
+ */
+static cell AMX_NATIVE_CALL vdf_set_search(AMX *amx, cell *params)
+{
+	int			level;
+	UINT		searchType;
+	UINT		ignoreCase;
+	char		*searchStr;
+	VDFTree		*tree;
+	VDFSearch	*search;
+	int			len;
+
+	search		=	reinterpret_cast<VDFSearch*>(params[1]);
+	tree		=	reinterpret_cast<VDFTree*>(params[2]);
+	searchStr	=	MF_GetAmxString(amx, params[3], 0, &len);
+	searchType	=	(UINT)params[4];
+	level		=	(int)params[5];
+	ignoreCase	=	(UINT)params[6];
+
+	if(tree == NULL || search == NULL)
+		return 0;
+
+	// searches read regular nodes
+	tree->Thaw();
+
+	vdfCollection.SetSearch(search, tree, searchStr, searchType,
+											  level, ignoreCase);
+
+	return 1;
+}
+
+
+/**
+ *	<code>	vdf_find_next_match(search, startnode = 0)	</code>
+ *	@return	Returns next node or 0 if nothing is found.
+ */
+static cell AMX_NATIVE_CALL vdf_find_next_match(AMX *amx, cell *params)
+{
+	VDFSearch *search;
+	VDFNode   *node;
+	
+	search = reinterpret_cast<VDFSearch*>(params[1]);
+	node   = GetRegularNode(params[2]);
+
+	if(search == NULL)
+		return 0;
+
+	node = search->FindNextNode(node);
+	
+	return (cell)node;
+}
+
+/**
+ *	<code>	vdf_close_search(search)	</code>
+ */
+static cell AMX_NATIVE_CALL vdf_close_search(AMX *amx, cell *params)
+{
+	VDFSearch *search;
+	
+	search = reinterpret_cast<VDFSearch*>(params[1]);
+	
+	if(search == NULL)
+		return 0;
+	
+	vdfCollection.RemoveSearch(search->searchId);
+	return 1;
+}
+
+/*
+ * <code>	vdf_get_node_level(node) </code>
+ *	@return	The level of a node. Because a node level 0 is valid, it returns -1 on error.
+ */
+
+static cell AMX_NATIVE_CALL vdf_get_node_level(AMX *amx, cell *params)
+{
+	VDFNode			*vdfNode;
+	VDFImage		*image;
+	UINT			imageNode;
+
+	vdfNode = GetReadableNode(params[1], &image, imageNode);
+
+	if(image != NULL)
+		return (cell)(image->GetNodeLevel(imageNode));
+
+	if(vdfNode == NULL)
+		return -1;
+	
+
+	return (cell)(VDFTree::GetNodeLevel(vdfNode));
+}
+
+//vdf_get_node_value_int(node)
+static cell AMX_NATIVE_CALL vdf_get_node_value_num(AMX *amx, cell *params)
+{
+	const char	*value;
+	bool		valid;
+
+	value = GetNodeString(params[1], false, valid);
+
+	if(value == NULL)
+		return 0;
+
+	return (cell)atoi(value);
+}
+
+//vdf_get_node_value_float(node, Float:value)
+static cell AMX_NATIVE_CALL vdf_get_node_value_float(AMX *amx, cell *params)
+{
+	const char	*value;
+	bool		valid;
+
+	value = GetNodeString(params[1], false, valid);
+
+	if(!valid)
+		return 0;
+
+	return StringToFloat((value == NULL) ? "" : value);	
+}
+
+//vdf_get_node_value_vector(node, Float:vector[3])
+static cell AMX_NATIVE_CALL vdf_get_node_value_vector(AMX *amx, cell *params)
+{
+	char		*value;
+	char		sep[4];
+	char		*token;
+	cell		*vec;
+	const char	*nodevalue;
+	bool		valid;
+	size_t		len;
+	
+	vec = MF_GetAmxAddr(amx, params[2]);
+	nodevalue = GetNodeString(params[1], false, valid);
+
+	if(!valid)
+		return 0;
+	
+	if(nodevalue == NULL) {
+		vec[0] = 0;
+		vec[1] = 0;
+		vec[2] = 0;
+		return 0;
+	}
+	
+	value = new char[strlen(nodevalue) + 1];
+	strcpy(value, nodevalue);
+
+	sprintf(sep, " ,");
+	token = strtok(value, sep);
+	len = 0;
+	
+	while(len < 3 && token != NULL) {
+		vec[len++] = StringToFloat(token);
+		token = strtok(NULL, sep);
+	}
+	
+	delete(value);
+
+	if(len)
+		return 1;
+
+	return 0;
+}
+
+//vdf_set_node_value_num(VdfNode:node, value)
+static cell AMX_NATIVE_CALL vdf_set_node_value_num(AMX *amx, cell *params)
+{
+	char value[12];
+	VDFNode* node;
+	VDFJournal *journal;
+
+	node = GetWritableNode(params[1]);
+
+	if (node == NULL)
+		return 0;
+
+	_snprintf(value, 12, "%d", params[2]);
+	VDFTree::SetKeyPair(node, NULL, value);
+
+	if((journal = vdfCollection.GetNodeJournal(node)) != NULL)
+		journal->RecordValue(node);
+
+	return 1;
+}
+
+//vdf_set_node_value_float(VdfNode:node, Float:value)
+static cell AMX_NATIVE_CALL vdf_set_node_value_float(AMX *amx, cell *params)
+{
+	char		value[22];
+	VDFNode		*node;
+	VDFJournal	*journal;
+
+	node = GetWritableNode(params[1]);
+	
+	if(node == NULL)
+		return 0;
+
+	_snprintf(value, 22, "%f", amx_ctof(params[2]));
+	VDFTree::SetKeyPair(node, NULL, value);	
+
+	if((journal = vdfCollection.GetNodeJournal(node)) != NULL)
+		journal->RecordValue(node);
+
+	return 1;
+}
+
+//vdf_set_node_value_vector(VdfNode:node, Float:vector[3])
+static cell AMX_NATIVE_CALL vdf_set_node_value_vector(AMX *amx, cell *params)
+{
+	char		value[70];
+	int			len;
+	VDFNode		*node;
+	VDFJournal	*journal;
+	cell		*vector;
+
+	node = GetWritableNode(params[1]);
+
+	if(node == NULL)
+		return 0;
+	
+	vector = MF_GetAmxAddr(amx, params[2]);
+
+	len = _snprintf(value, 22, "%f ", amx_ctof(vector[0]));
+	len += _snprintf(value + len, 22, "%f ", amx_ctof(vector[1]));
+	len += _snprintf(value + len, 21, "%f", amx_ctof(vector[2]));
+	
+	VDFTree::SetKeyPair(node, NULL, value);
+
+	if((journal = vdfCollection.GetNodeJournal(node)) != NULL)
+		journal->RecordValue(node);
+
+	return 1;
+
+}
+
+//vdf_set_node_value_vector(VdfNode:node, Float:vector[3])
+static cell AMX_NATIVE_CALL vdf_sort_branch(AMX *amx, cell *params)
+{
+	VDFTree		*tree;
+	VDFNode		*node;
+	VDFJournal	*journal;
+	UINT		byValue;
+	UINT		asNumber;
+
+	tree = reinterpret_cast<VDFTree*>(params[1]);
+	node = GetWritableNode(params[2]);
+	byValue = (UINT)params[3];
+	asNumber = (UINT)params[4];
+
+	if(tree == NULL || node == NULL)
+		return 0;
+
+	if((journal = vdfCollection.GetNodeJournal(node)) != NULL)
+		journal->RecordSort(node, byValue == 1, asNumber == 1);
+
+	tree->SortBranchNodes(node, byValue == 1, asNumber == 1);
+	return (cell) VDFTree::GetFirstNode(node);
+}
+
+//vdf_move_to_branch(VdfTree:tree, VdfNode:moveNode, anchorNode, bool:insertAfter = true) 
+static cell AMX_NATIVE_CALL vdf_move_to_branch(AMX *amx, cell *params)
+{
+	VDFTree		*tree;
+	VDFNode		*moveNode;
+	VDFNode		*anchorNode;
+	VDFJournal	*journal;
+	UINT		insertAfter;
+
+	tree = reinterpret_cast<VDFTree*>(params[1]);
+	moveNode = GetWritableNode(params[2]);
+	anchorNode = GetWritableNode(params[3]);
+	insertAfter = (UINT)params[4];
+
+	if(moveNode == NULL || anchorNode == NULL || moveNode == anchorNode)
+		return 0;
+
+	if((journal = JournalMove(moveNode, anchorNode)) != NULL)
+		journal->RecordMove(moveNode, anchorNode, (insertAfter) ? VDF_MOVEPOS_AFTER : VDF_MOVEPOS_BEFORE);
+
+	tree->MoveToBranch(anchorNode, moveNode, (insertAfter) ? VDF_MOVEPOS_AFTER : VDF_MOVEPOS_BEFORE);
+	
+	return 1;
+
+}
+
+
+//vdf_move_as_child(VdfTree:tree, VdfNode:moveNode, VdfNode:parentNode) 
+static cell AMX_NATIVE_CALL vdf_move_as_child(AMX *amx, cell *params)
+{
+	VDFTree		*tree;
+	VDFNode		*moveNode;
+	VDFNode		*parentNode;
+	VDFJournal	*journal;
+
+	tree = reinterpret_cast<VDFTree*>(params[1]);
+	moveNode = GetWritableNode(params[2]);
+	parentNode = GetWritableNode(params[3]);
+
+	if(moveNode == NULL || parentNode == NULL || moveNode->parentNode == parentNode)
+		return 0;
+
+	if((journal = JournalMove(moveNode, parentNode)) != NULL)
+		journal->RecordMoveAsChild(moveNode, parentNode);
+
+	tree->MoveAsChild(parentNode, moveNode);
+	
+	return 1;
+
+}
+
+/**
+ *	<code> native vdf_merge(VdfTree:dst, VdfTree:src, policy = VDF_MERGE_OVERWRITE) </code>
+ *	@return	Returns 1 if suceeded, 0 on fail.
+ */
+static cell AMX_NATIVE_CALL vdf_merge(AMX *amx, cell *params)
+{
+	VDFTree *dst;
+	VDFTree *src;
+
+	dst = reinterpret_cast<VDFTree*>(params[1]);
+	src = reinterpret_cast<VDFTree*>(params[2]);
+
+	if(dst == NULL || src == NULL || dst == src
+		|| params[3] < VDF_MERGE_OVERWRITE || params[3] > VDF_MERGE_APPEND)
+		return 0;
+
+	// source is read as regular nodes
+	dst->Thaw();
+	src->Thaw();
+	dst->DetachSnapshots();
+
+	// merges aren't recorded, tree is saved on next sync
+	if(dst->journal)
+		dst->journal->Invalidate();
+
+	dst->MergeTree(src, params[3]);
+
+	return 1;
+}
+
+/**
+ *	<code> native vdf_journal_start(VdfTree:tree, limit = 262144) </code>
+ *	@return	Returns 1 if succeeded, 0 on fail.
+ */
+static cell AMX_NATIVE_CALL vdf_journal_start(AMX *amx, cell *params)
+{
+	VDFTree *tree;
+
+	tree = reinterpret_cast<VDFTree*>(params[1]);
+
+	logger.SetAmxContext(amx);
+
+	if(!vdfCollection.StartJournal(tree, params[2] > 0 ? (size_t)params[2] : VDF_JOURNAL_DEFAULT_LIMIT))
+		return 0;
+
+	// tree may have been saved
+	vdfCollection.SetTreeWritten(tree, vdfCollection.GetContainerById(tree->treeId)->vdfFile);
+
+	return 1;
+}
+
+/**
+ *	<code> native vdf_journal_sync(VdfTree:tree) </code>
+ *	@return	Returns 1 if succeeded, 0 on fail.
+ */
+static cell AMX_NATIVE_CALL vdf_journal_sync(AMX *amx, cell *params)
+{
+	VDFTree *tree;
+	bool	ret;
+
+	tree = reinterpret_cast<VDFTree*>(params[1]);
+
+	if(tree == NULL || tree->journal == NULL)
+		return 0;
+
+	logger.SetAmxContext(amx);
+	ret = tree->journal->Sync();
+	vdfCollection.SetTreeWritten(tree, vdfCollection.GetContainerById(tree->treeId)->vdfFile);
+
+	return ret ? 1 : 0;
+}
+
+/**
+ *	<code> native vdf_journal_stop(VdfTree:tree) </code>
+ *	@return	Returns 1 if tree was journaled, 0 otherwise.
+ */
+static cell AMX_NATIVE_CALL vdf_journal_stop(AMX *amx, cell *params)
+{
+	VDFTree *tree;
+
+	tree = reinterpret_cast<VDFTree*>(params[1]);
+
+	if(tree == NULL || tree->journal == NULL)
+		return 0;
+
+	logger.SetAmxContext(amx);
+	vdfCollection.StopJournal(tree);
+	vdfCollection.SetTreeWritten(tree, vdfCollection.GetContainerById(tree->treeId)->vdfFile);
+
+	return 1;
+}
+
+/**
+ *	<code> native vdf_watch(VdfTree:tree, const callback[]) </code>
+ *	@return	Returns 1 if succeeded, 0 on fail.
+ */
+static cell AMX_NATIVE_CALL vdf_watch(AMX *amx, cell *params)
+{
+	VDFTree *tree;
+	char	*callback;
+	int		len;
+	int		forward;
+
+	tree = reinterpret_cast<VDFTree*>(params[1]);
+	callback = MF_GetAmxString(amx, params[2], 0, &len);
+
+	if(tree == NULL || !len)
+		return 0;
+
+	// public callback(VdfTree:tree, const filename[])
+	if((forward = MF_RegisterSPForwardByName(amx, callback, FP_CELL, FP_STRING, FP_DONE)) < 0)
+		return 0;
+
+	if(!vdfCollection.WatchTree(tree, forward)) {
+		MF_UnregisterSPForward(forward);
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ *	<code> native vdf_unwatch(VdfTree:tree) </code>
+ *	@return	Returns 1 if tree was watched, 0 otherwise.
+ */
+static cell AMX_NATIVE_CALL vdf_unwatch(AMX *amx, cell *params)
+{
+	int forward;
+
+	if((forward = vdfCollection.watcher.Unwatch(reinterpret_cast<VDFTree*>(params[1]))) < 0)
+		return 0;
+
+	MF_UnregisterSPForward(forward);
+
+	return 1;
+}
+
+/**
+ *	<code> native vdf_watch_dispatch() </code>
+ *	@return	Returns the number of reloaded trees.
+ */
+static cell AMX_NATIVE_CALL vdf_watch_dispatch(AMX *amx, cell *params)
+{
+	VDFTree *tree;
+	int		forward;
+	cell	count;
+
+	logger.SetAmxContext(amx);
+
+	for(count = 0; (tree = vdfCollection.ReloadNext(forward)) != NULL; count++)
+		MF_ExecuteForward(forward, (cell)tree, vdfCollection.GetContainerById(tree->treeId)->vdfFile);
+
+	return count;
+}
+
+/**
+ *	<code> native VdfTree:vdf_diff(VdfTree:oldtree, VdfTree:newtree, VdfNode:oldnode = VdfNode:0,
+ *			VdfNode:newnode = VdfNode:0, const filename[] = "") </code>
+ *	@return	Returns a pointer to the change set tree if succeeded, 0 on fail.
+ */
+static cell AMX_NATIVE_CALL vdf_diff(AMX *amx, cell *params)
+{
+	VDFTree	*oldTree;
+	VDFTree	*newTree;
+	VDFNode	*oldNode;
+	VDFNode	*newNode;
+	VDFDiff	diff;
+	char	*vdfFile;
+	int		len;
+
+	oldTree = reinterpret_cast<VDFTree*>(params[1]);
+	newTree = reinterpret_cast<VDFTree*>(params[2]);
+	vdfFile = MF_GetAmxString(amx, params[5], 0, &len);
+
+	if(oldTree == NULL || newTree == NULL || (params[3] == 0) != (params[4] == 0))
+		return 0;
+
+	// trees are read as regular nodes
+	oldTree->Thaw();
+	newTree->Thaw();
+
+	if(params[3] == 0)
+		return (cell)vdfCollection.RegisterTree(diff.CompareTrees(oldTree, newTree),
+			g_fn_BuildPathname("%s", vdfFile));
+
+	oldNode = GetRegularNode(params[3]);
+	newNode = GetRegularNode(params[4]);
+
+	if(oldNode == NULL || newNode == NULL)
+		return 0;
+
+	return (cell)vdfCollection.RegisterTree(diff.Compare(oldNode, newNode),
+		g_fn_BuildPathname("%s", vdfFile));
+}
+
+//VdfNode:vdf_find_in_branch(VdfNode:node, const schstring[], bool:bykey = true, bool ignorecase = false) 
+static cell AMX_NATIVE_CALL vdf_find_in_branch(AMX *amx, cell *params)
+{
+	VDFNode *startNode;
+	VDFImage *image;
+	UINT	imageNode;
+	const char *cmp;
+	char	*sch;
+	char	*searchStr;
+	UINT	byKey;
+	UINT	ignoreCase;
+	int		len;
+
+	startNode = GetReadableNode(params[1], &image, imageNode);
+
+	if(startNode == NULL && image == NULL)
+		return 0;
+
+	sch	=	MF_GetAmxString(amx, params[2], 0, &len);
+	byKey = (UINT)params[3];
+	ignoreCase = (UINT)params[4];
+	
+
+	if(ignoreCase) {
+		searchStr = new char[strlen(sch) + 1];
+		ToLowerCase(sch, searchStr);
+	}
+	else
+		searchStr = sch;
+
+	while(startNode) {
+		
+		if((cmp = (byKey) ? startNode->key : startNode->value) != NULL) {			
+			if(strcmp(cmp, searchStr) == 0)
+				break;
+		}
+
+		startNode = startNode->nextNode;
+	}
+
+	while(image != NULL && imageNode != VDF_IMAGE_NONE) {
+
+		cmp = (byKey) ? image->GetKey(imageNode) : image->GetValue(imageNode);
+		if(cmp != NULL && strcmp(cmp, searchStr) == 0)
+			break;
+
+		imageNode = image->GetNextNode(imageNode);
+	}
+	
+	if(ignoreCase)
+		delete(searchStr);
+
+	if(image != NULL)
+		return (cell)(image->GetHandle(imageNode));
+
+	return (cell)startNode;
+
+}
+
+
+/**
+ *	<code> native vdf_stats_enable(bool:enable = true) </code>
+ *	@return	Previous state.
+ */
+static cell AMX_NATIVE_CALL vdf_stats_enable(AMX *amx, cell *params)
+{
+	bool wasEnabled;
+
+	wasEnabled = nativeStats.enabled;
+	nativeStats.enabled = params[1] != 0;
+
+	return wasEnabled ? 1 : 0;
+}
+
+/**
+ *	<code> native vdf_stats_dump(bool:reset = true) </code>
+ *	Prints native counters into server console.
+ *	@return	Number of natives listed.
+ */
+static cell AMX_NATIVE_CALL vdf_stats_dump(AMX *amx, cell *params)
+{
+	VDFNativeStat	*stat;
+	char			line[512];
+	size_t			len;
+	size_t			i;
+	int				bucket;
+	cell			listed;
+
+	len = _snprintf(line, sizeof(line), "vdf_stats: native calls total_ms avg_us max_us hist_us");
+	for(bucket = 0; bucket < VDF_STATS_BUCKETS - 1; bucket++)
+		len += _snprintf(line + len, sizeof(line) - len, "%c<%.0f", bucket ? ',' : ' ',
+			VDFStats::GetBucketLimit(bucket));
+	_snprintf(line + len, sizeof(line) - len, ",more\n");
+	MF_PrintSrvConsole((char*)"%s", line);
+
+	listed = 0;
+
+	for(i = 0; i < nativeStats.GetCount(); i++) {
+		stat = nativeStats.GetStat(i);
+		if(!stat->calls)
+			continue;
+
+		len = _snprintf(line, sizeof(line), "vdf_stats: %s %u %.3f %.3f %.3f", stat->name, stat->calls,
+			stat->totalTime / 1000.0, stat->totalTime / stat->calls, stat->maxTime);
+		for(bucket = 0; bucket < VDF_STATS_BUCKETS && len < sizeof(line); bucket++)
+			len += _snprintf(line + len, sizeof(line) - len, "%c%u", bucket ? ',' : ' ', stat->buckets[bucket]);
+		if(len < sizeof(line) - 1)
+			strcat(line, "\n");
+
+		MF_PrintSrvConsole((char*)"%s", line);
+		listed++;
+	}
+
+	if(params[1])
+		nativeStats.Reset();
+
+	return listed;
+}
+
+/**
+ *	<code> native vdf_get_memory_usage(VdfTree:tree = VDF_NULL_TREE, &nodes = 0) </code>
+ *	@return	Bytes used by tree, or by all trees and searches if tree is 0.
+ */
+static cell AMX_NATIVE_CALL vdf_get_memory_usage(AMX *amx, cell *params)
+{
+	VDFTree			*tree;
+	VDFMemoryUsage	usage;
+
+	tree = reinterpret_cast<VDFTree*>(params[1]);
+
+	if(tree == NULL)
+		vdfCollection.GetMemoryUsage(usage);
+	else
+		vdfCollection.GetTreeMemoryUsage(tree->treeId, usage);
+
+	*MF_GetAmxAddr(amx, params[2]) = (cell)usage.nodeCount;
+
+	return (cell)usage.GetTotal();
+}
+
+/**
+ *	<code> native vdf_memory_dump() </code>
+ *	Prints open trees and memory usage into server console.
+ *	@return	Number of open trees.
+ */
+static cell AMX_NATIVE_CALL vdf_memory_dump(AMX *amx, cell *params)
+{
+	VDFMemoryUsage	usage;
+	VDFMemoryUsage	total;
+	VDFEnum			*container;
+	char			line[VDF_MAX_PATH + 128];
+	size_t			i;
+	cell			listed;
+
+	MF_PrintSrvConsole((char*)"vdf_mem: id nodes bytes frozen file\n");
+
+	listed = 0;
+
+	for(i = 0; i < vdfCollection.treeCounter; i++) {
+		if((container = vdfCollection.GetContainerById((UINT)i)) == NULL)
+			continue;
+
+		usage = VDFMemoryUsage();
+		vdfCollection.GetTreeMemoryUsage((UINT)i, usage);
+
+		_snprintf(line, sizeof(line), "vdf_mem: %u %u %u %d \"%s\"\n", (UINT)i, (UINT)usage.nodeCount,
+			(UINT)usage.GetTotal(), container->vdfTree->IsFrozen() ? 1 : 0, container->vdfFile);
+		line[sizeof(line) - 1] = '\0';
+		MF_PrintSrvConsole((char*)"%s", line);
+		listed++;
+	}
+
+	vdfCollection.GetMemoryUsage(total);
+
+	_snprintf(line, sizeof(line), "vdf_mem: total trees=%u nodes=%u bytes=%u (nodes=%u strings=%u"
+		" indexes=%u images=%u searches=%u)\n", (UINT)listed, (UINT)total.nodeCount, (UINT)total.GetTotal(),
+		(UINT)total.nodeBytes, (UINT)total.stringBytes, (UINT)total.indexBytes, (UINT)total.imageBytes,
+		(UINT)total.searchBytes);
+	MF_PrintSrvConsole((char*)"%s", line);
+
+	return listed;
+}
+
+AMX_NATIVE_INFO vdfNatives[] = 
+{
+	{"vdf_open",					vdf_open},
+	{"vdf_save",					vdf_save},
+	{"vdf_save_binary",				vdf_save_binary},
+	{"vdf_save_image",				vdf_save_image},
+	{"vdf_set_cache",				vdf_set_cache},
+	{"vdf_parse",					vdf_parse},
+	{"vdf_get_first_node",			vdf_get_first_node},
+	{"vdf_get_child_node",			vdf_get_child_node},
+	{"vdf_get_parent_node",			vdf_get_parent_node},
+	{"vdf_get_root_node",			vdf_get_root_node},
+	{"vdf_get_last_node",			vdf_get_last_node},
+	{"vdf_get_previous_node",		vdf_get_previous_node},
+	{"vdf_get_next_node",			vdf_get_next_node},
+	{"vdf_get_node_key",			vdf_get_node_key},
+	{"vdf_get_node_value",			vdf_get_node_value},
+	{"vdf_get_node_value_vector",	vdf_get_node_value_vector},
+	{"vdf_get_node_value_float",	vdf_get_node_value_float},
+	{"vdf_get_node_value_num",		vdf_get_node_value_num},
+	{"vdf_set_node_key",			vdf_set_node_key},
+	{"vdf_set_node_value",			vdf_set_node_value},
+	{"vdf_set_node_value_num",		vdf_set_node_value_num},
+	{"vdf_set_node_value_float",	vdf_set_node_value_float},
+	{"vdf_set_node_value_vector",	vdf_set_node_value_vector},
+	{"vdf_delete_node",				vdf_delete_node},
+	{"vdf_append_node",				vdf_append_node},
+	{"vdf_append_child_node",		vdf_append_child_node},
+	{"vdf_create_tree",				vdf_create_tree},
+	{"vdf_count_branch_nodes",		vdf_count_branch_nodes},
+	{"vdf_remove_tree",				vdf_remove_tree},
+	{"vdf_create_search",			vdf_create_search},
+	{"vdf_find_next_match",			vdf_find_next_match},
+	{"vdf_set_search",				vdf_set_search},
+	{"vdf_get_node_level",			vdf_get_node_level},
+	{"vdf_close_search",			vdf_close_search},
+	{"vdf_sort_branch",				vdf_sort_branch},
+	{"vdf_move_to_branch",			vdf_move_to_branch},
+	{"vdf_move_as_child",			vdf_move_as_child},
+	{"vdf_find_in_branch",			vdf_find_in_branch},
+	{"vdf_next_in_traverse",        vdf_next_in_traverse},
+	{"vdf_stats_enable",			vdf_stats_enable},
+	{"vdf_stats_dump",				vdf_stats_dump},
+	{"vdf_get_memory_usage",		vdf_get_memory_usage},
+	{"vdf_memory_dump",				vdf_memory_dump},
+	{"vdf_save_begin",				vdf_save_begin},
+	{"vdf_save_step",				vdf_save_step},
+	{"vdf_save_close",				vdf_save_close},
+	{"vdf_delete_node_deferred",	vdf_delete_node_deferred},
+	{"vdf_process_deletes",			vdf_process_deletes},
+	{"vdf_open_begin",				vdf_open_begin},
+	{"vdf_open_step",				vdf_open_step},
+	{"vdf_open_end",				vdf_open_end},
+	{"vdf_open_from_string",		vdf_open_from_string},
+	{"vdf_parse_string",			vdf_parse_string},
+	{"vdf_dump_to_string",			vdf_dump_to_string},
+	{"vdf_set_escapes",				vdf_set_escapes},
+	{"vdf_set_condition",			vdf_set_condition},
+	{"vdf_clear_conditions",		vdf_clear_conditions},
+	{"vdf_merge",					vdf_merge},
+	{"vdf_clone_tree",				vdf_clone_tree},
+	{"vdf_copy_subtree",			vdf_copy_subtree},
+	{"vdf_diff",					vdf_diff},
+	{"vdf_journal_start",			vdf_journal_start},
+	{"vdf_journal_sync",			vdf_journal_sync},
+	{"vdf_journal_stop",			vdf_journal_stop},
+	{"vdf_watch",					vdf_watch},
+	{"vdf_unwatch",					vdf_unwatch},
+	{"vdf_watch_dispatch",			vdf_watch_dispatch},
+	{"vdf_open_lazy",				vdf_open_lazy},
+	{"vdf_build_index",				vdf_build_index},
+	{"vdf_read_path",				vdf_read_path},
+	{NULL,							NULL},
+};
+
+/** Natives that can be profiled, must be a multiple of 8 */
+#define PROFILED_NATIVES_MAX	96
+
+static AMX_NATIVE		profiledFuncs[PROFILED_NATIVES_MAX];
+static AMX_NATIVE_INFO	registeredNatives[PROFILED_NATIVES_MAX + 1];
+
+/**
+ *	Natives are registered through these wrappers, so calls can be timed.
+ *	While stats are disabled a wrapper costs one flag check.
+ */
+template <size_t N>
+static cell AMX_NATIVE_CALL ProfiledNative(AMX *amx, cell *params)
+{
+	double	start;
+	cell	ret;
+
+	if(!nativeStats.enabled)
+		return profiledFuncs[N](amx, params);
+
+	start = GetMicroseconds();
+	ret = profiledFuncs[N](amx, params);
+	nativeStats.Record(N, GetMicroseconds() - start);
+
+	return ret;
+}
+
+#define PROFILED_NATIVES_8(n)\
+	ProfiledNative<n>, ProfiledNative<n + 1>, ProfiledNative<n + 2>, ProfiledNative<n + 3>,\
+	ProfiledNative<n + 4>, ProfiledNative<n + 5>, ProfiledNative<n + 6>, ProfiledNative<n + 7>
+
+static AMX_NATIVE profiledNatives[PROFILED_NATIVES_MAX] =
+{
+	PROFILED_NATIVES_8(0),  PROFILED_NATIVES_8(8),  PROFILED_NATIVES_8(16), PROFILED_NATIVES_8(24),
+	PROFILED_NATIVES_8(32), PROFILED_NATIVES_8(40), PROFILED_NATIVES_8(48), PROFILED_NATIVES_8(56),
+	PROFILED_NATIVES_8(64), PROFILED_NATIVES_8(72), PROFILED_NATIVES_8(80), PROFILED_NATIVES_8(88),
+};
+
+/**
+ *	Builds the table passed to AMXX, natives past wrappers
+ *	capacity are registered directly (not profiled).
+ */
+static void SetupNatives()
+{
+	size_t count;
+	size_t i;
+
+	for(count = 0; vdfNatives[count].name != NULL; count++)
+		;
+
+	if(count > PROFILED_NATIVES_MAX)
+		count = PROFILED_NATIVES_MAX;
+
+	nativeStats.Setup(count);
+
+	for(i = 0; i < count; i++) {
+		profiledFuncs[i] = vdfNatives[i].func;
+		registeredNatives[i].name = vdfNatives[i].name;
+		registeredNatives[i].func = profiledNatives[i];
+		nativeStats.SetName(i, vdfNatives[i].name);
+	}
+
+	registeredNatives[i].name = NULL;
+	registeredNatives[i].func = NULL;
+}
+
+void OnAmxxAttach()
+{
+	vdfCollection.SetLogger(&logger);
+
+#if defined _WIN32
+	VDFReader::SetCondition("WIN32");
+	VDFReader::SetCondition("WINDOWS");
+#else
+	VDFReader::SetCondition("LINUX");
+	VDFReader::SetCondition("POSIX");
+#endif
+	VDFReader::SetCondition(MF_GetModname());
+	vdfCollection.watcher.SetReaderSettings(VDFReader::shared);
+
+	SetupNatives();
+	MF_AddNatives(registeredNatives);
+
+	if(vdfNatives[nativeStats.GetCount()].name != NULL)
+		MF_AddNatives(vdfNatives + nativeStats.GetCount());
+}
+
+void OnAmxxDetach()
+{
+	vdfCollection.Destroy();
+	VDFReader::ClearConditions();
+}